@@ -21,11 +21,20 @@
 #include <cstdlib>
 #include <stdio.h>
 #include <ctype.h>
+#include <time.h>
 
 #include "utils.h"
 #include "../include/debug.h"
 #include "../wallet/wallet.h"
+#include "../wallet/arena.h"
 #include "test.h"
+#include "bench.h"
+#include "verify.h"
+#include "monitor.h"
+#include "fleet.h"
+#include "ecalls.h"
+#include "../wallet/accesslog.h"
+#include "../wallet/generator.h"
 
 using namespace std;
 
@@ -37,12 +46,16 @@ int main(int argc, char** argv) {
     ////////////////////////////////////////////////
     // read input arguments 
     ////////////////////////////////////////////////
-    const char* options = "hvtn:p:c:sax:y:z:r:";
+    const char* options = "hvtbn:p:c:sK:Uax:y:z:G:g:E:m:r:lu:V:Fj:A:q:W:DM:B:i:o:R:L:";
     opterr=0; // prevent 'getopt' from printing err messages
     char err_message[100];
     int opt, stop=0;
-    int h_flag=0, v_flag=0, s_flag=0, a_flag=0, t_flag=0;
-    char * n_value=NULL, *p_value=NULL, *c_value=NULL, *x_value=NULL, *y_value=NULL, *z_value=NULL, *r_value=NULL;
+    int h_flag=0, v_flag=0, s_flag=0, U_flag=0, a_flag=0, t_flag=0, b_flag=0, l_flag=0, F_flag=0, D_flag=0;
+    char * n_value=NULL, *p_value=NULL, *c_value=NULL, *x_value=NULL, *y_value=NULL, *z_value=NULL, *r_value=NULL, *u_value=NULL;
+    char *V_value=NULL, *j_value=NULL, *A_value=NULL, *g_value=NULL, *q_value=NULL;
+    char *E_value=NULL, *m_value=NULL, *W_value=NULL, *M_value=NULL;
+    char *B_value=NULL, *i_value=NULL, *o_value=NULL, *R_value=NULL, *L_value=NULL, *G_value=NULL, *K_value=NULL;
+    int64_t expires=0;
   
     // read user input
     while ((opt = getopt(argc, argv, options)) != -1) {
@@ -62,6 +75,11 @@ int main(int argc, char** argv) {
                 t_flag = 1;
                 break;
 
+            // run benchmarks
+            case 'b':
+                b_flag = 1;
+                break;
+
             // create new wallet
             case 'n':
                 n_value = optarg;
@@ -81,6 +99,14 @@ int main(int argc, char** argv) {
             case 's':
                 s_flag = 1;
                 break;
+            case 'K': // decrypted bytes kept resident while showing
+                K_value = optarg;
+                break;
+
+            // migrate a legacy wallet
+            case 'U':
+                U_flag = 1;
+                break;
 
             // add item
             case 'a': // add item flag
@@ -95,16 +121,104 @@ int main(int argc, char** argv) {
             case 'z': // item's password
                 z_value = optarg;
                 break;
+            case 'G': // generate the item's password: length[:classes]
+                G_value = optarg;
+                break;
 
             // remove item
             case 'r':
                 r_value = optarg;
                 break;
 
+            // list snapshots
+            case 'l':
+                l_flag = 1;
+                break;
+
+            // restore snapshot
+            case 'u':
+                u_value = optarg;
+                break;
+
+            // verify wallet files
+            case 'V': // file or directory
+                V_value = optarg;
+                break;
+            case 'F': // repair damaged files
+                F_flag = 1;
+                break;
+            case 'j': // number of threads
+                j_value = optarg;
+                break;
+
+            // audit passwords
+            case 'A':
+                A_value = optarg;
+                break;
+
+            // item tags
+            case 'g':
+                g_value = optarg;
+                break;
+
+            // search by tags
+            case 'q':
+                q_value = optarg;
+                break;
+
+            // item expiry, in days
+            case 'E':
+                E_value = optarg;
+                break;
+
+            // update item
+            case 'm':
+                m_value = optarg;
+                break;
+
+            // list items expiring within a number of days
+            case 'W':
+                W_value = optarg;
+                break;
+
+            // monitor expirations
+            case 'D':
+                D_flag = 1;
+                break;
+
+            // merge with a replica
+            case 'M':
+                M_value = optarg;
+                break;
+
+            // item blobs
+            case 'B': // item's index
+                B_value = optarg;
+                break;
+            case 'i': // file to attach
+                i_value = optarg;
+                break;
+            case 'o': // file to extract to
+                o_value = optarg;
+                break;
+
+            // run across many wallet files
+            case 'R': // file, directory or @list
+                R_value = optarg;
+                break;
+
+            // verify an access log
+            case 'L':
+                L_value = optarg;
+                break;
+
             // exceptions
             case '?':
-                if (optopt == 'n' || optopt == 'p' || optopt == 'c' || optopt == 'r' ||
-                    optopt == 'x' || optopt == 'y' || optopt == 'z'
+                if (optopt == 'n' || optopt == 'p' || optopt == 'c' || optopt == 'K' || optopt == 'r' ||
+                    optopt == 'x' || optopt == 'y' || optopt == 'z' || optopt == 'G' || optopt == 'u' ||
+                    optopt == 'V' || optopt == 'j' || optopt == 'A' ||
+                    optopt == 'g' || optopt == 'q' || optopt == 'E' || optopt == 'm' || optopt == 'W' ||
+                    optopt == 'M' || optopt == 'B' || optopt == 'i' || optopt == 'o' || optopt == 'R' || optopt == 'L'
                 ) {
                     sprintf(err_message, "Option -%c requires an argument.", optopt);
                 }
@@ -125,6 +239,58 @@ int main(int argc, char** argv) {
     }
 
 
+    // password generated for an added item: a length, then optionally
+    // the classes (l, u, d, s; all by default) and p for pronounceable
+    password_policy_t generate = {PASSWORD_DEFAULT_LENGTH, PASSWORD_CLASSES};
+    if (stop != 1 && G_value != NULL) {
+        char* p_end;
+        long length = strtol(G_value, &p_end, 10);
+        int valid = G_value != p_end && length > 0 && length < MAX_ITEM_SIZE && (*p_end == '\0' || *p_end == ':');
+        generate.flags = 0;
+        for (const char* c = *p_end == ':' ? p_end + 1 : p_end; valid && *c != '\0'; ++c) {
+            switch (*c) {
+                case 'l': generate.flags |= PASSWORD_LOWER; break;
+                case 'u': generate.flags |= PASSWORD_UPPER; break;
+                case 'd': generate.flags |= PASSWORD_DIGITS; break;
+                case 's': generate.flags |= PASSWORD_SYMBOLS; break;
+                case 'p': generate.flags |= PASSWORD_PRONOUNCEABLE; break;
+                default: valid = 0;
+            }
+        }
+        if ((generate.flags & PASSWORD_CLASSES) == 0) {generate.flags |= PASSWORD_CLASSES;}
+        generate.length = (uint32_t)length;
+        if (!valid || password_policy_check(&generate, MAX_ITEM_SIZE) != GENERATOR_OK) {
+            error_print("Option -G requires a length and optional classes, e.g. 20 or 16:luds or 12:lup.");
+            stop = 1;
+        }
+    }
+
+    // expiry date of added or updated items
+    if (stop != 1 && E_value != NULL) {
+        char* p_end;
+        long days = strtol(E_value, &p_end, 10);
+        if (E_value == p_end || days <= 0) {
+            error_print("Option -E requires a positive integer argument.");
+            stop = 1;
+        }
+        else {
+            expires = (int64_t)time(NULL) + (int64_t)days * SECONDS_PER_DAY;
+        }
+    }
+
+
+    // record the operations on the wallet
+    int logging = 0;
+    if (stop != 1 && p_value != NULL && R_value == NULL) {
+        if (access_log_open(ACCESS_LOG_FILE) != ACCESS_LOG_OK) {
+            warning_print("Could not open the access log: operations are not recorded.");
+        }
+        else {
+            logging = 1;
+        }
+    }
+
+
     ////////////////////////////////////////////////
     // perform actions
     ////////////////////////////////////////////////
@@ -146,9 +312,61 @@ int main(int argc, char** argv) {
             else {info_print("All tests successfully passed.");}
         }
 
+        // run benchmarks
+        else if(b_flag) {
+            info_print("Running benchmarks...");
+            if (bench() != 0) {error_print("One or more benchmarks failed.");}
+            else {info_print("All benchmarks successfully run.");}
+        }
+
+        // verify wallet files
+        else if(V_value!=NULL) {
+            int threads = j_value != NULL ? atoi(j_value) : 0;
+            if (verify_tree(V_value, F_flag, threads) != 0) {
+                error_print("One or more wallet files are damaged.");
+            }
+            else {
+                info_print("Wallet files successfully verified.");
+            }
+        }
+
+        // verify an access log
+        else if(L_value!=NULL) {
+            access_log_report_t report;
+            access_record_t records[ACCESS_LOG_TAIL];
+            size_t count = 0;
+            ret_status = access_log_verify(L_value, j_value != NULL ? atoi(j_value) : 0, &report);
+            access_log_tail(L_value, records, ACCESS_LOG_TAIL, &count);
+            print_access_log(&report, records, count);
+            if (ret_status == ACCESS_LOG_ERR_IO) {
+                error_print("Fail to read the access log.");
+            }
+            else if (ret_status != ACCESS_LOG_OK) {
+                error_print("The access log has been tampered with.");
+            }
+            else {
+                info_print("Access log successfully verified.");
+            }
+        }
+
+        // find or rotate a credential across wallet files
+        else if(p_value!=NULL && R_value!=NULL && x_value!=NULL) {
+            fleet_job_t job = {z_value != NULL ? FLEET_ROTATE : FLEET_FIND, p_value, x_value, y_value, z_value,
+                j_value != NULL ? atoi(j_value) : 0, 0};
+            fleet_report_t report;
+            ret_status = run_fleet(R_value, &job, &report);
+            print_fleet(&report, job.operation);
+            if (ret_status != 0) {
+                error_print("One or more wallet files could not be processed.");
+            }
+            else {
+                info_print("Wallet files successfully processed.");
+            }
+        }
+
         // create new wallet
         else if(n_value!=NULL) {
-            ret_status = create_wallet(n_value);
+            ret_status = ecall_create_wallet(n_value);
             if (ret_status != RET_SUCCESS) {
                 error_print("Fail to create new wallet.");
             }
@@ -159,7 +377,7 @@ int main(int argc, char** argv) {
 
         // change master-password
         else if (p_value!=NULL && c_value!=NULL) {
-            ret_status = change_master_password(p_value, c_value);
+            ret_status = ecall_change_master_password(p_value, c_value);
             if (ret_status != RET_SUCCESS) {
                 error_print("Fail change master-password.");
             }
@@ -168,10 +386,44 @@ int main(int argc, char** argv) {
             }
         }
 
+        // migrate a legacy wallet
+        else if(p_value!=NULL && U_flag) {
+            ret_status = ecall_migrate_wallet(WALLET_FILE, p_value);
+            if (ret_status != RET_SUCCESS) {
+                is_error(ret_status);
+                error_print("Fail to migrate wallet.");
+            }
+            else {
+                info_print("Wallet successfully migrated.");
+            }
+        }
+
+        // show wallet under a memory budget: the items are paged in
+        // one at a time, and at most the budget stays decrypted
+        else if(p_value!=NULL && s_flag && K_value!=NULL) {
+            char* p_end;
+            long long budget = strtoll(K_value, &p_end, 10);
+            item_store_t store;
+            if (K_value == p_end || *p_end != '\0' || budget <= 0) {
+                error_print("Option -K requires a positive number of bytes.");
+            }
+            else if ((ret_status = ecall_open_item_store(p_value, (size_t)budget, &store)) != RET_SUCCESS) {
+                is_error(ret_status);
+                error_print("Fail to retrieve wallet.");
+            }
+            else {
+                info_print("Wallet successfully retrieved.");
+                if (print_item_store(&store) != 0) {
+                    error_print("Fail to page items in.");
+                }
+                ecall_close_item_store(&store);
+            }
+        }
+
         // show wallet
         else if(p_value!=NULL && s_flag) {
-            wallet_t* wallet = (wallet_t*)malloc(sizeof(wallet_t));
-            ret_status = show_wallet(p_value, wallet);
+            wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+            ret_status = ecall_show_wallet(p_value, wallet);
             if (ret_status != RET_SUCCESS) {
                 error_print("Fail to retrieve wallet.");
             }
@@ -179,23 +431,62 @@ int main(int argc, char** argv) {
                 info_print("Wallet successfully retrieved.");
                 print_wallet(wallet);
             }
-            free(wallet);
+            secure_free(wallet);
         }
 
         // add item
-        else if (p_value!=NULL && a_flag && x_value!=NULL && y_value!=NULL && z_value!=NULL) {
-            item_t* new_item = (item_t*)malloc(sizeof(item_t));
-            strcpy(new_item->title, x_value); 
-            strcpy(new_item->username, y_value); 
-            strcpy(new_item->password, z_value);
-            ret_status = add_item(p_value, new_item, sizeof(item_t));
+        else if (p_value!=NULL && a_flag && x_value!=NULL && y_value!=NULL && (z_value!=NULL || G_value!=NULL)) {
+            item_t* new_item = (item_t*)secure_malloc(sizeof(item_t));
+            ret_status = ERR_ITEM_TOO_LONG;
+            if (strlen(x_value) < MAX_ITEM_SIZE && strlen(y_value) < MAX_ITEM_SIZE &&
+                (z_value == NULL || strlen(z_value) < MAX_ITEM_SIZE) && (g_value == NULL || strlen(g_value) < MAX_ITEM_SIZE)) {
+                strncpy(new_item->title, x_value, MAX_ITEM_SIZE - 1);
+                strncpy(new_item->username, y_value, MAX_ITEM_SIZE - 1);
+                if (z_value != NULL) {strncpy(new_item->password, z_value, MAX_ITEM_SIZE - 1);}
+                if (g_value != NULL) {strncpy(new_item->tags, g_value, MAX_ITEM_SIZE - 1);}
+                new_item->expires = expires;
+                if (G_value != NULL) {
+                    ret_status = ecall_add_items(WALLET_FILE, p_value, new_item, 1, &generate);
+                }
+                else {
+                    ret_status = ecall_add_item(p_value, new_item);
+                }
+            }
             if (ret_status != RET_SUCCESS) {
+                is_error(ret_status);
                 error_print("Fail to add new item to wallet.");
             }
             else {
                 info_print("Item successfully added to the wallet.");
+                if (G_value != NULL) {printf("Generated password: %s\n", new_item->password);}
+            }
+            secure_free(new_item);
+        }
+
+        // update item
+        else if (p_value!=NULL && m_value!=NULL && x_value!=NULL && y_value!=NULL && z_value!=NULL) {
+            char* p_end;
+            int index = (int)strtol(m_value, &p_end, 10);
+            if (m_value == p_end) {
+                error_print("Option -m requires an integer argument.");
+            }
+            else {
+                item_t* item = (item_t*)secure_malloc(sizeof(item_t));
+                strncpy(item->title, x_value, MAX_ITEM_SIZE - 1);
+                strncpy(item->username, y_value, MAX_ITEM_SIZE - 1);
+                strncpy(item->password, z_value, MAX_ITEM_SIZE - 1);
+                if (g_value != NULL) {strncpy(item->tags, g_value, MAX_ITEM_SIZE - 1);}
+                item->expires = expires;
+                ret_status = ecall_update_item(p_value, index, item);
+                if (ret_status != RET_SUCCESS) {
+                    is_error(ret_status);
+                    error_print("Fail to update item.");
+                }
+                else {
+                    info_print("Item successfully updated.");
+                }
+                secure_free(item);
             }
-            free(new_item);
         }
 
         // remove item
@@ -206,7 +497,7 @@ int main(int argc, char** argv) {
                 error_print("Option -r requires an integer argument.");
             }
             else {
-                ret_status = remove_item(p_value, index);
+                ret_status = ecall_remove_item(p_value, index);
                 if (ret_status != RET_SUCCESS) {
                     error_print("Fail to remove item.");
                 }
@@ -216,6 +507,143 @@ int main(int argc, char** argv) {
             }
         }
 
+        // list snapshots
+        else if (p_value!=NULL && l_flag) {
+            snapshot_t snapshots[HISTORY_DEPTH];
+            size_t count = 0;
+            ret_status = ecall_list_snapshots(p_value, snapshots, &count);
+            if (ret_status != RET_SUCCESS) {
+                error_print("Fail to list snapshots.");
+            }
+            else {
+                info_print("Snapshots successfully listed.");
+                print_snapshots(snapshots, count);
+            }
+        }
+
+        // restore snapshot
+        else if (p_value!=NULL && u_value!=NULL) {
+            char* p_end;
+            unsigned long long version = strtoull(u_value, &p_end, 10);
+            if (u_value == p_end) {
+                error_print("Option -u requires an integer argument.");
+            }
+            else {
+                ret_status = ecall_restore_snapshot(p_value, version);
+                if (ret_status != RET_SUCCESS) {
+                    error_print("Fail to restore snapshot.");
+                }
+                else {
+                    info_print("Snapshot successfully restored.");
+                }
+            }
+        }
+
+        // audit passwords
+        else if (p_value!=NULL && A_value!=NULL) {
+            audit_result_t* results = (audit_result_t*)secure_malloc(MAX_ITEMS * sizeof(audit_result_t));
+            size_t count = 0;
+            ret_status = ecall_audit_wallet(p_value, A_value, results, &count);
+            if (ret_status != RET_SUCCESS) {
+                is_error(ret_status);
+                error_print("Fail to audit wallet.");
+            }
+            else {
+                info_print("Wallet successfully audited.");
+                print_audit(results, count);
+            }
+            secure_free(results);
+        }
+
+        // search by tags
+        else if (p_value!=NULL && q_value!=NULL) {
+            uint32_t* indexes = (uint32_t*)secure_malloc(MAX_ITEMS * sizeof(uint32_t));
+            item_t* items = (item_t*)secure_malloc(MAX_ITEMS * sizeof(item_t));
+            size_t count = 0;
+            ret_status = ecall_search_items(p_value, q_value, indexes, items, &count);
+            if (ret_status != RET_SUCCESS) {
+                is_error(ret_status);
+                error_print("Fail to search wallet.");
+            }
+            else {
+                info_print("Wallet successfully searched.");
+                print_search(indexes, items, count);
+            }
+            secure_free(indexes);
+            secure_free(items);
+        }
+
+        // merge with a replica
+        else if (p_value!=NULL && M_value!=NULL) {
+            merge_stats_t stats;
+            ret_status = ecall_merge_wallets(p_value, WALLET_FILE, M_value, &stats);
+            if (ret_status != RET_SUCCESS) {
+                is_error(ret_status);
+                error_print("Fail to merge wallets.");
+            }
+            else {
+                info_print("Wallets successfully merged.");
+                print_merge(&stats);
+            }
+        }
+
+        // attach or extract a blob
+        else if (p_value!=NULL && B_value!=NULL && (i_value!=NULL || o_value!=NULL)) {
+            char* p_end;
+            int index = (int)strtol(B_value, &p_end, 10);
+            FILE* file = NULL;
+            if (B_value == p_end) {
+                error_print("Option -B requires an integer argument.");
+            }
+            else if ((file = i_value != NULL ? fopen(i_value, "rb") : fopen(o_value, "wb")) == NULL) {
+                error_print("Fail to open the blob file.");
+            }
+            else {
+                if (i_value != NULL) {ret_status = ecall_attach_blob(p_value, index, file_source, file);}
+                else {ret_status = ecall_read_blob(p_value, index, file_sink, file);}
+                if (fclose(file) != 0 && ret_status == RET_SUCCESS) {ret_status = ERR_CANNOT_LOAD_BLOB;}
+                if (ret_status != RET_SUCCESS) {
+                    if (i_value == NULL) {remove(o_value);}
+                    is_error(ret_status);
+                    error_print(i_value != NULL ? "Fail to attach blob." : "Fail to extract blob.");
+                }
+                else {
+                    info_print(i_value != NULL ? "Blob successfully attached." : "Blob successfully extracted.");
+                }
+            }
+        }
+
+        // monitor expirations
+        else if (p_value!=NULL && D_flag) {
+            int lead_days = W_value != NULL ? atoi(W_value) : 0;
+            if (monitor_expiry(p_value, lead_days) != 0) {
+                error_print("Fail to monitor expirations.");
+            }
+        }
+
+        // list expiring items
+        else if (p_value!=NULL && W_value!=NULL) {
+            char* p_end;
+            long days = strtol(W_value, &p_end, 10);
+            if (W_value == p_end || days < 0) {
+                error_print("Option -W requires a non-negative integer argument.");
+            }
+            else {
+                expiring_t* items = (expiring_t*)secure_malloc(MAX_ITEMS * sizeof(expiring_t));
+                size_t count = 0;
+                ret_status = ecall_list_expiring(p_value, (int64_t)time(NULL) + (int64_t)days * SECONDS_PER_DAY, items, &count);
+                if (ret_status != RET_SUCCESS) {
+                    is_error(ret_status);
+                    error_print("Fail to list expiring items.");
+                }
+                else {
+                    info_print("Expiring items successfully listed.");
+                    print_expiring(items, count);
+                }
+                secure_free(items);
+            }
+        }
+
         // display help
         else {
             error_print("Wrong inputs.");
@@ -224,6 +652,14 @@ int main(int argc, char** argv) {
     }
 
 
+    if (logging) {
+        if (access_log_flush() != ACCESS_LOG_OK) {
+            warning_print("Some operations could not be recorded in the access log.");
+        }
+        access_log_close();
+    }
+
+
     ////////////////////////////////////////////////
     // exit success
     ////////////////////////////////////////////////
@@ -0,0 +1,853 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <time.h>
+#include <thread>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+#include "utils.h"
+#include "../wallet/wallet.h"
+#include "../wallet/secure.h"
+#include "../wallet/compress.h"
+#include "../wallet/arena.h"
+#include "../wallet/crypto.h"
+#include "../wallet/audit.h"
+#include "../wallet/tags.h"
+#include "../wallet/merkle.h"
+#include "../wallet/enclave.h"
+#include "../wallet/pager.h"
+#include "../wallet/accesslog.h"
+#include "../wallet/watch.h"
+#include "../wallet/generator.h"
+#include "../wallet/policy.h"
+#include "../include/libwallet.h"
+#include "ecalls.h"
+#include "fleet.h"
+
+
+/**
+ * @brief      Reads a monotonic clock.
+ *
+ */
+double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+/**
+ * @brief      Prints one benchmark result line.
+ *
+ */
+static void report(const char* name, double ns_per_op) {
+    printf("[BENCH] %-40s %12.1f ns/op\n", name, ns_per_op);
+}
+
+
+/**
+ * @brief      Times wallet operations through the enclave boundary in
+ *             a given mode, and reports what crossing it cost. Runs
+ *             in the current directory, which must hold no wallet.
+ *
+ */
+static int bench_boundary(const char* label, const enclave_config_t* config, int operations) {
+    const char* master_password = "bench-master";
+    char name[64];
+    enclave_stats_t stats;
+    item_t* item = (item_t*)secure_malloc(sizeof(item_t));
+    wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    strcpy(item->title, "bench item");
+    strcpy(item->password, "bench password");
+
+    enclave_configure(config);
+    int ret = ecall_create_wallet(master_password);
+    enclave_reset_stats();
+    double start = now_ns();
+    for (int i = 0; i < operations && ret == RET_SUCCESS; ++i) {
+        // an add and a read per operation; the wallet stays small
+        ret = ecall_add_item(master_password, item);
+        if (ret == RET_SUCCESS) {ret = ecall_show_wallet(master_password, wallet);}
+        if (ret == RET_SUCCESS && wallet->size >= MAX_ITEMS / 2) {ret = ecall_remove_item(master_password, 0);}
+    }
+    double elapsed = now_ns() - start;
+    enclave_get_stats(&stats);
+
+    enclave_config_t direct = {ENCLAVE_DIRECT, 0, 0};
+    enclave_configure(&direct);
+    remove(WALLET_FILE);
+    remove(WALLET_HISTORY_FILE);
+    remove(WALLET_LOCK_FILE);
+    secure_free(item);
+    secure_free(wallet);
+    if (ret != RET_SUCCESS) {return 1;}
+
+    sprintf(name, "wallet operation (%s)", label);
+    report(name, elapsed / operations);
+    printf("[BENCH] %-40s %12.0f ops/s\n", "", operations / (elapsed / 1e9));
+    printf("[BENCH] %-40s %12.2f transitions/op\n", "", (double)stats.transitions / operations);
+    printf("[BENCH] %-40s %12.2f ocalls/op, %.2f posts/op\n", "", (double)stats.ocalls / operations,
+        (double)stats.batches / operations);
+    return 0;
+}
+
+
+/**
+ * @brief      Produces, or swallows, blob content without holding it.
+ *
+ */
+static long zero_source(void* ctx, uint8_t* buf, size_t len) {
+    uint64_t* left = (uint64_t*)ctx;
+    if (len > *left) {len = (size_t)*left;}
+    memset(buf, 0x42, len);
+    *left -= len;
+    return (long)len;
+}
+
+static int null_sink(void* ctx, const uint8_t* data, size_t len) {
+    *(uint64_t*)ctx += len + data[0];
+    return 0;
+}
+
+
+/**
+ * @brief      Times attaching and reading a blob, and listing the
+ *             wallet holding it. Runs in the current directory, which
+ *             must hold no wallet.
+ *
+ */
+static int bench_blob(uint64_t length) {
+    const char* master_password = "bench-master";
+    char name[64];
+    uint64_t left = length, consumed = 0;
+    item_t* item = (item_t*)secure_malloc(sizeof(item_t));
+    wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    strcpy(item->title, "bench blob");
+
+    int ret = create_wallet(master_password);
+    if (ret == RET_SUCCESS) {ret = add_item(master_password, item, sizeof(item_t));}
+    double start = now_ns();
+    if (ret == RET_SUCCESS) {ret = attach_blob(master_password, 0, zero_source, &left);}
+    double attached = now_ns();
+    if (ret == RET_SUCCESS) {ret = read_blob(master_password, 0, null_sink, &consumed);}
+    double read = now_ns();
+    if (ret == RET_SUCCESS) {ret = show_wallet(master_password, wallet);}
+    double listed = now_ns();
+
+    if (ret == RET_SUCCESS) {ret = remove_item(master_password, 0);}
+    remove(WALLET_FILE);
+    remove(WALLET_HISTORY_FILE);
+    remove(WALLET_LOCK_FILE);
+    secure_free(item);
+    secure_free(wallet);
+    if (ret != RET_SUCCESS) {return 1;}
+
+    sprintf(name, "attach_blob (%llu MB)", (unsigned long long)(length >> 20));
+    report(name, attached - start);
+    printf("[BENCH] %-40s %12.1f MB/s\n", "", length / ((attached - start) / 1e9) / (1 << 20));
+    sprintf(name, "read_blob (%llu MB)", (unsigned long long)(length >> 20));
+    report(name, read - attached);
+    printf("[BENCH] %-40s %12.1f MB/s\n", "", length / ((read - attached) / 1e9) / (1 << 20));
+    report("show_wallet (item with blob)", listed - read);
+    return 0;
+}
+
+
+/**
+ * @brief      Times a query across copies of one wallet file with a
+ *             growing number of workers, the files being in the page
+ *             cache. Runs in the current directory, which must hold
+ *             no wallet.
+ *
+ */
+static int bench_fleet(int files) {
+    const char* master_password = "bench-master";
+    char name[64], path[64];
+    item_t* item = (item_t*)secure_malloc(sizeof(item_t));
+    int ret = create_wallet(master_password);
+    for (int i = 0; i < MAX_ITEMS / 2 && ret == RET_SUCCESS; ++i) {
+        sprintf(item->title, "service %d", i);
+        strcpy(item->username, "fleet");
+        strcpy(item->password, "fleet password");
+        ret = add_item(master_password, item, sizeof(item_t));
+    }
+    secure_free(item);
+
+    // copies of the wallet, read once to warm the cache
+    FILE* in = fopen(WALLET_FILE, "rb");
+    std::vector<char> image(1 << 20);
+    size_t image_size = in != NULL ? fread(image.data(), 1, image.size(), in) : 0;
+    if (in != NULL) {fclose(in);}
+    if (ret != RET_SUCCESS || image_size == 0 || mkdir("fleet", 0700) != 0) {return 1;}
+    for (int i = 0; i < files; ++i) {
+        sprintf(path, "fleet/%04d.seal", i);
+        FILE* out = fopen(path, "wb");
+        if (out == NULL) {return 1;}
+        fwrite(image.data(), 1, image_size, out);
+        fclose(out);
+    }
+
+    fleet_job_t job = {FLEET_FIND, master_password, "service 7", NULL, NULL, 1, 1};
+    fleet_report_t outcome;
+    run_fleet("fleet", &job, &outcome);
+    int cores = (int)std::thread::hardware_concurrency();
+    double single = 0;
+    for (int threads = 1; threads <= (cores > 4 ? cores : 4) && ret == RET_SUCCESS; threads *= 2) {
+        job.threads = threads;
+        if (run_fleet("fleet", &job, &outcome) != 0 || outcome.matched != (size_t)files) {ret = 1;}
+        if (threads == 1) {single = outcome.seconds;}
+        sprintf(name, "fleet query (%d files, %d threads)", files, threads);
+        report(name, outcome.seconds * 1e9 / files);
+        printf("[BENCH] %-40s %12.0f files/s, %.2fx\n", "", files / outcome.seconds, single / outcome.seconds);
+    }
+
+    for (int i = 0; i < files; ++i) {
+        sprintf(path, "fleet/%04d.seal", i);
+        remove(path);
+    }
+    rmdir("fleet");
+    remove(WALLET_FILE);
+    remove(WALLET_HISTORY_FILE);
+    remove(WALLET_LOCK_FILE);
+    return ret != RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Times wallet operations with and without the access log,
+ *             then the log alone: how fast records are sealed, and how
+ *             fast a long log is verified with a growing number of
+ *             threads. Runs in the current directory, which must hold
+ *             no wallet.
+ *
+ */
+static int bench_access_log(int operations, int records) {
+    const char* master_password = "bench-master";
+    char name[64];
+    item_t* item = (item_t*)secure_malloc(sizeof(item_t));
+    wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    strcpy(item->title, "bench item");
+    strcpy(item->password, "bench password");
+
+    // the same operations, auditing off then on; the flush is timed
+    int ret = create_wallet(master_password);
+    double elapsed[2] = {0, 0};
+    for (int audited = 0; audited < 2 && ret == RET_SUCCESS; ++audited) {
+        if (audited && access_log_open("bench.access") != ACCESS_LOG_OK) {ret = 1;}
+        double start = now_ns();
+        for (int i = 0; i < operations && ret == RET_SUCCESS; ++i) {
+            ret = add_item(master_password, item, sizeof(item_t));
+            if (ret == RET_SUCCESS) {ret = show_wallet(master_password, wallet);}
+            if (ret == RET_SUCCESS) {ret = remove_item(master_password, 0);}
+        }
+        if (audited && access_log_flush() != ACCESS_LOG_OK) {ret = 1;}
+        elapsed[audited] = now_ns() - start;
+        if (audited) {access_log_close();}
+    }
+    remove(WALLET_FILE);
+    remove(WALLET_HISTORY_FILE);
+    remove(WALLET_LOCK_FILE);
+    remove("bench.access");
+    secure_free(item);
+    secure_free(wallet);
+    if (ret != RET_SUCCESS) {return 1;}
+    report("wallet operation (audit off)", elapsed[0] / (3 * operations));
+    report("wallet operation (audit on)", elapsed[1] / (3 * operations));
+    printf("[BENCH] %-40s %12.1f %% overhead\n", "", (elapsed[1] / elapsed[0] - 1) * 100);
+
+    // records alone: group commit turns them into few flushes
+    access_log_report_t outcome;
+    if (access_log_open("bench.access") != ACCESS_LOG_OK) {return 1;}
+    double start = now_ns();
+    for (int i = 0; i < records; ++i) {access_log_record(ACCESS_SHOW, -1, 0, RET_SUCCESS);}
+    ret = access_log_flush();
+    double recorded = now_ns() - start;
+    access_log_close();
+    sprintf(name, "access_log_record (%d records)", records);
+    report(name, recorded / records);
+    int cores = (int)std::thread::hardware_concurrency();
+    double single = 0;
+    for (int threads = 1; threads <= (cores > 4 ? cores : 4) && ret == ACCESS_LOG_OK; threads *= 2) {
+        start = now_ns();
+        ret = access_log_verify("bench.access", threads, &outcome);
+        double verified = now_ns() - start;
+        if (threads == 1) {
+            single = verified;
+            printf("[BENCH] %-40s %12.1f records/seal\n", "", (double)outcome.entries / outcome.seals);
+        }
+        sprintf(name, "access_log_verify (%d threads)", threads);
+        report(name, verified / (outcome.entries + outcome.seals));
+        printf("[BENCH] %-40s %12.2fx\n", "", single / verified);
+    }
+    remove("bench.access");
+    return ret != ACCESS_LOG_OK;
+}
+
+
+/**
+ * @brief      Times a reader that needs a fresh wallet per request:
+ *             loading it every time, against checking a cache, and
+ *             against reloading the cache after one item changed.
+ *             Runs in the current directory, which must hold no
+ *             wallet.
+ *
+ */
+static int bench_cache(int operations) {
+    const char* master_password = "bench-master";
+    item_t* item = (item_t*)secure_malloc(sizeof(item_t));
+    wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    int ret = create_wallet(master_password);
+    for (int i = 0; i < MAX_ITEMS / 2 && ret == RET_SUCCESS; ++i) {
+        sprintf(item->title, "service %d", i);
+        strcpy(item->password, "cache password");
+        ret = add_item(master_password, item, sizeof(item_t));
+    }
+
+    double start = now_ns();
+    for (int i = 0; i < operations && ret == RET_SUCCESS; ++i) {ret = show_wallet(master_password, wallet);}
+    double loaded = now_ns() - start;
+
+    wallet_cache_t cache;
+    size_t changed = 0;
+    if (ret == RET_SUCCESS) {ret = open_wallet_cache(WALLET_FILE, master_password, 0, &cache);}
+    if (ret != RET_SUCCESS) {
+        secure_free(item);
+        secure_free(wallet);
+        return 1;
+    }
+    start = now_ns();
+    for (int i = 0; i < operations && ret == RET_SUCCESS; ++i) {ret = refresh_wallet_cache(&cache, 0, &changed);}
+    double checked = now_ns() - start;
+
+    // one item changes between requests; only the reload is timed
+    double reloaded = 0;
+    for (int i = 0; i < operations && ret == RET_SUCCESS; ++i) {
+        sprintf(item->password, "rotated %d", i);
+        ret = update_item(master_password, i % (MAX_ITEMS / 2), item, sizeof(item_t));
+        start = now_ns();
+        if (ret == RET_SUCCESS) {ret = refresh_wallet_cache(&cache, 1000, &changed);}
+        reloaded += now_ns() - start;
+        if (changed != 1) {ret = 1;}
+    }
+    wallet_cache_free(&cache);
+    remove(WALLET_FILE);
+    remove(WALLET_HISTORY_FILE);
+    remove(WALLET_LOCK_FILE);
+    secure_free(item);
+    secure_free(wallet);
+    if (ret != RET_SUCCESS) {return 1;}
+
+    report("show_wallet per request", loaded / operations);
+    report("refresh_wallet_cache (unchanged)", checked / operations);
+    report("refresh_wallet_cache (one item changed)", reloaded / operations);
+    return 0;
+}
+
+
+/**
+ * @brief      Times item reads and master-password checks on a wallet
+ *             laid out for a given policy, filled with up to 1024
+ *             items.
+ *
+ */
+template <class Policy>
+static int bench_policy(const char* label, int operations) {
+    char name[64], title[16];
+    volatile size_t sink = 0;
+    BasicWallet<Policy>* wallet = new BasicWallet<Policy>();
+    int ret = wallet->set_master_password("bench-master");
+    size_t count = BasicWallet<Policy>::capacity < 1024 ? BasicWallet<Policy>::capacity : 1024;
+    for (size_t i = 0; i < count && ret == RET_SUCCESS; ++i) {
+        snprintf(title, sizeof(title), "item %zu", i);
+        ret = wallet->add(title, "user", "secret");
+    }
+
+    double start = now_ns();
+    for (int i = 0; i < operations && ret == RET_SUCCESS; ++i) {
+        sink += (size_t)wallet->get((size_t)i * 7919 % count)->title[5];
+    }
+    double read = now_ns() - start;
+    int checks = operations / 1000 + 1;
+    start = now_ns();
+    for (int i = 0; i < checks && ret == RET_SUCCESS; ++i) {
+        sink += (size_t)wallet->check_master_password("bench-master");
+    }
+    double checked = now_ns() - start;
+    delete wallet;
+    if (ret != RET_SUCCESS || sink == (size_t)-1) {return 1;}
+
+    snprintf(name, sizeof(name), "policy get (%s)", label);
+    report(name, read / operations);
+    snprintf(name, sizeof(name), "policy password check (%s)", label);
+    report(name, checked / checks);
+    return 0;
+}
+
+
+/**
+ * @brief      Times credential fetches through the library, which
+ *             keeps the wallet unlocked, against loading the wallet
+ *             per fetch as the CLI does; and a batch add against as
+ *             many single adds. Runs in the current directory, which
+ *             must hold no wallet.
+ *
+ */
+static int bench_library(int operations) {
+    const char* master_password = "bench-master";
+    const int batch = 10;
+    item_t* item = (item_t*)secure_malloc(sizeof(item_t));
+    lw_item_t* items = (lw_item_t*)secure_malloc(batch * sizeof(lw_item_t));
+    memset(items, 0, batch * sizeof(lw_item_t));
+    int ret = create_wallet(master_password);
+    for (int i = 0; i < MAX_ITEMS / 2 && ret == RET_SUCCESS; ++i) {
+        sprintf(item->title, "service %d", i);
+        strcpy(item->password, "library password");
+        ret = add_item(master_password, item, sizeof(item_t));
+    }
+
+    uint32_t indexes[MAX_ITEMS];
+    size_t count = 0;
+    double start = now_ns();
+    for (int i = 0; i < operations && ret == RET_SUCCESS; ++i) {
+        ret = find_credential(WALLET_FILE, master_password, "service 7", NULL, indexes, item, &count);
+    }
+    double loaded = now_ns() - start;
+
+    lw_wallet_t* wallet = NULL;
+    if (ret == RET_SUCCESS) {ret = lw_open(WALLET_FILE, &wallet);}
+    if (ret == LW_OK) {ret = lw_unlock(wallet, master_password);}
+    start = now_ns();
+    for (int i = 0; i < operations * 100 && ret == LW_OK; ++i) {ret = lw_get(wallet, 7, &items[0]);}
+    double fetched = now_ns() - start;
+
+    // the same items, one save per item or one per batch
+    uint32_t added[batch];
+    for (int i = 0; i < batch; ++i) {
+        sprintf(items[i].title, "batch %d", i);
+        added[i] = (uint32_t)(MAX_ITEMS / 2 + i);
+    }
+    start = now_ns();
+    for (int i = 0; i < batch && ret == LW_OK; ++i) {ret = lw_add(wallet, &items[i], 1);}
+    double single = now_ns() - start;
+    if (ret == LW_OK) {ret = lw_remove(wallet, added, batch);}
+    start = now_ns();
+    if (ret == LW_OK) {ret = lw_add(wallet, items, batch);}
+    double batched = now_ns() - start;
+    lw_close(wallet);
+    remove(WALLET_FILE);
+    remove(WALLET_HISTORY_FILE);
+    remove(WALLET_LOCK_FILE);
+    secure_free(item);
+    secure_free(items);
+    if (ret != LW_OK) {return 1;}
+
+    report("fetch, wallet loaded per fetch", loaded / operations);
+    report("fetch, lw_get on an unlocked wallet", fetched / (operations * 100));
+    report("lw_add, one item per call", single / batch);
+    report("lw_add, one batch (per item)", batched / batch);
+    return 0;
+}
+
+
+/**
+ * @brief      Times how long a caller is held by an unlock, the load
+ *             and key checks included: run in place, or queued on an
+ *             executor. Then times unlocks of several handles in
+ *             flight at once. Runs in the current directory, which
+ *             must hold no wallet.
+ *
+ */
+static int bench_async(int operations) {
+    const char* master_password = "bench-master";
+    const int handles = 8;
+    item_t* item = (item_t*)secure_malloc(sizeof(item_t));
+    int ret = create_wallet(master_password);
+    for (int i = 0; i < MAX_ITEMS / 2 && ret == RET_SUCCESS; ++i) {
+        sprintf(item->title, "service %d", i);
+        ret = add_item(master_password, item, sizeof(item_t));
+    }
+    secure_free(item);
+
+    lw_wallet_t* wallets[handles];
+    int status[handles];
+    lw_executor_t* executor = NULL;
+    for (int i = 0; i < handles && ret == RET_SUCCESS; ++i) {ret = lw_open(WALLET_FILE, &wallets[i]);}
+    if (ret == LW_OK) {ret = lw_executor_create(0, &executor);}
+    if (ret != LW_OK) {return 1;}
+
+    double start = now_ns();
+    for (int i = 0; i < operations && ret == LW_OK; ++i) {ret = lw_unlock(wallets[0], master_password);}
+    double blocking = now_ns() - start;
+
+    // submitting is all the caller waits for; the executor drains the
+    // queue when destroyed
+    double queued = 0;
+    start = now_ns();
+    for (int round = 0; round < operations / handles && ret == LW_OK; ++round) {
+        double submitted = now_ns();
+        for (int i = 0; i < handles && ret == LW_OK; ++i) {
+            ret = lw_unlock_async(executor, wallets[i], master_password, NULL, NULL);
+        }
+        queued += now_ns() - submitted;
+        lw_executor_destroy(executor);
+        executor = NULL;
+        if (ret == LW_OK) {ret = lw_executor_create(0, &executor);}
+    }
+    double overlapped = now_ns() - start;
+    lw_executor_destroy(executor);
+    for (int i = 0; i < handles; ++i) {
+        if (lw_count(wallets[i], (size_t*)&status[i]) != LW_OK) {ret = 1;}
+        lw_close(wallets[i]);
+    }
+    remove(WALLET_FILE);
+    remove(WALLET_HISTORY_FILE);
+    remove(WALLET_LOCK_FILE);
+    if (ret != LW_OK) {return 1;}
+
+    int unlocks = operations / handles * handles;
+    report("lw_unlock, caller held", blocking / operations);
+    report("lw_unlock_async, caller held", queued / unlocks);
+    report("lw_unlock_async, 8 handles in flight", overlapped / unlocks);
+    return 0;
+}
+
+
+/**
+ * @brief      Times the ChaCha20 keystream, four blocks at a time and
+ *             one at a time, the passwords drawn from it, and wallets
+ *             filled with generated passwords in one batch. Runs in the
+ *             current directory, which must hold no wallet.
+ *
+ */
+static int bench_generator(int operations) {
+    const char* master_password = "bench-master";
+    const uint8_t key[CHACHA20_KEY_SIZE] = {0}, nonce[CHACHA20_NONCE_SIZE] = {0};
+    std::vector<uint8_t> keystream(CSPRNG_BUFFER_SIZE);
+    double start = now_ns();
+    for (int i = 0; i < operations * 10; ++i) {
+        chacha20_keystream(key, nonce, (uint32_t)i, keystream.data(), keystream.size());
+    }
+    double lanes = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < operations * 10; ++i) {
+        for (size_t block = 0; block < keystream.size(); block += CHACHA20_BLOCK_SIZE) {
+            chacha20_keystream(key, nonce, (uint32_t)i, keystream.data() + block, CHACHA20_BLOCK_SIZE);
+        }
+    }
+    double blocks = now_ns() - start;
+
+    csprng_t* rng = (csprng_t*)secure_malloc(sizeof(csprng_t));
+    const password_policy_t random = {PASSWORD_DEFAULT_LENGTH, PASSWORD_CLASSES};
+    const password_policy_t pronounceable = {PASSWORD_DEFAULT_LENGTH, PASSWORD_CLASSES | PASSWORD_PRONOUNCEABLE};
+    char password[MAX_ITEM_SIZE];
+    int ret = csprng_init(rng);
+    start = now_ns();
+    for (int i = 0; i < operations * 100 && ret == GENERATOR_OK; ++i) {ret = generate_password(rng, &random, password);}
+    double drawn = now_ns() - start;
+    start = now_ns();
+    for (int i = 0; i < operations * 100 && ret == GENERATOR_OK; ++i) {
+        ret = generate_password(rng, &pronounceable, password);
+    }
+    double spoken = now_ns() - start;
+    csprng_free(rng);
+    secure_free(rng);
+    if (ret != GENERATOR_OK) {return 1;}
+
+    // a full wallet provisioned per round
+    item_t* items = (item_t*)secure_malloc(MAX_ITEMS * sizeof(item_t));
+    double provisioned = 0;
+    for (int round = 0; round < operations / 10 && ret == RET_SUCCESS; ++round) {
+        memset(items, 0, MAX_ITEMS * sizeof(item_t));
+        for (int i = 0; i < MAX_ITEMS; ++i) {sprintf(items[i].title, "service %d", i);}
+        ret = create_wallet(master_password);
+        start = now_ns();
+        if (ret == RET_SUCCESS) {ret = add_items(WALLET_FILE, master_password, items, MAX_ITEMS, &random);}
+        provisioned += now_ns() - start;
+        remove(WALLET_FILE);
+        remove(WALLET_HISTORY_FILE);
+        remove(WALLET_LOCK_FILE);
+    }
+    secure_free(items);
+    if (ret != RET_SUCCESS) {return 1;}
+
+    report("chacha20, 4 blocks per call (per KiB)", lanes / (operations * 10));
+    report("chacha20, 1 block per call (per KiB)", blocks / (operations * 10));
+    report("generate_password, 20 characters", drawn / (operations * 100));
+    report("generate_password, 20 pronounceable", spoken / (operations * 100));
+    report("add_items, generated passwords (per item)", provisioned / (operations / 10 * MAX_ITEMS));
+    return 0;
+}
+
+
+/**
+ * @brief      Times reads from an item store ten times larger than its
+ *             memory budget, under a given access pattern, and reports
+ *             the hit rate.
+ *
+ */
+static int bench_paging(const char* label, item_store_t* store, uint32_t hot, int operations) {
+    char name[64];
+    item_t item;
+    uint64_t state = 0x9e3779b97f4a7c15ull;
+    store->stats = pager_stats_t();
+    double start = now_ns();
+    for (int i = 0; i < operations; ++i) {
+        // xorshift; 'hot' items get nine accesses in ten
+        state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+        uint32_t index = (state % 10 != 0) ? (uint32_t)(state >> 8) % hot : (uint32_t)(state >> 8) % store->capacity;
+        if (pager_get(store, index, &item) != PAGER_OK) {return 1;}
+    }
+    double elapsed = now_ns() - start;
+    sprintf(name, "pager_get (%s)", label);
+    report(name, elapsed / operations);
+    printf("[BENCH] %-40s %12.1f %% hits, %llu evictions\n", "",
+        100.0 * store->stats.hits / operations, (unsigned long long)store->stats.evictions);
+    return 0;
+}
+
+
+/**
+ * @brief      Runs the micro-benchmarks and prints the results.
+ *
+ */
+int bench() {
+    const int iterations = 200000;
+    volatile int sink = 0;
+    char name[64];
+
+
+    ////////////////////////////////////////////////
+    // bench constant-time comparison
+    ////////////////////////////////////////////////
+    static unsigned char a[4096], b[4096];
+    memset(a, 0x5a, sizeof(a));
+    memset(b, 0x5a, sizeof(b));
+    const size_t sizes[] = {16, 32, MAX_ITEM_SIZE, 1024, 4096};
+    for (size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s) {
+        double start = now_ns();
+        for (int i = 0; i < iterations; ++i) {sink = sink + secure_memcmp(a, b, sizes[s]);}
+        sprintf(name, "secure_memcmp (%zu bytes)", sizes[s]);
+        report(name, (now_ns() - start) / iterations);
+
+        start = now_ns();
+        for (int i = 0; i < iterations; ++i) {sink = sink + (memcmp(a, b, sizes[s]) != 0);}
+        sprintf(name, "memcmp (%zu bytes)", sizes[s]);
+        report(name, (now_ns() - start) / iterations);
+    }
+
+    char stored[MAX_ITEM_SIZE] = "This is the master-password";
+    char candidate[MAX_ITEM_SIZE] = "This is the master-password";
+    double start = now_ns();
+    for (int i = 0; i < iterations; ++i) {sink = sink + secure_strcmp(stored, candidate, MAX_ITEM_SIZE);}
+    report("secure_strcmp (master-password)", (now_ns() - start) / iterations);
+
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) {secure_zero(a, sizeof(a));}
+    report("secure_zero (4096 bytes)", (now_ns() - start) / iterations);
+
+
+    ////////////////////////////////////////////////
+    // bench wallet image compression
+    ////////////////////////////////////////////////
+    wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    for (int i = 0; i < MAX_ITEMS; ++i) {
+        sprintf(wallet->items[i].title, "prod-db-%03d.example.com", i);
+        sprintf(wallet->items[i].username, "svc-account-%d", i % 7);
+        sprintf(wallet->items[i].password, "%08x%08x", i * 2654435761u, i * 40503u);
+    }
+    wallet->size = MAX_ITEMS;
+    size_t bound = lz_compress_bound(sizeof(wallet_t));
+    unsigned char* packed = (unsigned char*)secure_malloc(bound);
+    size_t packed_size = 0;
+    const int rounds = 200;
+    start = now_ns();
+    for (int i = 0; i < rounds; ++i) {packed_size = lz_compress(wallet, sizeof(wallet_t), packed, bound);}
+    report("lz_compress (full wallet)", (now_ns() - start) / rounds);
+    start = now_ns();
+    for (int i = 0; i < rounds; ++i) {sink = sink + lz_decompress(packed, packed_size, wallet, sizeof(wallet_t));}
+    report("lz_decompress (full wallet)", (now_ns() - start) / rounds);
+    printf("[BENCH] %-40s %12zu -> %zu bytes\n", "full wallet image", sizeof(wallet_t), packed_size);
+    secure_free(packed);
+
+
+    ////////////////////////////////////////////////
+    // bench password audit
+    ////////////////////////////////////////////////
+    // SHA-1 of one item password, one lane vs four
+    const uint8_t* lanes[SHA1_LANES];
+    size_t lens[SHA1_LANES];
+    uint8_t digests[SHA1_LANES][SHA1_SIZE];
+    for (int i = 0; i < SHA1_LANES; ++i) {
+        lanes[i] = (const uint8_t*)wallet->items[i].password;
+        lens[i] = strlen(wallet->items[i].password);
+    }
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) {sha1(lanes[i & 3], lens[i & 3], digests[i & 3]);}
+    report("sha1 (per password)", (now_ns() - start) / iterations);
+    start = now_ns();
+    for (int i = 0; i < iterations; i += SHA1_LANES) {sha1_x4(lanes, lens, digests);}
+    report("sha1_x4 (per password)", (now_ns() - start) / iterations);
+
+    // synthetic corpus of random sorted hashes
+    const char* corpus_file = "/tmp/bench.corpus";
+    const size_t corpus_lines = 1000000;
+    std::vector<std::string> hashes(corpus_lines);
+    srand(42);
+    for (size_t i = 0; i < corpus_lines; ++i) {
+        char line[CORPUS_HASH_HEX+1];
+        for (int j = 0; j < CORPUS_HASH_HEX; ++j) {line[j] = "0123456789ABCDEF"[rand() & 15];}
+        line[CORPUS_HASH_HEX] = '\0';
+        hashes[i] = line;
+    }
+    std::sort(hashes.begin(), hashes.end());
+    FILE* file = fopen(corpus_file, "w");
+    for (size_t i = 0; i < corpus_lines; ++i) {fprintf(file, "%s:%zu\n", hashes[i].c_str(), i % 1000 + 1);}
+    fclose(file);
+    remove("/tmp/bench.corpus" BLOOM_SUFFIX);
+
+    corpus_t corpus;
+    start = now_ns();
+    if (corpus_open(corpus_file, &corpus) != 0) {return 1;}
+    report("Bloom filter build (1M hashes)", now_ns() - start);
+    corpus_close(&corpus);
+    start = now_ns();
+    if (corpus_open(corpus_file, &corpus) != 0) {return 1;}
+    report("corpus_open (cached filter)", now_ns() - start);
+
+    audit_result_t* results = (audit_result_t*)secure_malloc(MAX_ITEMS * sizeof(audit_result_t));
+    start = now_ns();
+    for (int i = 0; i < rounds; ++i) {audit_items(wallet->items, MAX_ITEMS, &corpus, results);}
+    report("audit_items (full wallet)", (now_ns() - start) / rounds);
+    start = now_ns();
+    for (int i = 0; i < rounds; ++i) {audit_items(wallet->items, MAX_ITEMS, NULL, results);}
+    report("audit_items (reuse only)", (now_ns() - start) / rounds);
+    secure_free(results);
+    corpus_close(&corpus);
+    remove(corpus_file);
+    remove("/tmp/bench.corpus" BLOOM_SUFFIX);
+
+
+    ////////////////////////////////////////////////
+    // bench tag queries
+    ////////////////////////////////////////////////
+    const char* environments[] = {"prod", "staging", "dev"};
+    for (int i = 0; i < MAX_ITEMS; ++i) {
+        sprintf(wallet->items[i].tags, "%s,%s%s", environments[i % 3], i % 2 ? "db" : "web", i % 5 ? "" : ",legacy");
+    }
+    tag_index_build(&wallet->tags, wallet->items, MAX_ITEMS);
+    bitmap_t matches;
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) {sink = sink + tag_query(&wallet->tags, MAX_ITEMS, "prod AND db AND NOT legacy", &matches);}
+    report("tag_query (3 terms, full wallet)", (now_ns() - start) / iterations);
+    start = now_ns();
+    for (int i = 0; i < iterations / 10; ++i) {
+        for (int j = 0; j < MAX_ITEMS; ++j) {
+            const char* tags = wallet->items[j].tags;
+            sink = sink + (strstr(tags, "prod") && strstr(tags, "db") && !strstr(tags, "legacy"));
+        }
+    }
+    report("tag scan (3 terms, full wallet)", (now_ns() - start) / (iterations / 10));
+
+
+    ////////////////////////////////////////////////
+    // bench merge trees
+    ////////////////////////////////////////////////
+    // a replica differing by one item: the tree is kept up to date
+    // incrementally and compared top-down
+    for (int i = 0; i < MAX_ITEMS; ++i) {random_bytes(&wallet->items[i].id, sizeof(uint64_t));}
+    merkle_tree_t* other = (merkle_tree_t*)secure_malloc(sizeof(merkle_tree_t));
+    start = now_ns();
+    for (int i = 0; i < rounds; ++i) {merkle_build(&wallet->merkle, wallet->items, MAX_ITEMS, &wallet->tombstones);}
+    report("merkle_build (full wallet)", (now_ns() - start) / rounds);
+    *other = wallet->merkle;
+    uint8_t hash[MERKLE_HASH_SIZE];
+    merkle_item_hash(&wallet->items[0], hash);
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) {merkle_toggle(other, wallet->items[0].id, hash);}
+    report("merkle_toggle (one item)", (now_ns() - start) / iterations);
+    merkle_toggle(other, wallet->items[0].id, hash);
+    uint32_t buckets[MERKLE_LEAVES], differing = 0;
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) {sink = sink + merkle_diff(&wallet->merkle, other, buckets, &differing);}
+    report("merkle_diff (one change)", (now_ns() - start) / iterations);
+    secure_free(other);
+    secure_free(wallet);
+
+
+    ////////////////////////////////////////////////
+    // bench enclave boundary
+    ////////////////////////////////////////////////
+    // in a scratch directory, so that no wallet is overwritten
+    char cwd[4096], scratch[] = "/tmp/bench.XXXXXX";
+    if (getcwd(cwd, sizeof(cwd)) == NULL || mkdtemp(scratch) == NULL || chdir(scratch) != 0) {return 1;}
+    const enclave_config_t simulated = {ENCLAVE_SIMULATED, ENCLAVE_TRANSITION_NS, 0};
+    const enclave_config_t switchless = {ENCLAVE_SWITCHLESS, ENCLAVE_TRANSITION_NS, 2};
+    int boundary_status = bench_boundary("simulated", &simulated, 200);
+    boundary_status |= bench_boundary("switchless", &switchless, 200);
+    boundary_status |= bench_blob(16ull << 20);
+    boundary_status |= bench_fleet(256);
+    boundary_status |= bench_access_log(100, 100000);
+    boundary_status |= bench_cache(100);
+    boundary_status |= bench_library(100);
+    boundary_status |= bench_async(200);
+    boundary_status |= bench_generator(100);
+    if (chdir(cwd) != 0 || rmdir(scratch) != 0 || boundary_status != 0) {return 1;}
+
+
+    ////////////////////////////////////////////////
+    // bench paging
+    ////////////////////////////////////////////////
+    // 1024 items, a tenth of them resident
+    const uint32_t paged_items = 1024;
+    item_store_t store;
+    item_t paged;
+    memset(&paged, 0, sizeof(paged));
+    if (pager_init(&store, paged_items, paged_items * sizeof(item_t) / 10, NULL) != PAGER_OK) {return 1;}
+    for (uint32_t i = 0; i < paged_items; ++i) {
+        sprintf(paged.title, "paged %u", i);
+        pager_put(&store, i, &paged);
+    }
+    pager_flush(&store);
+    int paging_status = bench_paging("uniform", &store, paged_items, iterations / 10);
+    paging_status |= bench_paging("hot 5%", &store, paged_items / 20, iterations / 10);
+    pager_free(&store);
+    if (paging_status != 0) {return 1;}
+
+
+    ////////////////////////////////////////////////
+    // bench wallet policies
+    ////////////////////////////////////////////////
+    // the same limits inline and paged, then a large stretched wallet
+    int policy_status = bench_policy<default_policy_t>("default, inline", iterations);
+    policy_status |= bench_policy<WalletPolicy<MAX_ITEMS, MAX_ITEM_SIZE, PASSWORD_MIN_SIZE, PlainKdf, PagedStorage>>(
+        "default, paged", iterations);
+    policy_status |= bench_policy<WalletPolicy<4, 16>>("tiny, inline", iterations);
+    policy_status |= bench_policy<WalletPolicy<100000, 64, 12, Pbkdf2Kdf<10000>>>("service, pbkdf2", iterations);
+    if (policy_status != 0) {return 1;}
+
+
+    return sink == -1;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BENCH_H_
+#define BENCH_H_
+
+
+/**
+ * @brief      Runs the micro-benchmarks and prints the results.
+ *
+ * @param      -
+ *
+ * @return     0 if successful, 1 otherwise.
+ */
+int bench();
+
+
+/**
+ * @brief      Reads a monotonic clock.
+ *
+ * @param      -
+ *
+ * @return     The current time in nanoseconds.
+ */
+double now_ns();
+
+
+#endif // BENCH_H_
@@ -0,0 +1,403 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ecalls.h"
+#include "../wallet/enclave.h"
+
+
+/***************************************************
+ * Marshalling
+ ***************************************************/
+// arguments of a call, as copied across the boundary
+struct EcallArgs {
+	const char* master_password;
+	int index;
+	const item_t* item;
+	wallet_t* wallet;
+};
+
+static int run_create_wallet(void* ctx) {
+	struct EcallArgs* args = (struct EcallArgs*)ctx;
+	return create_wallet(args->master_password);
+}
+
+static int run_show_wallet(void* ctx) {
+	struct EcallArgs* args = (struct EcallArgs*)ctx;
+	return show_wallet(args->master_password, args->wallet);
+}
+
+static int run_add_item(void* ctx) {
+	struct EcallArgs* args = (struct EcallArgs*)ctx;
+	return add_item(args->master_password, args->item, sizeof(item_t));
+}
+
+static int run_update_item(void* ctx) {
+	struct EcallArgs* args = (struct EcallArgs*)ctx;
+	return update_item(args->master_password, args->index, args->item, sizeof(item_t));
+}
+
+static int run_remove_item(void* ctx) {
+	struct EcallArgs* args = (struct EcallArgs*)ctx;
+	return remove_item(args->master_password, args->index);
+}
+
+// the calls that take more than a master-password, an index and an
+// item have their own layout, as in the EDL file
+
+struct ChangePasswordArgs {
+	const char* old_password;
+	const char* new_password;
+};
+
+static int run_change_master_password(void* ctx) {
+	struct ChangePasswordArgs* args = (struct ChangePasswordArgs*)ctx;
+	return change_master_password(args->old_password, args->new_password);
+}
+
+struct PathArgs {
+	const char* path;
+	const char* master_password;
+};
+
+static int run_migrate_wallet(void* ctx) {
+	struct PathArgs* args = (struct PathArgs*)ctx;
+	return migrate_wallet(args->path, args->master_password);
+}
+
+struct AddItemsArgs {
+	const char* path;
+	const char* master_password;
+	item_t* items;
+	size_t count;
+	const struct PasswordPolicy* generate;
+};
+
+static int run_add_items(void* ctx) {
+	struct AddItemsArgs* args = (struct AddItemsArgs*)ctx;
+	return add_items(args->path, args->master_password, args->items, args->count, args->generate);
+}
+
+struct RemoveItemsArgs {
+	const char* path;
+	const char* master_password;
+	const uint32_t* indexes;
+	size_t count;
+};
+
+static int run_remove_items(void* ctx) {
+	struct RemoveItemsArgs* args = (struct RemoveItemsArgs*)ctx;
+	return remove_items(args->path, args->master_password, args->indexes, args->count);
+}
+
+struct SnapshotsArgs {
+	const char* master_password;
+	snapshot_t* snapshots;
+	size_t* count;
+	uint64_t version;
+};
+
+static int run_list_snapshots(void* ctx) {
+	struct SnapshotsArgs* args = (struct SnapshotsArgs*)ctx;
+	return list_snapshots(args->master_password, args->snapshots, args->count);
+}
+
+static int run_restore_snapshot(void* ctx) {
+	struct SnapshotsArgs* args = (struct SnapshotsArgs*)ctx;
+	return restore_snapshot(args->master_password, args->version);
+}
+
+struct AuditArgs {
+	const char* master_password;
+	const char* corpus_path;
+	audit_result_t* results;
+	size_t* count;
+};
+
+static int run_audit_wallet(void* ctx) {
+	struct AuditArgs* args = (struct AuditArgs*)ctx;
+	return audit_wallet(args->master_password, args->corpus_path, args->results, args->count);
+}
+
+struct SearchArgs {
+	const char* path;
+	const char* master_password;
+	const char* query;
+	const char* title;
+	const char* username;
+	uint32_t* indexes;
+	item_t* items;
+	size_t* count;
+};
+
+static int run_search_items(void* ctx) {
+	struct SearchArgs* args = (struct SearchArgs*)ctx;
+	return search_items(args->master_password, args->query, args->indexes, args->items, args->count);
+}
+
+static int run_find_credential(void* ctx) {
+	struct SearchArgs* args = (struct SearchArgs*)ctx;
+	return find_credential(args->path, args->master_password, args->title, args->username, args->indexes, args->items,
+		args->count);
+}
+
+struct ExpiringArgs {
+	const char* master_password;
+	int64_t horizon;
+	expiring_t* items;
+	size_t* count;
+};
+
+static int run_list_expiring(void* ctx) {
+	struct ExpiringArgs* args = (struct ExpiringArgs*)ctx;
+	return list_expiring(args->master_password, args->horizon, args->items, args->count);
+}
+
+struct MergeArgs {
+	const char* master_password;
+	const char* path_a;
+	const char* path_b;
+	merge_stats_t* stats;
+};
+
+static int run_merge_wallets(void* ctx) {
+	struct MergeArgs* args = (struct MergeArgs*)ctx;
+	return merge_wallets(args->master_password, args->path_a, args->path_b, args->stats);
+}
+
+struct ItemStoreArgs {
+	const char* master_password;
+	size_t budget;
+	struct ItemStore* store;
+};
+
+static int run_open_item_store(void* ctx) {
+	struct ItemStoreArgs* args = (struct ItemStoreArgs*)ctx;
+	return open_item_store(args->master_password, args->budget, args->store);
+}
+
+struct ItemStoreGetArgs {
+	item_store_t* store;
+	uint32_t index;
+	item_t* item;
+};
+
+static int run_item_store_get(void* ctx) {
+	struct ItemStoreGetArgs* args = (struct ItemStoreGetArgs*)ctx;
+	return pager_get(args->store, args->index, args->item);
+}
+
+static int run_close_item_store(void* ctx) {
+	pager_free((item_store_t*)ctx);
+	return PAGER_OK;
+}
+
+// the stream callbacks are the untrusted side of the blob ocalls
+struct BlobArgs {
+	const char* master_password;
+	int index;
+	blob_source_fn source;
+	blob_sink_fn sink;
+	void* ctx;
+};
+
+static int run_attach_blob(void* ctx) {
+	struct BlobArgs* args = (struct BlobArgs*)ctx;
+	return attach_blob(args->master_password, args->index, args->source, args->ctx);
+}
+
+static int run_read_blob(void* ctx) {
+	struct BlobArgs* args = (struct BlobArgs*)ctx;
+	return read_blob(args->master_password, args->index, args->sink, args->ctx);
+}
+
+struct RotateArgs {
+	const char* path;
+	const char* master_password;
+	const char* title;
+	const char* username;
+	const char* password;
+	size_t* count;
+};
+
+static int run_rotate_credential(void* ctx) {
+	struct RotateArgs* args = (struct RotateArgs*)ctx;
+	return rotate_credential(args->path, args->master_password, args->title, args->username, args->password,
+		args->count);
+}
+
+struct CacheArgs {
+	const char* path;
+	const char* master_password;
+	int polling;
+	int timeout_ms;
+	wallet_cache_t* cache;
+	size_t* changed;
+};
+
+static int run_open_wallet_cache(void* ctx) {
+	struct CacheArgs* args = (struct CacheArgs*)ctx;
+	return open_wallet_cache(args->path, args->master_password, args->polling, args->cache);
+}
+
+static int run_refresh_wallet_cache(void* ctx) {
+	struct CacheArgs* args = (struct CacheArgs*)ctx;
+	return refresh_wallet_cache(args->cache, args->timeout_ms, args->changed);
+}
+
+struct TagQueryArgs {
+	const wallet_cache_t* cache;
+	const char* query;
+	bitmap_t* matches;
+};
+
+static int run_tag_query(void* ctx) {
+	struct TagQueryArgs* args = (struct TagQueryArgs*)ctx;
+	const wallet_t* wallet = args->cache->wallet;
+	return tag_query(&wallet->tags, wallet->size, args->query, args->matches);
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int ecall_create_wallet(const char* master_password) {
+	struct EcallArgs args = {master_password, 0, NULL, NULL};
+	return enclave_call(run_create_wallet, &args);
+}
+
+int ecall_show_wallet(const char* master_password, wallet_t* wallet) {
+	struct EcallArgs args = {master_password, 0, NULL, wallet};
+	return enclave_call(run_show_wallet, &args);
+}
+
+int ecall_add_item(const char* master_password, const item_t* item) {
+	struct EcallArgs args = {master_password, 0, item, NULL};
+	return enclave_call(run_add_item, &args);
+}
+
+int ecall_update_item(const char* master_password, int index, const item_t* item) {
+	struct EcallArgs args = {master_password, index, item, NULL};
+	return enclave_call(run_update_item, &args);
+}
+
+int ecall_remove_item(const char* master_password, int index) {
+	struct EcallArgs args = {master_password, index, NULL, NULL};
+	return enclave_call(run_remove_item, &args);
+}
+
+int ecall_change_master_password(const char* old_password, const char* new_password) {
+	struct ChangePasswordArgs args = {old_password, new_password};
+	return enclave_call(run_change_master_password, &args);
+}
+
+int ecall_migrate_wallet(const char* path, const char* master_password) {
+	struct PathArgs args = {path, master_password};
+	return enclave_call(run_migrate_wallet, &args);
+}
+
+int ecall_add_items(const char* path, const char* master_password, item_t* items, size_t count,
+	const struct PasswordPolicy* generate) {
+	struct AddItemsArgs args = {path, master_password, items, count, generate};
+	return enclave_call(run_add_items, &args);
+}
+
+int ecall_remove_items(const char* path, const char* master_password, const uint32_t* indexes, size_t count) {
+	struct RemoveItemsArgs args = {path, master_password, indexes, count};
+	return enclave_call(run_remove_items, &args);
+}
+
+int ecall_list_snapshots(const char* master_password, snapshot_t* snapshots, size_t* count) {
+	struct SnapshotsArgs args = {master_password, snapshots, count, 0};
+	return enclave_call(run_list_snapshots, &args);
+}
+
+int ecall_restore_snapshot(const char* master_password, uint64_t version) {
+	struct SnapshotsArgs args = {master_password, NULL, NULL, version};
+	return enclave_call(run_restore_snapshot, &args);
+}
+
+int ecall_audit_wallet(const char* master_password, const char* corpus_path, audit_result_t* results, size_t* count) {
+	struct AuditArgs args = {master_password, corpus_path, results, count};
+	return enclave_call(run_audit_wallet, &args);
+}
+
+int ecall_search_items(const char* master_password, const char* query, uint32_t* indexes, item_t* items, size_t* count) {
+	struct SearchArgs args = {NULL, master_password, query, NULL, NULL, indexes, items, count};
+	return enclave_call(run_search_items, &args);
+}
+
+int ecall_list_expiring(const char* master_password, int64_t horizon, expiring_t* items, size_t* count) {
+	struct ExpiringArgs args = {master_password, horizon, items, count};
+	return enclave_call(run_list_expiring, &args);
+}
+
+int ecall_merge_wallets(const char* master_password, const char* path_a, const char* path_b, merge_stats_t* stats) {
+	struct MergeArgs args = {master_password, path_a, path_b, stats};
+	return enclave_call(run_merge_wallets, &args);
+}
+
+int ecall_open_item_store(const char* master_password, size_t budget, struct ItemStore* store) {
+	struct ItemStoreArgs args = {master_password, budget, store};
+	return enclave_call(run_open_item_store, &args);
+}
+
+int ecall_item_store_get(item_store_t* store, uint32_t index, item_t* item) {
+	struct ItemStoreGetArgs args = {store, index, item};
+	return enclave_call(run_item_store_get, &args);
+}
+
+int ecall_close_item_store(item_store_t* store) {
+	return enclave_call(run_close_item_store, store);
+}
+
+int ecall_attach_blob(const char* master_password, int index, blob_source_fn source, void* ctx) {
+	struct BlobArgs args = {master_password, index, source, NULL, ctx};
+	return enclave_call(run_attach_blob, &args);
+}
+
+int ecall_read_blob(const char* master_password, int index, blob_sink_fn sink, void* ctx) {
+	struct BlobArgs args = {master_password, index, NULL, sink, ctx};
+	return enclave_call(run_read_blob, &args);
+}
+
+int ecall_find_credential(const char* path, const char* master_password, const char* title, const char* username,
+	uint32_t* indexes, item_t* items, size_t* count) {
+	struct SearchArgs args = {path, master_password, NULL, title, username, indexes, items, count};
+	return enclave_call(run_find_credential, &args);
+}
+
+int ecall_rotate_credential(const char* path, const char* master_password, const char* title, const char* username,
+	const char* password, size_t* count) {
+	struct RotateArgs args = {path, master_password, title, username, password, count};
+	return enclave_call(run_rotate_credential, &args);
+}
+
+int ecall_open_wallet_cache(const char* path, const char* master_password, int polling, wallet_cache_t* cache) {
+	struct CacheArgs args = {path, master_password, polling, 0, cache, NULL};
+	return enclave_call(run_open_wallet_cache, &args);
+}
+
+int ecall_refresh_wallet_cache(wallet_cache_t* cache, int timeout_ms, size_t* changed) {
+	struct CacheArgs args = {NULL, NULL, 0, timeout_ms, cache, changed};
+	return enclave_call(run_refresh_wallet_cache, &args);
+}
+
+int ecall_tag_query(const wallet_cache_t* cache, const char* query, bitmap_t* matches) {
+	struct TagQueryArgs args = {cache, query, matches};
+	return enclave_call(run_tag_query, &args);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ECALLS_H_
+#define ECALLS_H_
+
+#include <stddef.h>
+
+#include "../wallet/wallet.h"
+#include "../wallet/watch.h"
+#include "../wallet/tags.h"
+#include "../wallet/pager.h"
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+// Untrusted proxies of the wallet functions: each one packs its
+// arguments and enters the enclave through enclave_call, as the
+// proxies generated from an EDL file would. They return the wallet
+// function's RET_SUCCESS or ERR_* code.
+
+int ecall_create_wallet(const char* master_password);
+int ecall_show_wallet(const char* master_password, wallet_t* wallet);
+int ecall_add_item(const char* master_password, const item_t* item);
+int ecall_update_item(const char* master_password, int index, const item_t* item);
+int ecall_remove_item(const char* master_password, int index);
+int ecall_change_master_password(const char* old_password, const char* new_password);
+int ecall_migrate_wallet(const char* path, const char* master_password);
+int ecall_add_items(const char* path, const char* master_password, item_t* items, size_t count,
+	const struct PasswordPolicy* generate);
+int ecall_remove_items(const char* path, const char* master_password, const uint32_t* indexes, size_t count);
+int ecall_list_snapshots(const char* master_password, snapshot_t* snapshots, size_t* count);
+int ecall_restore_snapshot(const char* master_password, uint64_t version);
+int ecall_audit_wallet(const char* master_password, const char* corpus_path, audit_result_t* results, size_t* count);
+int ecall_search_items(const char* master_password, const char* query, uint32_t* indexes, item_t* items, size_t* count);
+int ecall_list_expiring(const char* master_password, int64_t horizon, expiring_t* items, size_t* count);
+int ecall_merge_wallets(const char* master_password, const char* path_a, const char* path_b, merge_stats_t* stats);
+int ecall_open_item_store(const char* master_password, size_t budget, struct ItemStore* store);
+int ecall_item_store_get(item_store_t* store, uint32_t index, item_t* item);
+int ecall_close_item_store(item_store_t* store);
+int ecall_attach_blob(const char* master_password, int index, blob_source_fn source, void* ctx);
+int ecall_read_blob(const char* master_password, int index, blob_sink_fn sink, void* ctx);
+int ecall_find_credential(const char* path, const char* master_password, const char* title, const char* username,
+	uint32_t* indexes, item_t* items, size_t* count);
+int ecall_rotate_credential(const char* path, const char* master_password, const char* title, const char* username,
+	const char* password, size_t* count);
+int ecall_open_wallet_cache(const char* path, const char* master_password, int polling, wallet_cache_t* cache);
+int ecall_refresh_wallet_cache(wallet_cache_t* cache, int timeout_ms, size_t* changed);
+
+// The unlocked copy of a wallet cache stays in the enclave: it is
+// only queried from inside. Returns TAGS_OK or TAGS_ERR_*.
+int ecall_tag_query(const wallet_cache_t* cache, const char* query, bitmap_t* matches);
+
+
+#endif // ECALLS_H_
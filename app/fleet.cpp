@@ -0,0 +1,267 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <stdio.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "fleet.h"
+#include "utils.h"
+#include "bench.h"
+#include "ecalls.h"
+#include "../wallet/wallet.h"
+#include "../wallet/arena.h"
+#include "../wallet/secure.h"
+
+using namespace std;
+
+#define FLEET_PROGRESS_MS 1000	// interval between progress lines
+
+
+/***************************************************
+ * Work-stealing queues
+ ***************************************************/
+// files owned by one worker: the owner pops from the back, thieves
+// steal from the front, so they rarely contend for the same end
+struct FleetDeque {
+	mutex lock;
+	deque<string> paths;
+};
+
+struct Fleet {
+	const fleet_job_t* job;
+	vector<struct FleetDeque*> queues;
+	atomic<size_t> done;
+	size_t total;
+
+	// report and output
+	mutex lock;
+	condition_variable finished;
+	fleet_report_t report;
+};
+
+static int pop_own(struct FleetDeque* queue, string* path, string* next) {
+	lock_guard<mutex> guard(queue->lock);
+	if (queue->paths.empty()) {return 0;}
+	*path = queue->paths.back();
+	queue->paths.pop_back();
+	*next = queue->paths.empty() ? string() : queue->paths.back();
+	return 1;
+}
+
+static int steal(struct Fleet* fleet, size_t self, string* path) {
+	size_t count = fleet->queues.size();
+	for (size_t i = 1; i < count; ++i) {
+		struct FleetDeque* victim = fleet->queues[(self + i) % count];
+		lock_guard<mutex> guard(victim->lock);
+		if (victim->paths.empty()) {continue;}
+		*path = victim->paths.front();
+		victim->paths.pop_front();
+		return 1;
+	}
+	return 0;
+}
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+static int is_wallet_file(const char* name) {
+	const char* extension = strrchr(WALLET_FILE, '.');
+	size_t len = strlen(name), ext_len = strlen(extension);
+	return len > ext_len && strcmp(name + len - ext_len, extension) == 0;
+}
+
+/**
+ * @brief      Lists the wallet files under a directory, in walk order
+ *             so that neighbours end up in the same worker's queue.
+ *
+ */
+static void walk(const string& path, vector<string>& out) {
+	struct stat st;
+	if (lstat(path.c_str(), &st) != 0) {return;}
+	if (S_ISREG(st.st_mode)) {
+		out.push_back(path);
+		return;
+	}
+	if (!S_ISDIR(st.st_mode)) {return;}
+	DIR* dir = opendir(path.c_str());
+	if (dir == NULL) {return;}
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {continue;}
+		string child = path + "/" + entry->d_name;
+		if (entry->d_type == DT_DIR) {walk(child, out);}
+		else if ((entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN) && is_wallet_file(entry->d_name)) {
+			if (entry->d_type == DT_REG || (lstat(child.c_str(), &st) == 0 && S_ISREG(st.st_mode))) {
+				out.push_back(child);
+			}
+		}
+	}
+	closedir(dir);
+}
+
+static int read_list(const char* list, vector<string>& out) {
+	FILE* file = fopen(list, "r");
+	if (file == NULL) {return 1;}
+	char line[4096];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (line[0] != '\0') {out.push_back(line);}
+	}
+	fclose(file);
+	return 0;
+}
+
+/**
+ * @brief      Asks the kernel to read a file ahead, so that its I/O
+ *             overlaps with the work on the current one.
+ *
+ */
+static void prefetch(const string& path) {
+	if (path.empty()) {return;}
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {return;}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+}
+
+static void run_one(struct Fleet* fleet, const string& path, uint32_t* indexes, item_t* items) {
+	const fleet_job_t* job = fleet->job;
+	size_t count = 0;
+	int ret;
+	if (job->operation == FLEET_ROTATE) {
+		ret = ecall_rotate_credential(path.c_str(), job->master_password, job->title, job->username, job->password, &count);
+	}
+	else {
+		ret = ecall_find_credential(path.c_str(), job->master_password, job->title, job->username, indexes, items, &count);
+	}
+
+	lock_guard<mutex> guard(fleet->lock);
+	fleet_report_t* report = &fleet->report;
+	++report->files;
+	if (ret == ERR_WRONG_MASTER_PASSWORD) {++report->locked;}
+	else if (ret != RET_SUCCESS) {++report->failed;}
+	else if (count > 0) {
+		++report->matched;
+		report->items += count;
+	}
+	if (job->quiet) {return;}
+
+	char message[4096 + 256];
+	if (ret != RET_SUCCESS) {
+		snprintf(message, sizeof(message), "%s: %s", path.c_str(),
+			ret == ERR_WRONG_MASTER_PASSWORD ? "other master-password" : "could not be processed");
+		warning_print(message);
+	}
+	else if (job->operation == FLEET_ROTATE && count > 0) {
+		printf("%s: %zu item(s) rotated\n", path.c_str(), count);
+	}
+	else {
+		for (size_t i = 0; i < count; ++i) {
+			printf("%s: #%u -- %s [%s]\n", path.c_str(), indexes[i], items[i].title, items[i].username);
+		}
+	}
+}
+
+static void worker(struct Fleet* fleet, size_t self) {
+	uint32_t* indexes = (uint32_t*)secure_malloc(MAX_ITEMS * sizeof(uint32_t));
+	item_t* items = (item_t*)secure_malloc(MAX_ITEMS * sizeof(item_t));
+	string path, next;
+	size_t steals = 0;
+
+	// no file is queued once the workers run, so a worker that finds
+	// every queue empty is done
+	for (;;) {
+		if (pop_own(fleet->queues[self], &path, &next)) {prefetch(next);}
+		else if (steal(fleet, self, &path)) {++steals;}
+		else {break;}
+		run_one(fleet, path, indexes, items);
+		if (fleet->done.fetch_add(1) + 1 == fleet->total) {
+			lock_guard<mutex> guard(fleet->lock);
+			fleet->finished.notify_all();
+		}
+	}
+
+	secure_zero(items, MAX_ITEMS * sizeof(item_t));
+	secure_free(indexes);
+	secure_free(items);
+	lock_guard<mutex> guard(fleet->lock);
+	fleet->report.steals += steals;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int run_fleet(const char* target, const fleet_job_t* job, fleet_report_t* report) {
+	vector<string> paths;
+	memset(report, 0, sizeof(fleet_report_t));
+	if (target[0] == FLEET_LIST_PREFIX) {
+		if (read_list(target + 1, paths) != 0) {return 1;}
+	}
+	else {
+		walk(target, paths);
+	}
+
+	// deal the files out in contiguous runs, one per worker
+	int threads = job->threads;
+	if (threads <= 0) {threads = (int)thread::hardware_concurrency();}
+	if (threads <= 0) {threads = 1;}
+	struct Fleet fleet;
+	fleet.job = job;
+	fleet.done = 0;
+	fleet.total = paths.size();
+	memset(&fleet.report, 0, sizeof(fleet_report_t));
+	for (int i = 0; i < threads; ++i) {fleet.queues.push_back(new FleetDeque());}
+	for (size_t i = 0; i < paths.size(); ++i) {
+		fleet.queues[i * threads / paths.size()]->paths.push_front(paths[i]);
+	}
+
+	double start = now_ns();
+	vector<thread> workers;
+	for (int i = 0; i < threads; ++i) {workers.push_back(thread(worker, &fleet, (size_t)i));}
+	{
+		unique_lock<mutex> guard(fleet.lock);
+		while (fleet.done.load() < fleet.total) {
+			fleet.finished.wait_for(guard, chrono::milliseconds(FLEET_PROGRESS_MS));
+			if (!job->quiet && fleet.done.load() < fleet.total) {
+				char message[128];
+				snprintf(message, sizeof(message), "%zu/%zu wallet files processed...", fleet.done.load(), fleet.total);
+				info_print(message);
+			}
+		}
+	}
+	for (size_t i = 0; i < workers.size(); ++i) {workers[i].join();}
+	for (size_t i = 0; i < fleet.queues.size(); ++i) {delete fleet.queues[i];}
+
+	*report = fleet.report;
+	report->seconds = (now_ns() - start) / 1e9;
+	return report->failed + report->locked != 0;
+}
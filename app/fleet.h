@@ -0,0 +1,85 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FLEET_H_
+#define FLEET_H_
+
+#include <stddef.h>
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define FLEET_FIND 0		// list the matching items
+#define FLEET_ROTATE 1		// set a new password on the matching items
+
+#define FLEET_LIST_PREFIX '@'	// "@file" names a list of wallet files, one per line
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// operation run on every wallet file
+struct FleetJob {
+	int operation;					// FLEET_*
+	const char* master_password;
+	const char* title;				// shell pattern
+	const char* username;			// shell pattern, NULL for any
+	const char* password;			// FLEET_ROTATE: the new password
+	int threads;					// 0 for one per core
+	int quiet;						// no per-file or progress lines
+};
+typedef struct FleetJob fleet_job_t;
+
+// aggregated outcome
+struct FleetReport {
+	size_t files;			// wallet files processed
+	size_t matched;			// files holding the credential
+	size_t items;			// items found, or rotated
+	size_t locked;			// files with another master-password
+	size_t failed;			// files that could not be read or saved
+	size_t steals;			// files taken from another worker's queue
+	double seconds;
+};
+typedef struct FleetReport fleet_report_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Runs a query or an update on many wallet files. Every
+ *             worker owns a deque of files and takes from its back;
+ *             idle workers steal from the front of the others', so
+ *             a slow directory does not hold the whole run. A worker
+ *             asks the kernel to read its next file ahead while it
+ *             decodes the current one. Matches and progress stream
+ *             out as they come.
+ *
+ * @param[in]  target    A wallet file, a directory walked for *.seal
+ *                       files, or '@' followed by a list of files
+ * @param[in]  job       The operation
+ * @param[out] report    The aggregated outcome
+ *
+ * @return     0 if every file was processed, 1 otherwise.
+ */
+int run_fleet(const char* target, const fleet_job_t* job, fleet_report_t* report);
+
+
+#endif // FLEET_H_
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "monitor.h"
+#include "wheel.h"
+#include "utils.h"
+#include "ecalls.h"
+#include "../wallet/wallet.h"
+#include "../wallet/arena.h"
+#include "../wallet/expiry.h"
+#include "../wallet/watch.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_interrupt(int signum) {
+	(void)signum;
+	interrupted = 1;
+}
+
+// one timer per indexed item
+struct MonitorContext {
+	const expiring_t* items;
+	int64_t lead;
+};
+
+static void report_expiry(wheel_timer_t* timer, void* ctx) {
+	const struct MonitorContext* monitor = (const struct MonitorContext*)ctx;
+	const expiring_t* item = &monitor->items[timer->id];
+	char date[32], message[MAX_ITEM_SIZE + 96];
+	time_t expires = (time_t)item->expires;
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&expires));
+	snprintf(message, sizeof(message), "#%u -- %s %s on %s.", item->index, item->title,
+		item->expires <= (int64_t)time(NULL) ? "expired" : "expires", date);
+	warning_print(message);
+}
+
+/**
+ * @brief      Sets a timer for every expiring item, 'lead' ahead. Past
+ *             deadlines fire at once, unless the item was reported
+ *             already: it has not changed since the last schedule.
+ *
+ */
+static size_t schedule(const wallet_t* wallet, int64_t since, const struct MonitorContext* ctx,
+	expiring_t* items, wheel_timer_t* timers, timer_wheel_t* wheel) {
+	int64_t now = (int64_t)time(NULL);
+	size_t count = expiry_index_until(&wallet->expiry, INT64_MAX), scheduled = 0;
+	wheel_init(wheel, now);
+	for (size_t i = 0; i < count; ++i) {
+		const expiry_entry_t* entry = &wallet->expiry.entries[i];
+		const item_t* item = &wallet->items[entry->item];
+		if (entry->expires - ctx->lead <= now && item->modified < since) {continue;}
+		items[scheduled].index = entry->item;
+		items[scheduled].expires = entry->expires;
+		memcpy(items[scheduled].title, item->title, MAX_ITEM_SIZE);
+		timers[scheduled].deadline = entry->expires - ctx->lead;
+		timers[scheduled].id = (uint32_t)scheduled;
+		wheel_add(wheel, &timers[scheduled]);
+		++scheduled;
+	}
+	return scheduled;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int monitor_expiry(const char* master_password, int lead_days) {
+	wallet_cache_t cache;
+	int ret = ecall_open_wallet_cache(WALLET_FILE, master_password, 0, &cache);
+	if (ret != RET_SUCCESS) {
+		is_error(ret);
+		return 1;
+	}
+	expiring_t* items = (expiring_t*)secure_malloc(MAX_ITEMS * sizeof(expiring_t));
+	wheel_timer_t* timers = (wheel_timer_t*)secure_malloc(MAX_ITEMS * sizeof(wheel_timer_t));
+	timer_wheel_t* wheel = (timer_wheel_t*)secure_malloc(sizeof(timer_wheel_t));
+
+	// schedule every expiry; past ones fire at once
+	struct MonitorContext ctx = {items, (int64_t)lead_days * SECONDS_PER_DAY};
+	int64_t scheduled_at = (int64_t)time(NULL);
+	size_t count = schedule(cache.wallet, INT64_MIN, &ctx, items, timers, wheel);
+	char message[96];
+	snprintf(message, sizeof(message), "Monitoring %zu expiring items (%s).", count,
+		cache.watch.mode == WATCH_INOTIFY ? "inotify" : "polling");
+	info_print(message);
+
+	// every tick waits on the wallet file rather than sleeping, and
+	// reschedules when another process saved it
+	signal(SIGINT, on_interrupt);
+	signal(SIGTERM, on_interrupt);
+	while (!interrupted) {
+		wheel_advance(wheel, (int64_t)time(NULL), report_expiry, &ctx);
+		uint64_t generation = cache.generation;
+		size_t changed = 0;
+		ret = ecall_refresh_wallet_cache(&cache, 1000, &changed);
+		if (ret == ERR_WRONG_MASTER_PASSWORD) {
+			warning_print("The master-password changed: monitoring stopped.");
+			break;
+		}
+		if (ret != RET_SUCCESS || cache.generation == generation) {continue;}
+		wheel_advance(wheel, (int64_t)time(NULL), report_expiry, &ctx);
+		count = schedule(cache.wallet, scheduled_at, &ctx, items, timers, wheel);
+		scheduled_at = (int64_t)time(NULL);
+		snprintf(message, sizeof(message), "Wallet changed (%zu items): monitoring %zu expiring items.", changed, count);
+		info_print(message);
+	}
+	wallet_cache_free(&cache);
+	secure_free(items);
+	secure_free(timers);
+	secure_free(wheel);
+	return ret == ERR_WRONG_MASTER_PASSWORD;
+}
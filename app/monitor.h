@@ -0,0 +1,42 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MONITOR_H_
+#define MONITOR_H_
+
+
+/**
+ * @brief      Reports item expirations as they happen, until
+ *             interrupted. The expiry index is read once and fed to
+ *             a timer wheel; afterwards every one-second tick only
+ *             touches the timers that are due. The wallet is kept in
+ *             a cache that follows the file: when another process
+ *             saves it, the changed items are reloaded and the timers
+ *             rescheduled.
+ *
+ * @param[in]  master_password    The master-password
+ * @param[in]  lead_days          How many days before its expiry an
+ *                                item is reported
+ *
+ * @return     0 if interrupted, 1 if the wallet could not be read or
+ *             its master-password changed.
+ */
+int monitor_expiry(const char* master_password, int lead_days);
+
+
+#endif // MONITOR_H_
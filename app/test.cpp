@@ -18,10 +18,237 @@
  */
 #include <cstring>
 #include <cstdlib>
+#include <ctype.h>
+#include <fcntl.h>
+#include <exception>
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "test.h"
 #include "utils.h"
 #include "../wallet/wallet.h"
+#include "../wallet/arena.h"
+#include "../wallet/secure.h"
+#include "../wallet/compress.h"
+#include "../wallet/format.h"
+#include "../wallet/crc32c.h"
+#include "../wallet/crypto.h"
+#include "../wallet/audit.h"
+#include "../wallet/bitmap.h"
+#include "../wallet/tags.h"
+#include "../wallet/enclave.h"
+#include "../wallet/pager.h"
+#include "../wallet/blob.h"
+#include "../wallet/accesslog.h"
+#include "../wallet/watch.h"
+#include "../wallet/policy.h"
+#include "../wallet/history.h"
+#include "../wallet/generator.h"
+#include "../include/libwallet.h"
+#include "bench.h"
+#include "wheel.h"
+#include "ecalls.h"
+#include "fleet.h"
+
+
+/**
+ * @brief      Records the order in which timers fire.
+ *
+ */
+struct FiredTimers {
+    int64_t deadlines[16];
+    size_t count;
+};
+
+static void record_timer(wheel_timer_t* timer, void* ctx) {
+    struct FiredTimers* fired = (struct FiredTimers*)ctx;
+    if (fired->count < 16) {fired->deadlines[fired->count++] = timer->deadline;}
+}
+
+
+/**
+ * @brief      Records the status an asynchronous library call completed
+ *             with.
+ *
+ */
+static void record_status(void* ctx, int status) {
+    *(int*)ctx = status;
+}
+
+#ifdef __cpp_impl_coroutine
+/**
+ * @brief      A coroutine that runs to completion on its own.
+ *
+ */
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() {return DetachedTask();}
+        std::suspend_never initial_suspend() noexcept {return {};}
+        std::suspend_never final_suspend() noexcept {return {};}
+        void return_void() {}
+        void unhandled_exception() {std::terminate();}
+    };
+};
+
+/**
+ * @brief      Unlocks a wallet and reads its first item, awaiting the
+ *             library calls.
+ *
+ */
+static DetachedTask fetch_first_item(lw_executor_t* executor, lw_wallet_t* wallet, const char* master_password,
+    lw_item_t* item, int* status) {
+    *status = co_await lw_await_unlock(executor, wallet, master_password);
+    if (*status == LW_OK) {*status = co_await lw_await_get(executor, wallet, 0, item);}
+}
+#endif
+
+
+/**
+ * @brief      Copies a file, e.g. a wallet into a replica.
+ *
+ */
+static int copy_file(const char* from, const char* to) {
+    char buf[4096];
+    size_t n;
+    FILE* in = fopen(from, "r");
+    if (in == NULL) {return 1;}
+    FILE* out = fopen(to, "w");
+    if (out == NULL) {
+        fclose(in);
+        return 1;
+    }
+    int ret = 0;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) {ret = 1;}
+    }
+    fclose(in);
+    if (fclose(out) != 0) {ret = 1;}
+    return ret;
+}
+
+/**
+ * @brief      Checks that two files hold the same bytes.
+ *
+ */
+static int same_file(const char* a, const char* b) {
+    FILE* in_a = fopen(a, "r");
+    FILE* in_b = fopen(b, "r");
+    int same = in_a != NULL && in_b != NULL;
+    while (same) {
+        int c = fgetc(in_a);
+        same = c == fgetc(in_b);
+        if (c == EOF) {break;}
+    }
+    if (in_a != NULL) {fclose(in_a);}
+    if (in_b != NULL) {fclose(in_b);}
+    return same;
+}
+
+/**
+ * @brief      Swaps the wallet with a replica, so that the API, which
+ *             works on WALLET_FILE, acts on the replica.
+ *
+ */
+static int swap_files(const char* a, const char* b) {
+    const char* tmp = "swap.seal";
+    return rename(a, tmp) != 0 || rename(b, a) != 0 || rename(tmp, b) != 0;
+}
+
+/**
+ * @brief      Checks that two wallets hold the same items, in any
+ *             order.
+ *
+ */
+static int same_items(const wallet_t* a, const wallet_t* b) {
+    if (a->size != b->size) {return 0;}
+    for (size_t i = 0; i < a->size; ++i) {
+        size_t j = 0;
+        while (j < b->size && memcmp(&a->items[i], &b->items[j], sizeof(item_t)) != 0) {++j;}
+        if (j == b->size) {return 0;}
+    }
+    return 1;
+}
+
+static int has_title(const wallet_t* wallet, const char* title) {
+    for (size_t i = 0; i < wallet->size; ++i) {
+        if (strcmp(wallet->items[i].title, title) == 0) {return 1;}
+    }
+    return 0;
+}
+
+
+/**
+ * @brief      Produces, then checks, a blob of a given length without
+ *             holding it in memory. Sources return odd-sized pieces.
+ *
+ */
+struct PatternStream {
+    uint64_t length;
+    uint64_t position;
+    int mismatch;
+};
+
+static uint8_t pattern_byte(uint64_t position) {
+    return (uint8_t)(position * 131 + (position >> 11));
+}
+
+static long pattern_source(void* ctx, uint8_t* buf, size_t len) {
+    struct PatternStream* stream = (struct PatternStream*)ctx;
+    if (len > 1000) {len = 1000;}
+    if (len > stream->length - stream->position) {len = (size_t)(stream->length - stream->position);}
+    for (size_t i = 0; i < len; ++i) {buf[i] = pattern_byte(stream->position++);}
+    return (long)len;
+}
+
+static int pattern_sink(void* ctx, const uint8_t* data, size_t len) {
+    struct PatternStream* stream = (struct PatternStream*)ctx;
+    for (size_t i = 0; i < len; ++i) {
+        if (data[i] != pattern_byte(stream->position++)) {stream->mismatch = 1;}
+    }
+    return 0;
+}
+
+
+/**
+ * @brief      Times a constant-time comparison against two candidates.
+ *             Rounds alternate between them so that both see the same
+ *             clock and load, and the fastest round of each is kept
+ *             to filter out scheduling noise.
+ *
+ */
+static void time_compare(const unsigned char* a, const unsigned char* b1, const unsigned char* b2, size_t len,
+    double* t1, double* t2) {
+    const int rounds = 50, iterations = 2000;
+    volatile int sink = 0;
+    for (int r = 0; r < 2 * rounds; ++r) {
+        const unsigned char* b = (r & 1) ? b2 : b1;
+        double* best = (r & 1) ? t2 : t1;
+        double start = now_ns();
+        for (int i = 0; i < iterations; ++i) {sink = sink + secure_memcmp(a, b, len);}
+        double elapsed = (now_ns() - start) / iterations;
+        if (r < 2 || elapsed < *best) {*best = elapsed;}
+    }
+}
+
+
+// wallets of other sizes than the default one
+typedef WalletPolicy<4, 16> tiny_policy_t;
+typedef WalletPolicy<100000, 64, 12, Pbkdf2Kdf<1000>> service_policy_t;
+static_assert(BasicWallet<tiny_policy_t>::is_inline && sizeof(BasicWallet<tiny_policy_t>) < 512,
+    "a tiny wallet is a small inline object");
+static_assert(!BasicWallet<service_policy_t>::is_inline && BasicWallet<service_policy_t>::verifier_size == SHA256_SIZE,
+    "a service wallet is paged and keeps a stretched master-password");
+static_assert(std::is_same<decltype(wallet_t::items), InlineStorage<item_t, MAX_ITEMS>>::value &&
+    sizeof(wallet_t::items) == MAX_ITEMS * sizeof(item_t), "the wallet file lays its items out by the default policy");
+static_assert(!tiny_policy_t::password_in_range(7) && tiny_policy_t::password_in_range(15) &&
+    !tiny_policy_t::password_in_range(16), "the password policy is checked at compile time");
+static_assert(!service_policy_t::password_in_range(11) && service_policy_t::password_in_range(63),
+    "a policy sets its own shortest master-password");
 
 
 /**
@@ -42,6 +269,9 @@ int test() {
     
     warning_print("Only 'happy path' is tested.");
     
+    // a scratch install secret, so the run never touches the user's
+    const char* seal_secret = "wallet.seal.key";
+    setenv(SEAL_SECRET_ENV, seal_secret, 1);
 
     ////////////////////////////////////////////////
     // test create wallet
@@ -59,7 +289,7 @@ int test() {
     // test add items
     ////////////////////////////////////////////////
     // happy path
-    item_t* new_item = (item_t*)malloc(sizeof(item_t));
+    item_t* new_item = (item_t*)secure_malloc(sizeof(item_t));
     strcpy(new_item->title, title); 
     strcpy(new_item->username, username); 
     strcpy(new_item->password, password);
@@ -71,7 +301,7 @@ int test() {
         }
         info_print("[TEST] Item successfully added to the wallet.");
     }
-    free(new_item);
+    secure_free(new_item);
     
 
     ////////////////////////////////////////////////
@@ -104,7 +334,7 @@ int test() {
     // test show wallet
     ////////////////////////////////////////////////
     // happy path
-    wallet_t* wallet = (wallet_t*)malloc(sizeof(wallet_t));
+    wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
     ret_status = show_wallet(new_master_password, wallet);
     if (ret_status != RET_SUCCESS) {
         error_print("[TEST] Fail to retrieve wallet.");
@@ -112,7 +342,1570 @@ int test() {
     }
     info_print("[TEST] Wallet successfully retrieved.");
     print_wallet(wallet);
-    free(wallet);
+
+
+    ////////////////////////////////////////////////
+    // test wallet compression
+    ////////////////////////////////////////////////
+    // the persisted image is several times smaller than the wallet
+    FILE* file = fopen(WALLET_FILE, "r");
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fclose(file);
+    if (file_size <= 0 || (size_t)file_size > sizeof(wallet_t) / 4) {
+        error_print("[TEST] Wallet image was not compressed.");
+        return 1;
+    }
+    info_print("[TEST] Wallet image successfully compressed.");
+
+    // round trip of incompressible data
+    size_t bound = lz_compress_bound(sizeof(wallet_t));
+    unsigned char* packed = (unsigned char*)secure_malloc(bound);
+    unsigned char* noise = (unsigned char*)secure_malloc(sizeof(wallet_t));
+    unsigned int seed = 1;
+    for (size_t i = 0; i < sizeof(wallet_t); ++i) {noise[i] = (unsigned char)(rand_r(&seed) >> 7);}
+    size_t packed_size = lz_compress(noise, sizeof(wallet_t), packed, bound);
+    if (packed_size == 0 ||
+        lz_decompress(packed, packed_size, wallet, sizeof(wallet_t)) != 0 ||
+        memcmp(noise, wallet, sizeof(wallet_t)) != 0 ||
+        lz_decompress(packed, packed_size - 1, wallet, sizeof(wallet_t)) == 0
+    ) {
+        error_print("[TEST] Fail to round-trip compressed data.");
+        return 1;
+    }
+    secure_free(noise);
+    secure_free(packed);
+    secure_free(wallet);
+    info_print("[TEST] Compressed data successfully round-tripped.");
+
+
+    ////////////////////////////////////////////////
+    // test sealing keys
+    ////////////////////////////////////////////////
+    // keyed by a private install secret, one key per purpose
+    uint8_t seal_a[SEAL_KEY_SIZE], seal_b[SEAL_KEY_SIZE], seal_c[SEAL_KEY_SIZE];
+    struct stat secret_stat;
+    if (derive_seal_key("test-a", seal_a) != 0 || derive_seal_key("test-a", seal_b) != 0 ||
+        derive_seal_key("test-b", seal_c) != 0 ||
+        memcmp(seal_a, seal_b, SEAL_KEY_SIZE) != 0 || memcmp(seal_a, seal_c, SEAL_KEY_SIZE) == 0 ||
+        stat(seal_secret, &secret_stat) != 0 || (secret_stat.st_mode & 0777) != 0600 ||
+        secret_stat.st_size != SEAL_KEY_SIZE
+    ) {
+        error_print("[TEST] Fail to derive sealing keys from the install secret.");
+        return 1;
+    }
+    info_print("[TEST] Sealing keys successfully derived.");
+
+
+    ////////////////////////////////////////////////
+    // test file header
+    ////////////////////////////////////////////////
+    // checksum
+    if (crc32c(0, "123456789", 9) != 0xe3069283) {
+        error_print("[TEST] Wrong CRC32C.");
+        return 1;
+    }
+    info_print("[TEST] CRC32C successfully checked.");
+
+    // valid, corrupt, foreign and legacy files
+    const char* test_file = "test.seal";
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    show_wallet(new_master_password, wallet);
+    file = fopen(test_file, "w+");
+    int valid = write_wallet_file(file, wallet) == FORMAT_OK && fflush(file) == 0 &&
+        read_wallet_file(file, wallet) == FORMAT_OK;
+    fseek(file, offsetof(file_header_t, item_count), SEEK_SET);
+    fputc(MAX_ITEMS, file);
+    fflush(file);
+    int corrupt = read_wallet_file(file, wallet) == FORMAT_ERR_CHECKSUM;
+    fclose(file);
+    file = fopen(test_file, "w+");
+    fputs("definitely not a wallet", file);
+    fflush(file);
+    int foreign = read_wallet_file(file, wallet) == FORMAT_ERR_MAGIC;
+    fclose(file);
+    legacy_wallet_t* old_wallet = (legacy_wallet_t*)secure_malloc(sizeof(legacy_wallet_t));
+    strcpy(old_wallet->items[0][0], title);
+    strcpy(old_wallet->master_password, master_password);
+    old_wallet->size = 1;
+    file = fopen(test_file, "w+");
+    fwrite(old_wallet, sizeof(legacy_wallet_t), 1, file);
+    fflush(file);
+    int legacy = read_wallet_file(file, wallet) == FORMAT_ERR_LEGACY &&
+        read_legacy_wallet_file(file, wallet) == FORMAT_OK && wallet->size == 1 &&
+        strcmp(wallet->items[0].title, title) == 0 && strcmp(wallet->master_password, master_password) == 0;
+    fclose(file);
+    secure_free(old_wallet);
+    if (!valid || !corrupt || !foreign || !legacy) {
+        error_print("[TEST] Wallet file header not properly validated.");
+        return 1;
+    }
+
+    // a legacy image is only read by an explicit migration, which
+    // seals it in the current format
+    if (migrate_wallet(test_file, new_master_password) != ERR_WRONG_MASTER_PASSWORD ||
+        migrate_wallet(test_file, master_password) != RET_SUCCESS ||
+        migrate_wallet(test_file, master_password) != ERR_CANNOT_LOAD_WALLET
+    ) {
+        error_print("[TEST] Fail to migrate a legacy wallet.");
+        return 1;
+    }
+    file = fopen(test_file, "r");
+    ret_status = read_wallet_file(file, wallet);
+    fclose(file);
+    remove(test_file);
+    remove("test.seal" WALLET_LOCK_SUFFIX);
+    remove("test.seal" WALLET_HISTORY_SUFFIX);
+    if (ret_status != FORMAT_OK || wallet->size != 1 || wallet->version != 1 || wallet->items[0].id == 0 ||
+        strcmp(wallet->items[0].title, title) != 0
+    ) {
+        error_print("[TEST] Migrated wallet not sealed.");
+        return 1;
+    }
+    secure_free(wallet);
+    info_print("[TEST] Wallet file header successfully validated.");
+
+
+    ////////////////////////////////////////////////
+    // test verification and salvage
+    ////////////////////////////////////////////////
+    // a tampered record is detected and the others are salvaged
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    strcpy(wallet->master_password, master_password);
+    for (int i = 0; i < 3; ++i) {
+        strcpy(wallet->items[i].title, title);
+        wallet->items[i].title[0] = 'A' + i;
+    }
+    wallet->size = 3;
+    file = fopen(test_file, "w+");
+    write_wallet_file(file, wallet);
+    fflush(file);
+    file_header_t header;
+    read_header(file, &header);
+    fseek(file, (long)find_section(&header, SECTION_MACS)->offset + 2 * MAC_TAG_SIZE, SEEK_SET);
+    fputc(0, file);
+    fflush(file);
+    verify_report_t report;
+    ret_status = verify_wallet_file(file, wallet, &report);
+    fclose(file);
+    remove(test_file);
+    if (ret_status == FORMAT_OK || report.items != 3 || report.intact != 2 || !report.meta_intact ||
+        wallet->size != 2 || wallet->items[0].title[0] != 'A' || wallet->items[1].title[0] != 'C'
+    ) {
+        error_print("[TEST] Tampered record not detected.");
+        return 1;
+    }
+
+    // stripping the integrity sections, then replacing the
+    // master-password, does not get past authentication
+    file = fopen(test_file, "w+");
+    write_wallet_file(file, wallet);
+    fflush(file);
+    read_header(file, &header);
+    for (uint32_t i = 0; i < header.section_count; ++i) {
+        if (header.sections[i].type == SECTION_MACS || header.sections[i].type == SECTION_SYNC) {
+            header.sections[i].type += 100;
+        }
+    }
+    header.crc = crc32c(0, &header, offsetof(file_header_t, crc));
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    fflush(file);
+    ret_status = read_wallet_file(file, wallet);
+    fclose(file);
+    remove(test_file);
+    if (ret_status != FORMAT_ERR_MAC) {
+        error_print("[TEST] Wallet without integrity sections accepted.");
+        return 1;
+    }
+
+    // a forged number of saves, with its checksums fixed up, is caught
+    // by the meta tag
+    wallet->version = 5;
+    file = fopen(test_file, "w+");
+    write_wallet_file(file, wallet);
+    fflush(file);
+    read_header(file, &header);
+    uint64_t forged_version = 4;
+    for (uint32_t i = 0; i < header.section_count; ++i) {
+        if (header.sections[i].type == SECTION_VERSION) {
+            fseek(file, (long)header.sections[i].offset, SEEK_SET);
+            fwrite(&forged_version, sizeof(forged_version), 1, file);
+            header.sections[i].crc = crc32c(0, &forged_version, sizeof(forged_version));
+        }
+    }
+    header.crc = crc32c(0, &header, offsetof(file_header_t, crc));
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    fflush(file);
+    uint64_t generation = 0;
+    int generation_status = read_generation(file, &generation);
+    ret_status = read_wallet_file(file, wallet);
+    fclose(file);
+    remove(test_file);
+    if (ret_status != FORMAT_ERR_MAC || generation_status != FORMAT_ERR_MAC || generation != 0) {
+        error_print("[TEST] Forged wallet version accepted.");
+        return 1;
+    }
+    secure_free(wallet);
+    info_print("[TEST] Tampered record successfully detected and salvaged.");
+
+
+    ////////////////////////////////////////////////
+    // test secure arena
+    ////////////////////////////////////////////////
+    // freed blocks are zeroed and reused
+    arena_stats_t stats_before, stats_after;
+    arena_get_stats(&stats_before);
+    char* secret = (char*)secure_malloc(MAX_ITEM_SIZE);
+    strcpy(secret, password);
+    secure_free(secret);
+    char* reused = (char*)secure_malloc(MAX_ITEM_SIZE);
+    arena_get_stats(&stats_after);
+    if (reused != secret || reused[0] != '\0' || stats_after.reuses <= stats_before.reuses) {
+        error_print("[TEST] Arena block was not wiped and reused.");
+        return 1;
+    }
+    secure_free(reused);
+
+    // a second free aborts rather than pushing the block twice
+    pid_t child = fork();
+    if (child == 0) {
+        secure_free(reused);
+        _exit(0);
+    }
+    int child_status = 0;
+    if (child < 0 || waitpid(child, &child_status, 0) != child || !WIFSIGNALED(child_status) ||
+        WTERMSIG(child_status) != SIGABRT
+    ) {
+        error_print("[TEST] Arena block freed twice.");
+        return 1;
+    }
+    info_print("[TEST] Arena block successfully wiped and reused.");
+
+
+    ////////////////////////////////////////////////
+    // test constant-time comparison
+    ////////////////////////////////////////////////
+    // results
+    char stored[MAX_ITEM_SIZE] = {0}, candidate[MAX_ITEM_SIZE] = {0};
+    strcpy(stored, master_password);
+    strcpy(candidate, master_password);
+    memset(candidate + strlen(candidate) + 1, 'x', 10); // stale padding is ignored
+    if (secure_strcmp(stored, candidate, MAX_ITEM_SIZE) != 0 ||
+        secure_strcmp(stored, new_master_password, MAX_ITEM_SIZE) == 0 ||
+        secure_memcmp(title, title, MAX_ITEM_SIZE) != 0 ||
+        secure_memcmp(title, username, MAX_ITEM_SIZE) == 0
+    ) {
+        error_print("[TEST] Constant-time comparison returned a wrong result.");
+        return 1;
+    }
+    info_print("[TEST] Constant-time comparison successfully checked.");
+
+    // timing does not depend on the mismatch position
+    static unsigned char buf_a[4096], buf_b[4096], buf_c[4096];
+    memset(buf_a, 0x5a, sizeof(buf_a));
+    memcpy(buf_b, buf_a, sizeof(buf_b));
+    memcpy(buf_c, buf_a, sizeof(buf_c));
+    buf_b[0] ^= 1;
+    buf_c[sizeof(buf_c)-1] ^= 1;
+    double early, late;
+    time_compare(buf_a, buf_b, buf_c, sizeof(buf_a), &early, &late);
+    double spread = (early > late ? early - late : late - early) / (early > late ? early : late);
+    if (spread > 0.25) {
+        error_print("[TEST] Comparison time depends on the mismatch position.");
+        return 1;
+    }
+    info_print("[TEST] Comparison time successfully checked.");
+
+
+    ////////////////////////////////////////////////
+    // test snapshots
+    ////////////////////////////////////////////////
+    // one reverse delta per save, newest first
+    snapshot_t snapshots[HISTORY_DEPTH];
+    size_t count = 0;
+    ret_status = list_snapshots(new_master_password, snapshots, &count);
+    if (ret_status != RET_SUCCESS || count != 4 || snapshots[0].version != 4 || snapshots[0].size != 2) {
+        error_print("[TEST] Fail to list snapshots.");
+        return 1;
+    }
+    info_print("[TEST] Snapshots successfully listed.");
+
+    // deltas only hold the edits
+    file = fopen(WALLET_HISTORY_FILE, "r");
+    fseek(file, 0, SEEK_END);
+    long history_size = ftell(file);
+    fclose(file);
+    if (history_size <= 0 || (size_t)history_size > 4 * sizeof(item_t)) {
+        error_print("[TEST] History does not store deltas.");
+        return 1;
+    }
+    info_print("[TEST] History successfully stored as deltas.");
+
+    // restore the version before the removal
+    ret_status = restore_snapshot(new_master_password, 4);
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    if (ret_status != RET_SUCCESS || show_wallet(new_master_password, wallet) != RET_SUCCESS ||
+        wallet->size != 2 || wallet->version != 6
+    ) {
+        error_print("[TEST] Fail to restore snapshot.");
+        return 1;
+    }
+    secure_free(wallet);
+    if (restore_snapshot(new_master_password, 42) != ERR_SNAPSHOT_DOES_NOT_EXIST) {
+        error_print("[TEST] Restored a snapshot that does not exist.");
+        return 1;
+    }
+
+    // what a crash left of a record is cut off by the next save
+    file = fopen(WALLET_HISTORY_FILE, "a");
+    fwrite("torn", 4, 1, file);
+    fclose(file);
+    ret_status = change_master_password(new_master_password, new_master_password);
+    ret_status |= list_snapshots(new_master_password, snapshots, &count);
+    if (ret_status != RET_SUCCESS || count != 6 || snapshots[0].version != 6) {
+        error_print("[TEST] Torn history record not dropped.");
+        return 1;
+    }
+
+    // records are authenticated: an edited one is not restored
+    history_record_t record;
+    long newest = 0;
+    file = fopen(WALLET_HISTORY_FILE, "r+");
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        newest = ftell(file) - (long)sizeof(record);
+        fseek(file, (long)record.length, SEEK_CUR);
+    }
+    fseek(file, newest + (long)offsetof(history_record_t, timestamp), SEEK_SET);
+    fputc((record.timestamp & 0xff) ^ 1, file);
+    fclose(file);
+    if (restore_snapshot(new_master_password, 6) != ERR_SNAPSHOT_DOES_NOT_EXIST) {
+        error_print("[TEST] Restored an edited snapshot.");
+        return 1;
+    }
+    file = fopen(WALLET_HISTORY_FILE, "r+");
+    fseek(file, newest + (long)offsetof(history_record_t, timestamp), SEEK_SET);
+    fputc(record.timestamp & 0xff, file);
+    fclose(file);
+    info_print("[TEST] Snapshot successfully restored.");
+
+
+    ////////////////////////////////////////////////
+    // test password audit
+    ////////////////////////////////////////////////
+    // multi-buffer SHA-1 matches the one-shot digest
+    const uint8_t* lanes[SHA1_LANES] = {(const uint8_t*)"", (const uint8_t*)"abc", (const uint8_t*)password, (const uint8_t*)title};
+    size_t lane_lens[SHA1_LANES] = {0, 3, strlen(password), strlen(title)};
+    uint8_t lane_digests[SHA1_LANES][SHA1_SIZE], digest[SHA1_SIZE];
+    sha1_x4(lanes, lane_lens, lane_digests);
+    for (int i = 0; i < SHA1_LANES; ++i) {
+        sha1(lanes[i], lane_lens[i], digest);
+        if (memcmp(digest, lane_digests[i], SHA1_SIZE) != 0) {
+            error_print("[TEST] Multi-buffer SHA-1 returned a wrong digest.");
+            return 1;
+        }
+    }
+    info_print("[TEST] Multi-buffer SHA-1 successfully checked.");
+
+    // both items share a breached password ("test1234")
+    const char* corpus_file = "test.corpus";
+    file = fopen(corpus_file, "w");
+    fputs("5BAA61E4C9B93F3F0682250B6CF8331B7EE68FD8:3861493\n", file);
+    fputs("9BC34549D565D9505B287DE0CD20AC77BE1D3F2C:12051\n", file);
+    fputs("F7C3BC1D808E04732ADF679965CCC34CA7AE3441:2254650\n", file);
+    fclose(file);
+    audit_result_t results[MAX_ITEMS];
+    ret_status = audit_wallet(new_master_password, corpus_file, results, &count);
+    if (ret_status != RET_SUCCESS || count != 2 ||
+        !results[0].breached || !results[1].breached ||
+        results[0].reused_with != 1 || results[1].reused_with != 0
+    ) {
+        error_print("[TEST] Fail to audit wallet.");
+        return 1;
+    }
+    if (audit_wallet(new_master_password, "does-not-exist.corpus", results, &count) != ERR_CANNOT_LOAD_CORPUS) {
+        error_print("[TEST] Audited against a missing corpus.");
+        return 1;
+    }
+    remove(corpus_file);
+    remove("test.corpus" BLOOM_SUFFIX);
+    info_print("[TEST] Wallet successfully audited.");
+
+
+    ////////////////////////////////////////////////
+    // test tags
+    ////////////////////////////////////////////////
+    // containers switch form with their cardinality
+    bitmap_t bitmap;
+    bitmap_clear(&bitmap);
+    for (uint32_t i = 0; i < MAX_ITEMS; i += 2) {bitmap_add(&bitmap, i);}
+    bitmap_delete(&bitmap, 10);
+    if (bitmap.containers[0].kind != CONTAINER_BITMAP || bitmap_cardinality(&bitmap) != MAX_ITEMS/2 - 1 ||
+        !bitmap_contains(&bitmap, 8) || !bitmap_contains(&bitmap, 11) || bitmap_contains(&bitmap, 12)
+    ) {
+        error_print("[TEST] Bitmap returned wrong values.");
+        return 1;
+    }
+    for (uint32_t i = 11; i < MAX_ITEMS; ++i) {bitmap_remove(&bitmap, i);}
+    if (bitmap.containers[0].kind != CONTAINER_ARRAY || bitmap_cardinality(&bitmap) != 5) {
+        error_print("[TEST] Bitmap did not switch back to an array.");
+        return 1;
+    }
+    info_print("[TEST] Bitmap successfully checked.");
+
+    // items 2, 3 and 4 carry tags
+    const char* item_tags[] = {"prod,db", "prod, db, legacy", "staging,db"};
+    new_item = (item_t*)secure_malloc(sizeof(item_t));
+    for (int i = 0; i < 3; ++i) {
+        sprintf(new_item->title, "tagged %d", i);
+        strcpy(new_item->tags, item_tags[i]);
+        if (add_item(new_master_password, new_item, sizeof(item_t)) != RET_SUCCESS) {
+            error_print("[TEST] Fail to add tagged item.");
+            return 1;
+        }
+    }
+    secure_free(new_item);
+    uint32_t indexes[MAX_ITEMS];
+    const char* queries[] = {"prod AND db AND NOT legacy", "prod OR staging", "NOT db", "db AND NOT (prod OR staging)"};
+    const size_t expected_counts[] = {1, 3, 2, 0};
+    for (int i = 0; i < 4; ++i) {
+        if (search_items(new_master_password, queries[i], indexes, NULL, &count) != RET_SUCCESS || count != expected_counts[i]) {
+            error_print("[TEST] Tag query returned wrong items.");
+            return 1;
+        }
+    }
+    if (search_items(new_master_password, "prod AND", indexes, NULL, &count) != ERR_INVALID_QUERY) {
+        error_print("[TEST] Malformed query accepted.");
+        return 1;
+    }
+    info_print("[TEST] Items successfully searched by tags.");
+
+    // the index follows removals
+    item_t found[MAX_ITEMS];
+    if (remove_item(new_master_password, 0) != RET_SUCCESS ||
+        search_items(new_master_password, "legacy", indexes, found, &count) != RET_SUCCESS ||
+        count != 1 || indexes[0] != 2 || strcmp(found[0].title, "tagged 1") != 0
+    ) {
+        error_print("[TEST] Tag index out of date after removal.");
+        return 1;
+    }
+    info_print("[TEST] Tag index successfully updated.");
+
+    // an index spliced in without the sealing key is rebuilt, not trusted
+    const char* spliced_file = "spliced.seal";
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    show_wallet(new_master_password, wallet);
+    tag_index_remove(&wallet->tags, 2);
+    file = fopen(spliced_file, "w+");
+    write_wallet_file(file, wallet);
+    fflush(file);
+    read_header(file, &header);
+    section_t forged;
+    memset(&forged, 0, sizeof(forged));
+    for (uint32_t i = 0; i < header.section_count; ++i) {
+        if (header.sections[i].type == SECTION_TAGS) {forged = header.sections[i];}
+    }
+    uint8_t* forged_payload = (uint8_t*)secure_malloc(forged.length);
+    fseek(file, (long)forged.offset, SEEK_SET);
+    fread(forged_payload, forged.length, 1, file);
+    show_wallet(new_master_password, wallet);
+    fseek(file, 0, SEEK_SET);
+    ftruncate(fileno(file), 0);
+    write_wallet_file(file, wallet);
+    fflush(file);
+    read_header(file, &header);
+    fseek(file, 0, SEEK_END);
+    forged.offset = (uint64_t)ftell(file);
+    fwrite(forged_payload, forged.length, 1, file);
+    for (uint32_t i = 0; i < header.section_count; ++i) {
+        if (header.sections[i].type == SECTION_TAGS) {header.sections[i] = forged;}
+    }
+    header.crc = crc32c(0, &header, offsetof(file_header_t, crc));
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    fflush(file);
+    ret_status = read_wallet_file(file, wallet);
+    fclose(file);
+    remove(spliced_file);
+    secure_free(forged_payload);
+    if (ret_status != FORMAT_OK ||
+        tag_query(&wallet->tags, wallet->size, "legacy", &bitmap) != TAGS_OK || bitmap_cardinality(&bitmap) != 1
+    ) {
+        error_print("[TEST] Spliced tag index trusted.");
+        return 1;
+    }
+    secure_free(wallet);
+    info_print("[TEST] Spliced tag index successfully rejected.");
+
+
+    ////////////////////////////////////////////////
+    // test expiry
+    ////////////////////////////////////////////////
+    // items 4, 5 and 6 expire in 2 days, in 40 days, and a minute ago
+    const int64_t now = (int64_t)time(NULL), day = SECONDS_PER_DAY;
+    const int64_t expiries[] = {now + 2*day, now + 40*day, now - 60};
+    new_item = (item_t*)secure_malloc(sizeof(item_t));
+    for (int i = 0; i < 3; ++i) {
+        sprintf(new_item->title, "expiring %d", i);
+        new_item->expires = expiries[i];
+        if (add_item(new_master_password, new_item, sizeof(item_t)) != RET_SUCCESS) {
+            error_print("[TEST] Fail to add expiring item.");
+            return 1;
+        }
+    }
+    expiring_t expiring[MAX_ITEMS];
+    if (list_expiring(new_master_password, now + 7*day, expiring, &count) != RET_SUCCESS ||
+        count != 2 || expiring[0].index != 6 || expiring[1].index != 4
+    ) {
+        error_print("[TEST] Fail to list expiring items.");
+        return 1;
+    }
+    info_print("[TEST] Expiring items successfully listed.");
+
+    // moving an expiry date keeps the index ordered
+    sprintf(new_item->title, "expiring 1");
+    new_item->expires = now + 3*day;
+    if (update_item(new_master_password, 5, new_item, sizeof(item_t) - 1) != ERR_ITEM_TOO_LONG ||
+        update_item(new_master_password, 5, new_item, sizeof(item_t)) != RET_SUCCESS ||
+        list_expiring(new_master_password, now + 7*day, expiring, &count) != RET_SUCCESS ||
+        count != 3 || expiring[2].index != 5 || expiring[2].expires != now + 3*day
+    ) {
+        error_print("[TEST] Fail to update expiry date.");
+        return 1;
+    }
+    secure_free(new_item);
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    if (show_wallet(new_master_password, wallet) != RET_SUCCESS ||
+        wallet->items[5].created == 0 || wallet->items[5].modified < wallet->items[5].created
+    ) {
+        error_print("[TEST] Fail to track item dates.");
+        return 1;
+    }
+    secure_free(wallet);
+    if (remove_item(new_master_password, 4) != RET_SUCCESS ||
+        list_expiring(new_master_password, now + 7*day, expiring, &count) != RET_SUCCESS ||
+        count != 2 || expiring[0].index != 5 || expiring[1].index != 4
+    ) {
+        error_print("[TEST] Expiry index out of date after removal.");
+        return 1;
+    }
+    info_print("[TEST] Expiry index successfully updated.");
+
+    // the wheel fires timers in order, cascading far ones down
+    timer_wheel_t timer_wheel;
+    wheel_timer_t timers[6];
+    const int64_t deadlines[] = {1064, 999, 300000, 1001, 5000, 1063};
+    wheel_init(&timer_wheel, 1000);
+    for (int i = 0; i < 6; ++i) {
+        timers[i].deadline = deadlines[i];
+        timers[i].id = (uint32_t)i;
+        wheel_add(&timer_wheel, &timers[i]);
+    }
+    struct FiredTimers fired = {{0}, 0};
+    size_t early_fired = wheel_advance(&timer_wheel, 1064, record_timer, &fired);
+    size_t late_fired = wheel_advance(&timer_wheel, 299999, record_timer, &fired);
+    late_fired += wheel_advance(&timer_wheel, 300000, record_timer, &fired);
+    if (early_fired != 4 || late_fired != 2 || fired.count != 6 || fired.deadlines[5] != 300000) {
+        error_print("[TEST] Timer wheel fired wrong timers.");
+        return 1;
+    }
+    for (size_t i = 1; i < fired.count; ++i) {
+        if (fired.deadlines[i] < fired.deadlines[i-1]) {
+            error_print("[TEST] Timer wheel fired out of order.");
+            return 1;
+        }
+    }
+    info_print("[TEST] Timer wheel successfully checked.");
+
+
+    ////////////////////////////////////////////////
+    // test merge
+    ////////////////////////////////////////////////
+    // both replicas change after the copy: the wallet adds an item and
+    // renames item 0, the replica removes item 1 and adds another item
+    const char* replica_file = "replica.seal";
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    wallet_t* replica = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    new_item = (item_t*)secure_malloc(sizeof(item_t));
+    char removed_title[MAX_ITEM_SIZE];
+    if (copy_file(WALLET_FILE, replica_file) != 0 || show_wallet(new_master_password, wallet) != RET_SUCCESS) {
+        error_print("[TEST] Fail to copy wallet.");
+        return 1;
+    }
+    strcpy(removed_title, wallet->items[1].title);
+    strcpy(new_item->title, "added on the wallet");
+    ret_status = add_item(new_master_password, new_item, sizeof(item_t));
+    strcpy(new_item->title, "renamed on the wallet");
+    ret_status |= update_item(new_master_password, 0, new_item, sizeof(item_t));
+    strcpy(new_item->title, "added on the replica");
+    ret_status |= swap_files(WALLET_FILE, replica_file);
+    ret_status |= remove_item(new_master_password, 1);
+    ret_status |= add_item(new_master_password, new_item, sizeof(item_t));
+    ret_status |= swap_files(WALLET_FILE, replica_file);
+    secure_free(new_item);
+    if (ret_status != 0) {
+        error_print("[TEST] Fail to change replicas.");
+        return 1;
+    }
+
+    // each side takes the other's two changes, found without
+    // walking the whole tree
+    merge_stats_t merge_stats;
+    if (merge_wallets(new_master_password, WALLET_FILE, replica_file, &merge_stats) != RET_SUCCESS ||
+        merge_stats.pulled != 2 || merge_stats.pushed != 2 || merge_stats.leaves > 4 ||
+        merge_stats.nodes >= 2 * MERKLE_LEAVES - 1
+    ) {
+        error_print("[TEST] Fail to merge wallets.");
+        return 1;
+    }
+    ret_status = show_wallet(new_master_password, wallet);
+    ret_status |= swap_files(WALLET_FILE, replica_file);
+    ret_status |= show_wallet(new_master_password, replica);
+    ret_status |= swap_files(WALLET_FILE, replica_file);
+    if (ret_status != 0 || !same_items(wallet, replica) ||
+        !has_title(wallet, "added on the wallet") || !has_title(wallet, "added on the replica") ||
+        !has_title(wallet, "renamed on the wallet") || has_title(wallet, removed_title)
+    ) {
+        error_print("[TEST] Replicas did not converge.");
+        return 1;
+    }
+
+    // merged replicas have the same tree: nothing left to exchange
+    if (merge_wallets(new_master_password, WALLET_FILE, replica_file, &merge_stats) != RET_SUCCESS ||
+        merge_stats.nodes != 1 || merge_stats.entries != 0
+    ) {
+        error_print("[TEST] Merged replicas still differ.");
+        return 1;
+    }
+    secure_free(wallet);
+    secure_free(replica);
+    remove(replica_file);
+    remove("replica.seal.history");
+    remove("replica.seal" WALLET_LOCK_SUFFIX);
+    info_print("[TEST] Wallets successfully merged.");
+
+
+    ////////////////////////////////////////////////
+    // test enclave boundary
+    ////////////////////////////////////////////////
+    // switchless: worker threads serve the calls and no transition is
+    // paid; an add takes two posts, one to lock and load the wallet
+    // and its history and read the clock, one to append to the
+    // history, save and unlock
+    enclave_config_t enclave_config = {ENCLAVE_SWITCHLESS, ENCLAVE_TRANSITION_NS, 2};
+    enclave_stats_t enclave_stats;
+    if (enclave_configure(&enclave_config) != 0) {
+        error_print("[TEST] Fail to start switchless workers.");
+        return 1;
+    }
+    enclave_reset_stats();
+    new_item = (item_t*)secure_malloc(sizeof(item_t));
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    strcpy(new_item->title, "through the ring");
+    ret_status = ecall_add_item(new_master_password, new_item);
+    ret_status |= ecall_show_wallet(new_master_password, wallet);
+    enclave_get_stats(&enclave_stats);
+    if (ret_status != RET_SUCCESS || wallet->size == 0 || strcmp(wallet->items[wallet->size-1].title, "through the ring") != 0 ||
+        llabs(wallet->items[wallet->size-1].created - (int64_t)time(NULL)) > 60 ||
+        enclave_stats.ecalls != 2 || enclave_stats.transitions != 0 || enclave_stats.batches != 3 || enclave_stats.ocalls != 8
+    ) {
+        error_print("[TEST] Fail to call the wallet switchless.");
+        return 1;
+    }
+    info_print("[TEST] Switchless calls successfully checked.");
+
+    // simulated: every call crosses the boundary
+    enclave_config.mode = ENCLAVE_SIMULATED;
+    enclave_config.transition_ns = 1000;
+    enclave_configure(&enclave_config);
+    enclave_reset_stats();
+    ret_status = ecall_remove_item(new_master_password, (int)wallet->size - 1);
+    enclave_get_stats(&enclave_stats);
+    enclave_config.mode = ENCLAVE_DIRECT;
+    enclave_configure(&enclave_config);
+    secure_free(new_item);
+    secure_free(wallet);
+    if (ret_status != RET_SUCCESS || enclave_stats.ecalls != 1 ||
+        enclave_stats.transitions != enclave_stats.ecalls + enclave_stats.ocalls
+    ) {
+        error_print("[TEST] Fail to count enclave transitions.");
+        return 1;
+    }
+    info_print("[TEST] Enclave transitions successfully counted.");
+
+    // a save that cannot complete leaves the wallet file as it was
+    const char* atomic_file = "atomic.seal";
+    new_item = (item_t*)secure_malloc(sizeof(item_t));
+    strcpy(new_item->title, "never saved");
+    ret_status = copy_file(WALLET_FILE, atomic_file) != 0 || copy_file(WALLET_FILE, "atomic.seal.copy") != 0 ||
+        mkdir("atomic.seal.tmp", 0700) != 0;
+    ret_status |= add_items(atomic_file, new_master_password, new_item, 1, NULL) != ERR_CANNOT_SAVE_WALLET;
+    ret_status |= !same_file(atomic_file, "atomic.seal.copy");
+    secure_free(new_item);
+    rmdir("atomic.seal.tmp");
+    remove(atomic_file);
+    remove("atomic.seal.copy");
+    remove("atomic.seal.history");
+    remove("atomic.seal" WALLET_LOCK_SUFFIX);
+    if (ret_status != 0) {
+        error_print("[TEST] A failed save changed the wallet.");
+        return 1;
+    }
+    info_print("[TEST] Wallet successfully replaced atomically.");
+
+
+    ////////////////////////////////////////////////
+    // test paging
+    ////////////////////////////////////////////////
+    // ChaCha20 test vector from RFC 8439, section 2.4.2
+    uint8_t chacha_key[CHACHA20_KEY_SIZE];
+    const uint8_t chacha_nonce[CHACHA20_NONCE_SIZE] = {0, 0, 0, 0, 0, 0, 0, 0x4a, 0, 0, 0, 0};
+    const char* sunscreen = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+    const uint8_t sunscreen_start[16] = {0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80, 0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81};
+    const uint8_t sunscreen_end[2] = {0x87, 0x4d};
+    uint8_t ciphertext[128];
+    size_t sunscreen_len = strlen(sunscreen);
+    for (int i = 0; i < CHACHA20_KEY_SIZE; ++i) {chacha_key[i] = (uint8_t)i;}
+    chacha20_xor(chacha_key, chacha_nonce, 1, sunscreen, ciphertext, sunscreen_len);
+    if (memcmp(ciphertext, sunscreen_start, 16) != 0 || memcmp(ciphertext + sunscreen_len - 2, sunscreen_end, 2) != 0) {
+        error_print("[TEST] ChaCha20 does not match the RFC 8439 test vector.");
+        return 1;
+    }
+
+    // 64 items under a budget of two pages
+    item_store_t store;
+    item_t paged;
+    if (pager_init(&store, 64, 2 * PAGER_PAGE_SIZE, NULL) != PAGER_OK) {
+        error_print("[TEST] Fail to create item store.");
+        return 1;
+    }
+    memset(&paged, 0, sizeof(paged));
+    for (uint32_t i = 0; i < 64; ++i) {
+        sprintf(paged.title, "paged %u", i);
+        if (pager_put(&store, i, &paged) != PAGER_OK) {
+            error_print("[TEST] Fail to write paged item.");
+            return 1;
+        }
+    }
+    for (uint32_t i = 64; i-- > 0;) {
+        char expected[MAX_ITEM_SIZE];
+        sprintf(expected, "paged %u", i);
+        if (pager_get(&store, i, &paged) != PAGER_OK || strcmp(paged.title, expected) != 0) {
+            error_print("[TEST] Paged item lost.");
+            return 1;
+        }
+    }
+    if (store.stats.misses == 0 || store.stats.evictions == 0 || store.stats.writebacks == 0 ||
+        pager_get(&store, 64, &paged) != PAGER_ERR_RANGE
+    ) {
+        error_print("[TEST] Pager counters are wrong.");
+        return 1;
+    }
+
+    // sealed pages are authenticated: no tampering, no replay
+    uint8_t stale[PAGER_SEALED_SIZE];
+    pager_flush(&store);
+    memcpy(stale, store.backing + PAGER_SEALED_SIZE, PAGER_SEALED_SIZE);
+    strcpy(paged.title, "newer");
+    pager_put(&store, PAGER_ITEMS_PER_PAGE, &paged);
+    pager_flush(&store);
+    memcpy(store.backing + PAGER_SEALED_SIZE, stale, PAGER_SEALED_SIZE);
+    store.backing[MAC_TAG_SIZE] ^= 1;
+    if (pager_get(&store, PAGER_ITEMS_PER_PAGE, &paged) != PAGER_ERR_MAC || pager_get(&store, 0, &paged) != PAGER_ERR_MAC) {
+        error_print("[TEST] Tampered page accepted.");
+        return 1;
+    }
+    pager_free(&store);
+
+    // a failed write-back keeps the dirty page resident and intact
+    if (pager_init(&store, 64, PAGER_PAGE_SIZE, "pager.swap") != PAGER_OK) {
+        error_print("[TEST] Fail to create swapped item store.");
+        return 1;
+    }
+    strcpy(paged.title, "unsaved");
+    pager_put(&store, 0, &paged);
+    int swap_fd = store.fd;
+    store.fd = open("/dev/null", O_RDONLY);
+    int evict_status = pager_get(&store, PAGER_ITEMS_PER_PAGE, &paged);
+    close(store.fd);
+    store.fd = swap_fd;
+    if (evict_status != PAGER_ERR_IO || pager_get(&store, 0, &paged) != PAGER_OK || strcmp(paged.title, "unsaved") != 0) {
+        error_print("[TEST] Page lost after a failed write-back.");
+        return 1;
+    }
+    pager_free(&store);
+
+    // the wallet itself, shown through the enclave with one page resident
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    ret_status = show_wallet(new_master_password, wallet) != RET_SUCCESS ||
+        ecall_open_item_store(new_master_password, PAGER_PAGE_SIZE, &store) != RET_SUCCESS;
+    for (uint32_t i = 0; ret_status == 0 && i < wallet->size; ++i) {
+        ret_status = ecall_item_store_get(&store, i, &paged) != PAGER_OK ||
+            memcmp(&paged, &wallet->items[i], sizeof(item_t)) != 0;
+    }
+    if (ret_status != 0 || store.frames != 1 || store.capacity != wallet->size ||
+        store.stats.evictions < store.pages - 1
+    ) {
+        error_print("[TEST] Fail to page the wallet.");
+        return 1;
+    }
+    ecall_close_item_store(&store);
+    secure_free(wallet);
+    info_print("[TEST] Items successfully paged.");
+
+
+
+    ////////////////////////////////////////////////
+    // test blobs
+    ////////////////////////////////////////////////
+    // a few MB, not a whole number of chunks
+    const uint64_t blob_length = 3 * 1024 * 1024 + 123;
+    struct PatternStream produced = {blob_length, 0, 0};
+    struct PatternStream consumed = {blob_length, 0, 0};
+    char blob_file[BLOB_MAX_PATH], old_blob_file[BLOB_MAX_PATH];
+    new_item = (item_t*)secure_malloc(sizeof(item_t));
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    strcpy(new_item->title, "ssh key");
+    ret_status = add_item(new_master_password, new_item, sizeof(item_t));
+    ret_status |= show_wallet(new_master_password, wallet);
+    int blob_index = (int)wallet->size - 1;
+    if (ret_status != RET_SUCCESS || read_blob(new_master_password, blob_index, pattern_sink, &consumed) != ERR_BLOB_DOES_NOT_EXIST ||
+        attach_blob(new_master_password, blob_index, pattern_source, &produced) != RET_SUCCESS ||
+        read_blob(new_master_password, blob_index, pattern_sink, &consumed) != RET_SUCCESS ||
+        consumed.position != blob_length || consumed.mismatch
+    ) {
+        error_print("[TEST] Blob not restored.");
+        return 1;
+    }
+    show_wallet(new_master_password, wallet);
+    blob_path(WALLET_FILE, wallet->items[blob_index].blob, blob_file);
+    if (wallet->items[blob_index].blob_size != blob_length) {
+        error_print("[TEST] Blob size not recorded.");
+        return 1;
+    }
+
+    // updating the item keeps its blob
+    strcpy(new_item->title, "ssh key (renamed)");
+    if (update_item(new_master_password, blob_index, new_item, sizeof(item_t)) != RET_SUCCESS) {
+        error_print("[TEST] Fail to update item with blob.");
+        return 1;
+    }
+    consumed = {blob_length, 0, 0};
+    if (read_blob(new_master_password, blob_index, pattern_sink, &consumed) != RET_SUCCESS || consumed.mismatch) {
+        error_print("[TEST] Blob lost by an update.");
+        return 1;
+    }
+
+    // a tampered chunk is never streamed out
+    FILE* blob_handle = fopen(blob_file, "r+b");
+    if (blob_handle == NULL || fseek(blob_handle, sizeof(blob_header_t) + BLOB_SEALED_CHUNK_SIZE + MAC_TAG_SIZE + 7, SEEK_SET) != 0 ||
+        fputc(0x5a, blob_handle) == EOF || fclose(blob_handle) != 0
+    ) {
+        error_print("[TEST] Fail to tamper with the blob.");
+        return 1;
+    }
+    consumed = {blob_length, 0, 0};
+    if (read_blob(new_master_password, blob_index, pattern_sink, &consumed) != ERR_CANNOT_LOAD_BLOB ||
+        consumed.position != BLOB_CHUNK_SIZE || consumed.mismatch
+    ) {
+        error_print("[TEST] Tampered blob accepted.");
+        return 1;
+    }
+
+    // replacing, detaching and removing delete the blob file
+    strcpy(old_blob_file, blob_file);
+    produced = {1000, 0, 0};
+    consumed = {1000, 0, 0};
+    show_wallet(new_master_password, wallet);
+    if (attach_blob(new_master_password, blob_index, pattern_source, &produced) != RET_SUCCESS ||
+        fopen(old_blob_file, "rb") != NULL || read_blob(new_master_password, blob_index, pattern_sink, &consumed) != RET_SUCCESS ||
+        consumed.position != 1000 || consumed.mismatch || show_wallet(new_master_password, wallet) != RET_SUCCESS
+    ) {
+        error_print("[TEST] Blob not replaced.");
+        return 1;
+    }
+    blob_path(WALLET_FILE, wallet->items[blob_index].blob, blob_file);
+    if (attach_blob(new_master_password, blob_index, NULL, NULL) != RET_SUCCESS || fopen(blob_file, "rb") != NULL ||
+        read_blob(new_master_password, blob_index, pattern_sink, &consumed) != ERR_BLOB_DOES_NOT_EXIST
+    ) {
+        error_print("[TEST] Blob not detached.");
+        return 1;
+    }
+    produced = {10, 0, 0};
+    attach_blob(new_master_password, blob_index, pattern_source, &produced);
+    show_wallet(new_master_password, wallet);
+    blob_path(WALLET_FILE, wallet->items[blob_index].blob, blob_file);
+    if (remove_item(new_master_password, blob_index) != RET_SUCCESS || fopen(blob_file, "rb") != NULL) {
+        error_print("[TEST] Blob left behind by its item.");
+        return 1;
+    }
+    secure_free(new_item);
+    secure_free(wallet);
+    info_print("[TEST] Blobs successfully streamed.");
+
+
+
+    ////////////////////////////////////////////////
+    // test fleet operations
+    ////////////////////////////////////////////////
+    // two copies of the wallet and a damaged file, in a tree
+    const char* fleet_files[] = {"fleet.test/a.seal", "fleet.test/sub/b.seal", "fleet.test/c.seal"};
+    fleet_report_t fleet_report;
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    if (show_wallet(new_master_password, wallet) != RET_SUCCESS || wallet->size == 0 ||
+        mkdir("fleet.test", 0700) != 0 || mkdir("fleet.test/sub", 0700) != 0 ||
+        copy_file(WALLET_FILE, fleet_files[0]) != 0 || copy_file(WALLET_FILE, fleet_files[1]) != 0 ||
+        copy_file(WALLET_FILE ".history", fleet_files[2]) != 0
+    ) {
+        error_print("[TEST] Fail to lay out wallet files.");
+        return 1;
+    }
+    char fleet_title[MAX_ITEM_SIZE];
+    strcpy(fleet_title, wallet->items[0].title);
+    fleet_job_t fleet_job = {FLEET_FIND, new_master_password, fleet_title, NULL, NULL, 3, 1};
+    ret_status = run_fleet("fleet.test", &fleet_job, &fleet_report);
+    if (ret_status == 0 || fleet_report.files != 3 || fleet_report.matched != 2 || fleet_report.failed != 1 ||
+        fleet_report.locked != 0 || fleet_report.items < 2
+    ) {
+        error_print("[TEST] Fail to find a credential across wallet files.");
+        return 1;
+    }
+
+    // rotate through a list of files; only the matching items change
+    FILE* fleet_list = fopen("fleet.test/list", "w");
+    if (fleet_list == NULL) {return 1;}
+    fprintf(fleet_list, "%s\n%s\n", fleet_files[0], fleet_files[1]);
+    fclose(fleet_list);
+    fleet_job.operation = FLEET_ROTATE;
+    fleet_job.password = "rotated password";
+    ret_status = run_fleet("@fleet.test/list", &fleet_job, &fleet_report);
+    size_t fleet_count = 0;
+    uint32_t fleet_indexes[MAX_ITEMS];
+    item_t* fleet_items = (item_t*)secure_malloc(MAX_ITEMS * sizeof(item_t));
+    ret_status |= find_credential(fleet_files[1], new_master_password, "*", NULL, fleet_indexes, fleet_items, &fleet_count);
+    if (ret_status != 0 || fleet_report.files != 2 || fleet_report.matched != 2 || fleet_count != wallet->size) {
+        error_print("[TEST] Fail to rotate a credential across wallet files.");
+        return 1;
+    }
+    for (size_t i = 0; i < fleet_count; ++i) {
+        int rotated = strcmp(fleet_items[i].password, "rotated password") == 0;
+        int expected = strcmp(fleet_items[i].title, fleet_title) == 0;
+        if (rotated != expected || (!rotated && strcmp(fleet_items[i].password, wallet->items[i].password) != 0)) {
+            error_print("[TEST] Rotation changed the wrong items.");
+            return 1;
+        }
+    }
+
+    // files under another master-password are reported, not touched
+    fleet_job.operation = FLEET_FIND;
+    fleet_job.master_password = master_password;
+    ret_status = run_fleet("@fleet.test/list", &fleet_job, &fleet_report);
+    if (ret_status == 0 || fleet_report.locked != 2 || fleet_report.matched != 0) {
+        error_print("[TEST] Fail to report locked wallet files.");
+        return 1;
+    }
+    for (int i = 0; i < 3; ++i) {
+        char fleet_history[64], fleet_lock[64];
+        snprintf(fleet_history, sizeof(fleet_history), "%s.history", fleet_files[i]);
+        snprintf(fleet_lock, sizeof(fleet_lock), "%s" WALLET_LOCK_SUFFIX, fleet_files[i]);
+        remove(fleet_files[i]);
+        remove(fleet_history);
+        remove(fleet_lock);
+    }
+    remove("fleet.test/list");
+    rmdir("fleet.test/sub");
+    rmdir("fleet.test");
+    secure_free(fleet_items);
+    secure_free(wallet);
+    info_print("[TEST] Credentials successfully found and rotated across wallet files.");
+
+
+    ////////////////////////////////////////////////
+    // test access log
+    ////////////////////////////////////////////////
+    // a granted and a denied show, an add and a remove
+    remove("access.test");
+    wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    ret_status = access_log_open("access.test");
+    ret_status |= show_wallet(new_master_password, wallet);
+    show_wallet(master_password, wallet);
+    show_wallet(new_master_password, wallet);
+    ret_status |= add_item(new_master_password, &wallet->items[0], sizeof(item_t));
+    int access_index = (int)wallet->size;
+    ret_status |= remove_item(new_master_password, access_index);
+    ret_status |= access_log_flush();
+    access_log_close();
+    access_log_report_t access_report;
+    access_record_t access_records[8];
+    size_t access_count = 0;
+    ret_status |= access_log_verify("access.test", 2, &access_report);
+    ret_status |= access_log_tail("access.test", access_records, 8, &access_count);
+    if (ret_status != 0 || access_report.entries != 5 || access_report.seals == 0 || access_report.unsealed != 0 ||
+        access_count != 5 || access_records[1].status != ERR_WRONG_MASTER_PASSWORD ||
+        access_records[3].operation != ACCESS_ADD || access_records[3].item != access_index ||
+        access_records[4].operation != ACCESS_REMOVE || access_records[4].item_id != access_records[3].item_id ||
+        access_records[3].item_id == 0 || access_records[4].uid != (uint32_t)getuid()
+    ) {
+        error_print("[TEST] Fail to record wallet operations.");
+        return 1;
+    }
+
+    // reopening carries on the chain
+    ret_status = access_log_open("access.test");
+    access_log_record(ACCESS_SHOW, -1, 0, RET_SUCCESS);
+    access_log_close();
+    ret_status |= access_log_verify("access.test", 0, &access_report);
+    if (ret_status != 0 || access_report.entries != 6) {
+        error_print("[TEST] Fail to append to an access log.");
+        return 1;
+    }
+
+    // an entry appended without the key is cut off, not sealed
+    FILE* access_file = fopen("access.test", "r+b");
+    if (access_file == NULL) {return 1;}
+    access_record_t access_record;
+    fseek(access_file, -(long)sizeof(access_record_t), SEEK_END);
+    fread(&access_record, sizeof(access_record), 1, access_file);
+    uint8_t access_previous[SHA256_SIZE];
+    memcpy(access_previous, access_record.hash, SHA256_SIZE);
+    access_record.sequence += 1;
+    access_record.kind = ACCESS_ENTRY;
+    access_record.operation = ACCESS_SHOW;
+    access_record.status = RET_SUCCESS;
+    access_record.item = 42;
+    sha256_t access_ctx;
+    sha256_init(&access_ctx);
+    sha256_update(&access_ctx, access_previous, SHA256_SIZE);
+    sha256_update(&access_ctx, &access_record, offsetof(access_record_t, hash));
+    sha256_final(&access_ctx, access_record.hash);
+    fseek(access_file, 0, SEEK_END);
+    fwrite(&access_record, sizeof(access_record), 1, access_file);
+    fclose(access_file);
+    ret_status = access_log_open("access.test");
+    access_log_record(ACCESS_SHOW, -1, 0, RET_SUCCESS);
+    access_log_close();
+    ret_status |= access_log_verify("access.test", 0, &access_report);
+    ret_status |= access_log_tail("access.test", access_records, 8, &access_count);
+    if (ret_status != 0 || access_report.entries != 7 || access_count != 7 || access_records[6].item != -1) {
+        error_print("[TEST] Access log entry forged without the key got sealed.");
+        return 1;
+    }
+
+    // two processes appending to one log keep a single chain
+    pid_t access_child = fork();
+    if (access_child == 0) {
+        int child_status = access_log_open("access.test");
+        for (int i = 0; i < 20; ++i) {
+            access_log_record(ACCESS_SHOW, -1, 0, RET_SUCCESS);
+            child_status |= access_log_flush();
+        }
+        access_log_close();
+        _exit(child_status);
+    }
+    int access_child_status = -1;
+    ret_status = access_log_open("access.test");
+    for (int i = 0; i < 20; ++i) {
+        access_log_record(ACCESS_SHOW, -1, 0, RET_SUCCESS);
+        ret_status |= access_log_flush();
+    }
+    access_log_close();
+    ret_status |= waitpid(access_child, &access_child_status, 0) != access_child;
+    ret_status |= !WIFEXITED(access_child_status) || WEXITSTATUS(access_child_status) != 0;
+    ret_status |= access_log_verify("access.test", 0, &access_report);
+    if (ret_status != 0 || access_report.entries != 47) {
+        error_print("[TEST] Fail to share an access log between processes.");
+        return 1;
+    }
+
+    // changing an entry breaks the chain at that entry; the writer may
+    // have sealed any number of batches, so look the denied show up
+    access_file = fopen("access.test", "r+b");
+    if (access_file == NULL) {return 1;}
+    long access_denied = -1, access_seal = -1;
+    for (long i = 0; fread(&access_record, sizeof(access_record), 1, access_file) == 1; ++i) {
+        if (access_denied < 0 && access_record.status == ERR_WRONG_MASTER_PASSWORD) {access_denied = i;}
+        else if (access_denied >= 0 && access_seal < 0 && access_record.kind == ACCESS_SEAL) {access_seal = i;}
+    }
+    if (access_denied < 0 || access_seal < 0) {return 1;}
+    fseek(access_file, access_denied * (long)sizeof(access_record_t), SEEK_SET);
+    fread(&access_record, sizeof(access_record), 1, access_file);
+    access_record.status = RET_SUCCESS;
+    fseek(access_file, access_denied * (long)sizeof(access_record_t), SEEK_SET);
+    fwrite(&access_record, sizeof(access_record), 1, access_file);
+    fflush(access_file);
+    if (access_log_verify("access.test", 2, &access_report) != ACCESS_LOG_ERR_CHAIN ||
+        access_report.first_bad != (uint64_t)access_denied + 1
+    ) {
+        error_print("[TEST] Fail to detect a changed access log entry.");
+        return 1;
+    }
+
+    // rebuilding the chain from there still fails at the next seal
+    fseek(access_file, (access_denied - 1) * (long)sizeof(access_record_t), SEEK_SET);
+    fread(&access_record, sizeof(access_record), 1, access_file);
+    memcpy(access_previous, access_record.hash, SHA256_SIZE);
+    for (long i = access_denied; fseek(access_file, i * (long)sizeof(access_record_t), SEEK_SET) == 0 &&
+        fread(&access_record, sizeof(access_record), 1, access_file) == 1; ++i) {
+        sha256_init(&access_ctx);
+        sha256_update(&access_ctx, access_previous, SHA256_SIZE);
+        sha256_update(&access_ctx, &access_record, offsetof(access_record_t, hash));
+        sha256_final(&access_ctx, access_record.hash);
+        memcpy(access_previous, access_record.hash, SHA256_SIZE);
+        fseek(access_file, i * (long)sizeof(access_record_t), SEEK_SET);
+        fwrite(&access_record, sizeof(access_record), 1, access_file);
+    }
+    fclose(access_file);
+    if (access_log_verify("access.test", 2, &access_report) != ACCESS_LOG_ERR_MAC ||
+        access_report.first_bad != (uint64_t)access_seal + 1
+    ) {
+        error_print("[TEST] Fail to detect a forged access log.");
+        return 1;
+    }
+    // a restore, a merge and a rotation are recorded, denied or not;
+    // the second restore undoes the first
+    remove("access.test");
+    ret_status = access_log_open("access.test");
+    ret_status |= list_snapshots(new_master_password, snapshots, &count);
+    ret_status |= restore_snapshot(master_password, snapshots[0].version) != ERR_WRONG_MASTER_PASSWORD;
+    ret_status |= restore_snapshot(new_master_password, snapshots[0].version);
+    ret_status |= list_snapshots(new_master_password, snapshots, &count);
+    ret_status |= restore_snapshot(new_master_password, snapshots[0].version);
+    ret_status |= copy_file(WALLET_FILE, replica_file);
+    ret_status |= merge_wallets(master_password, WALLET_FILE, replica_file, &merge_stats) != ERR_WRONG_MASTER_PASSWORD;
+    ret_status |= merge_wallets(new_master_password, WALLET_FILE, replica_file, &merge_stats);
+    ret_status |= show_wallet(new_master_password, wallet);
+    size_t access_rotated = 0;
+    ret_status |= rotate_credential(replica_file, master_password, wallet->items[0].title, NULL, "rotated",
+        &access_rotated) != ERR_WRONG_MASTER_PASSWORD;
+    ret_status |= rotate_credential(replica_file, new_master_password, wallet->items[0].title, NULL, "rotated",
+        &access_rotated);
+    ret_status |= access_log_flush();
+    access_log_close();
+    ret_status |= access_log_tail("access.test", access_records, 8, &access_count);
+    if (ret_status != 0 || access_rotated != 1 || access_count != 8 ||
+        access_records[0].operation != ACCESS_RESTORE || access_records[0].status != ERR_WRONG_MASTER_PASSWORD ||
+        access_records[1].operation != ACCESS_RESTORE || access_records[2].status != RET_SUCCESS ||
+        access_records[3].operation != ACCESS_MERGE || access_records[3].status != ERR_WRONG_MASTER_PASSWORD ||
+        access_records[4].operation != ACCESS_MERGE || access_records[4].status != RET_SUCCESS ||
+        access_records[5].operation != ACCESS_SHOW || access_records[6].operation != ACCESS_ROTATE ||
+        access_records[6].status != ERR_WRONG_MASTER_PASSWORD || access_records[7].operation != ACCESS_ROTATE ||
+        access_records[7].status != RET_SUCCESS || access_records[7].item_id == 0
+    ) {
+        error_print("[TEST] Fail to record restores, merges and rotations.");
+        return 1;
+    }
+    remove(replica_file);
+    remove("replica.seal.history");
+    remove("replica.seal" WALLET_LOCK_SUFFIX);
+    remove("access.test");
+    secure_free(wallet);
+    info_print("[TEST] Wallet operations successfully recorded in the access log.");
+
+
+    ////////////////////////////////////////////////
+    // test wallet cache
+    ////////////////////////////////////////////////
+    // nothing to do while the file is untouched
+    wallet_cache_t cache, polled;
+    size_t cache_changed = 0;
+    ret_status = open_wallet_cache(WALLET_FILE, new_master_password, 0, &cache);
+    ret_status |= open_wallet_cache(WALLET_FILE, new_master_password, 1, &polled);
+    if (ret_status != RET_SUCCESS || polled.watch.mode != WATCH_POLLING) {
+        error_print("[TEST] Fail to open a wallet cache.");
+        return 1;
+    }
+    size_t cache_size = cache.wallet->size;
+    uint64_t cache_generation = cache.generation;
+    ret_status = refresh_wallet_cache(&cache, 0, &cache_changed);
+    if (ret_status != RET_SUCCESS || cache_changed != 0 || cache.reloads != 0) {
+        error_print("[TEST] Fail to keep an untouched wallet cache.");
+        return 1;
+    }
+
+    // an add only authenticates the new record, an update the one changed
+    item_t* cache_item = (item_t*)secure_malloc(sizeof(item_t));
+    *cache_item = cache.wallet->items[0];
+    ret_status = add_item(new_master_password, cache_item, sizeof(item_t));
+    ret_status |= refresh_wallet_cache(&cache, 1000, &cache_changed);
+    if (ret_status != RET_SUCCESS || cache_changed != 1 || cache.wallet->size != cache_size + 1 ||
+        cache.generation != cache_generation + 1 || !bitmap_contains(&cache.changed, (uint32_t)cache_size)
+    ) {
+        error_print("[TEST] Fail to reload an added item.");
+        return 1;
+    }
+    strcpy(cache_item->password, "cached password");
+    ret_status = update_item(new_master_password, 0, cache_item, sizeof(item_t));
+    ret_status |= refresh_wallet_cache(&cache, 1000, &cache_changed);
+    if (ret_status != RET_SUCCESS || cache_changed != 1 || !bitmap_contains(&cache.changed, 0) ||
+        strcmp(cache.wallet->items[0].password, "cached password") != 0 || cache.authenticated != 2
+    ) {
+        error_print("[TEST] Fail to reload an updated item.");
+        return 1;
+    }
+
+    // polling sees both saves at once
+    ret_status = refresh_wallet_cache(&polled, 1000, &cache_changed);
+    if (ret_status != RET_SUCCESS || cache_changed != 2 || polled.generation != cache.generation ||
+        memcmp(polled.wallet->items, cache.wallet->items, cache.wallet->size * sizeof(item_t)) != 0
+    ) {
+        error_print("[TEST] Fail to reload a polled wallet cache.");
+        return 1;
+    }
+    wallet_cache_free(&polled);
+
+    // put the wallet back; a new master-password drops the cache
+    strcpy(cache_item->password, cache.wallet->items[cache_size].password);
+    ret_status = update_item(new_master_password, 0, cache_item, sizeof(item_t));
+    ret_status |= remove_item(new_master_password, (int)cache_size);
+    ret_status |= change_master_password(new_master_password, master_password);
+    ret_status |= refresh_wallet_cache(&cache, 1000, &cache_changed) != ERR_WRONG_MASTER_PASSWORD;
+    ret_status |= change_master_password(master_password, new_master_password);
+    if (ret_status != RET_SUCCESS || cache.wallet != NULL) {
+        error_print("[TEST] Fail to drop a wallet cache.");
+        return 1;
+    }
+    wallet_cache_free(&cache);
+    secure_free(cache_item);
+    info_print("[TEST] Wallet cache successfully kept in step with its file.");
+
+
+    ////////////////////////////////////////////////
+    // test wallet policies
+    ////////////////////////////////////////////////
+    // the default policy at both ends, the master-password left as it was
+    char policy_password[MAX_ITEM_SIZE + 1];
+    memset(policy_password, 'p', sizeof(policy_password));
+    policy_password[PASSWORD_MIN_SIZE - 1] = '\0';
+    ret_status = change_master_password(new_master_password, policy_password) != ERR_PASSWORD_OUT_OF_RANGE;
+    policy_password[PASSWORD_MIN_SIZE - 1] = 'p';
+    policy_password[MAX_ITEM_SIZE] = '\0';
+    ret_status |= change_master_password(new_master_password, policy_password) != ERR_PASSWORD_OUT_OF_RANGE;
+    policy_password[MAX_ITEM_SIZE - 1] = '\0';
+    ret_status |= change_master_password(new_master_password, policy_password);
+    ret_status |= change_master_password(policy_password, new_master_password);
+    if (ret_status != 0) {
+        error_print("[TEST] Fail to enforce the password policy.");
+        return 1;
+    }
+
+    // PBKDF2-HMAC-SHA256 test vector from RFC 7914, section 11
+    const uint8_t pbkdf2_expected[16] = {0x55, 0xac, 0x04, 0x6e, 0x56, 0xe3, 0x08, 0x9f,
+        0xec, 0x16, 0x91, 0xc2, 0x25, 0x44, 0xb6, 0x05};
+    const uint8_t pbkdf2_end[2] = {0x97, 0x83};
+    uint8_t pbkdf2_out[64];
+    pbkdf2_sha256("passwd", 6, (const uint8_t*)"salt", 4, 1, pbkdf2_out, sizeof(pbkdf2_out));
+    if (memcmp(pbkdf2_out, pbkdf2_expected, 16) != 0 || memcmp(pbkdf2_out + 62, pbkdf2_end, 2) != 0) {
+        error_print("[TEST] PBKDF2 does not match the RFC 7914 test vector.");
+        return 1;
+    }
+
+    // a tiny wallet: its limits, and items moving down on removal
+    {
+        BasicWallet<tiny_policy_t> tiny;
+        ret_status = tiny.set_master_password("short") != ERR_PASSWORD_OUT_OF_RANGE;
+        ret_status |= tiny.set_master_password("fifteen chars!!");
+        ret_status |= tiny.check_master_password("fifteen chars!!") != 0 || tiny.check_master_password("fifteen chars!?") == 0;
+        for (int i = 0; i < 4; ++i) {
+            char title[16];
+            snprintf(title, sizeof(title), "tiny %d", i);
+            ret_status |= tiny.add(title, "user", "secret");
+        }
+        ret_status |= tiny.add("one too", "many", "items") != ERR_WALLET_FULL;
+        ret_status |= tiny.remove(1);
+        ret_status |= tiny.add("a title that is too long", "user", "secret") != ERR_ITEM_TOO_LONG;
+        if (ret_status != 0 || tiny.size() != 3 || strcmp(tiny.get(1)->title, "tiny 2") != 0 || tiny.get(3) != NULL) {
+            error_print("[TEST] Fail to enforce a tiny wallet policy.");
+            return 1;
+        }
+    }
+
+    // a service wallet: paged, its pages released with it
+    arena_stats_t policy_before, policy_after;
+    arena_get_stats(&policy_before);
+    {
+        BasicWallet<service_policy_t>* service = new BasicWallet<service_policy_t>();
+        ret_status = service->set_master_password("short pass!") != ERR_PASSWORD_OUT_OF_RANGE;
+        ret_status |= service->set_master_password("service master-password");
+        ret_status |= service->check_master_password("service master-password");
+        for (int i = 0; i < 1000 && ret_status == 0; ++i) {
+            char title[64];
+            snprintf(title, sizeof(title), "service %d", i);
+            ret_status |= service->add(title, "user", "secret");
+        }
+        ret_status |= service->remove(0);
+        if (ret_status != 0 || service->size() != 999 || strcmp(service->get(998)->title, "service 999") != 0 ||
+            service->check_master_password("service master-passworD") == 0
+        ) {
+            error_print("[TEST] Fail to enforce a service wallet policy.");
+            return 1;
+        }
+        delete service;
+    }
+    arena_get_stats(&policy_after);
+    if (policy_after.in_use != policy_before.in_use) {
+        error_print("[TEST] A paged wallet leaked its pages.");
+        return 1;
+    }
+    info_print("[TEST] Wallet policies successfully enforced.");
+
+
+    ////////////////////////////////////////////////
+    // test library
+    ////////////////////////////////////////////////
+    // a missing file, a locked handle, a wrong and an overlong master-password
+    lw_wallet_t* lib = NULL;
+    size_t lib_size = 0, lib_count = 0;
+    char overlong[MAX_ITEM_SIZE + 1];
+    memset(overlong, 0, sizeof(overlong));
+    strcpy(overlong, new_master_password);
+    memset(overlong + strlen(overlong), ' ', MAX_ITEM_SIZE - strlen(overlong));
+    if (lw_open("missing.seal", &lib) != LW_ERR_CANNOT_LOAD || lib != NULL ||
+        lw_open(WALLET_FILE, &lib) != LW_OK || lw_get(lib, 0, NULL) != LW_ERR_INVALID_ARGUMENT ||
+        lw_count(lib, &lib_size) != LW_ERR_LOCKED || lw_unlock(lib, master_password) != LW_ERR_WRONG_PASSWORD ||
+        lw_unlock(lib, overlong) != LW_ERR_WRONG_PASSWORD ||
+        lw_unlock(lib, new_master_password) != LW_OK || lw_count(lib, &lib_size) != LW_OK
+    ) {
+        error_print("[TEST] Fail to open a wallet through the library.");
+        return 1;
+    }
+
+    // a batch is added whole or not at all
+    lw_item_t* lib_items = (lw_item_t*)secure_malloc(3 * sizeof(lw_item_t));
+    memset(lib_items, 0, 3 * sizeof(lw_item_t));
+    for (int i = 0; i < 3; ++i) {
+        sprintf(lib_items[i].title, "library %d", i);
+        strcpy(lib_items[i].username, "service");
+        strcpy(lib_items[i].password, "library password");
+        strcpy(lib_items[i].tags, "library");
+    }
+    memset(lib_items[2].password, 'x', LW_FIELD_SIZE);
+    ret_status = lw_add(lib, lib_items, 3) != LW_ERR_ITEM_TOO_LONG;
+    ret_status |= lw_count(lib, &lib_count) != LW_OK || lib_count != lib_size;
+    ret_status |= lw_add(lib, lib_items, 2) != LW_OK;
+    ret_status |= lw_count(lib, &lib_count) != LW_OK || lib_count != lib_size + 2;
+    ret_status |= lw_get(lib, lib_size + 1, &lib_items[2]) != LW_OK;
+    if (ret_status != 0 || strcmp(lib_items[2].title, "library 1") != 0 || lib_items[2].id == 0 ||
+        lib_items[2].revision != 1
+    ) {
+        error_print("[TEST] Fail to add items through the library.");
+        return 1;
+    }
+
+    // search, then remove both; every call enters the enclave
+    uint32_t lib_indexes[2];
+    enclave_reset_stats();
+    ret_status = lw_search(lib, "library", lib_indexes, 1, &lib_count) != LW_ERR_BUFFER_TOO_SMALL || lib_count != 2;
+    ret_status |= lw_search(lib, "library AND (", lib_indexes, 2, &lib_count) != LW_ERR_INVALID_QUERY;
+    ret_status |= lw_search(lib, "library", lib_indexes, 2, &lib_count) != LW_OK || lib_count != 2 ||
+        lib_indexes[0] != lib_size || lib_indexes[1] != lib_size + 1;
+    ret_status |= lw_remove(lib, lib_indexes, 2) != LW_OK;
+    ret_status |= lw_count(lib, &lib_count) != LW_OK || lib_count != lib_size;
+    ret_status |= lw_get(lib, lib_size, &lib_items[2]) != LW_ERR_NO_SUCH_ITEM;
+    enclave_get_stats(&enclave_stats);
+    if (ret_status != 0 || enclave_stats.ecalls != 10 || strcmp(lw_strerror(LW_ERR_NO_SUCH_ITEM), "item does not exist") != 0 ||
+        lw_abi_version() != LW_ABI_VERSION
+    ) {
+        error_print("[TEST] Fail to search and remove items through the library.");
+        return 1;
+    }
+
+    // a save by another process shows up without unlocking again
+    item_t* lib_item = (item_t*)secure_malloc(sizeof(item_t));
+    memset(lib_item, 0, sizeof(item_t));
+    strcpy(lib_item->title, "outside the library");
+    ret_status = add_item(new_master_password, lib_item, sizeof(item_t));
+    ret_status |= lw_get(lib, lib_size, &lib_items[2]) != LW_OK || strcmp(lib_items[2].title, lib_item->title) != 0;
+    ret_status |= remove_item(new_master_password, (int)lib_size);
+    ret_status |= lw_count(lib, &lib_count) != LW_OK || lib_count != lib_size;
+    if (ret_status != 0) {
+        error_print("[TEST] Fail to follow the wallet file through the library.");
+        return 1;
+    }
+    lw_close(lib);
+    secure_free(lib_item);
+    secure_free(lib_items);
+    info_print("[TEST] Wallet successfully used through the library.");
+
+
+    ////////////////////////////////////////////////
+    // test asynchronous library
+    ////////////////////////////////////////////////
+    // unlocks of separate handles in flight at once, one of them denied
+    lw_executor_t* executor = NULL;
+    lw_wallet_t* async_wallets[3] = {NULL, NULL, NULL};
+    int async_status[3] = {-1, -1, -1};
+    ret_status = lw_executor_create(2, &executor) != LW_OK;
+    for (int i = 0; i < 3; ++i) {ret_status |= lw_open(WALLET_FILE, &async_wallets[i]) != LW_OK;}
+    ret_status |= lw_unlock_async(executor, async_wallets[0], new_master_password, record_status, &async_status[0]);
+    ret_status |= lw_unlock_async(executor, async_wallets[1], new_master_password, record_status, &async_status[1]);
+    ret_status |= lw_unlock_async(executor, async_wallets[2], master_password, record_status, &async_status[2]);
+    ret_status |= lw_unlock_async(executor, NULL, master_password, record_status, NULL) != LW_ERR_INVALID_ARGUMENT;
+    lw_executor_destroy(executor);
+    if (ret_status != 0 || async_status[0] != LW_OK || async_status[1] != LW_OK ||
+        async_status[2] != LW_ERR_WRONG_PASSWORD
+    ) {
+        error_print("[TEST] Fail to unlock wallets asynchronously.");
+        return 1;
+    }
+
+    // reads and a batch add, their inputs released as soon as queued
+    lw_item_t* async_items = (lw_item_t*)secure_malloc(3 * sizeof(lw_item_t));
+    memset(async_items, 0, 3 * sizeof(lw_item_t));
+    strcpy(async_items[0].title, "asynchronous item");
+    ret_status = lw_get(async_wallets[0], 0, &async_items[2]) != LW_OK;
+    ret_status |= lw_executor_create(0, &executor) != LW_OK;
+    ret_status |= lw_get_async(executor, async_wallets[0], 0, &async_items[1], record_status, &async_status[0]);
+    ret_status |= lw_add_async(executor, async_wallets[1], async_items, 1, record_status, &async_status[1]);
+    memset(async_items[0].title, 0, LW_FIELD_SIZE);
+    lw_executor_destroy(executor);
+    ret_status |= async_status[0] != LW_OK || async_status[1] != LW_OK;
+    ret_status |= lw_count(async_wallets[0], &lib_count) != LW_OK || lib_count != lib_size + 1;
+    ret_status |= lw_get(async_wallets[0], lib_size, &async_items[0]) != LW_OK;
+    ret_status |= strcmp(async_items[0].title, "asynchronous item") != 0;
+    ret_status |= strcmp(async_items[1].title, async_items[2].title) != 0;
+    ret_status |= remove_item(new_master_password, (int)lib_size);
+    if (ret_status != 0) {
+        error_print("[TEST] Fail to read and add items asynchronously.");
+        return 1;
+    }
+
+    // adds through two handles on one file at once both land, and an
+    // overlong master-password is refused rather than cut short
+    strcpy(async_items[0].title, "first handle");
+    strcpy(async_items[1].title, "second handle");
+    ret_status = lw_executor_create(2, &executor) != LW_OK;
+    ret_status |= lw_add_async(executor, async_wallets[0], &async_items[0], 1, record_status, &async_status[0]);
+    ret_status |= lw_add_async(executor, async_wallets[1], &async_items[1], 1, record_status, &async_status[1]);
+    ret_status |= lw_unlock_async(executor, async_wallets[2], overlong, record_status, &async_status[2]);
+    lw_executor_destroy(executor);
+    ret_status |= async_status[0] != LW_OK || async_status[1] != LW_OK || async_status[2] != LW_ERR_WRONG_PASSWORD;
+    ret_status |= lw_count(async_wallets[0], &lib_count) != LW_OK || lib_count != lib_size + 2;
+    ret_status |= remove_item(new_master_password, (int)lib_size + 1);
+    ret_status |= remove_item(new_master_password, (int)lib_size);
+    if (ret_status != 0) {
+        error_print("[TEST] Fail to add items through two handles at once.");
+        return 1;
+    }
+
+#ifdef __cpp_impl_coroutine
+    // the same calls, awaited
+    int coroutine_status = -1;
+    ret_status = lw_executor_create(1, &executor) != LW_OK;
+    fetch_first_item(executor, async_wallets[2], new_master_password, &async_items[0], &coroutine_status);
+    lw_executor_destroy(executor);
+    if (ret_status != 0 || coroutine_status != LW_OK || strcmp(async_items[0].title, async_items[2].title) != 0) {
+        error_print("[TEST] Fail to await library calls.");
+        return 1;
+    }
+#endif
+    for (int i = 0; i < 3; ++i) {lw_close(async_wallets[i]);}
+    secure_free(async_items);
+    info_print("[TEST] Wallet successfully used asynchronously.");
+
+
+    ////////////////////////////////////////////////
+    // test password generator
+    ////////////////////////////////////////////////
+    // blocks computed four at a time match blocks computed one by one,
+    // and the keystream encrypts the RFC 8439 vector
+    uint8_t keystream[7 * CHACHA20_BLOCK_SIZE], block[CHACHA20_BLOCK_SIZE];
+    chacha20_keystream(chacha_key, chacha_nonce, 1, keystream, sizeof(keystream));
+    ret_status = 0;
+    for (uint32_t i = 0; i < 7; ++i) {
+        chacha20_keystream(chacha_key, chacha_nonce, 1 + i, block, sizeof(block));
+        ret_status |= memcmp(keystream + i * CHACHA20_BLOCK_SIZE, block, sizeof(block)) != 0;
+    }
+    for (size_t i = 0; i < sunscreen_len; ++i) {ret_status |= (keystream[i] ^ (uint8_t)sunscreen[i]) != ciphertext[i];}
+    if (ret_status != 0) {
+        error_print("[TEST] ChaCha20 keystream does not match the test vector.");
+        return 1;
+    }
+
+    // uniform draws stay below the bound and reach every value
+    csprng_t* rng = (csprng_t*)secure_malloc(sizeof(csprng_t));
+    uint32_t drawn_values = 0, drawn = 0;
+    ret_status = csprng_init(rng);
+    for (int i = 0; i < 1000 && ret_status == 0; ++i) {
+        uint32_t bound = i % 2 == 0 ? 7 : 100000;
+        ret_status = csprng_uniform(rng, bound, &drawn) != 0 || drawn >= bound;
+        if (bound == 7) {drawn_values |= 1u << drawn;}
+    }
+    ret_status |= csprng_uniform(rng, 0, &drawn) == 0;
+    if (ret_status != 0 || drawn_values != 0x7f) {
+        error_print("[TEST] CSPRNG draws are not uniform.");
+        return 1;
+    }
+
+    // invalid policies are refused; passwords hold each class asked for
+    password_policy_t policies[4] = {
+        {20, PASSWORD_CLASSES}, {12, PASSWORD_LOWER | PASSWORD_DIGITS | PASSWORD_PRONOUNCEABLE},
+        {4, PASSWORD_CLASSES}, {MAX_ITEM_SIZE - 1, PASSWORD_LOWER | PASSWORD_UPPER | PASSWORD_PRONOUNCEABLE}
+    };
+    password_policy_t invalid[4] = {
+        {20, 0}, {3, PASSWORD_CLASSES}, {MAX_ITEM_SIZE, PASSWORD_LOWER}, {8, PASSWORD_DIGITS | PASSWORD_PRONOUNCEABLE}
+    };
+    char generated[MAX_ITEM_SIZE];
+    ret_status = 0;
+    for (int i = 0; i < 4; ++i) {
+        ret_status |= password_policy_check(&invalid[i], MAX_ITEM_SIZE) != GENERATOR_ERR_POLICY;
+        ret_status |= password_policy_check(&policies[i], MAX_ITEM_SIZE) != GENERATOR_OK;
+        for (int j = 0; j < 50 && ret_status == 0; ++j) {
+            uint32_t classes = 0, vowels = 0;
+            ret_status |= generate_password(rng, &policies[i], generated) != GENERATOR_OK;
+            ret_status |= strlen(generated) != policies[i].length;
+            for (size_t k = 0; generated[k] != '\0'; ++k) {
+                if (islower((unsigned char)generated[k])) {classes |= PASSWORD_LOWER;}
+                else if (isupper((unsigned char)generated[k])) {classes |= PASSWORD_UPPER;}
+                else if (isdigit((unsigned char)generated[k])) {classes |= PASSWORD_DIGITS;}
+                else if (strchr(PASSWORD_SYMBOL_SET, generated[k]) != NULL) {classes |= PASSWORD_SYMBOLS;}
+                vowels += k % 2 == 1 && strchr("aeiouAEIOU", generated[k]) != NULL;
+            }
+            ret_status |= classes != (policies[i].flags & PASSWORD_CLASSES);
+            // pronounceable: a vowel in every odd position, but the one
+            // a digit may have taken
+            if (policies[i].flags & PASSWORD_PRONOUNCEABLE) {ret_status |= vowels + 1 < policies[i].length / 2;}
+        }
+    }
+    csprng_free(rng);
+    secure_free(rng);
+    if (ret_status != 0) {
+        error_print("[TEST] Fail to generate passwords.");
+        return 1;
+    }
+
+    // a batch added with generated passwords, then the same through
+    // the library; the saved passwords are those handed back
+    item_t* generated_items = (item_t*)secure_malloc(2 * sizeof(item_t));
+    lw_item_t* generated_lib = (lw_item_t*)secure_malloc(2 * sizeof(lw_item_t));
+    memset(generated_items, 0, 2 * sizeof(item_t));
+    memset(generated_lib, 0, 2 * sizeof(lw_item_t));
+    strcpy(generated_items[0].title, "generated 0");
+    strcpy(generated_items[1].title, "generated 1");
+    strcpy(generated_lib[0].title, "generated 2");
+    ret_status = add_items(WALLET_FILE, new_master_password, generated_items, 2, &invalid[1]) != ERR_INVALID_PASSWORD_POLICY;
+    ret_status |= add_items(WALLET_FILE, new_master_password, generated_items, 2, &policies[0]);
+    ret_status |= strlen(generated_items[0].password) != 20 ||
+        strcmp(generated_items[0].password, generated_items[1].password) == 0;
+    ret_status |= lw_open(WALLET_FILE, &lib) != LW_OK || lw_unlock(lib, new_master_password) != LW_OK;
+    ret_status |= lw_add_generated(lib, generated_lib, 1, 3, LW_PASSWORD_LOWER | LW_PASSWORD_UPPER | LW_PASSWORD_DIGITS | LW_PASSWORD_SYMBOLS) != LW_ERR_INVALID_POLICY;
+    ret_status |= lw_add_generated(lib, generated_lib, 1, 16, LW_PASSWORD_LOWER | LW_PASSWORD_PRONOUNCEABLE) != LW_OK;
+    ret_status |= strlen(generated_lib[0].password) != 16;
+    ret_status |= lw_get(lib, lib_size + 1, &generated_lib[1]) != LW_OK ||
+        strcmp(generated_lib[1].password, generated_items[1].password) != 0;
+    ret_status |= lw_get(lib, lib_size + 2, &generated_lib[1]) != LW_OK ||
+        strcmp(generated_lib[1].password, generated_lib[0].password) != 0;
+    const uint32_t generated_indexes[3] = {(uint32_t)lib_size, (uint32_t)lib_size + 1, (uint32_t)lib_size + 2};
+    ret_status |= lw_remove(lib, generated_indexes, 3) != LW_OK;
+    ret_status |= lw_count(lib, &lib_count) != LW_OK || lib_count != lib_size;
+    lw_close(lib);
+    secure_free(generated_lib);
+    secure_free(generated_items);
+    if (ret_status != 0) {
+        error_print("[TEST] Fail to add items with generated passwords.");
+        return 1;
+    }
+    info_print("[TEST] Passwords successfully generated.");
 
 
     return 0;
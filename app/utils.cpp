@@ -18,9 +18,12 @@
  */
 #include <stdio.h>
 #include <cstring>
+#include <time.h>
 
 #include "utils.h"
 #include "../wallet/wallet.h"
+#include "../wallet/arena.h"
+#include "ecalls.h"
 
 
 /**
@@ -50,6 +53,26 @@ void error_print(const char* str) {
 }
 
 
+/**
+ * @brief      Prints one item of the wallet.
+ *
+ */
+static void print_item(int index, const item_t* item) {
+    printf("#%d -- %s\n", index, item->title);
+    printf("[username:] %s\n", item->username);
+    printf("[password:] %s\n", item->password);
+    if (item->tags[0] != '\0') {printf("[tags:] %s\n", item->tags);}
+    if (item->blob != 0) {printf("[blob:] %llu bytes\n", (unsigned long long)item->blob_size);}
+    if (item->expires != 0) {
+        char date[32];
+        time_t expires = (time_t)item->expires;
+        strftime(date, sizeof(date), "%Y-%m-%d", localtime(&expires));
+        printf("[expires:] %s\n", date);
+    }
+    printf("\n");
+}
+
+
 /**
  * @brief      Prints the wallet's content.
  *
@@ -59,16 +82,192 @@ void print_wallet(const wallet_t* wallet) {
     printf("%s v%s\n", APP_NAME, VERSION);
     printf("Simple password wallet.\n\n");
     printf("Number of items: %lu\n\n", wallet->size);
-    for (int i = 0; i < wallet->size; ++i) {
-        printf("#%d -- %s\n", i, wallet->items[i].title);
-        printf("[username:] %s\n", wallet->items[i].username);
-        printf("[password:] %s\n", wallet->items[i].password);
+    for (int i = 0; i < wallet->size && i < MAX_ITEMS; ++i) {
+        print_item(i, &wallet->items[i]);
+    }
+    printf("\n------------------------------------------\n\n");
+}
+
+
+/**
+ * @brief      Prints the items of a store, paging them in one at a
+ *             time; only the store's budget is ever decrypted.
+ *
+ */
+int print_item_store(item_store_t* store) {
+    item_t* item = (item_t*)secure_malloc(sizeof(item_t));
+    if (item == NULL) {return 1;}
+    printf("\n-----------------------------------------\n\n");
+    printf("%s v%s\n", APP_NAME, VERSION);
+    printf("Simple password wallet.\n\n");
+    printf("Number of items: %u\n\n", store->capacity);
+    int ret = 0;
+    for (uint32_t i = 0; i < store->capacity && ret == 0; ++i) {
+        ret = ecall_item_store_get(store, i, item) == PAGER_OK ? 0 : 1;
+        if (ret == 0) {print_item((int)i, item);}
+    }
+    printf("\n------------------------------------------\n\n");
+    secure_free(item);
+    return ret;
+}
+
+
+/**
+ * @brief      Prints the wallet's previous versions.
+ *
+ */
+void print_snapshots(const snapshot_t* snapshots, size_t count) {
+    char date[32];
+    printf("\n-----------------------------------------\n\n");
+    printf("Number of snapshots: %zu\n\n", count);
+    for (size_t i = 0; i < count; ++i) {
+        time_t timestamp = (time_t)snapshots[i].timestamp;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&timestamp));
+        printf("#%llu -- %u items, replaced %s\n", (unsigned long long)snapshots[i].version, snapshots[i].size, date);
+    }
+    printf("\n------------------------------------------\n\n");
+}
+
+
+/**
+ * @brief      Prints the items due for rotation, soonest first.
+ *
+ */
+void print_expiring(const expiring_t* items, size_t count) {
+    char date[32];
+    int64_t now = (int64_t)time(NULL);
+    printf("\n-----------------------------------------\n\n");
+    printf("Number of expiring items: %zu\n\n", count);
+    for (size_t i = 0; i < count; ++i) {
+        time_t expires = (time_t)items[i].expires;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&expires));
+        printf("#%u -- %s\n", items[i].index, items[i].title);
+        printf("[%s:] %s\n", items[i].expires <= now ? "expired" : "expires", date);
         printf("\n");
     }
     printf("\n------------------------------------------\n\n");
 }
 
 
+/**
+ * @brief      Prints what a merge compared and exchanged.
+ *
+ */
+void print_merge(const merge_stats_t* stats) {
+    printf("\n-----------------------------------------\n\n");
+    printf("Tree nodes compared: %u\n", stats->nodes);
+    printf("Buckets differing: %u\n", stats->leaves);
+    printf("Entries exchanged: %u\n", stats->entries);
+    printf("Taken from the replica: %u\n", stats->pulled);
+    printf("Sent to the replica: %u\n", stats->pushed);
+    printf("Bytes exchanged: %llu\n", (unsigned long long)stats->bytes);
+    printf("\n------------------------------------------\n\n");
+}
+
+
+/**
+ * @brief      Prints the aggregated outcome of a run across wallet
+ *             files.
+ *
+ */
+void print_fleet(const fleet_report_t* report, int operation) {
+    printf("\n-----------------------------------------\n\n");
+    printf("Wallet files processed: %zu\n", report->files);
+    printf("Holding the credential: %zu\n", report->matched);
+    printf("Items %s: %zu\n", operation == FLEET_ROTATE ? "rotated" : "found", report->items);
+    printf("Other master-password: %zu\n", report->locked);
+    printf("Failed: %zu\n", report->failed);
+    printf("Elapsed: %.3f s (%.0f files/s, %zu stolen)\n", report->seconds,
+        report->seconds > 0 ? report->files / report->seconds : 0.0, report->steals);
+    printf("\n------------------------------------------\n\n");
+}
+
+
+/**
+ * @brief      Prints the outcome of an access log verification, and
+ *             the last operations recorded.
+ *
+ */
+void print_access_log(const access_log_report_t* report, const access_record_t* records, size_t count) {
+    static const char* operations[] = {"?", "show", "add", "remove", "update", "change-password", "restore", "merge",
+        "rotate"};
+    static const char* problems[] = {"none", "cannot be read", "broken chain", "bad seal"};
+    char date[32];
+    printf("\n-----------------------------------------\n\n");
+    printf("Operations recorded: %llu\n", (unsigned long long)report->entries);
+    printf("Seals: %llu\n", (unsigned long long)report->seals);
+    printf("Not sealed yet: %llu\n", (unsigned long long)report->unsealed);
+    printf("Problem: %s", problems[report->status]);
+    if (report->first_bad != 0) {printf(" (record %llu)", (unsigned long long)report->first_bad);}
+    printf("\n\n");
+    for (size_t i = 0; i < count; ++i) {
+        time_t when = (time_t)records[i].timestamp;
+        uint32_t operation = records[i].operation <= ACCESS_ROTATE ? records[i].operation : 0;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&when));
+        printf("%s uid %u pid %u -- %s", date, records[i].uid, records[i].pid, operations[operation]);
+        if (records[i].item >= 0) {
+            printf(" #%d [%016llx]", records[i].item, (unsigned long long)records[i].item_id);
+        }
+        printf("%s\n", records[i].status == RET_SUCCESS ? "" : " (denied)");
+    }
+    printf("\n------------------------------------------\n\n");
+}
+
+
+/**
+ * @brief      Prints the items matching a search.
+ *
+ */
+void print_search(const uint32_t* indexes, const item_t* items, size_t count) {
+    printf("\n-----------------------------------------\n\n");
+    printf("Number of matches: %zu\n\n", count);
+    for (size_t i = 0; i < count; ++i) {
+        printf("#%u -- %s\n", indexes[i], items[i].title);
+        printf("[username:] %s\n", items[i].username);
+        printf("[password:] %s\n", items[i].password);
+        printf("[tags:] %s\n", items[i].tags);
+        printf("\n");
+    }
+    printf("\n------------------------------------------\n\n");
+}
+
+
+/**
+ * @brief      Prints the items flagged by an audit.
+ *
+ */
+size_t print_audit(const audit_result_t* results, size_t count) {
+    size_t flagged = 0;
+    printf("\n-----------------------------------------\n\n");
+    for (size_t i = 0; i < count; ++i) {
+        if (!results[i].breached && results[i].reused_with < 0) {continue;}
+        printf("#%zu -- %s\n", i, results[i].title);
+        if (results[i].breached) {printf("[breached:] password found in the breach corpus\n");}
+        if (results[i].reused_with >= 0) {printf("[reused:] same password as #%d\n", results[i].reused_with);}
+        printf("\n");
+        ++flagged;
+    }
+    printf("Items audited: %zu, flagged: %zu\n", count, flagged);
+    printf("\n------------------------------------------\n\n");
+    return flagged;
+}
+
+
+/**
+ * @brief      Streams a blob from or to a stdio file.
+ *
+ */
+long file_source(void* ctx, uint8_t* buf, size_t len) {
+    FILE* file = (FILE*)ctx;
+    size_t n = fread(buf, 1, len, file);
+    return (n == 0 && ferror(file)) ? -1 : (long)n;
+}
+
+int file_sink(void* ctx, const uint8_t* data, size_t len) {
+    return fwrite(data, 1, len, (FILE*)ctx) == len ? 0 : -1;
+}
+
+
 /**
  * @brief      Prints an error message correspondig to the
  *             error code.
@@ -114,6 +313,38 @@ int is_error(int error_code) {
             sprintf(err_message, "Item too longth (maximum size: %d).", MAX_ITEM_SIZE); 
             break;
 
+        case ERR_CANNOT_LOAD_CORPUS:
+            strcpy(err_message, "Could not load the breach corpus.");
+            break;
+
+        case ERR_TOO_MANY_TAGS:
+            strcpy(err_message, "The wallet cannot hold more distinct tags.");
+            break;
+
+        case ERR_INVALID_QUERY:
+            strcpy(err_message, "Malformed query.");
+            break;
+
+        case ERR_BLOB_DOES_NOT_EXIST:
+            strcpy(err_message, "Item has no blob attached.");
+            break;
+
+        case ERR_CANNOT_SAVE_BLOB:
+            strcpy(err_message, "Could not save the blob.");
+            break;
+
+        case ERR_CANNOT_LOAD_BLOB:
+            strcpy(err_message, "Could not load the blob: missing, damaged or tampered with.");
+            break;
+
+        case ERR_INVALID_PASSWORD_POLICY:
+            strcpy(err_message, "The password policy cannot be met.");
+            break;
+
+        case ERR_SNAPSHOT_DOES_NOT_EXIST:
+            sprintf(err_message, "Snapshot does not exist (only the last %d versions are kept).", HISTORY_DEPTH);
+            break;
+
         default:
             sprintf(err_message, "Unknown error."); 
     }
@@ -129,10 +360,21 @@ int is_error(int error_code) {
  *
  */
 void show_help() {
-	const char* command = "[-h Show this screen] [-v Show version] [-t Run tests] " \
-		"[-n master-password] [-p master-password -c new-master-password]" \
-		"[-p master-password -a -x items_title -y items_username -z toitems_password]" \
-		"[-p master-password -r items_index]";
+	const char* command = "[-h Show this screen] [-v Show version] [-t Run tests] [-b Run benchmarks] " \
+		"[-n master-password] [-p master-password -s Show [-K budget_bytes Page items in]] "\
+		"[-p master-password -c new-master-password] [-p master-password -U Migrate a legacy wallet]" \
+		"[-p master-password -a -x items_title -y items_username -z toitems_password [-g tag1,tag2] [-E expires_in_days]]" \
+		"[-p master-password -a -x items_title -y items_username -G length[:luds][p] Generate the password [-g tags] [-E days]]" \
+		"[-p master-password -m items_index -x items_title -y items_username -z items_password [-g tags] [-E days]]" \
+		"[-p master-password -r items_index]" \
+		"[-p master-password -l List snapshots] [-p master-password -u snapshot_version]" \
+		"[-V file_or_directory [-F Repair] [-j threads]] [-p master-password -A breach_corpus]" \
+		"[-p master-password -q \"tag1 AND tag2 AND NOT tag3\"]" \
+		"[-p master-password -W days List items expiring] [-p master-password -D Monitor expirations [-W lead_days]]" \
+		"[-p master-password -M replica_file Merge with a replica]" \
+		"[-p master-password -B items_index -i file Attach a blob | -o file Extract the blob]" \
+		"[-p master-password -R directory_or_@list -x title_pattern [-y username_pattern] [-z new_password Rotate] [-j threads]]" \
+		"[-L access_log Verify [-j threads]]";
 	printf("\nusage: %s %s\n\n", APP_NAME, command);
 }
 
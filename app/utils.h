@@ -20,6 +20,9 @@
 #define UTIL_H_
 
 #include "../wallet/wallet.h"
+#include "fleet.h"
+#include "../wallet/accesslog.h"
+#include "../wallet/pager.h"
 
 
 /***************************************************
@@ -27,6 +30,8 @@
  ***************************************************/
 #define APP_NAME "wallet"
 #define VERSION "0.0.1"
+#define ACCESS_LOG_TAIL 20	// access log entries printed
+#define SECONDS_PER_DAY 86400
 
 
 /***************************************************
@@ -73,6 +78,113 @@ void error_print(const char* str);
 void print_wallet(const wallet_t* wallet);
 
 
+/**
+ * @brief      Prints the items of a store, paging them in one at a
+ *             time through the enclave.
+ *
+ * @param      store    The store to print out
+ *
+ * @return     0 if every item was read, 1 otherwise.
+ */
+int print_item_store(item_store_t* store);
+
+
+/**
+ * @brief      Prints the wallet's previous versions.
+ *
+ * @param[in]  snapshots    The versions, newest first
+ * @param[in]  count        The number of versions
+ *
+ * @return     -
+ */
+void print_snapshots(const snapshot_t* snapshots, size_t count);
+
+
+/**
+ * @brief      Prints the items due for rotation, soonest first.
+ *
+ * @param[in]  items    The expiring items
+ * @param[in]  count    The number of items
+ *
+ * @return     -
+ */
+void print_expiring(const expiring_t* items, size_t count);
+
+
+/**
+ * @brief      Prints what a merge compared and exchanged.
+ *
+ * @param[in]  stats    The merge statistics
+ *
+ * @return     -
+ */
+void print_merge(const merge_stats_t* stats);
+
+
+/**
+ * @brief      Prints the aggregated outcome of a run across wallet
+ *             files.
+ *
+ * @param[in]  report       The outcome
+ * @param[in]  operation    The FLEET_* operation run
+ *
+ * @return     -
+ */
+void print_fleet(const fleet_report_t* report, int operation);
+
+
+/**
+ * @brief      Prints the outcome of an access log verification, and
+ *             the last operations recorded.
+ *
+ * @param[in]  report     The outcome
+ * @param[in]  records    The last entries, oldest first
+ * @param[in]  count      The number of entries
+ *
+ * @return     -
+ */
+void print_access_log(const access_log_report_t* report, const access_record_t* records, size_t count);
+
+
+/**
+ * @brief      Prints the items matching a search.
+ *
+ * @param[in]  indexes    The positions of the items in the wallet
+ * @param[in]  items      The items
+ * @param[in]  count      The number of items
+ *
+ * @return     -
+ */
+void print_search(const uint32_t* indexes, const item_t* items, size_t count);
+
+
+/**
+ * @brief      Prints the items flagged by an audit.
+ *
+ * @param[in]  results    The audit results, one per item
+ * @param[in]  count      The number of items
+ *
+ * @return     The number of items flagged.
+ */
+size_t print_audit(const audit_result_t* results, size_t count);
+
+
+/**
+ * @brief      Streams a blob from or to a stdio file: plugs a FILE*
+ *             into attach_blob and read_blob.
+ *
+ * @param      ctx    The FILE*
+ * @param      buf    The bytes read, up to 'len'
+ * @param[in]  data   The bytes to write
+ * @param[in]  len    The number of bytes
+ *
+ * @return     file_source: the bytes read, 0 at the end, -1 on error;
+ *             file_sink: 0 if successful, -1 otherwise.
+ */
+long file_source(void* ctx, uint8_t* buf, size_t len);
+int file_sink(void* ctx, const uint8_t* data, size_t len);
+
+
 /**
  * @brief      Prints an error message correspondig to the
  *			   error code.
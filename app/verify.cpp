@@ -0,0 +1,205 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <stdio.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "verify.h"
+#include "utils.h"
+#include "../wallet/wallet.h"
+#include "../wallet/arena.h"
+#include "../wallet/format.h"
+
+using namespace std;
+
+#define VERIFY_QUEUE_DEPTH 256	// paths buffered between walker and workers
+
+
+/***************************************************
+ * Work queue
+ ***************************************************/
+// paths produced by the directory walk, consumed by the workers
+struct VerifyQueue {
+	mutex lock;
+	condition_variable not_empty, not_full;
+	deque<string> paths;
+	int done = 0;
+
+	// totals
+	size_t files = 0, intact = 0, damaged = 0, repaired = 0;
+};
+
+static void push_path(struct VerifyQueue* queue, const string& path) {
+	unique_lock<mutex> guard(queue->lock);
+	queue->not_full.wait(guard, [queue] {return queue->paths.size() < VERIFY_QUEUE_DEPTH;});
+	queue->paths.push_back(path);
+	queue->not_empty.notify_one();
+}
+
+static int pop_path(struct VerifyQueue* queue, string* path) {
+	unique_lock<mutex> guard(queue->lock);
+	queue->not_empty.wait(guard, [queue] {return !queue->paths.empty() || queue->done;});
+	if (queue->paths.empty()) {return 0;}
+	*path = queue->paths.front();
+	queue->paths.pop_front();
+	queue->not_full.notify_one();
+	return 1;
+}
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+static const char* format_error(int status) {
+	switch (status) {
+		case FORMAT_OK: return "intact";
+		case FORMAT_ERR_IO: return "unreadable";
+		case FORMAT_ERR_MAGIC: return "not a wallet file";
+		case FORMAT_ERR_VERSION: return "incompatible version";
+		case FORMAT_ERR_CHECKSUM: return "checksum mismatch";
+		case FORMAT_ERR_LAYOUT: return "inconsistent layout";
+		case FORMAT_ERR_NO_SECTION: return "missing section";
+		case FORMAT_ERR_MAC: return "authentication failed";
+		case FORMAT_ERR_KEY: return "sealing key unavailable";
+		case FORMAT_ERR_LEGACY: return "legacy image, to be migrated with -U";
+		default: return "unknown error";
+	}
+}
+
+static int is_wallet_file(const char* name) {
+	const char* extension = strrchr(WALLET_FILE, '.');
+	size_t len = strlen(name), ext_len = strlen(extension);
+	return len > ext_len && strcmp(name + len - ext_len, extension) == 0;
+}
+
+/**
+ * @brief      Walks a directory tree and queues every wallet file.
+ *
+ */
+static void walk(struct VerifyQueue* queue, const string& path) {
+	struct stat st;
+	if (lstat(path.c_str(), &st) != 0) {return;}
+	if (S_ISREG(st.st_mode)) {
+		push_path(queue, path);
+		return;
+	}
+	if (!S_ISDIR(st.st_mode)) {return;}
+	DIR* dir = opendir(path.c_str());
+	if (dir == NULL) {return;}
+	struct dirent* entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {continue;}
+		string child = path + "/" + entry->d_name;
+		if (entry->d_type == DT_DIR) {walk(queue, child);}
+		else if ((entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN) && is_wallet_file(entry->d_name)) {
+			if (entry->d_type == DT_REG || (lstat(child.c_str(), &st) == 0 && S_ISREG(st.st_mode))) {
+				push_path(queue, child);
+			}
+		}
+	}
+	closedir(dir);
+}
+
+/**
+ * @brief      Keeps the damaged file aside and writes the salvaged
+ *             records in its place.
+ *
+ */
+static int repair_file(const string& path, const wallet_t* wallet) {
+	string aside = path + ".corrupt";
+	if (rename(path.c_str(), aside.c_str()) != 0) {return 1;}
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == NULL) {
+		rename(aside.c_str(), path.c_str());
+		return 1;
+	}
+	int ret = write_wallet_file(file, wallet);
+	if (fclose(file) != 0) {ret = 1;}
+	return ret != FORMAT_OK;
+}
+
+static void worker(struct VerifyQueue* queue, int repair) {
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	verify_report_t report;
+	string path;
+	char message[512];
+
+	while (pop_path(queue, &path)) {
+		int status = FORMAT_ERR_IO, repaired = 0;
+		FILE* file = fopen(path.c_str(), "r");
+		if (file != NULL) {
+			status = verify_wallet_file(file, wallet, &report);
+			fclose(file);
+		}
+		else {
+			memset(&report, 0, sizeof(report));
+		}
+
+		// salvage what can be, provided the master-password survived
+		if (status != FORMAT_OK && repair && report.meta_intact && !report.legacy) {
+			repaired = repair_file(path, wallet) == 0;
+		}
+
+		lock_guard<mutex> guard(queue->lock);
+		++queue->files;
+		if (status == FORMAT_OK) {
+			++queue->intact;
+			continue;
+		}
+		++queue->damaged;
+		queue->repaired += repaired;
+		snprintf(message, sizeof(message), "%s: %s (%u/%u records intact)%s", path.c_str(),
+			format_error(status), report.intact, report.items, repaired ? ", repaired" : "");
+		warning_print(message);
+	}
+	secure_free(wallet);
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int verify_tree(const char* path, int repair, int threads) {
+	struct VerifyQueue queue;
+	if (threads <= 0) {threads = (int)thread::hardware_concurrency();}
+	if (threads <= 0) {threads = 1;}
+
+	vector<thread> workers;
+	for (int i = 0; i < threads; ++i) {workers.push_back(thread(worker, &queue, repair));}
+	walk(&queue, path);
+	{
+		lock_guard<mutex> guard(queue.lock);
+		queue.done = 1;
+		queue.not_empty.notify_all();
+	}
+	for (size_t i = 0; i < workers.size(); ++i) {workers[i].join();}
+
+	char message[256];
+	snprintf(message, sizeof(message), "%zu files verified: %zu intact, %zu damaged, %zu repaired.",
+		queue.files, queue.intact, queue.damaged, queue.repaired);
+	info_print(message);
+	return queue.damaged != queue.repaired;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef VERIFY_H_
+#define VERIFY_H_
+
+
+/**
+ * @brief      Verifies every wallet file (*.seal) under a directory,
+ *             or a single file. Files are streamed from the directory
+ *             walk to a pool of worker threads through a bounded
+ *             queue, so memory stays constant whatever the tree size.
+ *
+ * @param[in]  path       The directory or file to verify
+ * @param[in]  repair     Truthy to salvage the intact records of
+ *                        damaged files; the original is kept next to
+ *                        it with a '.corrupt' suffix
+ * @param[in]  threads    The number of workers, 0 for one per core
+ *
+ * @return     0 if every file is intact (or was repaired), 1 otherwise.
+ */
+int verify_tree(const char* path, int repair, int threads);
+
+
+#endif // VERIFY_H_
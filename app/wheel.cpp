@@ -0,0 +1,96 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+
+#include "wheel.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+static void place(timer_wheel_t* wheel, wheel_timer_t* timer) {
+	int64_t delta = timer->deadline - wheel->now;
+	int level = 0;
+	while (level < WHEEL_LEVELS - 1 && delta >= ((int64_t)1 << (WHEEL_BITS * (level + 1)))) {++level;}
+	int slot = (int)((timer->deadline >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+	timer->next = wheel->slots[level][slot];
+	wheel->slots[level][slot] = timer;
+}
+
+/**
+ * @brief      Re-places the timers of a higher-level slot once the
+ *             wheel enters the span it covers.
+ *
+ */
+static void cascade(timer_wheel_t* wheel, int level) {
+	int slot = (int)((wheel->now >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+	wheel_timer_t* timer = wheel->slots[level][slot];
+	wheel->slots[level][slot] = NULL;
+	while (timer != NULL) {
+		wheel_timer_t* next = timer->next;
+		place(wheel, timer);
+		timer = next;
+	}
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+void wheel_init(timer_wheel_t* wheel, int64_t now) {
+	memset(wheel, 0, sizeof(timer_wheel_t));
+	wheel->now = now;
+}
+
+void wheel_add(timer_wheel_t* wheel, wheel_timer_t* timer) {
+	if (timer->deadline <= wheel->now) {timer->deadline = wheel->now + 1;}
+	place(wheel, timer);
+	++wheel->pending;
+}
+
+size_t wheel_advance(timer_wheel_t* wheel, int64_t now, timer_fn fire, void* ctx) {
+	size_t fired = 0;
+	// nothing scheduled: jump straight to the new tick
+	if (wheel->pending == 0 && now > wheel->now) {wheel->now = now;}
+	while (wheel->now < now) {
+		++wheel->now;
+
+		// entering a new span of a higher level: bring its timers down,
+		// highest level first
+		int top = 0;
+		while (top < WHEEL_LEVELS - 1 && (wheel->now & (((int64_t)1 << (WHEEL_BITS * (top + 1))) - 1)) == 0) {++top;}
+		for (int level = top; level > 0; --level) {cascade(wheel, level);}
+
+		// level 0 holds the timers due on this very tick
+		int slot = (int)(wheel->now & (WHEEL_SLOTS - 1));
+		wheel_timer_t* timer = wheel->slots[0][slot];
+		wheel->slots[0][slot] = NULL;
+		while (timer != NULL) {
+			wheel_timer_t* next = timer->next;
+			--wheel->pending;
+			++fired;
+			fire(timer, ctx);
+			timer = next;
+		}
+		if (wheel->pending == 0) {wheel->now = now;}
+	}
+	return fired;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef WHEEL_H_
+#define WHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+// hierarchical timer wheel: each level has WHEEL_SLOTS slots, and one
+// slot of level n spans a whole turn of level n-1
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 6		// 2^36 ticks ahead
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// pending timer, owned by the caller
+struct Timer {
+	int64_t deadline;		// tick at which the timer fires
+	uint32_t id;
+	struct Timer* next;
+};
+typedef struct Timer wheel_timer_t;
+
+// timer wheel
+struct TimerWheel {
+	int64_t now;			// last tick processed
+	size_t pending;
+	struct Timer* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+typedef struct TimerWheel timer_wheel_t;
+
+typedef void (*timer_fn)(wheel_timer_t* timer, void* ctx);
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Starts an empty wheel at a given tick.
+ *
+ * @param[out] wheel    The wheel
+ * @param[in]  now      The current tick
+ *
+ * @return     -
+ */
+void wheel_init(timer_wheel_t* wheel, int64_t now);
+
+
+/**
+ * @brief      Schedules a timer in O(1). Deadlines already past fire
+ *             on the next tick.
+ *
+ * @param      wheel    The wheel
+ * @param      timer    The timer, which must outlive its scheduling
+ *
+ * @return     -
+ */
+void wheel_add(timer_wheel_t* wheel, wheel_timer_t* timer);
+
+
+/**
+ * @brief      Advances the wheel and fires the timers that are due,
+ *             in deadline order. Only the slots reached are visited:
+ *             timers further ahead are not looked at until their
+ *             slot of a higher level cascades down.
+ *
+ * @param      wheel    The wheel
+ * @param[in]  now      The current tick
+ * @param[in]  fire     Called for every timer that expires
+ * @param      ctx      Passed to 'fire'
+ *
+ * @return     The number of timers fired.
+ */
+size_t wheel_advance(timer_wheel_t* wheel, int64_t now, timer_fn fire, void* ctx);
+
+
+#endif // WHEEL_H_
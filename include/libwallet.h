@@ -0,0 +1,371 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LIBWALLET_H_
+#define LIBWALLET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+// bumped whenever a type or a function below changes incompatibly
+#define LW_ABI_VERSION 1
+#define LW_FIELD_SIZE 100	// fields of an item, terminator included
+#define LW_EXECUTOR_MAX_THREADS 64
+
+// the library is built with -fvisibility=hidden: only the calls below
+// are exported
+#if defined(__GNUC__)
+#define LW_API __attribute__((visibility("default")))
+#else
+#define LW_API
+#endif
+
+// what generated passwords are made of
+#define LW_PASSWORD_LOWER 0x01
+#define LW_PASSWORD_UPPER 0x02
+#define LW_PASSWORD_DIGITS 0x04
+#define LW_PASSWORD_SYMBOLS 0x08
+#define LW_PASSWORD_PRONOUNCEABLE 0x10	// alternate consonants and vowels
+
+// errors; their values never change
+#define LW_OK 0
+#define LW_ERR_INVALID_ARGUMENT 1		// a NULL handle or pointer
+#define LW_ERR_LOCKED 2					// the wallet is not unlocked
+#define LW_ERR_NO_MEMORY 3
+#define LW_ERR_CANNOT_LOAD 4			// the wallet file cannot be read or is corrupted
+#define LW_ERR_CANNOT_SAVE 5
+#define LW_ERR_WRONG_PASSWORD 6
+#define LW_ERR_PASSWORD_OUT_OF_RANGE 7
+#define LW_ERR_WALLET_FULL 8
+#define LW_ERR_NO_SUCH_ITEM 9
+#define LW_ERR_ITEM_TOO_LONG 10
+#define LW_ERR_TOO_MANY_TAGS 11
+#define LW_ERR_INVALID_QUERY 12
+#define LW_ERR_BUFFER_TOO_SMALL 13		// the count returned is the size needed
+#define LW_ERR_INVALID_POLICY 14		// a password policy that cannot be met
+#define LW_ERR_INTERNAL 99				// an error this version cannot name
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// a wallet file, opaque to callers
+typedef struct LibWallet lw_wallet_t;
+
+// an item; dates are in seconds since the epoch. Items given to lw_add
+// only need their title, username, password, tags and expiry date
+struct LwItem {
+	char title[LW_FIELD_SIZE];
+	char username[LW_FIELD_SIZE];
+	char password[LW_FIELD_SIZE];
+	char tags[LW_FIELD_SIZE];		// separated by commas
+	int64_t created;
+	int64_t modified;
+	int64_t expires;				// 0 for never
+	uint64_t id;
+	uint64_t revision;
+};
+typedef struct LwItem lw_item_t;
+
+// runs wallet calls off the caller's thread, opaque to callers
+typedef struct LwExecutor lw_executor_t;
+
+// tells that an asynchronous call completed, with its LW_* status; runs
+// on an executor thread
+typedef void (*lw_done_fn)(void* ctx, int status);
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+// Every function is safe to call from several threads on the same
+// handle; calls on one handle are serialized.
+
+/**
+ * @brief      Tells which ABI the library implements; callers compare
+ *             it with the LW_ABI_VERSION they were built against.
+ *
+ * @return     The ABI version.
+ */
+LW_API int lw_abi_version(void);
+
+
+/**
+ * @brief      Describes an error.
+ *
+ * @param[in]  error    The LW_* error
+ *
+ * @return     A static string.
+ */
+LW_API const char* lw_strerror(int error);
+
+
+/**
+ * @brief      Opens the wallet stored at a given path, locked.
+ *
+ * @param[in]  path      The wallet file
+ * @param[out] wallet    The handle, to release with lw_close
+ *
+ * @return     LW_OK if successful, LW_ERR_* otherwise.
+ */
+LW_API int lw_open(const char* path, lw_wallet_t** wallet);
+
+
+/**
+ * @brief      Unlocks a wallet: it is loaded once and kept in step
+ *             with its file, so that reads do not load it again.
+ *
+ * @param      wallet             The handle
+ * @param[in]  master_password    The master-password
+ *
+ * @return     LW_OK if successful, LW_ERR_* otherwise.
+ */
+LW_API int lw_unlock(lw_wallet_t* wallet, const char* master_password);
+
+
+/**
+ * @brief      Counts the items of an unlocked wallet.
+ *
+ * @param      wallet    The handle
+ * @param[out] count     The number of items
+ *
+ * @return     LW_OK if successful, LW_ERR_* otherwise.
+ */
+LW_API int lw_count(lw_wallet_t* wallet, size_t* count);
+
+
+/**
+ * @brief      Reads an item of an unlocked wallet.
+ *
+ * @param      wallet    The handle
+ * @param[in]  index     The item index
+ * @param[out] item      The item
+ *
+ * @return     LW_OK if successful, LW_ERR_* otherwise.
+ */
+LW_API int lw_get(lw_wallet_t* wallet, size_t index, lw_item_t* item);
+
+
+/**
+ * @brief      Finds the items of an unlocked wallet whose tags match a
+ *             query such as "prod AND db AND NOT legacy".
+ *
+ * @param      wallet     The handle
+ * @param[in]  query      The query
+ * @param[out] indexes    The indexes of the matching items, ascending
+ * @param[in]  max        The room in 'indexes'
+ * @param[out] count      The number of matching items
+ *
+ * @return     LW_OK if successful, LW_ERR_* otherwise.
+ */
+LW_API int lw_search(lw_wallet_t* wallet, const char* query, uint32_t* indexes, size_t max, size_t* count);
+
+
+/**
+ * @brief      Adds items to an unlocked wallet, saving it once; either
+ *             every item is added or none is.
+ *
+ * @param      wallet    The handle
+ * @param[in]  items     The items
+ * @param[in]  count     The number of items
+ *
+ * @return     LW_OK if successful, LW_ERR_* otherwise.
+ */
+LW_API int lw_add(lw_wallet_t* wallet, const lw_item_t* items, size_t count);
+
+
+/**
+ * @brief      Adds items to an unlocked wallet like lw_add, each with a
+ *             password drawn from a CSPRNG instead of its own; the
+ *             passwords are written back to 'items'.
+ *
+ * @param      wallet    The handle
+ * @param      items     The items
+ * @param[in]  count     The number of items
+ * @param[in]  length    The length of the passwords
+ * @param[in]  flags     LW_PASSWORD_* classes the passwords hold one
+ *                       character of at least, and
+ *                       LW_PASSWORD_PRONOUNCEABLE
+ *
+ * @return     LW_OK if successful, LW_ERR_* otherwise.
+ */
+LW_API int lw_add_generated(lw_wallet_t* wallet, lw_item_t* items, size_t count, uint32_t length, uint32_t flags);
+
+
+/**
+ * @brief      Removes items from an unlocked wallet, saving it once;
+ *             either every item is removed or none is.
+ *
+ * @param      wallet     The handle
+ * @param[in]  indexes    The indexes of the items, before the call
+ * @param[in]  count      The number of indexes
+ *
+ * @return     LW_OK if successful, LW_ERR_* otherwise.
+ */
+LW_API int lw_remove(lw_wallet_t* wallet, const uint32_t* indexes, size_t count);
+
+
+/**
+ * @brief      Closes a wallet; its unlocked copy and master-password
+ *             are wiped.
+ *
+ * @param      wallet    The handle, NULL to do nothing
+ *
+ * @return     -
+ */
+LW_API void lw_close(lw_wallet_t* wallet);
+
+
+// Asynchronous calls: each one queues the call of the same name and
+// returns at once; the call runs on an executor thread, which then
+// calls 'done'. The master-password and the items and indexes given
+// are copied when queued, so only the outputs must stay valid until
+// 'done' is called; a handle must stay open until then too. Calls on
+// different handles run in parallel, calls on one handle one at a time
+// and in no set order: wait for one before queuing the next.
+
+/**
+ * @brief      Starts an executor: a pool of threads that run
+ *             asynchronous calls, so that loading a wallet, deriving
+ *             its keys and saving it never block the caller.
+ *
+ * @param[in]  threads     The number of threads, 0 for one per core
+ * @param[out] executor    The executor, to release with
+ *                         lw_executor_destroy
+ *
+ * @return     LW_OK if successful, LW_ERR_* otherwise.
+ */
+LW_API int lw_executor_create(unsigned threads, lw_executor_t** executor);
+
+
+/**
+ * @brief      Runs the calls still queued, then stops an executor.
+ *             Not to be called from an executor thread.
+ *
+ * @param      executor    The executor, NULL to do nothing
+ *
+ * @return     -
+ */
+LW_API void lw_executor_destroy(lw_executor_t* executor);
+
+
+LW_API int lw_unlock_async(lw_executor_t* executor, lw_wallet_t* wallet, const char* master_password,
+	lw_done_fn done, void* ctx);
+LW_API int lw_get_async(lw_executor_t* executor, lw_wallet_t* wallet, size_t index, lw_item_t* item,
+	lw_done_fn done, void* ctx);
+LW_API int lw_search_async(lw_executor_t* executor, lw_wallet_t* wallet, const char* query, uint32_t* indexes,
+	size_t max, size_t* count, lw_done_fn done, void* ctx);
+LW_API int lw_add_async(lw_executor_t* executor, lw_wallet_t* wallet, const lw_item_t* items, size_t count,
+	lw_done_fn done, void* ctx);
+LW_API int lw_remove_async(lw_executor_t* executor, lw_wallet_t* wallet, const uint32_t* indexes, size_t count,
+	lw_done_fn done, void* ctx);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+/***************************************************
+ * Coroutines
+ ***************************************************/
+// With C++20 coroutines, every asynchronous call can be awaited
+// instead: 'co_await lw_await_get(executor, wallet, 0, &item)' yields
+// its LW_* status. The coroutine resumes on the executor thread that
+// ran the call; a service with a reactor posts it back there.
+#if defined(__cplusplus) && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <functional>
+
+class LwAwaitable {
+public:
+	typedef std::function<int(lw_done_fn, void*)> submit_fn;
+
+	explicit LwAwaitable(submit_fn submit) : submit(std::move(submit)), status(LW_OK) {}
+
+	bool await_ready() const noexcept {return false;}
+
+	// a call that could not be queued does not suspend. Once queued,
+	// the coroutine may resume and destroy this awaitable at any time
+	bool await_suspend(std::coroutine_handle<> handle) {
+		waiting = handle;
+		submit_fn call = std::move(submit);
+		int queued = call(&LwAwaitable::resume, this);
+		if (queued == LW_OK) {return true;}
+		status = queued;
+		return false;
+	}
+
+	int await_resume() const noexcept {return status;}
+
+private:
+	static void resume(void* ctx, int status) {
+		LwAwaitable* self = (LwAwaitable*)ctx;
+		self->status = status;
+		self->waiting.resume();
+	}
+
+	submit_fn submit;
+	std::coroutine_handle<> waiting;
+	int status;
+};
+
+// the arguments are only read when the call is queued, before the
+// awaiting coroutine suspends
+inline LwAwaitable lw_await_unlock(lw_executor_t* executor, lw_wallet_t* wallet, const char* master_password) {
+	return LwAwaitable([=](lw_done_fn done, void* ctx) {
+		return lw_unlock_async(executor, wallet, master_password, done, ctx);
+	});
+}
+
+inline LwAwaitable lw_await_get(lw_executor_t* executor, lw_wallet_t* wallet, size_t index, lw_item_t* item) {
+	return LwAwaitable([=](lw_done_fn done, void* ctx) {
+		return lw_get_async(executor, wallet, index, item, done, ctx);
+	});
+}
+
+inline LwAwaitable lw_await_search(lw_executor_t* executor, lw_wallet_t* wallet, const char* query,
+	uint32_t* indexes, size_t max, size_t* count) {
+	return LwAwaitable([=](lw_done_fn done, void* ctx) {
+		return lw_search_async(executor, wallet, query, indexes, max, count, done, ctx);
+	});
+}
+
+inline LwAwaitable lw_await_add(lw_executor_t* executor, lw_wallet_t* wallet, const lw_item_t* items, size_t count) {
+	return LwAwaitable([=](lw_done_fn done, void* ctx) {
+		return lw_add_async(executor, wallet, items, count, done, ctx);
+	});
+}
+
+inline LwAwaitable lw_await_remove(lw_executor_t* executor, lw_wallet_t* wallet, const uint32_t* indexes,
+	size_t count) {
+	return LwAwaitable([=](lw_done_fn done, void* ctx) {
+		return lw_remove_async(executor, wallet, indexes, count, done, ctx);
+	});
+}
+#endif
+
+#endif // LIBWALLET_H_
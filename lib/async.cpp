@@ -0,0 +1,187 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <new>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+#include "../include/libwallet.h"
+#include "../wallet/wallet.h"
+#include "../wallet/arena.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// one queued call; 'input' is a copy of what it reads, in secure
+// memory, wiped once the call ran
+struct AsyncJob {
+	function<int(void)> run;
+	lw_done_fn done;
+	void* ctx;
+	void* input;
+};
+
+struct LwExecutor {
+	mutex guard;
+	condition_variable wake;
+	deque<struct AsyncJob*> queue;
+	vector<thread> workers;
+	bool stopping;
+};
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+/**
+ * @brief      Runs queued calls until the executor stops and its queue
+ *             is empty.
+ *
+ */
+static void run_jobs(lw_executor_t* executor) {
+	for (;;) {
+		struct AsyncJob* job;
+		{
+			unique_lock<mutex> hold(executor->guard);
+			executor->wake.wait(hold, [executor] {return executor->stopping || !executor->queue.empty();});
+			if (executor->queue.empty()) {return;}
+			job = executor->queue.front();
+			executor->queue.pop_front();
+		}
+		int status = job->run();
+		secure_free(job->input);
+		lw_done_fn done = job->done;
+		void* ctx = job->ctx;
+		delete job;
+		if (done != NULL) {done(ctx, status);}
+	}
+}
+
+/**
+ * @brief      Queues a call; on failure its input is released.
+ *
+ */
+static int submit(lw_executor_t* executor, function<int(void)> run, void* input, lw_done_fn done, void* ctx) {
+	struct AsyncJob* job = new (nothrow) struct AsyncJob;
+	if (job == NULL) {
+		secure_free(input);
+		return LW_ERR_NO_MEMORY;
+	}
+	job->run = move(run);
+	job->done = done;
+	job->ctx = ctx;
+	job->input = input;
+	{
+		lock_guard<mutex> hold(executor->guard);
+		executor->queue.push_back(job);
+	}
+	executor->wake.notify_one();
+	return LW_OK;
+}
+
+/**
+ * @brief      Copies the input of a call into secure memory.
+ *
+ */
+static void* copy_input(const void* data, size_t len) {
+	void* copy = secure_malloc(len > 0 ? len : 1);
+	if (copy != NULL && len > 0) {memcpy(copy, data, len);}
+	return copy;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int lw_executor_create(unsigned threads, lw_executor_t** executor) {
+	if (executor == NULL) {return LW_ERR_INVALID_ARGUMENT;}
+	*executor = NULL;
+	if (threads == 0) {threads = thread::hardware_concurrency();}
+	if (threads == 0) {threads = 1;}
+	if (threads > LW_EXECUTOR_MAX_THREADS) {threads = LW_EXECUTOR_MAX_THREADS;}
+
+	lw_executor_t* created = new (nothrow) lw_executor_t;
+	if (created == NULL) {return LW_ERR_NO_MEMORY;}
+	created->stopping = false;
+	for (unsigned i = 0; i < threads; ++i) {created->workers.push_back(thread(run_jobs, created));}
+	*executor = created;
+	return LW_OK;
+}
+
+void lw_executor_destroy(lw_executor_t* executor) {
+	if (executor == NULL) {return;}
+	{
+		lock_guard<mutex> hold(executor->guard);
+		executor->stopping = true;
+	}
+	executor->wake.notify_all();
+	for (size_t i = 0; i < executor->workers.size(); ++i) {executor->workers[i].join();}
+	delete executor;
+}
+
+int lw_unlock_async(lw_executor_t* executor, lw_wallet_t* wallet, const char* master_password,
+	lw_done_fn done, void* ctx) {
+	if (executor == NULL || wallet == NULL || master_password == NULL) {return LW_ERR_INVALID_ARGUMENT;}
+	// an overlong master-password is copied whole, for lw_unlock to refuse
+	size_t len = strnlen(master_password, MAX_ITEM_SIZE);
+	char* password = (char*)copy_input(master_password, len + 1);
+	if (password == NULL) {return LW_ERR_NO_MEMORY;}
+	password[len] = '\0';
+	return submit(executor, [=] {return lw_unlock(wallet, password);}, password, done, ctx);
+}
+
+int lw_get_async(lw_executor_t* executor, lw_wallet_t* wallet, size_t index, lw_item_t* item,
+	lw_done_fn done, void* ctx) {
+	if (executor == NULL || wallet == NULL || item == NULL) {return LW_ERR_INVALID_ARGUMENT;}
+	return submit(executor, [=] {return lw_get(wallet, index, item);}, NULL, done, ctx);
+}
+
+int lw_search_async(lw_executor_t* executor, lw_wallet_t* wallet, const char* query, uint32_t* indexes,
+	size_t max, size_t* count, lw_done_fn done, void* ctx) {
+	if (executor == NULL || wallet == NULL || query == NULL) {return LW_ERR_INVALID_ARGUMENT;}
+	size_t len = strlen(query);
+	char* copy = (char*)copy_input(query, len + 1);
+	if (copy == NULL) {return LW_ERR_NO_MEMORY;}
+	return submit(executor, [=] {return lw_search(wallet, copy, indexes, max, count);}, copy, done, ctx);
+}
+
+int lw_add_async(lw_executor_t* executor, lw_wallet_t* wallet, const lw_item_t* items, size_t count,
+	lw_done_fn done, void* ctx) {
+	if (executor == NULL || wallet == NULL || (items == NULL && count > 0)) {return LW_ERR_INVALID_ARGUMENT;}
+	if (count > MAX_ITEMS) {return LW_ERR_WALLET_FULL;}
+	lw_item_t* copy = (lw_item_t*)copy_input(items, count * sizeof(lw_item_t));
+	if (copy == NULL) {return LW_ERR_NO_MEMORY;}
+	return submit(executor, [=] {return lw_add(wallet, copy, count);}, copy, done, ctx);
+}
+
+int lw_remove_async(lw_executor_t* executor, lw_wallet_t* wallet, const uint32_t* indexes, size_t count,
+	lw_done_fn done, void* ctx) {
+	if (executor == NULL || wallet == NULL || (indexes == NULL && count > 0)) {return LW_ERR_INVALID_ARGUMENT;}
+	if (count > MAX_ITEMS) {return LW_ERR_NO_SUCH_ITEM;}
+	uint32_t* copy = (uint32_t*)copy_input(indexes, count * sizeof(uint32_t));
+	if (copy == NULL) {return LW_ERR_NO_MEMORY;}
+	return submit(executor, [=] {return lw_remove(wallet, copy, count);}, copy, done, ctx);
+}
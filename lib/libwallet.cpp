@@ -0,0 +1,280 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <new>
+#include <mutex>
+#include <stdio.h>
+
+#include "../include/libwallet.h"
+#include "../wallet/wallet.h"
+#include "../wallet/watch.h"
+#include "../wallet/tags.h"
+#include "../wallet/arena.h"
+#include "../wallet/secure.h"
+#include "../wallet/generator.h"
+#include "../app/ecalls.h"
+
+using namespace std;
+
+static_assert(LW_FIELD_SIZE == MAX_ITEM_SIZE, "the ABI fields must match the wallet's");
+static_assert(LW_PASSWORD_LOWER == PASSWORD_LOWER && LW_PASSWORD_UPPER == PASSWORD_UPPER &&
+	LW_PASSWORD_DIGITS == PASSWORD_DIGITS && LW_PASSWORD_SYMBOLS == PASSWORD_SYMBOLS &&
+	LW_PASSWORD_PRONOUNCEABLE == PASSWORD_PRONOUNCEABLE, "the ABI password flags must match the generator's");
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+struct LibWallet {
+	char path[WATCH_MAX_PATH];
+	char* master_password;		// in secure memory, NULL while locked
+	wallet_cache_t cache;
+	mutex guard;
+};
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+/**
+ * @brief      Maps a wallet RET_SUCCESS or ERR_* code to its LW_*
+ *             error, which callers may rely on across versions.
+ *
+ */
+static int lw_status(int ret) {
+	switch (ret) {
+		case RET_SUCCESS: return LW_OK;
+		case ERR_PASSWORD_OUT_OF_RANGE: return LW_ERR_PASSWORD_OUT_OF_RANGE;
+		case ERR_CANNOT_SAVE_WALLET: return LW_ERR_CANNOT_SAVE;
+		case ERR_CANNOT_LOAD_WALLET: return LW_ERR_CANNOT_LOAD;
+		case ERR_WRONG_MASTER_PASSWORD: return LW_ERR_WRONG_PASSWORD;
+		case ERR_WALLET_FULL: return LW_ERR_WALLET_FULL;
+		case ERR_ITEM_DOES_NOT_EXIST: return LW_ERR_NO_SUCH_ITEM;
+		case ERR_ITEM_TOO_LONG: return LW_ERR_ITEM_TOO_LONG;
+		case ERR_TOO_MANY_TAGS: return LW_ERR_TOO_MANY_TAGS;
+		case ERR_INVALID_QUERY: return LW_ERR_INVALID_QUERY;
+		case ERR_INVALID_PASSWORD_POLICY: return LW_ERR_INVALID_POLICY;
+		default: return LW_ERR_INTERNAL;
+	}
+}
+
+/**
+ * @brief      Forgets the unlocked wallet and the master-password.
+ *
+ */
+static void lock_wallet(lw_wallet_t* wallet) {
+	if (wallet->master_password == NULL) {return;}
+	wallet_cache_free(&wallet->cache);
+	secure_free(wallet->master_password);
+	wallet->master_password = NULL;
+}
+
+/**
+ * @brief      Brings an unlocked wallet up to date without waiting. A
+ *             file being written by another process keeps the copy
+ *             already read, and is read again at the next call.
+ *
+ */
+static int refresh(lw_wallet_t* wallet, int force) {
+	if (wallet->master_password == NULL) {return LW_ERR_LOCKED;}
+	size_t changed = 0;
+	if (force) {wallet->cache.stale = 1;}
+	if (ecall_refresh_wallet_cache(&wallet->cache, 0, &changed) == ERR_WRONG_MASTER_PASSWORD) {
+		// the master-password changed: unlock again
+		lock_wallet(wallet);
+		return LW_ERR_LOCKED;
+	}
+	return LW_OK;
+}
+
+/**
+ * @brief      Adds items given in the ABI layout; with a policy, the
+ *             generated passwords are copied to 'generated'. Called
+ *             with the handle held.
+ *
+ */
+static int add_converted(lw_wallet_t* wallet, const lw_item_t* items, size_t count,
+	const password_policy_t* policy, lw_item_t* generated) {
+	if (wallet->master_password == NULL) {return LW_ERR_LOCKED;}
+
+	// the fields are copied as given; the wallet rejects unterminated ones
+	item_t* added = (item_t*)secure_malloc(count * sizeof(item_t));
+	if (added == NULL) {return LW_ERR_NO_MEMORY;}
+	memset(added, 0, count * sizeof(item_t));
+	for (size_t i = 0; i < count; ++i) {
+		memcpy(added[i].title, items[i].title, LW_FIELD_SIZE);
+		memcpy(added[i].username, items[i].username, LW_FIELD_SIZE);
+		memcpy(added[i].password, items[i].password, LW_FIELD_SIZE);
+		memcpy(added[i].tags, items[i].tags, LW_FIELD_SIZE);
+		added[i].expires = items[i].expires;
+	}
+	int ret = lw_status(ecall_add_items(wallet->path, wallet->master_password, added, count, policy));
+	for (size_t i = 0; i < count && ret == LW_OK && generated != NULL; ++i) {
+		memcpy(generated[i].password, added[i].password, LW_FIELD_SIZE);
+	}
+	secure_free(added);
+	if (ret != LW_OK) {return ret;}
+	return refresh(wallet, 1);
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int lw_abi_version(void) {
+	return LW_ABI_VERSION;
+}
+
+const char* lw_strerror(int error) {
+	switch (error) {
+		case LW_OK: return "success";
+		case LW_ERR_INVALID_ARGUMENT: return "invalid argument";
+		case LW_ERR_LOCKED: return "wallet is locked";
+		case LW_ERR_NO_MEMORY: return "out of secure memory";
+		case LW_ERR_CANNOT_LOAD: return "cannot load the wallet";
+		case LW_ERR_CANNOT_SAVE: return "cannot save the wallet";
+		case LW_ERR_WRONG_PASSWORD: return "wrong master-password";
+		case LW_ERR_PASSWORD_OUT_OF_RANGE: return "master-password out of range";
+		case LW_ERR_WALLET_FULL: return "wallet is full";
+		case LW_ERR_NO_SUCH_ITEM: return "item does not exist";
+		case LW_ERR_ITEM_TOO_LONG: return "item is too long";
+		case LW_ERR_TOO_MANY_TAGS: return "too many tags";
+		case LW_ERR_INVALID_QUERY: return "invalid query";
+		case LW_ERR_BUFFER_TOO_SMALL: return "buffer is too small";
+		case LW_ERR_INVALID_POLICY: return "invalid password policy";
+		default: return "internal error";
+	}
+}
+
+int lw_open(const char* path, lw_wallet_t** wallet) {
+	if (path == NULL || wallet == NULL) {return LW_ERR_INVALID_ARGUMENT;}
+	*wallet = NULL;
+	if (strlen(path) + 1 > WATCH_MAX_PATH) {return LW_ERR_INVALID_ARGUMENT;}
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {return LW_ERR_CANNOT_LOAD;}
+	fclose(file);
+
+	lw_wallet_t* opened = new (nothrow) lw_wallet_t;
+	if (opened == NULL) {return LW_ERR_NO_MEMORY;}
+	strcpy(opened->path, path);
+	opened->master_password = NULL;
+	*wallet = opened;
+	return LW_OK;
+}
+
+int lw_unlock(lw_wallet_t* wallet, const char* master_password) {
+	if (wallet == NULL || master_password == NULL) {return LW_ERR_INVALID_ARGUMENT;}
+	lock_guard<mutex> hold(wallet->guard);
+	lock_wallet(wallet);
+	if (strnlen(master_password, MAX_ITEM_SIZE) >= MAX_ITEM_SIZE) {return LW_ERR_WRONG_PASSWORD;}
+
+	char* copy = (char*)secure_malloc(MAX_ITEM_SIZE);
+	if (copy == NULL) {return LW_ERR_NO_MEMORY;}
+	memset(copy, 0, MAX_ITEM_SIZE);
+	strncpy(copy, master_password, MAX_ITEM_SIZE - 1);
+	int ret = ecall_open_wallet_cache(wallet->path, copy, 0, &wallet->cache);
+	if (ret != RET_SUCCESS) {
+		secure_free(copy);
+		return lw_status(ret);
+	}
+	wallet->master_password = copy;
+	return LW_OK;
+}
+
+int lw_count(lw_wallet_t* wallet, size_t* count) {
+	if (wallet == NULL || count == NULL) {return LW_ERR_INVALID_ARGUMENT;}
+	lock_guard<mutex> hold(wallet->guard);
+	int ret = refresh(wallet, 0);
+	*count = ret == LW_OK ? wallet->cache.wallet->size : 0;
+	return ret;
+}
+
+int lw_get(lw_wallet_t* wallet, size_t index, lw_item_t* item) {
+	if (wallet == NULL || item == NULL) {return LW_ERR_INVALID_ARGUMENT;}
+	lock_guard<mutex> hold(wallet->guard);
+	int ret = refresh(wallet, 0);
+	if (ret != LW_OK) {return ret;}
+	if (index >= wallet->cache.wallet->size) {return LW_ERR_NO_SUCH_ITEM;}
+
+	const item_t* found = &wallet->cache.wallet->items[index];
+	memcpy(item->title, found->title, LW_FIELD_SIZE);
+	memcpy(item->username, found->username, LW_FIELD_SIZE);
+	memcpy(item->password, found->password, LW_FIELD_SIZE);
+	memcpy(item->tags, found->tags, LW_FIELD_SIZE);
+	item->created = found->created;
+	item->modified = found->modified;
+	item->expires = found->expires;
+	item->id = found->id;
+	item->revision = found->revision;
+	return LW_OK;
+}
+
+int lw_search(lw_wallet_t* wallet, const char* query, uint32_t* indexes, size_t max, size_t* count) {
+	if (wallet == NULL || query == NULL || count == NULL || (indexes == NULL && max > 0)) {
+		return LW_ERR_INVALID_ARGUMENT;
+	}
+	*count = 0;
+	lock_guard<mutex> hold(wallet->guard);
+	int ret = refresh(wallet, 0);
+	if (ret != LW_OK) {return ret;}
+
+	bitmap_t matches;
+	if (ecall_tag_query(&wallet->cache, query, &matches) != TAGS_OK) {return LW_ERR_INVALID_QUERY;}
+	*count = bitmap_cardinality(&matches);
+	if (*count > max) {return LW_ERR_BUFFER_TOO_SMALL;}
+	bitmap_values(&matches, indexes, max);
+	return LW_OK;
+}
+
+int lw_add(lw_wallet_t* wallet, const lw_item_t* items, size_t count) {
+	if (wallet == NULL || (items == NULL && count > 0)) {return LW_ERR_INVALID_ARGUMENT;}
+	if (count == 0) {return LW_OK;}
+	if (count > MAX_ITEMS) {return LW_ERR_WALLET_FULL;}
+	lock_guard<mutex> hold(wallet->guard);
+	return add_converted(wallet, items, count, NULL, NULL);
+}
+
+int lw_add_generated(lw_wallet_t* wallet, lw_item_t* items, size_t count, uint32_t length, uint32_t flags) {
+	if (wallet == NULL || (items == NULL && count > 0)) {return LW_ERR_INVALID_ARGUMENT;}
+	if (count == 0) {return LW_OK;}
+	if (count > MAX_ITEMS) {return LW_ERR_WALLET_FULL;}
+	password_policy_t policy = {length, flags};
+	lock_guard<mutex> hold(wallet->guard);
+	return add_converted(wallet, items, count, &policy, items);
+}
+
+int lw_remove(lw_wallet_t* wallet, const uint32_t* indexes, size_t count) {
+	if (wallet == NULL || (indexes == NULL && count > 0)) {return LW_ERR_INVALID_ARGUMENT;}
+	if (count == 0) {return LW_OK;}
+	lock_guard<mutex> hold(wallet->guard);
+	if (wallet->master_password == NULL) {return LW_ERR_LOCKED;}
+
+	int ret = lw_status(ecall_remove_items(wallet->path, wallet->master_password, indexes, count));
+	if (ret != LW_OK) {return ret;}
+	return refresh(wallet, 1);
+}
+
+void lw_close(lw_wallet_t* wallet) {
+	if (wallet == NULL) {return;}
+	{
+		lock_guard<mutex> hold(wallet->guard);
+		lock_wallet(wallet);
+	}
+	delete wallet;
+}
@@ -0,0 +1,436 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <stddef.h>
+#include <time.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+#include <string>
+#include <unistd.h>
+
+#include "accesslog.h"
+#include "enclave.h"
+#include "secure.h"
+
+using namespace std;
+
+#define VERIFY_BLOCK 4096	// records read at once by a verifier thread, or by the tail
+
+
+/***************************************************
+ * Chaining
+ ***************************************************/
+static const uint8_t* mac_key(void) {
+	static uint8_t key[SEAL_KEY_SIZE];
+	static const int ready = (derive_seal_key("wallet-access-log", key), 1);
+	(void)ready;
+	return key;
+}
+
+static void chain_hash(const uint8_t previous[SHA256_SIZE], const access_record_t* record, uint8_t hash[SHA256_SIZE]) {
+	sha256_t ctx;
+	sha256_init(&ctx);
+	sha256_update(&ctx, previous, SHA256_SIZE);
+	sha256_update(&ctx, record, offsetof(access_record_t, hash));
+	sha256_final(&ctx, hash);
+}
+
+static void seal_mac(const access_record_t* seal, uint8_t tag[MAC_TAG_SIZE]) {
+	uint8_t mac[SHA256_SIZE];
+	hmac_t ctx;
+	hmac_init(&ctx, mac_key(), SEAL_KEY_SIZE);
+	hmac_update(&ctx, seal->hash, SHA256_SIZE);
+	hmac_final(&ctx, mac);
+	memcpy(tag, mac, MAC_TAG_SIZE);
+}
+
+/**
+ * @brief      Checks a record against the one before it, NULL for the
+ *             first record of the log.
+ *
+ */
+static int check_link(const access_record_t* previous, const access_record_t* record) {
+	static const uint8_t genesis[SHA256_SIZE] = {0};
+	uint8_t hash[SHA256_SIZE];
+	uint8_t tag[MAC_TAG_SIZE];
+	if (record->sequence != (previous != NULL ? previous->sequence + 1 : 1) ||
+		(record->kind != ACCESS_ENTRY && record->kind != ACCESS_SEAL)) {
+		return ACCESS_LOG_ERR_CHAIN;
+	}
+	chain_hash(previous != NULL ? previous->hash : genesis, record, hash);
+	if (memcmp(hash, record->hash, SHA256_SIZE) != 0) {return ACCESS_LOG_ERR_CHAIN;}
+	if (record->kind == ACCESS_SEAL) {
+		seal_mac(record, tag);
+		if (secure_memcmp(tag, record->mac, MAC_TAG_SIZE) != 0) {return ACCESS_LOG_ERR_MAC;}
+	}
+	return ACCESS_LOG_OK;
+}
+
+
+/***************************************************
+ * Writer
+ ***************************************************/
+static mutex log_lock;
+static condition_variable wake, durable;
+static thread writer;
+static string log_path;
+static int running = 0;
+static int failed = 0;					// a batch was lost: nothing more is written
+static int urgent = 0;					// a flush is waiting: cut the batch now
+static vector<access_record_t> pending;
+static uint64_t queued = 0, committed = 0;	// entries handed to, and done by, the writer
+
+// writer only, read again from the file before every batch
+static uint64_t next_sequence = 1;
+static uint64_t log_size = 0;
+static uint8_t head[SHA256_SIZE];		// hash of the last record written
+
+/**
+ * @brief      Locks the log, in the same batch of ocalls as reading
+ *             its size: other processes append to the same log, so
+ *             the lock is held while the chain is read and a batch
+ *             written. The lock's handle is used for both.
+ *
+ */
+static int lock_log(int* handle, uint64_t* size) {
+	ocall_t lock[] = {
+		{OCALL_LOCK, log_path.c_str(), NULL, 0, NULL, 0, 0, -1},
+		{OCALL_SIZE, log_path.c_str(), NULL, 0, NULL, 0, 0, -1},
+	};
+	enclave_ocalls(lock, 2);
+	if (lock[0].status != 0) {return ACCESS_LOG_ERR_IO;}
+	*handle = lock[0].handle;
+	*size = lock[1].length;
+	if (lock[1].status != 0) {
+		ocall_t unlock = {OCALL_UNLOCK, NULL, NULL, 0, NULL, 0, 0, *handle};
+		enclave_ocalls(&unlock, 1);
+		return ACCESS_LOG_ERR_IO;
+	}
+	return ACCESS_LOG_OK;
+}
+
+/**
+ * @brief      Looks for the last seal among the last 'span' records.
+ *             A seal is only trusted once its MAC and its link to the
+ *             record before check out. 'kept' is the number of records
+ *             up to the seal, 0 if there is none.
+ *
+ */
+static int find_seal(int handle, uint64_t records, uint64_t span, uint64_t* kept) {
+	*kept = 0;
+	uint64_t first = records > span ? records - span : 0;
+	uint64_t from = first > 0 ? first - 1 : 0;
+	vector<access_record_t> window((size_t)(records - from));
+	size_t length = window.size() * sizeof(access_record_t);
+	if (length > 0) {
+		ocall_t request = {OCALL_READ, NULL, NULL, length, (uint8_t*)window.data(), 0,
+			from * sizeof(access_record_t), handle};
+		if (enclave_ocalls(&request, 1) != 0 || request.length != length) {return ACCESS_LOG_ERR_IO;}
+	}
+	for (uint64_t i = records; i-- > first;) {
+		const access_record_t* record = &window[(size_t)(i - from)];
+		if (record->kind != ACCESS_SEAL) {continue;}
+		int ret = check_link(i > 0 ? &window[(size_t)(i - 1 - from)] : NULL, record);
+		if (ret != ACCESS_LOG_OK) {return ret;}
+		memcpy(head, record->hash, SHA256_SIZE);
+		next_sequence = record->sequence + 1;
+		*kept = i + 1;
+		break;
+	}
+	return ACCESS_LOG_OK;
+}
+
+/**
+ * @brief      Carries on the chain from the last seal; the log must be
+ *             locked. Records after it were never sealed: a batch torn
+ *             by a crash, or entries appended by someone without the
+ *             key. They are cut off rather than sealed by the next
+ *             batch. As a torn batch is never longer than a batch, a
+ *             longer unsealed tail is refused. The cut is left to the
+ *             caller, as 'log_size' is shorter than 'size'.
+ *
+ */
+static int resume_chain(int handle, uint64_t size) {
+	uint64_t records = size / sizeof(access_record_t);
+	uint64_t kept = 0;
+	memset(head, 0, sizeof(head));
+	next_sequence = 1;
+	int ret = find_seal(handle, records, 1, &kept);
+	if (ret == ACCESS_LOG_OK && kept == 0) {ret = find_seal(handle, records, ACCESS_LOG_MAX_BATCH + 1, &kept);}
+	if (ret != ACCESS_LOG_OK) {return ret;}
+	if (kept == 0 && records > ACCESS_LOG_MAX_BATCH) {return ACCESS_LOG_ERR_CHAIN;}
+	log_size = kept * sizeof(access_record_t);
+	return ACCESS_LOG_OK;
+}
+
+/**
+ * @brief      Chains a batch and closes it with a seal. The batch is
+ *             then written and flushed in one go, in the batch of
+ *             ocalls that cuts the unsealed tail and releases the lock.
+ *
+ */
+static int append(int handle, uint64_t size, vector<access_record_t>& batch) {
+	access_record_t seal;
+	memset(&seal, 0, sizeof(seal));
+	seal.timestamp = (int64_t)time(NULL);
+	seal.kind = ACCESS_SEAL;
+	seal.item = -1;
+	seal.uid = (uint32_t)getuid();
+	seal.pid = (uint32_t)getpid();
+	batch.push_back(seal);
+	for (size_t i = 0; i < batch.size(); ++i) {
+		batch[i].sequence = next_sequence++;
+		chain_hash(head, &batch[i], batch[i].hash);
+		memcpy(head, batch[i].hash, SHA256_SIZE);
+	}
+	seal_mac(&batch.back(), batch.back().mac);
+
+	size_t length = batch.size() * sizeof(access_record_t);
+	ocall_t write[] = {
+		{OCALL_TRUNCATE, NULL, NULL, 0, NULL, 0, log_size, handle},
+		{OCALL_WRITE, NULL, (const uint8_t*)batch.data(), length, NULL, 0, log_size, handle},
+		{OCALL_FSYNC, NULL, NULL, 0, NULL, 0, 0, handle},
+		{OCALL_UNLOCK, NULL, NULL, 0, NULL, 0, 0, handle},
+	};
+	ocall_t* first = log_size != size ? write : write + 1;
+	if (enclave_ocalls(first, (size_t)(write + 4 - first)) == 0) {
+		log_size += length;
+		return ACCESS_LOG_OK;
+	}
+	// a failed request skips the rest of the batch, unlock included
+	if (write[2].status != 0) {enclave_ocalls(&write[3], 1);}
+	return ACCESS_LOG_ERR_IO;
+}
+
+static int commit(vector<access_record_t>& batch) {
+	int handle;
+	uint64_t size;
+	if (lock_log(&handle, &size) != ACCESS_LOG_OK) {return ACCESS_LOG_ERR_IO;}
+	int ret = resume_chain(handle, size);
+	if (ret == ACCESS_LOG_OK) {return append(handle, size, batch);}
+	ocall_t unlock = {OCALL_UNLOCK, NULL, NULL, 0, NULL, 0, 0, handle};
+	enclave_ocalls(&unlock, 1);
+	return ret;
+}
+
+// group commit: whatever queued up during the last flush goes in the
+// next batch
+static void write_batches(void) {
+	unique_lock<mutex> guard(log_lock);
+	for (;;) {
+		wake.wait(guard, [] {return !pending.empty() || !running;});
+		if (pending.empty()) {break;}
+		wake.wait_for(guard, chrono::milliseconds(ACCESS_LOG_MAX_DELAY_MS),
+			[] {return pending.size() >= ACCESS_LOG_MAX_BATCH || urgent || !running;});
+		size_t count = pending.size() < ACCESS_LOG_MAX_BATCH ? pending.size() : ACCESS_LOG_MAX_BATCH;
+		vector<access_record_t> batch(pending.begin(), pending.begin() + count);
+		pending.erase(pending.begin(), pending.begin() + count);
+		int lost = failed;
+		guard.unlock();
+		int ret = lost ? ACCESS_LOG_ERR_IO : commit(batch);
+		guard.lock();
+		if (ret != ACCESS_LOG_OK) {failed = 1;}
+		committed += count;
+		if (pending.empty()) {urgent = 0;}
+		durable.notify_all();
+	}
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int access_log_open(const char* path) {
+	access_log_close();
+	log_path = path;
+
+	// cut off what no seal covers now, rather than at the first batch
+	int handle;
+	uint64_t size;
+	int ret = lock_log(&handle, &size);
+	if (ret == ACCESS_LOG_OK) {
+		ret = resume_chain(handle, size);
+		ocall_t cut[] = {
+			{OCALL_TRUNCATE, NULL, NULL, 0, NULL, 0, log_size, handle},
+			{OCALL_UNLOCK, NULL, NULL, 0, NULL, 0, 0, handle},
+		};
+		int cutting = ret == ACCESS_LOG_OK && log_size != size;
+		enclave_ocalls(cutting ? cut : cut + 1, cutting ? 2 : 1);
+		if (cutting && cut[0].status != 0) {
+			ret = ACCESS_LOG_ERR_IO;
+			enclave_ocalls(&cut[1], 1);
+		}
+	}
+	if (ret != ACCESS_LOG_OK) {
+		access_log_close();
+		return ret;
+	}
+	queued = committed = 0;
+	failed = 0;
+	running = 1;
+	writer = thread(write_batches);
+	return ACCESS_LOG_OK;
+}
+
+void access_log_record(uint32_t operation, int32_t item, uint64_t item_id, int32_t status) {
+	access_record_t record;
+	memset(&record, 0, sizeof(record));
+	record.timestamp = (int64_t)time(NULL);
+	record.kind = ACCESS_ENTRY;
+	record.operation = operation;
+	record.item = item;
+	record.status = status;
+	record.item_id = item_id;
+	record.uid = (uint32_t)getuid();
+	record.pid = (uint32_t)getpid();
+
+	lock_guard<mutex> guard(log_lock);
+	if (!running) {return;}
+	pending.push_back(record);
+	++queued;
+	wake.notify_one();
+}
+
+int access_log_flush(void) {
+	unique_lock<mutex> guard(log_lock);
+	uint64_t target = queued;
+	urgent = 1;
+	wake.notify_one();
+	durable.wait(guard, [target] {return committed >= target;});
+	return failed ? ACCESS_LOG_ERR_IO : ACCESS_LOG_OK;
+}
+
+void access_log_close(void) {
+	{
+		lock_guard<mutex> guard(log_lock);
+		running = 0;
+		wake.notify_one();
+	}
+	if (writer.joinable()) {writer.join();}
+	log_path.clear();
+}
+
+// the share of the log checked by one thread
+struct VerifyRange {
+	const char* path;
+	uint64_t first, last;		// records [first, last)
+	int status;
+	uint64_t first_bad, entries, seals, last_seal;
+};
+
+static void verify_range(struct VerifyRange* range) {
+	vector<access_record_t> block(VERIFY_BLOCK + 1);
+	range->status = ACCESS_LOG_OK;
+	for (uint64_t start = range->first; start < range->last && range->status == ACCESS_LOG_OK; start += VERIFY_BLOCK) {
+		// with the record before, to check the first link
+		uint64_t count = range->last - start < VERIFY_BLOCK ? range->last - start : VERIFY_BLOCK;
+		uint64_t from = start > 0 ? start - 1 : 0;
+		size_t length = (size_t)(start - from + count) * sizeof(access_record_t);
+		ocall_t request = {OCALL_READ, range->path, NULL, length, (uint8_t*)block.data(), 0,
+			from * sizeof(access_record_t), -1};
+		if (enclave_ocalls(&request, 1) != 0 || request.length != length) {
+			range->status = ACCESS_LOG_ERR_IO;
+			range->first_bad = start + 1;
+			break;
+		}
+		const access_record_t* records = block.data() + (start - from);
+		for (uint64_t i = 0; i < count; ++i) {
+			const access_record_t* previous = (start + i > 0) ? &records[(int64_t)i - 1] : NULL;
+			int ret = check_link(previous, &records[i]);
+			if (ret != ACCESS_LOG_OK) {
+				range->status = ret;
+				range->first_bad = start + i + 1;
+				break;
+			}
+			if (records[i].kind == ACCESS_SEAL) {
+				++range->seals;
+				range->last_seal = start + i + 1;
+			}
+			else {++range->entries;}
+		}
+	}
+}
+
+int access_log_verify(const char* path, int threads, access_log_report_t* report) {
+	memset(report, 0, sizeof(access_log_report_t));
+	ocall_t size = {OCALL_SIZE, path, NULL, 0, NULL, 0, 0, -1};
+	if (enclave_ocalls(&size, 1) != 0) {
+		report->status = ACCESS_LOG_ERR_IO;
+		return report->status;
+	}
+	uint64_t records = (uint64_t)size.length / sizeof(access_record_t);
+
+	if (threads <= 0) {threads = (int)thread::hardware_concurrency();}
+	if (threads <= 0) {threads = 1;}
+	if ((uint64_t)threads > records / VERIFY_BLOCK + 1) {threads = (int)(records / VERIFY_BLOCK + 1);}
+	vector<struct VerifyRange> ranges(threads);
+	vector<thread> workers;
+	for (int i = 0; i < threads; ++i) {
+		ranges[i] = {path, records * i / threads, records * (i + 1) / threads, ACCESS_LOG_OK, 0, 0, 0, 0};
+		workers.push_back(thread(verify_range, &ranges[i]));
+	}
+	for (int i = 0; i < threads; ++i) {workers[i].join();}
+
+	// the first error in log order wins
+	uint64_t last_seal = 0;
+	for (int i = 0; i < threads; ++i) {
+		report->entries += ranges[i].entries;
+		report->seals += ranges[i].seals;
+		if (ranges[i].last_seal > last_seal) {last_seal = ranges[i].last_seal;}
+		if (ranges[i].status != ACCESS_LOG_OK && report->status == ACCESS_LOG_OK) {
+			report->status = ranges[i].status;
+			report->first_bad = ranges[i].first_bad;
+		}
+	}
+	report->unsealed = records - last_seal;
+
+	// a torn trailing record is left by a crash, or by tampering
+	if (report->status == ACCESS_LOG_OK && (uint64_t)size.length % sizeof(access_record_t) != 0) {
+		report->status = ACCESS_LOG_ERR_CHAIN;
+		report->first_bad = records + 1;
+	}
+	return report->status;
+}
+
+int access_log_tail(const char* path, access_record_t* records, size_t max, size_t* count) {
+	*count = 0;
+	ocall_t size = {OCALL_SIZE, path, NULL, 0, NULL, 0, 0, -1};
+	if (enclave_ocalls(&size, 1) != 0) {return ACCESS_LOG_ERR_IO;}
+
+	// backwards, a block at a time, skipping the seals
+	vector<access_record_t> block(VERIFY_BLOCK);
+	uint64_t position = (uint64_t)size.length / sizeof(access_record_t);
+	while (position > 0 && *count < max) {
+		uint64_t from = position > VERIFY_BLOCK ? position - VERIFY_BLOCK : 0;
+		size_t length = (size_t)(position - from) * sizeof(access_record_t);
+		ocall_t request = {OCALL_READ, path, NULL, length, (uint8_t*)block.data(), 0,
+			from * sizeof(access_record_t), -1};
+		if (enclave_ocalls(&request, 1) != 0 || request.length != length) {return ACCESS_LOG_ERR_IO;}
+		for (uint64_t i = position - from; i-- > 0 && *count < max;) {
+			if (block[(size_t)i].kind == ACCESS_ENTRY) {records[(*count)++] = block[(size_t)i];}
+		}
+		position = from;
+	}
+	reverse(records, records + *count);
+	return ACCESS_LOG_OK;
+}
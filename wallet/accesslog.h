@@ -0,0 +1,176 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ACCESSLOG_H_
+#define ACCESSLOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wallet.h"
+#include "crypto.h"
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define ACCESS_LOG_FILE WALLET_FILE ".access"
+#define ACCESS_LOG_MAX_BATCH 1024	// records sealed together at most
+#define ACCESS_LOG_MAX_DELAY_MS 20	// how long a record waits for others to join its batch
+
+// operations recorded
+#define ACCESS_SHOW 1
+#define ACCESS_ADD 2
+#define ACCESS_REMOVE 3
+#define ACCESS_UPDATE 4
+#define ACCESS_CHANGE_PASSWORD 5
+#define ACCESS_RESTORE 6
+#define ACCESS_MERGE 7
+#define ACCESS_ROTATE 8
+
+// record kinds
+#define ACCESS_ENTRY 1		// one operation
+#define ACCESS_SEAL 2		// closes a batch: MAC of the chain so far
+
+// log errors
+#define ACCESS_LOG_OK 0
+#define ACCESS_LOG_ERR_IO 1			// log could not be read or written
+#define ACCESS_LOG_ERR_CHAIN 2		// a record was changed, removed or reordered
+#define ACCESS_LOG_ERR_MAC 3		// a seal failed authentication
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// fixed-size log record; 'hash' chains it to every record before
+struct AccessRecord {
+	uint64_t sequence;		// from 1, no gaps
+	int64_t timestamp;
+	uint32_t kind;			// ACCESS_ENTRY or ACCESS_SEAL
+	uint32_t operation;		// ACCESS_*, 0 for a seal
+	int32_t item;			// item index, -1 for the whole wallet
+	int32_t status;			// what the operation returned
+	uint64_t item_id;		// item id, 0 if none
+	uint32_t uid;			// who: the calling user and process
+	uint32_t pid;
+	uint8_t hash[SHA256_SIZE];	// SHA-256 of the previous hash and the fields above
+	uint8_t mac[MAC_TAG_SIZE];	// ACCESS_SEAL: MAC of 'hash'
+};
+typedef struct AccessRecord access_record_t;
+
+// outcome of a verification
+struct AccessLogReport {
+	int status;				// ACCESS_LOG_OK, or the first error found
+	uint64_t entries;		// operations recorded
+	uint64_t seals;
+	uint64_t unsealed;		// trailing entries no seal covers yet
+	uint64_t first_bad;		// sequence of the first bad record, 0 if none
+};
+typedef struct AccessLogReport access_log_report_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Starts recording wallet operations to a log, appending
+ *             to it if it exists. Records are chained and sealed by a
+ *             background writer, in batches: every batch is written
+ *             and flushed to storage once, so operations never wait
+ *             for the disk. A batch is cut when full, when its oldest
+ *             record has waited ACCESS_LOG_MAX_DELAY_MS, or on a
+ *             flush. The chain is carried on from the last seal, so
+ *             entries no seal covers (a batch torn by a crash, or
+ *             entries appended without the key) are cut off. Several
+ *             processes may append to one log.
+ *
+ * @param[in]  path    The log file
+ *
+ * @return     ACCESS_LOG_OK if successful, ACCESS_LOG_ERR_MAC if the
+ *             last seal fails authentication, ACCESS_LOG_ERR_* otherwise.
+ */
+int access_log_open(const char* path);
+
+
+/**
+ * @brief      Queues a record; does nothing if no log is open.
+ *
+ * @param[in]  operation    The ACCESS_* operation
+ * @param[in]  item         The item index, -1 for the whole wallet
+ * @param[in]  item_id      The item id, 0 if none
+ * @param[in]  status       What the operation returned
+ *
+ * @return     -
+ */
+void access_log_record(uint32_t operation, int32_t item, uint64_t item_id, int32_t status);
+
+
+/**
+ * @brief      Waits until every record queued so far is sealed and on
+ *             storage.
+ *
+ * @param      -
+ *
+ * @return     ACCESS_LOG_OK if successful, ACCESS_LOG_ERR_IO if a
+ *             batch could not be written.
+ */
+int access_log_flush(void);
+
+
+/**
+ * @brief      Flushes the log, stops the writer and closes the file.
+ *
+ * @param      -
+ *
+ * @return     -
+ */
+void access_log_close(void);
+
+
+/**
+ * @brief      Verifies a log. Every record is checked against the one
+ *             before it, and every seal against its MAC; since each
+ *             check only needs two adjacent records, the log is split
+ *             between threads. A log cut at a batch boundary cannot
+ *             be told from a shorter one: keep the last sequence
+ *             elsewhere to detect it.
+ *
+ * @param[in]  path       The log file
+ * @param[in]  threads    The number of threads, 0 for one per core
+ * @param[out] report     The outcome
+ *
+ * @return     ACCESS_LOG_OK if the log is intact, ACCESS_LOG_ERR_* otherwise.
+ */
+int access_log_verify(const char* path, int threads, access_log_report_t* report);
+
+
+/**
+ * @brief      Reads the last entries of a log, seals left out.
+ *
+ * @param[in]  path       The log file
+ * @param[out] records    The entries, oldest first
+ * @param[in]  max        The number of entries wanted
+ * @param[out] count      The number of entries read
+ *
+ * @return     ACCESS_LOG_OK if successful, ACCESS_LOG_ERR_IO otherwise.
+ */
+int access_log_tail(const char* path, access_record_t* records, size_t max, size_t* count);
+
+
+#endif // ACCESSLOG_H_
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "secure.h"
+
+using namespace std;
+
+#define ARENA_LARGE 0xff		// class of blocks mapped on their own
+#define ARENA_MAGIC 0x5ecb10c	// marks blocks handed out, cleared on free
+
+
+/***************************************************
+ * Internal state
+ ***************************************************/
+// every block is preceded by a 16-byte header
+struct ArenaBlock {
+	size_t size;		// usable size (class size or mapping size)
+	uint32_t cls;		// size class, or ARENA_LARGE
+	uint32_t magic;
+};
+
+// chunks are linked so they can be wiped on release
+struct ArenaChunk {
+	struct ArenaChunk* next;
+	size_t length;
+	size_t used;
+	int locked;
+};
+
+static mutex arena_mutex;
+static struct ArenaChunk* chunks = NULL;
+static void* free_lists[ARENA_MAX_CLASS+1];
+static arena_stats_t stats;
+
+
+/**
+ * @brief      Maps pages that are kept out of swap and core dumps.
+ *             If the mlock limit is reached the pages are still
+ *             handed out; they are only zeroed, not pinned.
+ *
+ */
+static void* map_locked(size_t length, int* locked) {
+	void* ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {return NULL;}
+#ifdef MADV_DONTDUMP
+	madvise(ptr, length, MADV_DONTDUMP);
+#endif
+	*locked = (mlock(ptr, length) == 0);
+	if (*locked) {stats.locked_bytes += length;}
+	else {stats.unlocked_bytes += length;}
+	return ptr;
+}
+
+static void unmap_locked(void* ptr, size_t length, int locked) {
+	secure_zero(ptr, length);
+	if (locked) {
+		munlock(ptr, length);
+		stats.locked_bytes -= length;
+	}
+	else {
+		stats.unlocked_bytes -= length;
+	}
+	munmap(ptr, length);
+}
+
+static size_t page_round(size_t size) {
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	return (size + page - 1) & ~(page - 1);
+}
+
+static uint32_t size_class(size_t size) {
+	uint32_t cls = ARENA_MIN_CLASS;
+	while (((size_t)1 << cls) < size) {++cls;}
+	return cls;
+}
+
+
+/**
+ * @brief      Carves a block of the given class out of the current
+ *             chunk, mapping a new chunk when it is exhausted.
+ *
+ */
+static struct ArenaBlock* carve(uint32_t cls) {
+	size_t need = (size_t)1 << cls;
+	if (chunks == NULL || chunks->used + need > chunks->length) {
+		int locked;
+		struct ArenaChunk* chunk = (struct ArenaChunk*)map_locked(ARENA_CHUNK_SIZE, &locked);
+		if (chunk == NULL) {return NULL;}
+		chunk->next = chunks;
+		chunk->length = ARENA_CHUNK_SIZE;
+		chunk->used = (sizeof(struct ArenaChunk) + 63) & ~(size_t)63;
+		chunk->locked = locked;
+		chunks = chunk;
+		++stats.chunks;
+	}
+	struct ArenaBlock* block = (struct ArenaBlock*)((char*)chunks + chunks->used);
+	chunks->used += need;
+	block->size = need - sizeof(struct ArenaBlock);
+	return block;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+void* secure_malloc(size_t size) {
+	lock_guard<mutex> guard(arena_mutex);
+	struct ArenaBlock* block;
+	uint32_t cls = size_class(size + sizeof(struct ArenaBlock));
+
+	// large blocks get their own mapping
+	if (cls > ARENA_MAX_CLASS) {
+		int locked;
+		size_t length = page_round(size + sizeof(struct ArenaBlock));
+		block = (struct ArenaBlock*)map_locked(length, &locked);
+		if (block == NULL) {return NULL;}
+		block->size = length - sizeof(struct ArenaBlock);
+		cls = locked ? ARENA_LARGE : ARENA_LARGE-1;
+	}
+
+	// reuse a zeroed block of the same class
+	else if (free_lists[cls] != NULL) {
+		block = (struct ArenaBlock*)free_lists[cls] - 1;
+		free_lists[cls] = *(void**)free_lists[cls];
+		*(void**)(block + 1) = NULL;
+		++stats.reuses;
+	}
+
+	// carve a fresh one
+	else {
+		block = carve(cls);
+		if (block == NULL) {return NULL;}
+	}
+
+	block->cls = cls;
+	block->magic = ARENA_MAGIC;
+	++stats.allocs;
+	++stats.in_use;
+	return block + 1;
+}
+
+void secure_free(void* ptr) {
+	if (ptr == NULL) {return;}
+	lock_guard<mutex> guard(arena_mutex);
+	struct ArenaBlock* block = (struct ArenaBlock*)ptr - 1;
+
+	// a foreign pointer or a second free would hand the same block
+	// out twice: secure memory must never alias
+	if (block->magic != ARENA_MAGIC) {abort();}
+	block->magic = 0;
+	--stats.in_use;
+
+	// large blocks are wiped and unmapped
+	if (block->cls >= ARENA_LARGE-1) {
+		unmap_locked(block, block->size + sizeof(struct ArenaBlock), block->cls == ARENA_LARGE);
+		return;
+	}
+
+	// pooled blocks are wiped and pushed on their free list
+	secure_zero(ptr, block->size);
+	*(void**)ptr = free_lists[block->cls];
+	free_lists[block->cls] = ptr;
+}
+
+void arena_get_stats(arena_stats_t* out) {
+	lock_guard<mutex> guard(arena_mutex);
+	*out = stats;
+}
+
+void arena_release(void) {
+	lock_guard<mutex> guard(arena_mutex);
+	while (chunks != NULL) {
+		struct ArenaChunk* next = chunks->next;
+		unmap_locked(chunks, chunks->length, chunks->locked);
+		chunks = next;
+		--stats.chunks;
+	}
+	memset(free_lists, 0, sizeof(free_lists));
+	stats.in_use = 0;
+}
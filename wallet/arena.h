@@ -0,0 +1,98 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define ARENA_CHUNK_SIZE (1 << 20)	// size of each locked chunk
+#define ARENA_MIN_CLASS 6			// smallest block: 64 bytes
+#define ARENA_MAX_CLASS 19			// largest pooled block: 512 KiB
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// arena statistics
+struct ArenaStats {
+	size_t chunks;			// number of chunks mapped
+	size_t locked_bytes;	// bytes pinned in RAM with mlock
+	size_t unlocked_bytes;	// bytes that could not be pinned
+	size_t in_use;			// blocks currently handed out
+	size_t allocs;			// total number of allocations
+	size_t reuses;			// allocations served from a free list
+};
+typedef struct ArenaStats arena_stats_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Allocates a zeroed block from the locked arena. Blocks
+ *             are carved out of mlock'd, non-dumpable pages and are
+ *             recycled through per-size free lists, so that repeated
+ *             wallet operations do not hit the system allocator.
+ *
+ * @param[in]  size    The number of bytes to allocate
+ *
+ * @return     A pointer to the zeroed block, NULL on failure.
+ */
+void* secure_malloc(size_t size);
+
+
+/**
+ * @brief      Zeroes a block and returns it to the arena. Freeing
+ *             NULL is a no-op; freeing a block twice, or a pointer
+ *             the arena did not hand out, aborts.
+ *
+ * @param[in]  ptr    The block to release
+ *
+ * @return     -
+ */
+void secure_free(void* ptr);
+
+
+/**
+ * @brief      Reads the arena statistics.
+ *
+ * @param[out] stats    The statistics
+ *
+ * @return     -
+ */
+void arena_get_stats(arena_stats_t* stats);
+
+
+/**
+ * @brief      Zeroes and unmaps every chunk of the arena. All
+ *             outstanding blocks become invalid.
+ *
+ * @param      -
+ *
+ * @return     -
+ */
+void arena_release(void);
+
+
+#endif // ARENA_H_
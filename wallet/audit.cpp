@@ -0,0 +1,271 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <cstdlib>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+
+#include "audit.h"
+#include "enclave.h"
+#include "secure.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+static int hex_value(char c) {
+	if (c >= '0' && c <= '9') {return c - '0';}
+	if (c >= 'A' && c <= 'F') {return c - 'A' + 10;}
+	if (c >= 'a' && c <= 'f') {return c - 'a' + 10;}
+	return -1;
+}
+
+/**
+ * @brief      Parses the hash at the start of a corpus line.
+ *
+ */
+static int parse_line(const char* line, const char* end, uint8_t digest[SHA1_SIZE]) {
+	if (end - line < CORPUS_HASH_HEX) {return 1;}
+	for (int i = 0; i < SHA1_SIZE; ++i) {
+		int hi = hex_value(line[2*i]), lo = hex_value(line[2*i+1]);
+		if (hi < 0 || lo < 0) {return 1;}
+		digest[i] = (uint8_t)((hi << 4) | lo);
+	}
+	return 0;
+}
+
+static const char* next_line(const char* p, const char* end) {
+	const char* eol = (const char*)memchr(p, '\n', (size_t)(end - p));
+	return eol == NULL ? end : eol + 1;
+}
+
+// the digest is uniformly random: its words index the filter directly
+static void bloom_position(const uint8_t digest[SHA1_SIZE], uint64_t blocks, uint64_t* block, uint64_t* bits) {
+	uint64_t h1, h2;
+	memcpy(&h1, digest, sizeof(h1));
+	memcpy(&h2, digest + 8, sizeof(h2));
+	*block = h1 % blocks;
+	*bits = h2;
+}
+
+static void bloom_add(uint8_t* filter, uint64_t blocks, const uint8_t digest[SHA1_SIZE]) {
+	uint64_t block, bits;
+	bloom_position(digest, blocks, &block, &bits);
+	uint8_t* line = filter + block * (BLOOM_BLOCK_BITS / 8);
+	for (int i = 0; i < BLOOM_HASHES; ++i) {
+		uint32_t bit = (uint32_t)(bits >> (9*i)) & (BLOOM_BLOCK_BITS - 1);
+		line[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+	}
+}
+
+static int bloom_test(const uint8_t* filter, uint64_t blocks, const uint8_t digest[SHA1_SIZE]) {
+	uint64_t block, bits;
+	bloom_position(digest, blocks, &block, &bits);
+	const uint8_t* line = filter + block * (BLOOM_BLOCK_BITS / 8);
+	int hit = 1;
+	for (int i = 0; i < BLOOM_HASHES; ++i) {
+		uint32_t bit = (uint32_t)(bits >> (9*i)) & (BLOOM_BLOCK_BITS - 1);
+		hit &= (line[bit >> 3] >> (bit & 7)) & 1;
+	}
+	return hit;
+}
+
+/**
+ * @brief      Takes the Bloom filter mapped by 'map' if it matches the
+ *             corpus, and unmaps it otherwise.
+ *
+ */
+static int map_bloom(corpus_t* corpus, const ocall_t* map, int64_t corpus_mtime) {
+	bloom_header_t header;
+	if (map->length >= sizeof(header)) {memcpy(&header, map->out, sizeof(header));}
+	if (map->length < sizeof(header) ||
+		header.magic != BLOOM_MAGIC || header.hashes != BLOOM_HASHES || header.blocks == 0 ||
+		header.corpus_size != (uint64_t)corpus->size || header.corpus_mtime != corpus_mtime ||
+		(uint64_t)map->length != sizeof(header) + header.blocks * (BLOOM_BLOCK_BITS / 8)) {
+		ocall_t unmap = {OCALL_UNMAP, NULL, NULL, map->length, map->out, 0, 0, -1};
+		enclave_ocalls(&unmap, 1);
+		return 1;
+	}
+	corpus->bloom_map = map->out;
+	corpus->bloom_map_size = map->length;
+	corpus->bloom = map->out + sizeof(header);
+	corpus->blocks = header.blocks;
+	return 0;
+}
+
+/**
+ * @brief      Builds the Bloom filter of a corpus in one sequential
+ *             scan, writes it next to the corpus and maps it. The
+ *             filter is sized for ~10 bits per line (about 1% false
+ *             positives). The scan reads ahead through a mapping of
+ *             its own, as the corpus' is set up for random lookups.
+ *
+ */
+static int build_bloom(corpus_t* corpus, const char* path, const string& bloom_path, int64_t corpus_mtime) {
+	ocall_t scan = {OCALL_MAP, path, NULL, 0, NULL, 0, MADV_SEQUENTIAL, -1};
+	if (enclave_ocalls(&scan, 1) != 0) {return 1;}
+
+	// the corpus must not have changed since it was mapped
+	bloom_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = BLOOM_MAGIC;
+	header.hashes = BLOOM_HASHES;
+	header.blocks = (corpus->size / (CORPUS_HASH_HEX + 1)) * 10 / BLOOM_BLOCK_BITS + 1;
+	header.corpus_size = (uint64_t)corpus->size;
+	header.corpus_mtime = corpus_mtime;
+	size_t image_size = sizeof(header) + header.blocks * (BLOOM_BLOCK_BITS / 8);
+	uint8_t* image = NULL;
+	if (scan.length == corpus->size && (int64_t)scan.offset == corpus_mtime) {
+		image = (uint8_t*)calloc(image_size, 1);
+	}
+	if (image != NULL) {
+		memcpy(image, &header, sizeof(header));
+		const char* data = (const char*)scan.out;
+		const char* end = data + scan.length;
+		uint8_t digest[SHA1_SIZE];
+		for (const char* p = data; p < end; p = next_line(p, end)) {
+			if (parse_line(p, end, digest) == 0) {bloom_add(image + sizeof(header), header.blocks, digest);}
+		}
+	}
+
+	ocall_t store[] = {
+		{OCALL_UNMAP, NULL, NULL, scan.length, scan.out, 0, 0, -1},
+		{OCALL_SAVE, bloom_path.c_str(), image, image_size, NULL, 0, 0, -1},
+		{OCALL_MAP, bloom_path.c_str(), NULL, 0, NULL, 0, MADV_RANDOM, -1},
+	};
+	enclave_ocalls(store, image != NULL ? 3 : 1);
+	free(image);
+	if (image == NULL || store[2].status != 0) {return 1;}
+	return map_bloom(corpus, &store[2], corpus_mtime);
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int corpus_open(const char* path, corpus_t* corpus) {
+	memset(corpus, 0, sizeof(corpus_t));
+	string bloom_path = string(path) + BLOOM_SUFFIX;
+
+	// both are mapped in one batch; lookups jump around either
+	ocall_t map[] = {
+		{OCALL_MAP, path, NULL, 0, NULL, 0, MADV_RANDOM, -1},
+		{OCALL_MAP, bloom_path.c_str(), NULL, 0, NULL, 0, MADV_RANDOM, -1},
+	};
+	enclave_ocalls(map, 2);
+	if (map[0].status != 0) {return 1;}
+	corpus->data = (const char*)map[0].out;
+	corpus->size = map[0].length;
+	int64_t corpus_mtime = (int64_t)map[0].offset;
+
+	// filter: the one mapped if it matches, or one built once
+	if ((map[1].status != 0 || map_bloom(corpus, &map[1], corpus_mtime) != 0) &&
+		build_bloom(corpus, path, bloom_path, corpus_mtime) != 0) {
+		corpus_close(corpus);
+		return 1;
+	}
+	return 0;
+}
+
+void corpus_close(corpus_t* corpus) {
+	ocall_t unmap[] = {
+		{OCALL_UNMAP, NULL, NULL, corpus->size, (uint8_t*)corpus->data, 0, 0, -1},
+		{OCALL_UNMAP, NULL, NULL, corpus->bloom_map_size, (uint8_t*)corpus->bloom_map, 0, 0, -1},
+	};
+	ocall_t* first = corpus->data != NULL ? unmap : unmap + 1;
+	size_t count = (corpus->data != NULL) + (corpus->bloom_map != NULL);
+	if (count > 0) {enclave_ocalls(first, count);}
+	memset(corpus, 0, sizeof(corpus_t));
+}
+
+int corpus_contains(const corpus_t* corpus, const uint8_t digest[SHA1_SIZE]) {
+	if (!bloom_test(corpus->bloom, corpus->blocks, digest)) {return 0;}
+
+	// binary search over lines; 'lo' always sits at a line start
+	const char* data = corpus->data;
+	const char* end = data + corpus->size;
+	size_t lo = 0, hi = corpus->size;
+	uint8_t line_digest[SHA1_SIZE];
+	while (lo < hi) {
+		size_t start = lo + (hi - lo) / 2;
+		while (start > lo && data[start-1] != '\n') {--start;}
+		int cmp = parse_line(data + start, end, line_digest) == 0 ? memcmp(line_digest, digest, SHA1_SIZE) : -1;
+		if (cmp == 0) {return 1;}
+		if (cmp < 0) {lo = (size_t)(next_line(data + start, end) - data);}
+		else {hi = start;}
+	}
+	return 0;
+}
+
+void audit_items(const item_t* items, size_t count, const corpus_t* corpus, audit_result_t* results) {
+	vector<uint8_t> digests(count * SHA1_SIZE);
+
+	// hash the passwords, SHA1_LANES at a time
+	size_t i = 0;
+	for (; i + SHA1_LANES <= count; i += SHA1_LANES) {
+		const uint8_t* data[SHA1_LANES];
+		size_t lens[SHA1_LANES];
+		uint8_t lane_digests[SHA1_LANES][SHA1_SIZE];
+		for (int j = 0; j < SHA1_LANES; ++j) {
+			data[j] = (const uint8_t*)items[i+j].password;
+			lens[j] = strnlen(items[i+j].password, MAX_ITEM_SIZE);
+		}
+		sha1_x4(data, lens, lane_digests);
+		memcpy(&digests[i * SHA1_SIZE], lane_digests, sizeof(lane_digests));
+	}
+	for (; i < count; ++i) {
+		sha1(items[i].password, strnlen(items[i].password, MAX_ITEM_SIZE), &digests[i * SHA1_SIZE]);
+	}
+
+	// reuse: open-addressing index over the digests
+	size_t capacity = 16;
+	while (capacity < 2 * count) {capacity <<= 1;}
+	vector<int64_t> index(capacity, -1);
+	for (i = 0; i < count; ++i) {
+		const uint8_t* digest = &digests[i * SHA1_SIZE];
+		uint64_t h;
+		memcpy(&h, digest, sizeof(h));
+		size_t slot = h & (capacity - 1);
+		results[i].reused_with = -1;
+		while (index[slot] >= 0) {
+			if (memcmp(&digests[index[slot] * SHA1_SIZE], digest, SHA1_SIZE) == 0) {
+				results[i].reused_with = (int)index[slot];
+				break;
+			}
+			slot = (slot + 1) & (capacity - 1);
+		}
+		if (index[slot] < 0) {index[slot] = (int64_t)i;}
+
+		// first item sharing this password points at the next one
+		if (results[i].reused_with >= 0 && results[results[i].reused_with].reused_with < 0) {
+			results[results[i].reused_with].reused_with = (int)i;
+		}
+	}
+
+	// breaches
+	for (i = 0; i < count; ++i) {
+		memcpy(results[i].title, items[i].title, MAX_ITEM_SIZE);
+		results[i].breached = corpus != NULL && corpus_contains(corpus, &digests[i * SHA1_SIZE]);
+	}
+	secure_zero(digests.data(), digests.size());
+}
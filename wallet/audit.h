@@ -0,0 +1,123 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef AUDIT_H_
+#define AUDIT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wallet.h"
+#include "crypto.h"
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define BLOOM_MAGIC 0x4d4f4c42		// "BLOM"
+#define BLOOM_SUFFIX ".bloom"		// filter stored next to the corpus
+#define BLOOM_HASHES 7				// bits set per entry
+#define BLOOM_BLOCK_BITS 512		// one cache line per entry
+#define CORPUS_HASH_HEX (2 * SHA1_SIZE)
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// header of the Bloom filter file
+struct BloomHeader {
+	uint32_t magic;
+	uint32_t hashes;
+	uint64_t blocks;		// number of BLOOM_BLOCK_BITS blocks
+	uint64_t corpus_size;	// corpus the filter was built from
+	int64_t corpus_mtime;
+};
+typedef struct BloomHeader bloom_header_t;
+
+// breached-password corpus, memory-mapped
+struct Corpus {
+	const char* data;		// sorted "SHA1HEX[:count]" lines
+	size_t size;
+	const uint8_t* bloom;	// filter bits
+	uint64_t blocks;
+	void* bloom_map;
+	size_t bloom_map_size;
+};
+typedef struct Corpus corpus_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Maps a corpus of breached password hashes: one
+ *             uppercase SHA-1 per line, sorted, optionally followed
+ *             by ':count' (the format of the public breach lists).
+ *             Its blocked Bloom filter is mapped from BLOOM_SUFFIX;
+ *             it is built by a single scan on first use, or when
+ *             the corpus has changed since.
+ *
+ * @param[in]  path      The corpus file
+ * @param[out] corpus    The mapped corpus
+ *
+ * @return     0 if successful, 1 otherwise.
+ */
+int corpus_open(const char* path, corpus_t* corpus);
+
+
+/**
+ * @brief      Unmaps a corpus.
+ *
+ * @param      corpus    The corpus
+ *
+ * @return     -
+ */
+void corpus_close(corpus_t* corpus);
+
+
+/**
+ * @brief      Looks a hash up in the corpus: the Bloom filter rules
+ *             out almost all misses with one cache line, and hits
+ *             are confirmed by binary search over the mapped file.
+ *
+ * @param[in]  corpus    The corpus
+ * @param[in]  digest    The SHA-1 of the password
+ *
+ * @return     Truthy if the hash is in the corpus.
+ */
+int corpus_contains(const corpus_t* corpus, const uint8_t digest[SHA1_SIZE]);
+
+
+/**
+ * @brief      Audits items: flags passwords found in the corpus and
+ *             passwords shared by several items. Passwords are
+ *             hashed SHA1_LANES at a time; reuse is found through a
+ *             hash index over the digests.
+ *
+ * @param[in]  items      The items
+ * @param[in]  count      The number of items
+ * @param[in]  corpus     The corpus, NULL to only check reuse
+ * @param[out] results    One result per item
+ *
+ * @return     -
+ */
+void audit_items(const item_t* items, size_t count, const corpus_t* corpus, audit_result_t* results);
+
+
+#endif // AUDIT_H_
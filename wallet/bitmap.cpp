@@ -0,0 +1,322 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <stdint.h>
+
+#include "wallet.h"
+#include "bitmap.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Containers
+ ***************************************************/
+#define HIGH(v) ((v) >> BITMAP_CONTAINER_BITS)
+#define LOW(v) ((uint16_t)((v) & ((1 << BITMAP_CONTAINER_BITS) - 1)))
+
+static int c_find(const container_t* c, uint16_t low, uint32_t* position) {
+	uint32_t lo = 0, hi = c->cardinality;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (c->values[mid] < low) {lo = mid + 1;}
+		else {hi = mid;}
+	}
+	*position = lo;
+	return lo < c->cardinality && c->values[lo] == low;
+}
+
+static int c_contains(const container_t* c, uint16_t low) {
+	if (c->kind == CONTAINER_BITMAP) {return (c->words[low >> 6] >> (low & 63)) & 1;}
+	uint32_t position;
+	return c_find(c, low, &position);
+}
+
+static void c_words(const container_t* c, uint64_t words[BITMAP_WORDS]) {
+	if (c->kind == CONTAINER_BITMAP) {
+		memcpy(words, c->words, sizeof(c->words));
+		return;
+	}
+	memset(words, 0, BITMAP_WORDS * sizeof(uint64_t));
+	for (uint32_t i = 0; i < c->cardinality; ++i) {words[c->values[i] >> 6] |= (uint64_t)1 << (c->values[i] & 63);}
+}
+
+/**
+ * @brief      Stores a set of words in whichever form is smaller.
+ *
+ */
+static void c_from_words(container_t* c, const uint64_t words[BITMAP_WORDS]) {
+	uint32_t cardinality = 0;
+	for (int i = 0; i < BITMAP_WORDS; ++i) {cardinality += (uint32_t)__builtin_popcountll(words[i]);}
+	c->cardinality = cardinality;
+	if (cardinality > BITMAP_ARRAY_MAX) {
+		c->kind = CONTAINER_BITMAP;
+		memmove(c->words, words, sizeof(c->words));
+		return;
+	}
+	uint64_t copy[BITMAP_WORDS];
+	memcpy(copy, words, sizeof(copy));
+	c->kind = CONTAINER_ARRAY;
+	memset(c->values, 0, sizeof(c->values));
+	uint32_t n = 0;
+	for (int i = 0; i < BITMAP_WORDS; ++i) {
+		for (uint64_t w = copy[i]; w != 0; w &= w - 1) {c->values[n++] = (uint16_t)(i * 64 + __builtin_ctzll(w));}
+	}
+}
+
+static void c_add(container_t* c, uint16_t low) {
+	if (c->kind == CONTAINER_BITMAP) {
+		uint64_t bit = (uint64_t)1 << (low & 63);
+		c->cardinality += (c->words[low >> 6] & bit) == 0;
+		c->words[low >> 6] |= bit;
+		return;
+	}
+	uint32_t position;
+	if (c_find(c, low, &position)) {return;}
+	if (c->cardinality == BITMAP_ARRAY_MAX) {
+		uint64_t words[BITMAP_WORDS];
+		c_words(c, words);
+		words[low >> 6] |= (uint64_t)1 << (low & 63);
+		c_from_words(c, words);
+		return;
+	}
+	memmove(&c->values[position+1], &c->values[position], (c->cardinality - position) * sizeof(uint16_t));
+	c->values[position] = low;
+	++c->cardinality;
+}
+
+static void c_remove(container_t* c, uint16_t low) {
+	if (c->kind == CONTAINER_BITMAP) {
+		if (!c_contains(c, low)) {return;}
+		uint64_t words[BITMAP_WORDS];
+		c_words(c, words);
+		words[low >> 6] &= ~((uint64_t)1 << (low & 63));
+		c_from_words(c, words);
+		return;
+	}
+	uint32_t position;
+	if (!c_find(c, low, &position)) {return;}
+	--c->cardinality;
+	memmove(&c->values[position], &c->values[position+1], (c->cardinality - position) * sizeof(uint16_t));
+	c->values[c->cardinality] = 0;
+}
+
+/**
+ * @brief      Removes a value and decrements every larger one.
+ *
+ */
+static void c_delete(container_t* c, uint16_t low) {
+	if (c->kind == CONTAINER_ARRAY) {
+		c_remove(c, low);
+		for (uint32_t i = 0; i < c->cardinality; ++i) {c->values[i] -= (c->values[i] > low);}
+		return;
+	}
+	// shift the bits above 'low' down by one
+	uint64_t words[BITMAP_WORDS];
+	c_words(c, words);
+	int w = low >> 6, b = low & 63;
+	uint64_t below = b ? words[w] & (((uint64_t)1 << b) - 1) : 0;
+	uint64_t above = b == 63 ? 0 : (words[w] >> (b + 1)) << b;
+	words[w] = below | above;
+	for (int i = w; i + 1 < BITMAP_WORDS; ++i) {
+		words[i] |= (words[i+1] & 1) << 63;
+		words[i+1] >>= 1;
+	}
+	c_from_words(c, words);
+}
+
+static void c_and(const container_t* a, const container_t* b, container_t* out) {
+	container_t r;
+	memset(&r, 0, sizeof(r));
+	// arrays: merge
+	if (a->kind == CONTAINER_ARRAY && b->kind == CONTAINER_ARRAY) {
+		uint32_t i = 0, j = 0;
+		while (i < a->cardinality && j < b->cardinality) {
+			if (a->values[i] < b->values[j]) {++i;}
+			else if (a->values[i] > b->values[j]) {++j;}
+			else {r.values[r.cardinality++] = a->values[i]; ++i; ++j;}
+		}
+	}
+	// array and bitmap: probe
+	else if (a->kind == CONTAINER_ARRAY || b->kind == CONTAINER_ARRAY) {
+		const container_t* array = a->kind == CONTAINER_ARRAY ? a : b;
+		const container_t* bits = a->kind == CONTAINER_ARRAY ? b : a;
+		for (uint32_t i = 0; i < array->cardinality; ++i) {
+			if (c_contains(bits, array->values[i])) {r.values[r.cardinality++] = array->values[i];}
+		}
+	}
+	// bitmaps: word by word
+	else {
+		uint64_t words[BITMAP_WORDS];
+		for (int i = 0; i < BITMAP_WORDS; ++i) {words[i] = a->words[i] & b->words[i];}
+		c_from_words(&r, words);
+	}
+	*out = r;
+}
+
+static void c_or(const container_t* a, const container_t* b, container_t* out) {
+	container_t r;
+	memset(&r, 0, sizeof(r));
+	// small arrays: merge
+	if (a->kind == CONTAINER_ARRAY && b->kind == CONTAINER_ARRAY &&
+		a->cardinality + b->cardinality <= BITMAP_ARRAY_MAX) {
+		uint32_t i = 0, j = 0;
+		while (i < a->cardinality || j < b->cardinality) {
+			if (j == b->cardinality || (i < a->cardinality && a->values[i] < b->values[j])) {r.values[r.cardinality++] = a->values[i++];}
+			else if (i == a->cardinality || b->values[j] < a->values[i]) {r.values[r.cardinality++] = b->values[j++];}
+			else {r.values[r.cardinality++] = a->values[i]; ++i; ++j;}
+		}
+	}
+	else {
+		uint64_t wa[BITMAP_WORDS], wb[BITMAP_WORDS];
+		c_words(a, wa);
+		c_words(b, wb);
+		for (int i = 0; i < BITMAP_WORDS; ++i) {wa[i] |= wb[i];}
+		c_from_words(&r, wa);
+	}
+	*out = r;
+}
+
+static void c_andnot(const container_t* a, const container_t* b, container_t* out) {
+	container_t r;
+	memset(&r, 0, sizeof(r));
+	// array: keep the values missing from 'b'
+	if (a->kind == CONTAINER_ARRAY) {
+		for (uint32_t i = 0; i < a->cardinality; ++i) {
+			if (!c_contains(b, a->values[i])) {r.values[r.cardinality++] = a->values[i];}
+		}
+	}
+	else {
+		uint64_t wa[BITMAP_WORDS], wb[BITMAP_WORDS];
+		c_words(a, wa);
+		c_words(b, wb);
+		for (int i = 0; i < BITMAP_WORDS; ++i) {wa[i] &= ~wb[i];}
+		c_from_words(&r, wa);
+	}
+	*out = r;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+void bitmap_clear(bitmap_t* bitmap) {
+	memset(bitmap, 0, sizeof(bitmap_t));
+}
+
+void bitmap_fill(bitmap_t* bitmap, size_t size) {
+	bitmap_clear(bitmap);
+	if (size > BITMAP_CAPACITY) {size = BITMAP_CAPACITY;}
+	for (int k = 0; k < BITMAP_CONTAINERS && size > 0; ++k) {
+		size_t n = size < BITMAP_CONTAINER_SPAN ? size : BITMAP_CONTAINER_SPAN;
+		uint64_t words[BITMAP_WORDS];
+		memset(words, 0, sizeof(words));
+		for (size_t i = 0; i < n / 64; ++i) {words[i] = ~(uint64_t)0;}
+		if (n % 64) {words[n / 64] = ((uint64_t)1 << (n % 64)) - 1;}
+		c_from_words(&bitmap->containers[k], words);
+		size -= n;
+	}
+}
+
+int bitmap_valid(const bitmap_t* bitmap, size_t size) {
+	for (int k = 0; k < BITMAP_CONTAINERS; ++k) {
+		const container_t* c = &bitmap->containers[k];
+		uint32_t base = (uint32_t)k << BITMAP_CONTAINER_BITS;
+		if (c->kind == CONTAINER_ARRAY) {
+			if (c->cardinality > BITMAP_ARRAY_MAX) {return 0;}
+			for (uint32_t i = 0; i < c->cardinality; ++i) {
+				if ((i > 0 && c->values[i] <= c->values[i-1]) || base + c->values[i] >= size) {return 0;}
+			}
+		}
+		else if (c->kind == CONTAINER_BITMAP) {
+			uint64_t words[BITMAP_WORDS];
+			c_words(c, words);
+			container_t check;
+			c_from_words(&check, words);
+			if (check.kind != CONTAINER_BITMAP || check.cardinality != c->cardinality) {return 0;}
+			for (size_t v = size > base ? size - base : 0; v < (size_t)BITMAP_WORDS * 64; ++v) {
+				if ((words[v >> 6] >> (v & 63)) & 1) {return 0;}
+			}
+		}
+		else {return 0;}
+	}
+	return 1;
+}
+
+void bitmap_add(bitmap_t* bitmap, uint32_t value) {
+	if (value >= BITMAP_CAPACITY) {return;}
+	c_add(&bitmap->containers[HIGH(value)], LOW(value));
+}
+
+void bitmap_remove(bitmap_t* bitmap, uint32_t value) {
+	if (value >= BITMAP_CAPACITY) {return;}
+	c_remove(&bitmap->containers[HIGH(value)], LOW(value));
+}
+
+void bitmap_delete(bitmap_t* bitmap, uint32_t value) {
+	if (value >= BITMAP_CAPACITY) {return;}
+	uint32_t key = HIGH(value);
+	c_delete(&bitmap->containers[key], LOW(value));
+	// the first value of every following container moves to the end
+	// of the previous one
+	for (uint32_t k = key + 1; k < BITMAP_CONTAINERS; ++k) {
+		int first = c_contains(&bitmap->containers[k], 0);
+		c_delete(&bitmap->containers[k], 0);
+		if (first) {c_add(&bitmap->containers[k-1], (uint16_t)(BITMAP_CONTAINER_SPAN - 1));}
+	}
+}
+
+int bitmap_contains(const bitmap_t* bitmap, uint32_t value) {
+	if (value >= BITMAP_CAPACITY) {return 0;}
+	return c_contains(&bitmap->containers[HIGH(value)], LOW(value));
+}
+
+size_t bitmap_cardinality(const bitmap_t* bitmap) {
+	size_t total = 0;
+	for (int k = 0; k < BITMAP_CONTAINERS; ++k) {total += bitmap->containers[k].cardinality;}
+	return total;
+}
+
+void bitmap_and(const bitmap_t* a, const bitmap_t* b, bitmap_t* out) {
+	for (int k = 0; k < BITMAP_CONTAINERS; ++k) {c_and(&a->containers[k], &b->containers[k], &out->containers[k]);}
+}
+
+void bitmap_or(const bitmap_t* a, const bitmap_t* b, bitmap_t* out) {
+	for (int k = 0; k < BITMAP_CONTAINERS; ++k) {c_or(&a->containers[k], &b->containers[k], &out->containers[k]);}
+}
+
+void bitmap_andnot(const bitmap_t* a, const bitmap_t* b, bitmap_t* out) {
+	for (int k = 0; k < BITMAP_CONTAINERS; ++k) {c_andnot(&a->containers[k], &b->containers[k], &out->containers[k]);}
+}
+
+size_t bitmap_values(const bitmap_t* bitmap, uint32_t* values, size_t max) {
+	size_t n = 0;
+	for (int k = 0; k < BITMAP_CONTAINERS; ++k) {
+		const container_t* c = &bitmap->containers[k];
+		uint32_t base = (uint32_t)k << BITMAP_CONTAINER_BITS;
+		if (c->kind == CONTAINER_ARRAY) {
+			for (uint32_t i = 0; i < c->cardinality && n < max; ++i) {values[n++] = base + c->values[i];}
+			continue;
+		}
+		for (int i = 0; i < BITMAP_WORDS; ++i) {
+			for (uint64_t w = c->words[i]; w != 0 && n < max; w &= w - 1) {values[n++] = base + i * 64 + __builtin_ctzll(w);}
+		}
+	}
+	return n;
+}
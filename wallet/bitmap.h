@@ -0,0 +1,187 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BITMAP_H_
+#define BITMAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+// Roaring-style bitmap over item indexes: values are split by their
+// high bits into containers, and every container is stored either as
+// a sorted array of its low bits or as a plain bitmap, whichever is
+// smaller for its cardinality. Storage is fixed-size so that bitmaps
+// can live inside the wallet image.
+#define BITMAP_CAPACITY MAX_ITEMS		// values range over [0, capacity)
+#define BITMAP_CONTAINER_BITS 16
+#define BITMAP_CONTAINER_SPAN (BITMAP_CAPACITY < (1 << BITMAP_CONTAINER_BITS) ? BITMAP_CAPACITY : (1 << BITMAP_CONTAINER_BITS))
+#define BITMAP_CONTAINERS ((BITMAP_CAPACITY + (1 << BITMAP_CONTAINER_BITS) - 1) >> BITMAP_CONTAINER_BITS)
+#define BITMAP_WORDS ((BITMAP_CONTAINER_SPAN + 63) / 64)
+#define BITMAP_ARRAY_MAX (4 * BITMAP_WORDS)	// array and bitmap forms have the same size
+
+// container kinds
+#define CONTAINER_ARRAY 0
+#define CONTAINER_BITMAP 1
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// values sharing the same high bits
+struct Container {
+	uint32_t kind;			// CONTAINER_*
+	uint32_t cardinality;
+	union {
+		uint16_t values[BITMAP_ARRAY_MAX];	// sorted low bits
+		uint64_t words[BITMAP_WORDS];
+	};
+};
+typedef struct Container container_t;
+
+// set of item indexes
+struct Bitmap {
+	container_t containers[BITMAP_CONTAINERS];
+};
+typedef struct Bitmap bitmap_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Empties a bitmap.
+ *
+ * @param[out] bitmap    The bitmap
+ *
+ * @return     -
+ */
+void bitmap_clear(bitmap_t* bitmap);
+
+
+/**
+ * @brief      Fills a bitmap with every value in [0, size).
+ *
+ * @param[out] bitmap    The bitmap
+ * @param[in]  size      The number of values
+ *
+ * @return     -
+ */
+void bitmap_fill(bitmap_t* bitmap, size_t size);
+
+
+/**
+ * @brief      Checks that a bitmap read from untrusted storage is
+ *             well formed and only holds values below 'size'.
+ *
+ * @param[in]  bitmap    The bitmap
+ * @param[in]  size      The bound on the values
+ *
+ * @return     1 if the bitmap is valid, 0 otherwise.
+ */
+int bitmap_valid(const bitmap_t* bitmap, size_t size);
+
+
+/**
+ * @brief      Adds a value; containers switch to the bitmap form
+ *             once the array form would be larger.
+ *
+ * @param      bitmap    The bitmap
+ * @param[in]  value     The value, below BITMAP_CAPACITY
+ *
+ * @return     -
+ */
+void bitmap_add(bitmap_t* bitmap, uint32_t value);
+
+
+/**
+ * @brief      Removes a value; containers switch back to the array
+ *             form once it is the smaller one.
+ *
+ * @param      bitmap    The bitmap
+ * @param[in]  value     The value
+ *
+ * @return     -
+ */
+void bitmap_remove(bitmap_t* bitmap, uint32_t value);
+
+
+/**
+ * @brief      Removes a value and shifts every larger value down by
+ *             one. This follows the items of a wallet being compacted.
+ *
+ * @param      bitmap    The bitmap
+ * @param[in]  value     The value
+ *
+ * @return     -
+ */
+void bitmap_delete(bitmap_t* bitmap, uint32_t value);
+
+
+/**
+ * @brief      Tests a value.
+ *
+ * @param[in]  bitmap    The bitmap
+ * @param[in]  value     The value
+ *
+ * @return     1 if the value is present, 0 otherwise.
+ */
+int bitmap_contains(const bitmap_t* bitmap, uint32_t value);
+
+
+/**
+ * @brief      Counts the values of a bitmap.
+ *
+ * @param[in]  bitmap    The bitmap
+ *
+ * @return     The number of values.
+ */
+size_t bitmap_cardinality(const bitmap_t* bitmap);
+
+
+/**
+ * @brief      Set operations. 'out' may alias either input.
+ *
+ * @param[in]  a      The first bitmap
+ * @param[in]  b      The second bitmap
+ * @param[out] out    a AND b, a OR b, or a AND NOT b
+ *
+ * @return     -
+ */
+void bitmap_and(const bitmap_t* a, const bitmap_t* b, bitmap_t* out);
+void bitmap_or(const bitmap_t* a, const bitmap_t* b, bitmap_t* out);
+void bitmap_andnot(const bitmap_t* a, const bitmap_t* b, bitmap_t* out);
+
+
+/**
+ * @brief      Writes the values of a bitmap in increasing order.
+ *
+ * @param[in]  bitmap    The bitmap
+ * @param[out] values    The values
+ * @param[in]  max       The capacity of 'values'
+ *
+ * @return     The number of values written.
+ */
+size_t bitmap_values(const bitmap_t* bitmap, uint32_t* values, size_t max);
+
+
+#endif // BITMAP_H_
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "blob.h"
+#include "arena.h"
+#include "secure.h"
+#include "enclave.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Sealing
+ ***************************************************/
+static const uint8_t* enc_key(void) {
+	static uint8_t key[SEAL_KEY_SIZE];
+	static const int ready = (derive_seal_key("wallet-blob-encryption", key), 1);
+	(void)ready;
+	return key;
+}
+
+static const uint8_t* mac_key(void) {
+	static uint8_t key[SEAL_KEY_SIZE];
+	static const int ready = (derive_seal_key("wallet-blob-mac", key), 1);
+	(void)ready;
+	return key;
+}
+
+static void header_tag(const blob_header_t* header, uint8_t tag[MAC_TAG_SIZE]) {
+	uint8_t mac[SHA256_SIZE];
+	hmac_t ctx;
+	hmac_init(&ctx, mac_key(), SEAL_KEY_SIZE);
+	hmac_update(&ctx, header, offsetof(blob_header_t, tag));
+	hmac_final(&ctx, mac);
+	memcpy(tag, mac, MAC_TAG_SIZE);
+}
+
+static void chunk_tag(uint64_t id, uint64_t chunk, const uint8_t* ciphertext, uint32_t len, uint8_t tag[MAC_TAG_SIZE]) {
+	uint8_t mac[SHA256_SIZE];
+	hmac_t ctx;
+	hmac_init(&ctx, mac_key(), SEAL_KEY_SIZE);
+	hmac_update(&ctx, &id, sizeof(id));
+	hmac_update(&ctx, &chunk, sizeof(chunk));
+	hmac_update(&ctx, &len, sizeof(len));
+	hmac_update(&ctx, ciphertext, len);
+	hmac_final(&ctx, mac);
+	memcpy(tag, mac, MAC_TAG_SIZE);
+}
+
+// blob ids are never reused, so (id, chunk) never repeats under the key
+static void chunk_nonce(uint64_t id, uint64_t chunk, uint8_t nonce[CHACHA20_NONCE_SIZE]) {
+	uint32_t position = (uint32_t)chunk;
+	memcpy(nonce, &id, sizeof(id));
+	memcpy(nonce + sizeof(id), &position, sizeof(position));
+}
+
+static uint64_t chunk_offset(uint64_t chunk) {
+	return sizeof(blob_header_t) + chunk * BLOB_SEALED_CHUNK_SIZE;
+}
+
+/**
+ * @brief      Fills a chunk from the source, which may return less
+ *             than asked for.
+ *
+ */
+static int fill_chunk(blob_source_fn source, void* ctx, uint8_t* buf, size_t* len) {
+	*len = 0;
+	while (*len < BLOB_CHUNK_SIZE) {
+		long n = source(ctx, buf + *len, BLOB_CHUNK_SIZE - *len);
+		if (n < 0 || (size_t)n > BLOB_CHUNK_SIZE - *len) {return BLOB_ERR_STREAM;}
+		if (n == 0) {break;}
+		*len += (size_t)n;
+	}
+	return BLOB_OK;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+void blob_path(const char* wallet_path, uint64_t id, char path[BLOB_MAX_PATH]) {
+	snprintf(path, BLOB_MAX_PATH, "%s.blob.%016llx", wallet_path, (unsigned long long)id);
+}
+
+int blob_write(const char* path, uint64_t id, blob_source_fn source, void* ctx, uint64_t* size) {
+	uint8_t* plain = (uint8_t*)secure_malloc(BLOB_CHUNK_SIZE);
+	uint8_t* sealed = (uint8_t*)secure_malloc(BLOB_SEALED_CHUNK_SIZE);
+	if (plain == NULL || sealed == NULL) {
+		secure_free(plain);
+		secure_free(sealed);
+		return BLOB_ERR_MEMORY;
+	}
+
+	// chunks first, each handed out as soon as it is sealed
+	uint8_t nonce[CHACHA20_NONCE_SIZE];
+	uint64_t total = 0;
+	int ret = BLOB_OK;
+	for (uint64_t chunk = 0; ret == BLOB_OK; ++chunk) {
+		size_t len = 0;
+		ret = fill_chunk(source, ctx, plain, &len);
+		if (ret != BLOB_OK || len == 0) {break;}
+		if (total + len > MAX_BLOB_SIZE) {
+			ret = BLOB_ERR_SIZE;
+			break;
+		}
+		chunk_nonce(id, chunk, nonce);
+		chacha20_xor(enc_key(), nonce, 1, plain, sealed + MAC_TAG_SIZE, len);
+		chunk_tag(id, chunk, sealed + MAC_TAG_SIZE, (uint32_t)len, sealed);
+		ocall_t request = {OCALL_WRITE, path, sealed, MAC_TAG_SIZE + len, NULL, 0, chunk_offset(chunk), -1};
+		if (enclave_ocalls(&request, 1) != 0) {ret = BLOB_ERR_IO;}
+		total += len;
+		if (len < BLOB_CHUNK_SIZE) {break;}
+	}
+	secure_free(plain);
+	secure_free(sealed);
+	if (ret != BLOB_OK) {return ret;}
+
+	// then the header, which makes the blob valid
+	blob_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = BLOB_MAGIC;
+	header.version = BLOB_FORMAT_VERSION;
+	header.header_size = sizeof(blob_header_t);
+	header.chunk_size = BLOB_CHUNK_SIZE;
+	header.id = id;
+	header.size = total;
+	header_tag(&header, header.tag);
+	ocall_t store[] = {
+		{OCALL_WRITE, path, (const uint8_t*)&header, sizeof(header), NULL, 0, 0, -1},
+		{OCALL_FSYNC, path, NULL, 0, NULL, 0, 0, -1},
+	};
+	if (enclave_ocalls(store, 2) != 0) {return BLOB_ERR_IO;}
+	*size = total;
+	return BLOB_OK;
+}
+
+int blob_read(const char* path, uint64_t id, uint64_t size, blob_sink_fn sink, void* ctx) {
+	blob_header_t header;
+	uint8_t tag[MAC_TAG_SIZE];
+	ocall_t request = {OCALL_READ, path, NULL, sizeof(header), (uint8_t*)&header, 0, 0, -1};
+	if (enclave_ocalls(&request, 1) != 0) {return BLOB_ERR_IO;}
+	if (request.length != sizeof(header) || header.magic != BLOB_MAGIC || header.version != BLOB_FORMAT_VERSION ||
+		header.header_size != sizeof(blob_header_t) || header.chunk_size != BLOB_CHUNK_SIZE) {
+		return BLOB_ERR_FORMAT;
+	}
+	header_tag(&header, tag);
+	if (secure_memcmp(tag, header.tag, MAC_TAG_SIZE) != 0) {return BLOB_ERR_MAC;}
+	if (header.id != id || header.size != size) {return BLOB_ERR_FORMAT;}
+
+	uint8_t* plain = (uint8_t*)secure_malloc(BLOB_CHUNK_SIZE);
+	uint8_t* sealed = (uint8_t*)secure_malloc(BLOB_SEALED_CHUNK_SIZE);
+	if (plain == NULL || sealed == NULL) {
+		secure_free(plain);
+		secure_free(sealed);
+		return BLOB_ERR_MEMORY;
+	}
+	uint8_t nonce[CHACHA20_NONCE_SIZE];
+	uint64_t done = 0;
+	int ret = BLOB_OK;
+	for (uint64_t chunk = 0; done < size && ret == BLOB_OK; ++chunk) {
+		size_t len = size - done < BLOB_CHUNK_SIZE ? (size_t)(size - done) : BLOB_CHUNK_SIZE;
+		request = {OCALL_READ, path, NULL, MAC_TAG_SIZE + len, sealed, 0, chunk_offset(chunk), -1};
+		if (enclave_ocalls(&request, 1) != 0) {ret = BLOB_ERR_IO;}
+		else if (request.length != MAC_TAG_SIZE + len) {ret = BLOB_ERR_FORMAT;}
+		else {
+			chunk_tag(id, chunk, sealed + MAC_TAG_SIZE, (uint32_t)len, tag);
+			if (secure_memcmp(tag, sealed, MAC_TAG_SIZE) != 0) {ret = BLOB_ERR_MAC;}
+		}
+		if (ret != BLOB_OK) {break;}
+		chunk_nonce(id, chunk, nonce);
+		chacha20_xor(enc_key(), nonce, 1, sealed + MAC_TAG_SIZE, plain, len);
+		if (sink(ctx, plain, len) != 0) {ret = BLOB_ERR_STREAM;}
+		done += len;
+	}
+	secure_free(plain);
+	secure_free(sealed);
+	return ret;
+}
+
+int blob_remove(const char* path) {
+	ocall_t request = {OCALL_REMOVE, path, NULL, 0, NULL, 0, 0, -1};
+	return enclave_ocalls(&request, 1) == 0 ? BLOB_OK : BLOB_ERR_IO;
+}
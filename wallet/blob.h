@@ -0,0 +1,127 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BLOB_H_
+#define BLOB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wallet.h"
+#include "crypto.h"
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define BLOB_MAGIC 0x42584753		// "SGXB"
+#define BLOB_FORMAT_VERSION 1
+#define BLOB_SEALED_CHUNK_SIZE (MAC_TAG_SIZE + BLOB_CHUNK_SIZE)
+#define BLOB_MAX_PATH 4096
+
+// blob errors
+#define BLOB_OK 0
+#define BLOB_ERR_IO 1			// blob file could not be read or written
+#define BLOB_ERR_FORMAT 2		// not a blob file, or not the blob expected
+#define BLOB_ERR_MAC 3			// chunk tampered with
+#define BLOB_ERR_SIZE 4			// larger than MAX_BLOB_SIZE
+#define BLOB_ERR_STREAM 5		// the source or the sink failed
+#define BLOB_ERR_MEMORY 6		// allocation failed
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// blob file header, followed by the sealed chunks: a MAC tag, then up
+// to BLOB_CHUNK_SIZE bytes of ciphertext; only the last chunk is short
+struct BlobHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;	// sizeof(blob_header_t) at write time
+	uint32_t chunk_size;	// BLOB_CHUNK_SIZE at write time
+	uint32_t reserved;
+	uint64_t id;			// as referenced by the item
+	uint64_t size;			// plaintext length
+	uint8_t tag[MAC_TAG_SIZE];	// MAC of the fields above
+};
+typedef struct BlobHeader blob_header_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Names the file holding a blob, next to its wallet.
+ *
+ * @param[in]  wallet_path    The wallet file
+ * @param[in]  id             The blob
+ * @param[out] path           The blob file, BLOB_MAX_PATH bytes
+ *
+ * @return     -
+ */
+void blob_path(const char* wallet_path, uint64_t id, char path[BLOB_MAX_PATH]);
+
+
+/**
+ * @brief      Encrypts a stream into a new blob file, one chunk at a
+ *             time: only one chunk is ever held in memory. Each chunk
+ *             has its own nonce and its tag binds the blob id and the
+ *             chunk's position, so chunks cannot be moved between or
+ *             within blobs. The header is written last, so a blob cut
+ *             short by a crash is never valid.
+ *
+ * @param[in]  path      The blob file, which must not exist
+ * @param[in]  id        The blob, never reused
+ * @param[in]  source    Produces the content
+ * @param      ctx       Passed to 'source'
+ * @param[out] size      The length of the content
+ *
+ * @return     BLOB_OK if successful, BLOB_ERR_* otherwise.
+ */
+int blob_write(const char* path, uint64_t id, blob_source_fn source, void* ctx, uint64_t* size);
+
+
+/**
+ * @brief      Authenticates, decrypts and streams a blob, one chunk at
+ *             a time. Nothing reaches the sink from a chunk that
+ *             fails its tag; a blob shorter or longer than 'size' is
+ *             rejected before its first chunk.
+ *
+ * @param[in]  path    The blob file
+ * @param[in]  id      The blob expected
+ * @param[in]  size    Its length, as recorded in the item
+ * @param[in]  sink    Consumes the content
+ * @param      ctx     Passed to 'sink'
+ *
+ * @return     BLOB_OK if successful, BLOB_ERR_* otherwise.
+ */
+int blob_read(const char* path, uint64_t id, uint64_t size, blob_sink_fn sink, void* ctx);
+
+
+/**
+ * @brief      Deletes a blob file.
+ *
+ * @param[in]  path    The blob file
+ *
+ * @return     BLOB_OK if successful, BLOB_ERR_IO otherwise.
+ */
+int blob_remove(const char* path);
+
+
+#endif // BLOB_H_
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <stdint.h>
+
+#include "compress.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+static uint32_t read32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t hash32(uint32_t v) {
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t* put_length(uint8_t* op, size_t len) {
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+/**
+ * @brief      Emits one sequence: a token, the literal run and, unless
+ *             this is the last sequence, the back-reference.
+ *
+ */
+static uint8_t* put_sequence(uint8_t* op, const uint8_t* literals, size_t literal_len,
+	size_t offset, size_t match_len, int last) {
+	uint8_t* token = op++;
+	size_t match_code = last ? 0 : match_len - LZ_MIN_MATCH;
+	*token = (uint8_t)(((literal_len < 15 ? literal_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+	if (literal_len >= 15) {op = put_length(op, literal_len - 15);}
+	memcpy(op, literals, literal_len);
+	op += literal_len;
+	if (last) {return op;}
+	*op++ = (uint8_t)(offset & 0xff);
+	*op++ = (uint8_t)(offset >> 8);
+	if (match_code >= 15) {op = put_length(op, match_code - 15);}
+	return op;
+}
+
+static int get_length(const uint8_t** ip, const uint8_t* end, size_t* len) {
+	uint8_t b;
+	do {
+		if (*ip >= end) {return 1;}
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return 0;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+size_t lz_compress_bound(size_t size) {
+	return size + size/255 + 16;
+}
+
+size_t lz_compress(const void* src, size_t src_size, void* dst, size_t dst_size) {
+	if (dst_size < lz_compress_bound(src_size)) {return 0;}
+	const uint8_t* in = (const uint8_t*)src;
+	uint8_t* op = (uint8_t*)dst;
+	uint32_t table[1 << LZ_HASH_BITS];	// last position + 1 of each hash
+	memset(table, 0, sizeof(table));
+
+	size_t ip = 0, anchor = 0;
+	while (ip + LZ_MIN_MATCH <= src_size) {
+		uint32_t seq = read32(in + ip);
+		uint32_t h = hash32(seq);
+		size_t candidate = table[h];
+		table[h] = (uint32_t)(ip + 1);
+		if (candidate == 0 || ip - (candidate-1) > 0xffff || read32(in + candidate-1) != seq) {
+			++ip;
+			continue;
+		}
+
+		// extend the match as far as it goes
+		size_t ref = candidate - 1;
+		size_t match_len = LZ_MIN_MATCH;
+		while (ip + match_len < src_size && in[ref + match_len] == in[ip + match_len]) {++match_len;}
+		op = put_sequence(op, in + anchor, ip - anchor, ip - ref, match_len, 0);
+		ip += match_len;
+		anchor = ip;
+	}
+	op = put_sequence(op, in + anchor, src_size - anchor, 0, 0, 1);
+	return (size_t)(op - (uint8_t*)dst);
+}
+
+int lz_decompress_partial(const void* src, size_t src_size, void* dst, size_t dst_size, size_t* produced) {
+	const uint8_t* ip = (const uint8_t*)src;
+	const uint8_t* end = ip + src_size;
+	uint8_t* out = (uint8_t*)dst;
+	size_t& op = *produced;
+	op = 0;
+
+	while (ip < end) {
+		// literals
+		uint8_t token = *ip++;
+		size_t literal_len = token >> 4;
+		if (literal_len == 15 && get_length(&ip, end, &literal_len) != 0) {return 1;}
+		if (literal_len > (size_t)(end - ip) || literal_len > dst_size - op) {return 1;}
+		memcpy(out + op, ip, literal_len);
+		ip += literal_len;
+		op += literal_len;
+		if (ip == end) {break;}
+
+		// back-reference, possibly overlapping the output
+		if (end - ip < 2) {return 1;}
+		size_t offset = ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		size_t match_len = token & 0x0f;
+		if (match_len == 15 && get_length(&ip, end, &match_len) != 0) {return 1;}
+		match_len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > op || match_len > dst_size - op) {return 1;}
+		if (offset == 1) {memset(out + op, out[op-1], match_len);}
+		else if (offset >= match_len) {memcpy(out + op, out + op - offset, match_len);}
+		else {
+			for (size_t i = 0; i < match_len; ++i) {out[op+i] = out[op+i - offset];}
+		}
+		op += match_len;
+	}
+	return op != dst_size;
+}
+
+int lz_decompress(const void* src, size_t src_size, void* dst, size_t dst_size) {
+	size_t produced;
+	return lz_decompress_partial(src, src_size, dst, dst_size, &produced);
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+#include <stddef.h>
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define CODEC_NONE 0	// image stored as is
+#define CODEC_LZ 1		// in-tree LZ77 codec
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Computes the worst-case size of a compressed buffer.
+ *
+ * @param[in]  size    The size of the input
+ *
+ * @return     The size the output buffer must have.
+ */
+size_t lz_compress_bound(size_t size);
+
+
+/**
+ * @brief      Compresses a buffer. The format is a sequence of
+ *             LZ77 tokens (literal run, back-reference) in the
+ *             style of LZ4: long zero runs and repeated titles or
+ *             usernames collapse into a few bytes.
+ *
+ * @param[in]  src         The input buffer
+ * @param[in]  src_size    The size of the input
+ * @param[out] dst         The output buffer
+ * @param[in]  dst_size    The capacity of the output buffer
+ *
+ * @return     The compressed size, 0 if 'dst' is too small.
+ */
+size_t lz_compress(const void* src, size_t src_size, void* dst, size_t dst_size);
+
+
+/**
+ * @brief      Decompresses a buffer. Every length and offset is
+ *             bounds-checked, so corrupt input fails cleanly.
+ *
+ * @param[in]  src         The compressed buffer
+ * @param[in]  src_size    The size of the compressed buffer
+ * @param[out] dst         The output buffer
+ * @param[in]  dst_size    The exact size of the decompressed data
+ *
+ * @return     0 if successful, 1 otherwise.
+ */
+int lz_decompress(const void* src, size_t src_size, void* dst, size_t dst_size);
+
+
+/**
+ * @brief      Decompresses as much of a damaged buffer as possible.
+ *             Output produced before the first inconsistency is
+ *             kept, so intact leading records can be salvaged.
+ *
+ * @param[in]  src         The compressed buffer
+ * @param[in]  src_size    The size of the compressed buffer
+ * @param[out] dst         The output buffer
+ * @param[in]  dst_size    The expected size of the decompressed data
+ * @param[out] produced    The number of bytes decoded
+ *
+ * @return     0 if the whole buffer decoded, 1 otherwise.
+ */
+int lz_decompress_partial(const void* src, size_t src_size, void* dst, size_t dst_size, size_t* produced);
+
+
+#endif // COMPRESS_H_
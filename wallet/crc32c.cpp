@@ -0,0 +1,106 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC32C_X86
+#endif
+
+#include "crc32c.h"
+
+using namespace std;
+
+#define CRC32C_POLY 0x82f63b78	// reflected Castagnoli polynomial
+
+
+/***************************************************
+ * Software fallback
+ ***************************************************/
+static uint32_t table[8][256];
+
+static int init_table(void) {
+	for (uint32_t n = 0; n < 256; ++n) {
+		uint32_t crc = n;
+		for (int k = 0; k < 8; ++k) {crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));}
+		table[0][n] = crc;
+	}
+	for (uint32_t n = 0; n < 256; ++n) {
+		for (int k = 1; k < 8; ++k) {table[k][n] = (table[k-1][n] >> 8) ^ table[0][table[k-1][n] & 0xff];}
+	}
+	return 1;
+}
+
+static uint32_t crc_soft(uint32_t crc, const unsigned char* p, size_t len) {
+	static const int ready = init_table();
+	(void)ready;
+	while (len >= 8) {
+		uint64_t word;
+		memcpy(&word, p, 8);
+		word ^= crc;
+		crc = table[7][word & 0xff] ^ table[6][(word >> 8) & 0xff] ^
+			table[5][(word >> 16) & 0xff] ^ table[4][(word >> 24) & 0xff] ^
+			table[3][(word >> 32) & 0xff] ^ table[2][(word >> 40) & 0xff] ^
+			table[1][(word >> 48) & 0xff] ^ table[0][word >> 56];
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];}
+	return crc;
+}
+
+
+/***************************************************
+ * Hardware path
+ ***************************************************/
+#ifdef CRC32C_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc_hw(uint32_t crc, const unsigned char* p, size_t len) {
+	uint64_t crc64 = crc;
+	while (len >= 8) {
+		uint64_t word;
+		memcpy(&word, p, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+		p += 8;
+		len -= 8;
+	}
+	crc = (uint32_t)crc64;
+	while (len--) {crc = _mm_crc32_u8(crc, *p++);}
+	return crc;
+}
+#endif
+
+typedef uint32_t (*crc_fn)(uint32_t, const unsigned char*, size_t);
+
+static crc_fn select_kernel(void) {
+#ifdef CRC32C_X86
+	if (__builtin_cpu_supports("sse4.2")) {return crc_hw;}
+#endif
+	return crc_soft;
+}
+
+static const crc_fn crc_kernel = select_kernel();
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+uint32_t crc32c(uint32_t crc, const void* data, size_t len) {
+	return ~crc_kernel(~crc, (const unsigned char*)data, len);
+}
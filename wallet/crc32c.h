@@ -0,0 +1,44 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Computes the CRC32C (Castagnoli) of a buffer. Uses the
+ *             SSE4.2 crc32 instruction when the CPU supports it and
+ *             a slicing-by-8 table otherwise.
+ *
+ * @param[in]  crc     The CRC of the preceding data (0 to start)
+ * @param[in]  data    The buffer
+ * @param[in]  len     The size of the buffer
+ *
+ * @return     The updated CRC.
+ */
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+
+#endif // CRC32C_H_
@@ -0,0 +1,660 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <vector>
+#include <cstdlib>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#define CRYPTO_SSE2
+#endif
+
+#include "crypto.h"
+#include "secure.h"
+
+using namespace std;
+
+
+/***************************************************
+ * SHA-256
+ ***************************************************/
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t rotr(uint32_t x, int n) {
+	return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_block(uint32_t state[8], const uint8_t* p) {
+	uint32_t w[64];
+	for (int i = 0; i < 16; ++i) {
+		w[i] = ((uint32_t)p[4*i] << 24) | ((uint32_t)p[4*i+1] << 16) | ((uint32_t)p[4*i+2] << 8) | p[4*i+3];
+	}
+	for (int i = 16; i < 64; ++i) {
+		uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+		uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+	for (int i = 0; i < 64; ++i) {
+		uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+		uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void sha256_init(sha256_t* ctx) {
+	static const uint32_t iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	memcpy(ctx->state, iv, sizeof(iv));
+	ctx->length = 0;
+	ctx->used = 0;
+}
+
+void sha256_update(sha256_t* ctx, const void* data, size_t len) {
+	const uint8_t* p = (const uint8_t*)data;
+	ctx->length += len;
+	if (ctx->used > 0) {
+		size_t take = SHA256_BLOCK_SIZE - ctx->used;
+		if (take > len) {take = len;}
+		memcpy(ctx->block + ctx->used, p, take);
+		ctx->used += take;
+		p += take;
+		len -= take;
+		if (ctx->used < SHA256_BLOCK_SIZE) {return;}
+		sha256_block(ctx->state, ctx->block);
+		ctx->used = 0;
+	}
+	for (; len >= SHA256_BLOCK_SIZE; p += SHA256_BLOCK_SIZE, len -= SHA256_BLOCK_SIZE) {
+		sha256_block(ctx->state, p);
+	}
+	memcpy(ctx->block, p, len);
+	ctx->used = len;
+}
+
+void sha256_final(sha256_t* ctx, uint8_t digest[SHA256_SIZE]) {
+	uint64_t bits = ctx->length * 8;
+	uint8_t pad = 0x80;
+	sha256_update(ctx, &pad, 1);
+	pad = 0;
+	while (ctx->used != SHA256_BLOCK_SIZE - 8) {sha256_update(ctx, &pad, 1);}
+	uint8_t length[8];
+	for (int i = 0; i < 8; ++i) {length[i] = (uint8_t)(bits >> (56 - 8*i));}
+	sha256_update(ctx, length, 8);
+	for (int i = 0; i < 8; ++i) {
+		digest[4*i] = (uint8_t)(ctx->state[i] >> 24);
+		digest[4*i+1] = (uint8_t)(ctx->state[i] >> 16);
+		digest[4*i+2] = (uint8_t)(ctx->state[i] >> 8);
+		digest[4*i+3] = (uint8_t)ctx->state[i];
+	}
+	secure_zero(ctx, sizeof(sha256_t));
+}
+
+void sha256(const void* data, size_t len, uint8_t digest[SHA256_SIZE]) {
+	sha256_t ctx;
+	sha256_init(&ctx);
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, digest);
+}
+
+
+/***************************************************
+ * SHA-1
+ ***************************************************/
+static const uint32_t SHA1_IV[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+static const uint32_t SHA1_K[4] = {0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6};
+
+static uint32_t rotl(uint32_t x, int n) {
+	return (x << n) | (x >> (32 - n));
+}
+
+static uint32_t load_be32(const uint8_t* p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief      Pads a message into whole 64-byte blocks.
+ *
+ */
+static size_t sha1_pad(const uint8_t* data, size_t len, vector<uint8_t>& out) {
+	size_t blocks = (len + 8) / 64 + 1;
+	out.assign(blocks * 64, 0);
+	memcpy(out.data(), data, len);
+	out[len] = 0x80;
+	uint64_t bits = (uint64_t)len * 8;
+	for (int i = 0; i < 8; ++i) {out[blocks*64 - 1 - i] = (uint8_t)(bits >> (8*i));}
+	return blocks;
+}
+
+static void sha1_block(uint32_t state[5], const uint8_t* p) {
+	uint32_t w[80];
+	for (int i = 0; i < 16; ++i) {w[i] = load_be32(p + 4*i);}
+	for (int i = 16; i < 80; ++i) {w[i] = rotl(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);}
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+	for (int i = 0; i < 80; ++i) {
+		uint32_t f = i < 20 ? ((b & c) | (~b & d)) : (i < 40 || i >= 60) ? (b ^ c ^ d) : ((b & c) | (b & d) | (c & d));
+		uint32_t t = rotl(a, 5) + f + e + SHA1_K[i / 20] + w[i];
+		e = d; d = c; c = rotl(b, 30); b = a; a = t;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+}
+
+static void sha1_store(const uint32_t state[5], uint8_t digest[SHA1_SIZE]) {
+	for (int i = 0; i < 5; ++i) {
+		digest[4*i] = (uint8_t)(state[i] >> 24);
+		digest[4*i+1] = (uint8_t)(state[i] >> 16);
+		digest[4*i+2] = (uint8_t)(state[i] >> 8);
+		digest[4*i+3] = (uint8_t)state[i];
+	}
+}
+
+void sha1(const void* data, size_t len, uint8_t digest[SHA1_SIZE]) {
+	vector<uint8_t> padded;
+	size_t blocks = sha1_pad((const uint8_t*)data, len, padded);
+	uint32_t state[5];
+	memcpy(state, SHA1_IV, sizeof(state));
+	for (size_t i = 0; i < blocks; ++i) {sha1_block(state, padded.data() + 64*i);}
+	sha1_store(state, digest);
+	secure_zero(padded.data(), padded.size());
+}
+
+#ifdef CRYPTO_SSE2
+#define ROTL4(x, n) _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+
+void sha1_x4(const uint8_t* const data[SHA1_LANES], const size_t lens[SHA1_LANES], uint8_t digests[SHA1_LANES][SHA1_SIZE]) {
+	vector<uint8_t> padded[SHA1_LANES];
+	size_t blocks[SHA1_LANES], max_blocks = 0;
+	for (int j = 0; j < SHA1_LANES; ++j) {
+		blocks[j] = sha1_pad(data[j], lens[j], padded[j]);
+		if (blocks[j] > max_blocks) {max_blocks = blocks[j];}
+	}
+
+	__m128i state[5];
+	for (int i = 0; i < 5; ++i) {state[i] = _mm_set1_epi32((int)SHA1_IV[i]);}
+	for (size_t n = 0; n < max_blocks; ++n) {
+		// lanes whose message is already consumed keep their state
+		__m128i active = _mm_set_epi32(-(n < blocks[3]), -(n < blocks[2]), -(n < blocks[1]), -(n < blocks[0]));
+		__m128i w[80];
+		for (int i = 0; i < 16; ++i) {
+			uint32_t word[SHA1_LANES];
+			for (int j = 0; j < SHA1_LANES; ++j) {
+				word[j] = n < blocks[j] ? load_be32(padded[j].data() + 64*n + 4*i) : 0;
+			}
+			w[i] = _mm_set_epi32((int)word[3], (int)word[2], (int)word[1], (int)word[0]);
+		}
+		for (int i = 16; i < 80; ++i) {
+			__m128i x = _mm_xor_si128(_mm_xor_si128(w[i-3], w[i-8]), _mm_xor_si128(w[i-14], w[i-16]));
+			w[i] = ROTL4(x, 1);
+		}
+		__m128i a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+		for (int i = 0; i < 80; ++i) {
+			__m128i f;
+			if (i < 20) {f = _mm_or_si128(_mm_and_si128(b, c), _mm_andnot_si128(b, d));}
+			else if (i < 40 || i >= 60) {f = _mm_xor_si128(_mm_xor_si128(b, c), d);}
+			else {f = _mm_or_si128(_mm_and_si128(b, c), _mm_and_si128(d, _mm_or_si128(b, c)));}
+			__m128i t = _mm_add_epi32(_mm_add_epi32(ROTL4(a, 5), f), _mm_add_epi32(e, _mm_add_epi32(_mm_set1_epi32((int)SHA1_K[i / 20]), w[i])));
+			e = d; d = c; c = ROTL4(b, 30); b = a; a = t;
+		}
+		__m128i next[5] = {a, b, c, d, e};
+		for (int i = 0; i < 5; ++i) {
+			__m128i sum = _mm_add_epi32(state[i], next[i]);
+			state[i] = _mm_or_si128(_mm_and_si128(active, sum), _mm_andnot_si128(active, state[i]));
+		}
+	}
+
+	for (int i = 0; i < 5; ++i) {
+		uint32_t lanes[SHA1_LANES];
+		_mm_storeu_si128((__m128i*)lanes, state[i]);
+		for (int j = 0; j < SHA1_LANES; ++j) {
+			digests[j][4*i] = (uint8_t)(lanes[j] >> 24);
+			digests[j][4*i+1] = (uint8_t)(lanes[j] >> 16);
+			digests[j][4*i+2] = (uint8_t)(lanes[j] >> 8);
+			digests[j][4*i+3] = (uint8_t)lanes[j];
+		}
+	}
+	for (int j = 0; j < SHA1_LANES; ++j) {secure_zero(padded[j].data(), padded[j].size());}
+}
+#else
+void sha1_x4(const uint8_t* const data[SHA1_LANES], const size_t lens[SHA1_LANES], uint8_t digests[SHA1_LANES][SHA1_SIZE]) {
+	for (int j = 0; j < SHA1_LANES; ++j) {sha1(data[j], lens[j], digests[j]);}
+}
+#endif
+
+
+/***************************************************
+ * ChaCha20
+ ***************************************************/
+static inline uint32_t rotl32(uint32_t x, int n) {
+	return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t load32_le(const uint8_t* p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+#define CHACHA_QR(a, b, c, d) \
+	a += b; d = rotl32(d ^ a, 16); \
+	c += d; b = rotl32(b ^ c, 12); \
+	a += b; d = rotl32(d ^ a, 8); \
+	c += d; b = rotl32(b ^ c, 7);
+
+static void chacha20_block(const uint32_t input[16], uint8_t out[CHACHA20_BLOCK_SIZE]) {
+	uint32_t x[16];
+	memcpy(x, input, sizeof(x));
+	for (int i = 0; i < 10; ++i) {
+		CHACHA_QR(x[0], x[4], x[8], x[12]);
+		CHACHA_QR(x[1], x[5], x[9], x[13]);
+		CHACHA_QR(x[2], x[6], x[10], x[14]);
+		CHACHA_QR(x[3], x[7], x[11], x[15]);
+		CHACHA_QR(x[0], x[5], x[10], x[15]);
+		CHACHA_QR(x[1], x[6], x[11], x[12]);
+		CHACHA_QR(x[2], x[7], x[8], x[13]);
+		CHACHA_QR(x[3], x[4], x[9], x[14]);
+	}
+	for (int i = 0; i < 16; ++i) {
+		uint32_t v = x[i] + input[i];
+		out[4*i] = (uint8_t)v;
+		out[4*i+1] = (uint8_t)(v >> 8);
+		out[4*i+2] = (uint8_t)(v >> 16);
+		out[4*i+3] = (uint8_t)(v >> 24);
+	}
+	secure_zero(x, sizeof(x));
+}
+
+#ifdef CRYPTO_SSE2
+#define CHACHA_QR4(a, b, c, d) \
+	a = _mm_add_epi32(a, b); d = ROTL4(_mm_xor_si128(d, a), 16); \
+	c = _mm_add_epi32(c, d); b = ROTL4(_mm_xor_si128(b, c), 12); \
+	a = _mm_add_epi32(a, b); d = ROTL4(_mm_xor_si128(d, a), 8); \
+	c = _mm_add_epi32(c, d); b = ROTL4(_mm_xor_si128(b, c), 7);
+
+/**
+ * @brief      Computes CHACHA20_LANES consecutive blocks at once, one
+ *             per 32-bit slot of the vector registers.
+ *
+ */
+static void chacha20_x4(const uint32_t input[16], uint8_t out[CHACHA20_LANES * CHACHA20_BLOCK_SIZE]) {
+	__m128i start[16], x[16];
+	for (int i = 0; i < 16; ++i) {start[i] = _mm_set1_epi32((int)input[i]);}
+	start[12] = _mm_add_epi32(start[12], _mm_set_epi32(3, 2, 1, 0));
+	for (int i = 0; i < 16; ++i) {x[i] = start[i];}
+	for (int i = 0; i < 10; ++i) {
+		CHACHA_QR4(x[0], x[4], x[8], x[12]);
+		CHACHA_QR4(x[1], x[5], x[9], x[13]);
+		CHACHA_QR4(x[2], x[6], x[10], x[14]);
+		CHACHA_QR4(x[3], x[7], x[11], x[15]);
+		CHACHA_QR4(x[0], x[5], x[10], x[15]);
+		CHACHA_QR4(x[1], x[6], x[11], x[12]);
+		CHACHA_QR4(x[2], x[7], x[8], x[13]);
+		CHACHA_QR4(x[3], x[4], x[9], x[14]);
+	}
+	// x86 is little-endian: the words are stored as they are
+	uint32_t lanes[CHACHA20_LANES];
+	for (int i = 0; i < 16; ++i) {
+		_mm_storeu_si128((__m128i*)lanes, _mm_add_epi32(x[i], start[i]));
+		for (int j = 0; j < CHACHA20_LANES; ++j) {memcpy(out + j * CHACHA20_BLOCK_SIZE + 4*i, &lanes[j], 4);}
+		x[i] = _mm_setzero_si128();
+	}
+	secure_zero(lanes, sizeof(lanes));
+}
+#endif
+
+/**
+ * @brief      Computes the keystream blocks from the one in 'input'
+ *             on, CHACHA20_LANES at a time where SSE2 is available.
+ *
+ */
+static void chacha20_blocks(const uint32_t input[16], uint8_t* out, size_t blocks) {
+	uint32_t state[16];
+	memcpy(state, input, sizeof(state));
+#ifdef CRYPTO_SSE2
+	for (; blocks >= CHACHA20_LANES; blocks -= CHACHA20_LANES) {
+		chacha20_x4(state, out);
+		state[12] += CHACHA20_LANES;
+		out += CHACHA20_LANES * CHACHA20_BLOCK_SIZE;
+	}
+#endif
+	for (; blocks > 0; --blocks) {
+		chacha20_block(state, out);
+		++state[12];
+		out += CHACHA20_BLOCK_SIZE;
+	}
+	secure_zero(state, sizeof(state));
+}
+
+static void chacha20_setup(uint32_t state[16], const uint8_t key[CHACHA20_KEY_SIZE],
+	const uint8_t nonce[CHACHA20_NONCE_SIZE], uint32_t counter) {
+	state[0] = 0x61707865;
+	state[1] = 0x3320646e;
+	state[2] = 0x79622d32;
+	state[3] = 0x6b206574;
+	for (int i = 0; i < 8; ++i) {state[4+i] = load32_le(key + 4*i);}
+	state[12] = counter;
+	for (int i = 0; i < 3; ++i) {state[13+i] = load32_le(nonce + 4*i);}
+}
+
+void chacha20_xor(const uint8_t key[CHACHA20_KEY_SIZE], const uint8_t nonce[CHACHA20_NONCE_SIZE], uint32_t counter,
+	const void* in, void* out, size_t len) {
+	uint32_t state[16];
+	uint8_t keystream[CHACHA20_LANES * CHACHA20_BLOCK_SIZE];
+	chacha20_setup(state, key, nonce, counter);
+
+	const uint8_t* src = (const uint8_t*)in;
+	uint8_t* dst = (uint8_t*)out;
+	while (len > 0) {
+		size_t blocks = (len + CHACHA20_BLOCK_SIZE - 1) / CHACHA20_BLOCK_SIZE;
+		if (blocks > CHACHA20_LANES) {blocks = CHACHA20_LANES;}
+		chacha20_blocks(state, keystream, blocks);
+		size_t n = len < sizeof(keystream) ? len : sizeof(keystream);
+		for (size_t i = 0; i < n; ++i) {dst[i] = src[i] ^ keystream[i];}
+		state[12] += (uint32_t)blocks;
+		src += n;
+		dst += n;
+		len -= n;
+	}
+	secure_zero(state, sizeof(state));
+	secure_zero(keystream, sizeof(keystream));
+}
+
+void chacha20_keystream(const uint8_t key[CHACHA20_KEY_SIZE], const uint8_t nonce[CHACHA20_NONCE_SIZE],
+	uint32_t counter, void* out, size_t len) {
+	uint32_t state[16];
+	chacha20_setup(state, key, nonce, counter);
+	size_t blocks = len / CHACHA20_BLOCK_SIZE;
+	chacha20_blocks(state, (uint8_t*)out, blocks);
+	if (len % CHACHA20_BLOCK_SIZE != 0) {
+		uint8_t last[CHACHA20_BLOCK_SIZE];
+		state[12] += (uint32_t)blocks;
+		chacha20_block(state, last);
+		memcpy((uint8_t*)out + blocks * CHACHA20_BLOCK_SIZE, last, len % CHACHA20_BLOCK_SIZE);
+		secure_zero(last, sizeof(last));
+	}
+	secure_zero(state, sizeof(state));
+}
+
+
+/***************************************************
+ * HMAC-SHA256
+ ***************************************************/
+void hmac_init(hmac_t* ctx, const void* key, size_t key_len) {
+	uint8_t pad[SHA256_BLOCK_SIZE];
+	uint8_t hashed[SHA256_SIZE];
+	memset(pad, 0, sizeof(pad));
+	if (key_len > SHA256_BLOCK_SIZE) {
+		sha256(key, key_len, hashed);
+		memcpy(pad, hashed, SHA256_SIZE);
+	}
+	else {
+		memcpy(pad, key, key_len);
+	}
+	for (int i = 0; i < SHA256_BLOCK_SIZE; ++i) {pad[i] ^= 0x36;}
+	sha256_init(&ctx->inner);
+	sha256_update(&ctx->inner, pad, sizeof(pad));
+	for (int i = 0; i < SHA256_BLOCK_SIZE; ++i) {pad[i] ^= 0x36 ^ 0x5c;}
+	sha256_init(&ctx->outer);
+	sha256_update(&ctx->outer, pad, sizeof(pad));
+	secure_zero(pad, sizeof(pad));
+	secure_zero(hashed, sizeof(hashed));
+}
+
+void hmac_update(hmac_t* ctx, const void* data, size_t len) {
+	sha256_update(&ctx->inner, data, len);
+}
+
+void hmac_final(hmac_t* ctx, uint8_t mac[SHA256_SIZE]) {
+	uint8_t inner[SHA256_SIZE];
+	sha256_final(&ctx->inner, inner);
+	sha256_update(&ctx->outer, inner, sizeof(inner));
+	sha256_final(&ctx->outer, mac);
+	secure_zero(inner, sizeof(inner));
+}
+
+
+/***************************************************
+ * PBKDF2
+ ***************************************************/
+void pbkdf2_sha256(const void* password, size_t len, const uint8_t* salt, size_t salt_len,
+	uint32_t iterations, uint8_t* out, size_t out_len) {
+	hmac_t keyed, ctx;
+	uint8_t u[SHA256_SIZE], t[SHA256_SIZE];
+	hmac_init(&keyed, password, len);
+	for (uint32_t block = 1; out_len > 0; ++block) {
+		uint8_t index[4] = {(uint8_t)(block >> 24), (uint8_t)(block >> 16), (uint8_t)(block >> 8), (uint8_t)block};
+		ctx = keyed;
+		hmac_update(&ctx, salt, salt_len);
+		hmac_update(&ctx, index, sizeof(index));
+		hmac_final(&ctx, u);
+		memcpy(t, u, SHA256_SIZE);
+		for (uint32_t i = 1; i < iterations; ++i) {
+			ctx = keyed;
+			hmac_update(&ctx, u, SHA256_SIZE);
+			hmac_final(&ctx, u);
+			for (int j = 0; j < SHA256_SIZE; ++j) {t[j] ^= u[j];}
+		}
+		size_t n = out_len < SHA256_SIZE ? out_len : SHA256_SIZE;
+		memcpy(out, t, n);
+		out += n;
+		out_len -= n;
+	}
+	secure_zero(&keyed, sizeof(keyed));
+	secure_zero(&ctx, sizeof(ctx));
+	secure_zero(u, sizeof(u));
+	secure_zero(t, sizeof(t));
+}
+
+
+/***************************************************
+ * Sealing key
+ ***************************************************/
+static int secret_path(char* path, size_t size) {
+	const char* custom = getenv(SEAL_SECRET_ENV);
+	if (custom != NULL && custom[0] != '\0') {
+		return (size_t)snprintf(path, size, "%s", custom) < size ? 0 : -1;
+	}
+	const char* home = getenv("HOME");
+	if (home == NULL || home[0] == '\0') {return -1;}
+	return (size_t)snprintf(path, size, "%s/%s", home, SEAL_SECRET_FILE) < size ? 0 : -1;
+}
+
+/**
+ * @brief      Reads the install secret. Refuses a file other users
+ *             could read or replace.
+ *
+ */
+static int read_secret(const char* path, uint8_t secret[SEAL_KEY_SIZE]) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+	if (fd < 0) {return -1;}
+	struct stat st;
+	int ret = -1;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == geteuid()
+		&& (st.st_mode & 077) == 0 && st.st_size == SEAL_KEY_SIZE) {
+		ret = read(fd, secret, SEAL_KEY_SIZE) == SEAL_KEY_SIZE ? 0 : -1;
+	}
+	close(fd);
+	if (ret != 0) {errno = EACCES;}
+	return ret;
+}
+
+/**
+ * @brief      Creates the install secret. It is written to a private
+ *             temporary file and linked into place, so a concurrent
+ *             first use never sees a partial secret.
+ *
+ */
+static int create_secret(const char* path) {
+	char tmp[PATH_MAX];
+	uint8_t secret[SEAL_KEY_SIZE];
+	if ((size_t)snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid()) >= sizeof(tmp)) {return -1;}
+	if (random_bytes(secret, sizeof(secret)) != 0) {return -1;}
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+	if (fd < 0) {
+		secure_zero(secret, sizeof(secret));
+		return -1;
+	}
+	int ret = (write(fd, secret, sizeof(secret)) == (ssize_t)sizeof(secret) && fsync(fd) == 0) ? 0 : -1;
+	close(fd);
+	secure_zero(secret, sizeof(secret));
+	if (ret == 0 && link(tmp, path) != 0 && errno != EEXIST) {ret = -1;}
+	unlink(tmp);
+	return ret;
+}
+
+static const uint8_t* install_secret(void) {
+	static uint8_t secret[SEAL_KEY_SIZE];
+	static const int ready = [] {
+		char path[PATH_MAX];
+		if (secret_path(path, sizeof(path)) != 0) {return 0;}
+		if (read_secret(path, secret) == 0) {return 1;}
+		if (errno != ENOENT || create_secret(path) != 0) {return 0;}
+		return read_secret(path, secret) == 0 ? 1 : 0;
+	}();
+	return ready ? secret : NULL;
+}
+
+int derive_seal_key(const char* label, uint8_t key[SEAL_KEY_SIZE]) {
+	const uint8_t* secret = install_secret();
+	if (secret == NULL) {
+		random_bytes(key, SEAL_KEY_SIZE);
+		return -1;
+	}
+	hmac_t ctx;
+	hmac_init(&ctx, secret, SEAL_KEY_SIZE);
+	hmac_update(&ctx, label, strlen(label));
+	hmac_final(&ctx, key);
+	secure_zero(&ctx, sizeof(ctx));
+	return 0;
+}
+
+
+/***************************************************
+ * Random source
+ ***************************************************/
+int random_bytes(void* buf, size_t len) {
+	uint8_t* p = (uint8_t*)buf;
+	while (len > 0) {
+		ssize_t n = getrandom(p, len, 0);
+		if (n < 0 && errno == EINTR) {continue;}
+		if (n <= 0) {break;}
+		p += n;
+		len -= (size_t)n;
+	}
+	if (len == 0) {return 0;}
+
+	// kernels without getrandom
+	FILE* file = fopen("/dev/urandom", "r");
+	if (file == NULL) {return -1;}
+	size_t n = fread(p, 1, len, file);
+	fclose(file);
+	return n == len ? 0 : -1;
+}
+
+
+/***************************************************
+ * CSPRNG
+ ***************************************************/
+/**
+ * @brief      Refills the buffer with keystream and replaces the key
+ *             with its first bytes, which are then wiped: a later
+ *             compromise cannot recover earlier output. The system's
+ *             random source is mixed in every CSPRNG_RESEED_BYTES.
+ *
+ */
+static int csprng_refill(csprng_t* rng) {
+	if (rng->since_reseed >= CSPRNG_RESEED_BYTES) {
+		uint8_t fresh[CHACHA20_KEY_SIZE];
+		if (random_bytes(fresh, sizeof(fresh)) != 0) {return -1;}
+		for (int i = 0; i < CHACHA20_KEY_SIZE; ++i) {rng->key[i] ^= fresh[i];}
+		secure_zero(fresh, sizeof(fresh));
+		rng->since_reseed = 0;
+	}
+	const uint8_t nonce[CHACHA20_NONCE_SIZE] = {0};
+	chacha20_keystream(rng->key, nonce, 0, rng->buffer, CSPRNG_BUFFER_SIZE);
+	memcpy(rng->key, rng->buffer, CHACHA20_KEY_SIZE);
+	secure_zero(rng->buffer, CHACHA20_KEY_SIZE);
+	rng->used = CHACHA20_KEY_SIZE;
+	rng->since_reseed += CSPRNG_BUFFER_SIZE;
+	return 0;
+}
+
+int csprng_init(csprng_t* rng) {
+	memset(rng, 0, sizeof(csprng_t));
+	if (random_bytes(rng->key, CHACHA20_KEY_SIZE) != 0) {return -1;}
+	return csprng_refill(rng);
+}
+
+int csprng_bytes(csprng_t* rng, void* buf, size_t len) {
+	uint8_t* p = (uint8_t*)buf;
+	while (len > 0) {
+		if (rng->used == CSPRNG_BUFFER_SIZE && csprng_refill(rng) != 0) {return -1;}
+		size_t n = CSPRNG_BUFFER_SIZE - rng->used;
+		if (n > len) {n = len;}
+		memcpy(p, rng->buffer + rng->used, n);
+		secure_zero(rng->buffer + rng->used, n);
+		rng->used += n;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int csprng_uniform(csprng_t* rng, uint32_t bound, uint32_t* value) {
+	// values from the incomplete last range would favour the low
+	// results: draw again. Small bounds draw a byte at a time
+	if (bound == 0) {return -1;}
+	if (bound <= 256) {
+		uint32_t limit = 256 - 256 % bound;
+		uint8_t byte;
+		do {
+			if (csprng_bytes(rng, &byte, 1) != 0) {return -1;}
+		} while (byte >= limit);
+		*value = byte % bound;
+		return 0;
+	}
+	uint64_t limit = (1ull << 32) - (1ull << 32) % bound;
+	uint32_t word;
+	do {
+		if (csprng_bytes(rng, &word, sizeof(word)) != 0) {return -1;}
+	} while (word >= limit);
+	*value = word % bound;
+	return 0;
+}
+
+void csprng_free(csprng_t* rng) {
+	secure_zero(rng, sizeof(csprng_t));
+}
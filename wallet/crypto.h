@@ -0,0 +1,257 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CRYPTO_H_
+#define CRYPTO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define SHA1_SIZE 20
+#define SHA1_LANES 4			// messages hashed together by sha1_x4
+#define SHA256_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+#define MAC_TAG_SIZE 16			// truncated HMAC-SHA256 tag
+#define SEAL_KEY_SIZE 32
+#define CHACHA20_KEY_SIZE 32
+#define CHACHA20_NONCE_SIZE 12
+#define CHACHA20_BLOCK_SIZE 64
+#define CHACHA20_LANES 4		// blocks computed together with SSE2
+#define CSPRNG_BUFFER_SIZE 1024	// keystream generated at once by the CSPRNG
+#define CSPRNG_RESEED_BYTES (1 << 20)	// output between two reseeds from the system
+#define SEAL_SECRET_ENV "SGX_WALLET_SEAL_KEY"	// overrides the path of the install secret
+#define SEAL_SECRET_FILE ".sgx-wallet.key"	// install secret, in $HOME
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// SHA-256 context
+struct Sha256 {
+	uint32_t state[8];
+	uint64_t length;
+	uint8_t block[SHA256_BLOCK_SIZE];
+	size_t used;
+};
+typedef struct Sha256 sha256_t;
+
+// HMAC-SHA256 context
+struct Hmac {
+	sha256_t inner;
+	sha256_t outer;
+};
+typedef struct Hmac hmac_t;
+
+// ChaCha20 CSPRNG with fast key erasure
+struct Csprng {
+	uint8_t key[CHACHA20_KEY_SIZE];
+	uint8_t buffer[CSPRNG_BUFFER_SIZE];		// output not handed out yet, from 'used' on
+	size_t used;
+	uint64_t since_reseed;
+};
+typedef struct Csprng csprng_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Incremental SHA-256.
+ *
+ * @param      ctx       The context
+ * @param[in]  data      The data to hash
+ * @param[in]  len       The size of the data
+ * @param[out] digest    The SHA256_SIZE-byte digest
+ *
+ * @return     -
+ */
+void sha256_init(sha256_t* ctx);
+void sha256_update(sha256_t* ctx, const void* data, size_t len);
+void sha256_final(sha256_t* ctx, uint8_t digest[SHA256_SIZE]);
+
+
+/**
+ * @brief      One-shot SHA-256.
+ *
+ * @param[in]  data      The data to hash
+ * @param[in]  len       The size of the data
+ * @param[out] digest    The SHA256_SIZE-byte digest
+ *
+ * @return     -
+ */
+void sha256(const void* data, size_t len, uint8_t digest[SHA256_SIZE]);
+
+
+/**
+ * @brief      One-shot SHA-1. Only used to match the SHA-1 corpora
+ *             of breached passwords, never for integrity.
+ *
+ * @param[in]  data      The data to hash
+ * @param[in]  len       The size of the data
+ * @param[out] digest    The SHA1_SIZE-byte digest
+ *
+ * @return     -
+ */
+void sha1(const void* data, size_t len, uint8_t digest[SHA1_SIZE]);
+
+
+/**
+ * @brief      Hashes SHA1_LANES messages at once. With SSE2 the lanes
+ *             run in parallel in the 32-bit slots of a vector
+ *             register; messages of different lengths are supported.
+ *
+ * @param[in]  data       The messages
+ * @param[in]  lens       The sizes of the messages
+ * @param[out] digests    The SHA1_SIZE-byte digests
+ *
+ * @return     -
+ */
+void sha1_x4(const uint8_t* const data[SHA1_LANES], const size_t lens[SHA1_LANES], uint8_t digests[SHA1_LANES][SHA1_SIZE]);
+
+
+/**
+ * @brief      Encrypts or decrypts with ChaCha20 (RFC 8439): XORs the
+ *             keystream starting at block 'counter' into the data.
+ *             'in' and 'out' may be the same buffer.
+ *
+ * @param[in]  key        The CHACHA20_KEY_SIZE-byte key
+ * @param[in]  nonce      The CHACHA20_NONCE_SIZE-byte nonce, never
+ *                        reused with the same key
+ * @param[in]  counter    The first block
+ * @param[in]  in         The input
+ * @param[out] out        The output
+ * @param[in]  len        The number of bytes
+ *
+ * @return     -
+ */
+void chacha20_xor(const uint8_t key[CHACHA20_KEY_SIZE], const uint8_t nonce[CHACHA20_NONCE_SIZE], uint32_t counter,
+	const void* in, void* out, size_t len);
+
+
+/**
+ * @brief      Writes the ChaCha20 keystream starting at block
+ *             'counter'. With SSE2, CHACHA20_LANES blocks are
+ *             computed at once.
+ *
+ * @param[in]  key        The CHACHA20_KEY_SIZE-byte key
+ * @param[in]  nonce      The CHACHA20_NONCE_SIZE-byte nonce
+ * @param[in]  counter    The first block
+ * @param[out] out        The keystream
+ * @param[in]  len        The number of bytes
+ *
+ * @return     -
+ */
+void chacha20_keystream(const uint8_t key[CHACHA20_KEY_SIZE], const uint8_t nonce[CHACHA20_NONCE_SIZE],
+	uint32_t counter, void* out, size_t len);
+
+
+/**
+ * @brief      Incremental HMAC-SHA256. The context is wiped by
+ *             hmac_final.
+ *
+ * @param      ctx       The context
+ * @param[in]  key       The key
+ * @param[in]  key_len   The size of the key
+ * @param[in]  data      The data to authenticate
+ * @param[in]  len       The size of the data
+ * @param[out] mac       The SHA256_SIZE-byte MAC
+ *
+ * @return     -
+ */
+void hmac_init(hmac_t* ctx, const void* key, size_t key_len);
+void hmac_update(hmac_t* ctx, const void* data, size_t len);
+void hmac_final(hmac_t* ctx, uint8_t mac[SHA256_SIZE]);
+
+
+/**
+ * @brief      Stretches a password with PBKDF2-HMAC-SHA256 (RFC 8018).
+ *             The keyed HMAC state is computed once and copied for
+ *             every iteration.
+ *
+ * @param[in]  password      The password
+ * @param[in]  len           The size of the password
+ * @param[in]  salt          The salt
+ * @param[in]  salt_len      The size of the salt
+ * @param[in]  iterations    The number of iterations, 1 at least
+ * @param[out] out           The derived key
+ * @param[in]  out_len       The size of the derived key
+ *
+ * @return     -
+ */
+void pbkdf2_sha256(const void* password, size_t len, const uint8_t* salt, size_t salt_len,
+	uint32_t iterations, uint8_t* out, size_t out_len);
+
+
+/**
+ * @brief      Derives a sealing key for the given purpose. On SGX
+ *             this is sgx_get_key(SGX_KEYSELECT_SEAL), bound to the
+ *             enclave identity; this build keys it with a random
+ *             install secret, kept in a file only its owner can read
+ *             (SEAL_SECRET_FILE, or $SEAL_SECRET_ENV) and created on
+ *             first use. If the secret is unavailable the key is
+ *             random, so nothing it seals ever verifies.
+ *
+ * @param[in]  label    The purpose of the key
+ * @param[out] key      The SEAL_KEY_SIZE-byte key
+ *
+ * @return     0 if successful, -1 if the install secret is unavailable.
+ */
+int derive_seal_key(const char* label, uint8_t key[SEAL_KEY_SIZE]);
+
+
+/**
+ * @brief      Fills a buffer from the system's random source. On SGX
+ *             this is sgx_read_rand; this build asks the kernel.
+ *
+ * @param[out] buf    The buffer
+ * @param[in]  len    The number of bytes
+ *
+ * @return     0 if successful, -1 otherwise.
+ */
+int random_bytes(void* buf, size_t len);
+
+
+/**
+ * @brief      A CSPRNG for bulk output: ChaCha20 keystream generated
+ *             CSPRNG_BUFFER_SIZE bytes at a time, rekeyed from its own
+ *             output at every refill and reseeded from random_bytes
+ *             every CSPRNG_RESEED_BYTES. Output is wiped from the
+ *             buffer as it is handed out. Not thread-safe: one per
+ *             thread. csprng_free wipes it.
+ *
+ * @param      rng      The CSPRNG
+ * @param[out] buf      The buffer to fill
+ * @param[in]  len      The number of bytes
+ * @param[in]  bound    The number of possible values, 1 at least
+ * @param[out] value    A value drawn uniformly in [0, bound)
+ *
+ * @return     0 if successful, -1 if the bound is 0 or the system's
+ *             random source failed.
+ */
+int csprng_init(csprng_t* rng);
+int csprng_bytes(csprng_t* rng, void* buf, size_t len);
+int csprng_uniform(csprng_t* rng, uint32_t bound, uint32_t* value);
+void csprng_free(csprng_t* rng);
+
+
+#endif // CRYPTO_H_
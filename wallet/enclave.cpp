@@ -0,0 +1,477 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <cstdlib>
+#include <errno.h>
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "enclave.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Request rings
+ ***************************************************/
+// a call waiting for a thread on the other side
+struct Job {
+	ecall_fn fn;
+	void* ctx;
+	int result;
+	atomic<int> done;
+};
+
+// bounded multi-producer, multi-consumer ring in shared memory: each
+// cell's sequence number tells whether it is free for the producer at
+// that position or full for the consumer
+struct Ring {
+	struct {
+		atomic<size_t> sequence;
+		struct Job* job;
+	} cells[ENCLAVE_RING_SIZE];
+	alignas(64) atomic<size_t> tail;	// next position to fill
+	alignas(64) atomic<size_t> head;	// next position to serve
+};
+
+static void ring_init(struct Ring* ring) {
+	for (size_t i = 0; i < ENCLAVE_RING_SIZE; ++i) {
+		ring->cells[i].sequence.store(i, memory_order_relaxed);
+		ring->cells[i].job = NULL;
+	}
+	ring->tail.store(0, memory_order_relaxed);
+	ring->head.store(0, memory_order_relaxed);
+}
+
+static int ring_push(struct Ring* ring, struct Job* job) {
+	size_t pos = ring->tail.load(memory_order_relaxed);
+	for (;;) {
+		auto* cell = &ring->cells[pos & (ENCLAVE_RING_SIZE - 1)];
+		intptr_t dif = (intptr_t)cell->sequence.load(memory_order_acquire) - (intptr_t)pos;
+		if (dif == 0) {
+			if (ring->tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+				cell->job = job;
+				cell->sequence.store(pos + 1, memory_order_release);
+				return 1;
+			}
+		}
+		else if (dif < 0) {return 0;}	// full
+		else {pos = ring->tail.load(memory_order_relaxed);}
+	}
+}
+
+static struct Job* ring_pop(struct Ring* ring) {
+	size_t pos = ring->head.load(memory_order_relaxed);
+	for (;;) {
+		auto* cell = &ring->cells[pos & (ENCLAVE_RING_SIZE - 1)];
+		intptr_t dif = (intptr_t)cell->sequence.load(memory_order_acquire) - (intptr_t)(pos + 1);
+		if (dif == 0) {
+			if (ring->head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+				struct Job* job = cell->job;
+				cell->sequence.store(pos + ENCLAVE_RING_SIZE, memory_order_release);
+				return job;
+			}
+		}
+		else if (dif < 0) {return NULL;}	// empty
+		else {pos = ring->head.load(memory_order_relaxed);}
+	}
+}
+
+
+/***************************************************
+ * State
+ ***************************************************/
+static int mode = ENCLAVE_DIRECT;
+static uint32_t transition_ns = ENCLAVE_TRANSITION_NS;
+static atomic<bool> running(false);
+static vector<thread> workers;
+static struct Ring ecall_ring;	// served by the trusted worker
+static struct Ring ocall_ring;	// served by the untrusted I/O threads
+
+static atomic<uint64_t> ecalls(0), ocalls(0), transitions(0), batches(0), fallbacks(0);
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+static uint64_t clock_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief      Pays for one transition: EENTER/EEXIT flush the TLB and
+ *             save the thread context, which is simulated by burning
+ *             CPU rather than sleeping.
+ *
+ */
+static void charge_transition(void) {
+	transitions.fetch_add(1, memory_order_relaxed);
+	uint64_t end = clock_ns() + transition_ns;
+	while (clock_ns() < end) {}
+}
+
+static void serve(struct Ring* ring) {
+	uint32_t idle = 0;
+	while (running.load(memory_order_acquire)) {
+		struct Job* job = ring_pop(ring);
+		if (job == NULL) {
+			// spin for a while, then give the core back
+			if (++idle < ENCLAVE_SPIN_ROUNDS) {sched_yield();}
+			else {usleep(50);}
+			continue;
+		}
+		idle = 0;
+		job->result = job->fn(job->ctx);
+		job->done.store(1, memory_order_release);
+	}
+}
+
+static void wait_job(struct Job* job) {
+	while (!job->done.load(memory_order_acquire)) {sched_yield();}
+}
+
+static int load_file(ocall_t* call) {
+	FILE* file = fopen(call->path, "r");
+	if (file == NULL) {
+		call->out = NULL;
+		call->length = 0;
+		return errno == ENOENT ? 0 : -1;
+	}
+	long size = -1;
+	if (fseek(file, 0, SEEK_END) == 0) {size = ftell(file);}
+	int ret = -1;
+	call->out = size >= 0 ? (uint8_t*)malloc((size_t)size + 1) : NULL;
+	if (call->out != NULL && fseek(file, 0, SEEK_SET) == 0 &&
+		fread(call->out, 1, (size_t)size, file) == (size_t)size) {
+		call->length = (size_t)size;
+		ret = 0;
+	}
+	fclose(file);
+	if (ret != 0) {
+		free(call->out);
+		call->out = NULL;
+	}
+	return ret;
+}
+
+// a renamed file is only durable once its directory is flushed too
+static int fsync_directory(const char* path) {
+	const char* slash = strrchr(path, '/');
+	string directory = slash == NULL ? string(".") : string(path, slash == path ? 1 : (size_t)(slash - path));
+	int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {return -1;}
+	int ret = fsync(fd);
+	close(fd);
+	return ret == 0 ? 0 : -1;
+}
+
+// the content goes to a temporary file, flushed, then renamed over the
+// old one: a crash leaves either version whole, never a mix of both
+static int save_file(const ocall_t* call) {
+	string tmp_path = string(call->path) + ".tmp";
+	int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) {return -1;}
+	size_t done = 0;
+	while (done < call->length) {
+		ssize_t n = write(fd, call->data + done, call->length - done);
+		if (n < 0 && errno == EINTR) {continue;}
+		if (n <= 0) {break;}
+		done += (size_t)n;
+	}
+	int ret = (done == call->length && fsync(fd) == 0) ? 0 : -1;
+	if (close(fd) != 0) {ret = -1;}
+	if (ret == 0 && rename(tmp_path.c_str(), call->path) != 0) {ret = -1;}
+	if (ret != 0) {
+		remove(tmp_path.c_str());
+		return -1;
+	}
+	return fsync_directory(call->path);
+}
+
+// a request names its file by path, or by the handle of a file
+// already open, which it must leave open
+static int use_file(const ocall_t* call, int flags) {
+	if (call->path == NULL) {return call->handle;}
+	return open(call->path, flags | O_CLOEXEC, 0600);
+}
+
+static int done_with_file(const ocall_t* call, int fd) {
+	if (call->path == NULL) {return 0;}
+	return close(fd) == 0 ? 0 : -1;
+}
+
+static int fsync_file(const ocall_t* call) {
+	int fd = use_file(call, O_RDONLY);
+	if (fd < 0) {return -1;}
+	int ret = fsync(fd) == 0 ? 0 : -1;
+	if (done_with_file(call, fd) != 0) {ret = -1;}
+	return ret;
+}
+
+// short reads only happen at the end of the file
+static int read_part(ocall_t* call) {
+	int fd = use_file(call, O_RDONLY);
+	if (fd < 0) {return -1;}
+	size_t done = 0;
+	int ret = 0;
+	while (done < call->length) {
+		ssize_t n = pread(fd, call->out + done, call->length - done, (off_t)(call->offset + done));
+		if (n < 0 && errno == EINTR) {continue;}
+		if (n < 0) {ret = -1;}
+		if (n <= 0) {break;}
+		done += (size_t)n;
+	}
+	done_with_file(call, fd);
+	call->length = done;
+	return ret;
+}
+
+static int write_part(const ocall_t* call) {
+	int fd = use_file(call, O_WRONLY | O_CREAT);
+	if (fd < 0) {return -1;}
+	size_t done = 0;
+	while (done < call->length) {
+		ssize_t n = pwrite(fd, call->data + done, call->length - done, (off_t)(call->offset + done));
+		if (n < 0 && errno == EINTR) {continue;}
+		if (n <= 0) {break;}
+		done += (size_t)n;
+	}
+	int ret = (done == call->length) ? 0 : -1;
+	if (done_with_file(call, fd) != 0) {ret = -1;}
+	return ret;
+}
+
+static int size_file(ocall_t* call) {
+	int fd = use_file(call, O_RDONLY);
+	if (fd < 0) {return -1;}
+	struct stat st;
+	int ret = fstat(fd, &st) == 0 ? 0 : -1;
+	if (ret == 0) {call->length = (size_t)st.st_size;}
+	done_with_file(call, fd);
+	return ret;
+}
+
+static int truncate_file(const ocall_t* call) {
+	int fd = use_file(call, O_WRONLY);
+	if (fd < 0) {return -1;}
+	int ret = ftruncate(fd, (off_t)call->offset) == 0 ? 0 : -1;
+	if (done_with_file(call, fd) != 0) {ret = -1;}
+	return ret;
+}
+
+static int open_file(ocall_t* call) {
+	call->handle = open(call->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	return call->handle >= 0 ? 0 : -1;
+}
+
+// the lock belongs to the open file, which stays open until released
+static int lock_file(ocall_t* call) {
+	if (open_file(call) != 0) {return -1;}
+	while (flock(call->handle, LOCK_EX) != 0) {
+		if (errno != EINTR) {
+			close(call->handle);
+			call->handle = -1;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int close_file(const ocall_t* call) {
+	return close(call->handle) == 0 ? 0 : -1;
+}
+
+// the enclave reads the mapping in place; the file need not stay open
+static int map_file(ocall_t* call) {
+	int fd = open(call->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {return -1;}
+	struct stat st;
+	void* map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) {return -1;}
+	madvise(map, (size_t)st.st_size, (int)call->offset);
+	call->out = (uint8_t*)map;
+	call->length = (size_t)st.st_size;
+	call->offset = (uint64_t)st.st_mtime;
+	return 0;
+}
+
+// linked under the new name, then unlinked: an existing file is never replaced
+static int rename_file(const ocall_t* call) {
+	if (link(call->path, (const char*)call->data) != 0) {return -1;}
+	return unlink(call->path) == 0 ? 0 : -1;
+}
+
+// the host's clock: the enclave has no trusted time source
+static int read_clock(ocall_t* call) {
+	time_t now = time(NULL);
+	if (now == (time_t)-1) {return -1;}
+	call->offset = (uint64_t)now;
+	return 0;
+}
+
+static int run_ocall(ocall_t* call) {
+	switch (call->type) {
+		case OCALL_LOAD: return load_file(call);
+		case OCALL_SAVE: return save_file(call);
+		case OCALL_FSYNC: return fsync_file(call);
+		case OCALL_READ: return read_part(call);
+		case OCALL_WRITE: return write_part(call);
+		case OCALL_REMOVE: return remove(call->path) == 0 ? 0 : -1;
+		case OCALL_LOCK: return lock_file(call);
+		case OCALL_UNLOCK: return close_file(call);
+		case OCALL_RENAME: return rename_file(call);
+		case OCALL_OPEN: return open_file(call);
+		case OCALL_CLOSE: return close_file(call);
+		case OCALL_SIZE: return size_file(call);
+		case OCALL_TRUNCATE: return truncate_file(call);
+		case OCALL_MAP: return map_file(call);
+		case OCALL_UNMAP: return munmap(call->out, call->length) == 0 ? 0 : -1;
+		case OCALL_CLOCK: return read_clock(call);
+		default: return -1;
+	}
+}
+
+// a batch of OCALLs, served in order by one I/O thread
+struct Batch {
+	ocall_t* calls;
+	size_t count;
+};
+
+static int run_batch(void* ctx) {
+	struct Batch* batch = (struct Batch*)ctx;
+	int ret = 0;
+	for (size_t i = 0; i < batch->count; ++i) {
+		// later requests depend on the earlier ones
+		batch->calls[i].status = ret == 0 ? run_ocall(&batch->calls[i]) : -1;
+		if (batch->calls[i].status != 0) {ret = -1;}
+	}
+	return ret;
+}
+
+static void stop_workers(void) {
+	running.store(false, memory_order_release);
+	for (size_t i = 0; i < workers.size(); ++i) {workers[i].join();}
+	workers.clear();
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int enclave_configure(const enclave_config_t* config) {
+	if (config->mode != ENCLAVE_DIRECT && config->mode != ENCLAVE_SIMULATED && config->mode != ENCLAVE_SWITCHLESS) {
+		return -1;
+	}
+	stop_workers();
+	mode = config->mode;
+	transition_ns = config->transition_ns;
+	if (mode != ENCLAVE_SWITCHLESS) {return 0;}
+
+	uint32_t count = config->workers;
+	if (count == 0) {count = 1;}
+	if (count > ENCLAVE_MAX_WORKERS) {count = ENCLAVE_MAX_WORKERS;}
+	ring_init(&ecall_ring);
+	ring_init(&ocall_ring);
+	running.store(true, memory_order_release);
+	workers.emplace_back(serve, &ecall_ring);
+	for (uint32_t i = 0; i < count; ++i) {workers.emplace_back(serve, &ocall_ring);}
+	return 0;
+}
+
+int enclave_call(ecall_fn fn, void* ctx) {
+	ecalls.fetch_add(1, memory_order_relaxed);
+	if (mode == ENCLAVE_DIRECT) {return fn(ctx);}
+	if (mode == ENCLAVE_SIMULATED) {
+		charge_transition();
+		return fn(ctx);
+	}
+
+	// switchless: wait for a free cell rather than entering, as the
+	// wallet is only ever run by the trusted worker
+	struct Job job;
+	job.fn = fn;
+	job.ctx = ctx;
+	job.result = 0;
+	job.done.store(0, memory_order_relaxed);
+	while (!ring_push(&ecall_ring, &job)) {sched_yield();}
+	wait_job(&job);
+	return job.result;
+}
+
+int enclave_ocalls(ocall_t* calls, size_t count) {
+	struct Batch batch = {calls, count};
+	ocalls.fetch_add(count, memory_order_relaxed);
+	if (mode == ENCLAVE_DIRECT) {return run_batch(&batch);}
+
+	// switchless: one post for the whole batch
+	if (mode == ENCLAVE_SWITCHLESS) {
+		struct Job job;
+		job.fn = run_batch;
+		job.ctx = &batch;
+		job.result = 0;
+		job.done.store(0, memory_order_relaxed);
+		if (ring_push(&ocall_ring, &job)) {
+			batches.fetch_add(1, memory_order_relaxed);
+			wait_job(&job);
+			return job.result;
+		}
+		fallbacks.fetch_add(count, memory_order_relaxed);
+	}
+
+	// one exit and re-entry per request
+	int ret = 0;
+	for (size_t i = 0; i < count; ++i) {
+		charge_transition();
+		calls[i].status = ret == 0 ? run_ocall(&calls[i]) : -1;
+		if (calls[i].status != 0) {ret = -1;}
+	}
+	return ret;
+}
+
+void enclave_get_stats(enclave_stats_t* stats) {
+	stats->ecalls = ecalls.load(memory_order_relaxed);
+	stats->ocalls = ocalls.load(memory_order_relaxed);
+	stats->transitions = transitions.load(memory_order_relaxed);
+	stats->batches = batches.load(memory_order_relaxed);
+	stats->fallbacks = fallbacks.load(memory_order_relaxed);
+}
+
+void enclave_reset_stats(void) {
+	ecalls.store(0, memory_order_relaxed);
+	ocalls.store(0, memory_order_relaxed);
+	transitions.store(0, memory_order_relaxed);
+	batches.store(0, memory_order_relaxed);
+	fallbacks.store(0, memory_order_relaxed);
+}
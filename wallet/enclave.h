@@ -0,0 +1,166 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ENCLAVE_H_
+#define ENCLAVE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+// how calls cross the enclave boundary
+#define ENCLAVE_DIRECT 0		// plain function calls (default)
+#define ENCLAVE_SIMULATED 1		// every ECALL and OCALL pays a transition
+#define ENCLAVE_SWITCHLESS 2	// calls are posted to rings served by worker threads
+
+#define ENCLAVE_TRANSITION_NS 8000	// simulated cost of one EENTER/EEXIT round trip
+#define ENCLAVE_RING_SIZE 64		// requests in flight, a power of two
+#define ENCLAVE_MAX_WORKERS 8		// untrusted I/O threads
+#define ENCLAVE_SPIN_ROUNDS 2000	// polls before an idle worker sleeps
+
+// requests served outside the enclave
+#define OCALL_LOAD 1		// read a whole file; a missing file reads as empty
+#define OCALL_SAVE 2		// replace a file's content atomically, and flush it
+#define OCALL_FSYNC 3		// flush a file to storage
+#define OCALL_READ 4		// read part of a file
+#define OCALL_WRITE 5		// write part of a file, creating it if needed
+#define OCALL_REMOVE 6		// delete a file
+#define OCALL_LOCK 7		// take an exclusive advisory lock, creating the file if needed
+#define OCALL_UNLOCK 8		// release a lock taken by OCALL_LOCK
+#define OCALL_RENAME 9		// give a file a new name, which must be free
+#define OCALL_OPEN 10		// open a file for reading and writing, creating it if needed
+#define OCALL_CLOSE 11		// close a file opened by OCALL_OPEN
+#define OCALL_SIZE 12		// the size of a file
+#define OCALL_TRUNCATE 13	// cut a file to a given size
+#define OCALL_MAP 14		// map a whole file read-only in untrusted memory
+#define OCALL_UNMAP 15		// unmap a file mapped by OCALL_MAP
+#define OCALL_CLOCK 16		// the time of day, in seconds since the epoch
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// boundary configuration
+struct EnclaveConfig {
+	int mode;					// ENCLAVE_*
+	uint32_t transition_ns;		// cost charged per transition
+	uint32_t workers;			// untrusted I/O threads in switchless mode
+};
+typedef struct EnclaveConfig enclave_config_t;
+
+// boundary counters, since the last reset
+struct EnclaveStats {
+	uint64_t ecalls;
+	uint64_t ocalls;
+	uint64_t transitions;	// enclave entries and exits actually paid
+	uint64_t batches;		// OCALL batches posted to the ring
+	uint64_t fallbacks;		// calls made with a transition because a ring was full
+};
+typedef struct EnclaveStats enclave_stats_t;
+
+// one request to the untrusted side
+struct Ocall {
+	uint32_t type;			// OCALL_*
+	const char* path;		// NULL to use 'handle' instead
+	const uint8_t* data;	// OCALL_SAVE, OCALL_WRITE: content to write; OCALL_RENAME: the new name
+	size_t length;			// OCALL_SAVE, OCALL_WRITE: its length; OCALL_LOAD, OCALL_SIZE: bytes in the file;
+							// OCALL_READ: bytes wanted, then bytes read; OCALL_MAP, OCALL_UNMAP: size mapped
+	uint8_t* out;			// OCALL_LOAD: content read, to be freed with free();
+							// OCALL_READ: caller's buffer of 'length' bytes; OCALL_MAP, OCALL_UNMAP: the mapping
+	int status;				// 0 if the request succeeded
+	uint64_t offset;		// OCALL_READ, OCALL_WRITE: position in the file; OCALL_TRUNCATE: the new size;
+							// OCALL_MAP: the MADV_* access pattern, then the file's modification time;
+							// OCALL_CLOCK: the time read
+	int handle;				// OCALL_OPEN, OCALL_LOCK: the file opened; OCALL_CLOSE, OCALL_UNLOCK:
+							// the file to close; OCALL_READ, OCALL_WRITE, OCALL_FSYNC, OCALL_SIZE,
+							// OCALL_TRUNCATE: the file to use when 'path' is NULL
+};
+typedef struct Ocall ocall_t;
+
+typedef int (*ecall_fn)(void* ctx);
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Sets how calls cross the boundary. In switchless mode
+ *             a trusted worker thread runs the ECALLs and untrusted
+ *             I/O threads serve the OCALLs; they are stopped when
+ *             another mode is set. Not to be called concurrently
+ *             with ECALLs.
+ *
+ * @param[in]  config    The configuration
+ *
+ * @return     0 if successful, -1 otherwise.
+ */
+int enclave_configure(const enclave_config_t* config);
+
+
+/**
+ * @brief      Enters the enclave: runs a wallet function on the
+ *             trusted side.
+ *
+ * @param[in]  fn     The function
+ * @param      ctx    Passed to 'fn'
+ *
+ * @return     The value returned by 'fn'.
+ */
+int enclave_call(ecall_fn fn, void* ctx);
+
+
+/**
+ * @brief      Leaves the enclave to serve a batch of requests. In
+ *             simulated mode each request pays a transition; in
+ *             switchless mode the batch is posted to the ring in one
+ *             go and served by the I/O threads, and requests only
+ *             pay a transition if the ring is full.
+ *
+ * @param      calls    The requests, in the order they must complete
+ * @param[in]  count    The number of requests
+ *
+ * @return     0 if every request succeeded, -1 otherwise.
+ */
+int enclave_ocalls(ocall_t* calls, size_t count);
+
+
+/**
+ * @brief      Reads the boundary counters.
+ *
+ * @param[out] stats    The counters
+ *
+ * @return     -
+ */
+void enclave_get_stats(enclave_stats_t* stats);
+
+
+/**
+ * @brief      Resets the boundary counters.
+ *
+ * @param      -
+ *
+ * @return     -
+ */
+void enclave_reset_stats(void);
+
+
+#endif // ENCLAVE_H_
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <algorithm>
+
+#include "expiry.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+// entries are ordered by date, then by position
+static int entry_before(const expiry_entry_t* a, int64_t expires, uint32_t item) {
+	return a->expires < expires || (a->expires == expires && a->item < item);
+}
+
+static uint32_t lower_bound(const expiry_index_t* index, int64_t expires, uint32_t item) {
+	uint32_t lo = 0, hi = index->count;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (entry_before(&index->entries[mid], expires, item)) {lo = mid + 1;}
+		else {hi = mid;}
+	}
+	return lo;
+}
+
+static void erase_entry(expiry_index_t* index, uint32_t at) {
+	--index->count;
+	memmove(&index->entries[at], &index->entries[at+1], (index->count - at) * sizeof(expiry_entry_t));
+	memset(&index->entries[index->count], 0, sizeof(expiry_entry_t));
+}
+
+static int find_entry(const expiry_index_t* index, uint32_t position) {
+	for (uint32_t i = 0; i < index->count; ++i) {
+		if (index->entries[i].item == position) {return (int)i;}
+	}
+	return -1;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+void expiry_index_add(expiry_index_t* index, uint32_t position, int64_t expires) {
+	if (expires == 0 || index->count >= MAX_ITEMS) {return;}
+	uint32_t at = lower_bound(index, expires, position);
+	memmove(&index->entries[at+1], &index->entries[at], (index->count - at) * sizeof(expiry_entry_t));
+	index->entries[at].expires = expires;
+	index->entries[at].item = position;
+	index->entries[at].reserved = 0;
+	++index->count;
+}
+
+void expiry_index_update(expiry_index_t* index, uint32_t position, int64_t expires) {
+	int at = find_entry(index, position);
+	if (at >= 0) {erase_entry(index, (uint32_t)at);}
+	expiry_index_add(index, position, expires);
+}
+
+void expiry_index_delete(expiry_index_t* index, uint32_t position) {
+	int at = find_entry(index, position);
+	if (at >= 0) {erase_entry(index, (uint32_t)at);}
+	// shifting positions keeps the order: ties stay in item order
+	for (uint32_t i = 0; i < index->count; ++i) {
+		index->entries[i].item -= (index->entries[i].item > position);
+	}
+}
+
+void expiry_index_build(expiry_index_t* index, const item_t* items, size_t count) {
+	memset(index, 0, sizeof(expiry_index_t));
+	for (size_t i = 0; i < count && i < MAX_ITEMS; ++i) {
+		if (items[i].expires == 0) {continue;}
+		index->entries[index->count].expires = items[i].expires;
+		index->entries[index->count].item = (uint32_t)i;
+		++index->count;
+	}
+	sort(index->entries, index->entries + index->count, [](const expiry_entry_t& a, const expiry_entry_t& b) {
+		return entry_before(&a, b.expires, b.item);
+	});
+}
+
+int expiry_index_valid(const expiry_index_t* index, size_t size) {
+	if (index->count > size) {return 0;}
+	for (uint32_t i = 0; i < index->count; ++i) {
+		const expiry_entry_t* entry = &index->entries[i];
+		if (entry->item >= size || entry->expires == 0) {return 0;}
+		if (i > 0 && !entry_before(&index->entries[i-1], entry->expires, entry->item)) {return 0;}
+	}
+	return 1;
+}
+
+size_t expiry_index_until(const expiry_index_t* index, int64_t horizon) {
+	uint32_t lo = 0, hi = index->count;
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (index->entries[mid].expires <= horizon) {lo = mid + 1;}
+		else {hi = mid;}
+	}
+	return lo;
+}
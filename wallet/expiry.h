@@ -0,0 +1,106 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef EXPIRY_H_
+#define EXPIRY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wallet.h"
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Inserts an item in the expiry index, keeping it ordered
+ *             by expiry date. Items that never expire are not indexed.
+ *
+ * @param      index       The expiry index
+ * @param[in]  position    The position of the item in the wallet
+ * @param[in]  expires     The expiry date, 0 for never
+ *
+ * @return     -
+ */
+void expiry_index_add(expiry_index_t* index, uint32_t position, int64_t expires);
+
+
+/**
+ * @brief      Moves an item to its new expiry date.
+ *
+ * @param      index       The expiry index
+ * @param[in]  position    The position of the item in the wallet
+ * @param[in]  expires     The new expiry date, 0 for never
+ *
+ * @return     -
+ */
+void expiry_index_update(expiry_index_t* index, uint32_t position, int64_t expires);
+
+
+/**
+ * @brief      Drops an item from the index; the items after it move
+ *             down by one, as they do in the wallet.
+ *
+ * @param      index       The expiry index
+ * @param[in]  position    The position of the removed item
+ *
+ * @return     -
+ */
+void expiry_index_delete(expiry_index_t* index, uint32_t position);
+
+
+/**
+ * @brief      Rebuilds the index from the items' expiry dates.
+ *
+ * @param[out] index    The expiry index
+ * @param[in]  items    The items
+ * @param[in]  count    The number of items
+ *
+ * @return     -
+ */
+void expiry_index_build(expiry_index_t* index, const item_t* items, size_t count);
+
+
+/**
+ * @brief      Checks an index read from untrusted storage: ordered,
+ *             and only referring to existing items.
+ *
+ * @param[in]  index    The expiry index
+ * @param[in]  size     The number of items
+ *
+ * @return     1 if the index is valid, 0 otherwise.
+ */
+int expiry_index_valid(const expiry_index_t* index, size_t size);
+
+
+/**
+ * @brief      Counts the items expiring up to a date. They are the
+ *             first entries of the index, found by binary search.
+ *
+ * @param[in]  index      The expiry index
+ * @param[in]  horizon    The date
+ *
+ * @return     The number of leading entries expiring at 'horizon'
+ *             or before.
+ */
+size_t expiry_index_until(const expiry_index_t* index, int64_t horizon);
+
+
+#endif // EXPIRY_H_
@@ -0,0 +1,628 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <stddef.h>
+
+#include "format.h"
+#include "arena.h"
+#include "secure.h"
+#include "compress.h"
+#include "crc32c.h"
+#include "crypto.h"
+#include "tags.h"
+#include "expiry.h"
+#include "merkle.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Legacy images
+ ***************************************************/
+// images written before the versioned header: a bare legacy_wallet_t,
+// or a legacy_wallet_t behind this small codec header
+struct ImageHeader {
+	uint32_t codec;
+	uint32_t raw_size;
+	uint32_t data_size;
+};
+typedef struct ImageHeader image_header_t;
+
+static void from_legacy(const legacy_wallet_t* legacy, wallet_t* wallet) {
+	for (int i = 0; i < MAX_ITEMS; ++i) {
+		memcpy(wallet->items[i].title, legacy->items[i][0], MAX_ITEM_SIZE);
+		memcpy(wallet->items[i].username, legacy->items[i][1], MAX_ITEM_SIZE);
+		memcpy(wallet->items[i].password, legacy->items[i][2], MAX_ITEM_SIZE);
+	}
+	wallet->size = legacy->size;
+	memcpy(wallet->master_password, legacy->master_password, MAX_ITEM_SIZE);
+}
+
+static int read_legacy(FILE* file, uint64_t file_size, wallet_t* wallet) {
+	image_header_t image;
+	if (fseek(file, 0, SEEK_SET) != 0) {return FORMAT_ERR_IO;}
+	legacy_wallet_t* legacy = (legacy_wallet_t*)secure_malloc(sizeof(legacy_wallet_t));
+	if (legacy == NULL) {return FORMAT_ERR_IO;}
+	int ret = FORMAT_ERR_MAGIC;
+
+	// bare legacy wallet
+	if (file_size == sizeof(legacy_wallet_t)) {
+		ret = fread(legacy, sizeof(legacy_wallet_t), 1, file) == 1 ? FORMAT_OK : FORMAT_ERR_IO;
+	}
+
+	// codec header followed by the image
+	else if (fread(&image, sizeof(image), 1, file) == 1 && image.raw_size == sizeof(legacy_wallet_t) &&
+		file_size == sizeof(image) + (uint64_t)image.data_size && image.data_size <= sizeof(legacy_wallet_t)) {
+		ret = FORMAT_ERR_LAYOUT;
+		uint8_t* data = (uint8_t*)secure_malloc(image.data_size);
+		if (data != NULL && fread(data, image.data_size, 1, file) == 1) {
+			if (image.codec == CODEC_NONE && image.data_size == sizeof(legacy_wallet_t)) {
+				memcpy(legacy, data, sizeof(legacy_wallet_t));
+				ret = FORMAT_OK;
+			}
+			else if (image.codec == CODEC_LZ) {
+				ret = lz_decompress(data, image.data_size, legacy, sizeof(legacy_wallet_t)) ? FORMAT_ERR_CHECKSUM : FORMAT_OK;
+			}
+		}
+		secure_free(data);
+	}
+
+	// the size was trusted blindly back then
+	if (ret == FORMAT_OK && legacy->size > MAX_ITEMS) {ret = FORMAT_ERR_LAYOUT;}
+	if (ret == FORMAT_OK) {from_legacy(legacy, wallet);}
+	secure_free(legacy);
+	return ret;
+}
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+static uint32_t header_crc(const file_header_t* header) {
+	return crc32c(0, header, offsetof(file_header_t, crc));
+}
+
+// also works on memory streams, which have no descriptor to fstat
+static int file_size(FILE* file, uint64_t* size) {
+	if (fseek(file, 0, SEEK_END) != 0) {return FORMAT_ERR_IO;}
+	long end = ftell(file);
+	if (end < 0) {return FORMAT_ERR_IO;}
+	*size = (uint64_t)end;
+	return FORMAT_OK;
+}
+
+// sections every image carries: one missing was stripped
+static int required(int status) {
+	return status == FORMAT_ERR_NO_SECTION ? FORMAT_ERR_MAC : status;
+}
+
+static const uint8_t* mac_key(void) {
+	static uint8_t key[SEAL_KEY_SIZE];
+	static const int ready = derive_seal_key("wallet-record-mac", key) == 0;
+	return ready ? key : NULL;
+}
+
+/**
+ * @brief      Computes the MAC tag of a record. The index is bound to
+ *             the tag, so records cannot be reordered undetected.
+ *
+ */
+static void record_tag(uint32_t index, const void* record, size_t len, uint8_t tag[MAC_TAG_SIZE]) {
+	hmac_t ctx;
+	uint8_t mac[SHA256_SIZE];
+	hmac_init(&ctx, mac_key(), SEAL_KEY_SIZE);
+	hmac_update(&ctx, &index, sizeof(index));
+	hmac_update(&ctx, record, len);
+	hmac_final(&ctx, mac);
+	memcpy(tag, mac, MAC_TAG_SIZE);
+}
+
+static int tag_matches(const uint8_t* tags, uint32_t index, uint32_t slot, const void* record, size_t len) {
+	uint8_t tag[MAC_TAG_SIZE];
+	record_tag(index, record, len, tag);
+	return secure_memcmp(tag, tags + (size_t)slot * MAC_TAG_SIZE, MAC_TAG_SIZE) == 0;
+}
+
+#define META_TAG_INDEX 0xffffffff
+#define SYNC_TAG_INDEX 0xfffffffe
+
+/**
+ * @brief      Computes the tag of the wallet-wide fields. The version
+ *             is bound to the master-password, so the number of saves
+ *             cannot be rolled back or forged.
+ *
+ */
+static void meta_tag(const char* master_password, uint64_t version, uint8_t tag[MAC_TAG_SIZE]) {
+	hmac_t ctx;
+	uint32_t index = META_TAG_INDEX;
+	uint8_t mac[SHA256_SIZE];
+	hmac_init(&ctx, mac_key(), SEAL_KEY_SIZE);
+	hmac_update(&ctx, &index, sizeof(index));
+	hmac_update(&ctx, master_password, MAX_ITEM_SIZE);
+	hmac_update(&ctx, &version, sizeof(version));
+	hmac_final(&ctx, mac);
+	memcpy(tag, mac, MAC_TAG_SIZE);
+}
+
+static int meta_matches(const uint8_t* tags, const char* master_password, uint64_t version) {
+	uint8_t tag[MAC_TAG_SIZE];
+	meta_tag(master_password, version, tag);
+	return secure_memcmp(tag, tags, MAC_TAG_SIZE) == 0;
+}
+
+// the version section is optional: 0 if absent
+static int read_meta(FILE* file, const file_header_t* header, char* master_password, uint64_t* version) {
+	int ret = required(read_section(file, header, SECTION_META, master_password, MAX_ITEM_SIZE));
+	int version_status = read_section(file, header, SECTION_VERSION, version, sizeof(uint64_t));
+	if (version_status != FORMAT_OK) {*version = 0;}
+	if (ret == FORMAT_OK && version_status != FORMAT_ERR_NO_SECTION) {ret = version_status;}
+	return ret;
+}
+
+// merge state: the removals are authoritative, the tree is derived;
+// the tag index is vouched for by its digest
+struct SyncSection {
+	tombstones_t tombstones;
+	merkle_tree_t merkle;
+	uint8_t tag_index[SHA256_SIZE];
+	uint8_t tag[MAC_TAG_SIZE];
+};
+typedef struct SyncSection sync_section_t;
+
+/**
+ * @brief      Computes the tag of the merge state. It covers the tags
+ *             of all the records, so the cached tree cannot outlive
+ *             the records it was computed from.
+ *
+ */
+static void sync_tag(const sync_section_t* sync, const uint8_t* tags, uint32_t count, uint8_t tag[MAC_TAG_SIZE]) {
+	hmac_t ctx;
+	uint32_t index = SYNC_TAG_INDEX;
+	uint8_t mac[SHA256_SIZE];
+	hmac_init(&ctx, mac_key(), SEAL_KEY_SIZE);
+	hmac_update(&ctx, &index, sizeof(index));
+	hmac_update(&ctx, tags, (size_t)(count + 1) * MAC_TAG_SIZE);
+	hmac_update(&ctx, sync, offsetof(sync_section_t, tag));
+	hmac_final(&ctx, mac);
+	memcpy(tag, mac, MAC_TAG_SIZE);
+}
+
+/**
+ * @brief      Gives an id to the items written before items had one.
+ *             The id only depends on the record and its position, so
+ *             replicas copied from the same file agree on it.
+ *
+ */
+static uint32_t derive_ids(item_t* items, size_t count) {
+	uint32_t derived = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (items[i].id != 0) {continue;}
+		uint8_t digest[SHA256_SIZE];
+		sha256_t ctx;
+		uint32_t position = (uint32_t)i;
+		sha256_init(&ctx);
+		sha256_update(&ctx, &position, sizeof(position));
+		sha256_update(&ctx, &items[i], sizeof(item_t));
+		sha256_final(&ctx, digest);
+		memcpy(&items[i].id, digest, sizeof(uint64_t));
+		items[i].id |= (items[i].id == 0);
+		items[i].revision = 1;
+		++derived;
+	}
+	return derived;
+}
+
+/**
+ * @brief      Reads, verifies and decodes a section payload. A damaged
+ *             payload is still decoded as far as possible; 'produced'
+ *             tells how many bytes came out.
+ *
+ */
+static int load_payload(FILE* file, const section_t* section, void* buf, size_t size, size_t* produced) {
+	*produced = 0;
+	if (section->raw_length != size) {return FORMAT_ERR_LAYOUT;}
+	if (section->codec == CODEC_NONE && section->length != size) {return FORMAT_ERR_LAYOUT;}
+	if (section->codec != CODEC_NONE && section->codec != CODEC_LZ) {return FORMAT_ERR_VERSION;}
+	if (size == 0) {return FORMAT_OK;}
+	if (fseek(file, (long)section->offset, SEEK_SET) != 0) {return FORMAT_ERR_IO;}
+
+	// stored as is: read in place
+	if (section->codec == CODEC_NONE) {
+		if (fread(buf, size, 1, file) != 1) {return FORMAT_ERR_IO;}
+		*produced = size;
+		return crc32c(0, buf, size) == section->crc ? FORMAT_OK : FORMAT_ERR_CHECKSUM;
+	}
+
+	// compressed: verify, then decode
+	int ret = FORMAT_ERR_IO;
+	uint8_t* data = (uint8_t*)secure_malloc((size_t)section->length);
+	if (data != NULL && fread(data, (size_t)section->length, 1, file) == 1) {
+		int decoded = lz_decompress_partial(data, (size_t)section->length, buf, size, produced);
+		if (crc32c(0, data, (size_t)section->length) != section->crc) {ret = FORMAT_ERR_CHECKSUM;}
+		else if (decoded != 0) {ret = FORMAT_ERR_LAYOUT;}
+		else {ret = FORMAT_OK;}
+	}
+	secure_free(data);
+	return ret;
+}
+
+// a section to be written, and the buffer it is stored from
+struct PendingSection {
+	uint32_t type;
+	uint32_t codec;
+	const void* data;
+	size_t size;
+	uint8_t* encoded;
+};
+
+/**
+ * @brief      Encodes a section payload. Falls back to CODEC_NONE
+ *             when the codec does not shrink the data.
+ *
+ */
+static int encode_section(struct PendingSection* pending, section_t* section) {
+	section->type = pending->type;
+	section->codec = CODEC_NONE;
+	section->raw_length = pending->size;
+	section->length = pending->size;
+	pending->encoded = NULL;
+
+	if (pending->codec == CODEC_LZ && pending->size > 0) {
+		size_t bound = lz_compress_bound(pending->size);
+		pending->encoded = (uint8_t*)secure_malloc(bound);
+		if (pending->encoded == NULL) {return FORMAT_ERR_IO;}
+		size_t encoded_size = lz_compress(pending->data, pending->size, pending->encoded, bound);
+		if (encoded_size != 0 && encoded_size < pending->size) {
+			section->codec = CODEC_LZ;
+			section->length = encoded_size;
+			pending->data = pending->encoded;
+		}
+	}
+	section->crc = crc32c(0, pending->data, (size_t)section->length);
+	return FORMAT_OK;
+}
+
+
+/**
+ * @brief      Verifies a wallet file against a copy loaded from it
+ *             before, if any: a record whose tag and bytes both match
+ *             the known copy was authenticated then, so only the
+ *             records that changed are authenticated again. The tags
+ *             read, and which records changed, are handed back.
+ *
+ */
+static int verify_image(FILE* file, wallet_t* wallet, verify_report_t* report,
+	const wallet_t* known, const uint8_t* known_tags, uint8_t* tags_out, bitmap_t* changed) {
+	file_header_t header;
+	memset(report, 0, sizeof(verify_report_t));
+	secure_zero(wallet, sizeof(wallet_t));
+	if (tags_out != NULL) {memset(tags_out, 0, (MAX_ITEMS + 1) * MAC_TAG_SIZE);}
+	if (changed != NULL) {bitmap_clear(changed);}
+
+	// header
+	int ret = read_header(file, &header);
+	// a legacy image carries no tag: it is only read by a migration
+	if (ret == FORMAT_ERR_MAGIC) {
+		uint64_t size;
+		report->legacy = file_size(file, &size) == FORMAT_OK && read_legacy(file, size, wallet) == FORMAT_OK;
+		secure_zero(wallet, sizeof(wallet_t));
+		ret = report->legacy ? FORMAT_ERR_LEGACY : FORMAT_ERR_MAGIC;
+		report->status = ret;
+		return ret;
+	}
+	if (ret == FORMAT_OK && mac_key() == NULL) {ret = FORMAT_ERR_KEY;}
+	if (ret != FORMAT_OK) {
+		report->status = ret;
+		return ret;
+	}
+	const uint32_t count = header.item_count;
+	const size_t item_size = header.item_size;
+	report->items = count;
+
+	// integrity sections: every image of this format version carries
+	// them, so a missing one is a stripped one
+	uint32_t* checksums = (uint32_t*)secure_malloc((count + 1) * sizeof(uint32_t));
+	uint8_t* tags = (uint8_t*)secure_malloc((count + 1) * MAC_TAG_SIZE);
+	uint8_t* items = (uint8_t*)secure_malloc((count + 1) * item_size);
+	if (checksums == NULL || tags == NULL || items == NULL) {
+		secure_free(checksums);
+		secure_free(tags);
+		secure_free(items);
+		report->status = FORMAT_ERR_IO;
+		return FORMAT_ERR_IO;
+	}
+	int crc_status = required(read_section(file, &header, SECTION_CHECKSUMS, checksums, count * sizeof(uint32_t)));
+	int mac_status = required(read_section(file, &header, SECTION_MACS, tags, (count + 1) * MAC_TAG_SIZE));
+	// a damaged integrity section still vouches for the entries that match
+	int have_crc = (crc_status == FORMAT_OK || crc_status == FORMAT_ERR_CHECKSUM);
+	int have_mac = (mac_status == FORMAT_OK || mac_status == FORMAT_ERR_CHECKSUM);
+	ret = crc_status;
+	if (ret == FORMAT_OK) {ret = mac_status;}
+
+	// master-password and version, under one tag
+	int meta_status = read_meta(file, &header, wallet->master_password, &wallet->version);
+	if (meta_status == FORMAT_OK && !have_mac) {meta_status = FORMAT_ERR_MAC;}
+	int meta_known = known != NULL && have_mac && secure_memcmp(tags, known_tags, MAC_TAG_SIZE) == 0 &&
+		wallet->version == known->version &&
+		secure_memcmp(wallet->master_password, known->master_password, MAX_ITEM_SIZE) == 0;
+	if (meta_status == FORMAT_OK && have_mac && !meta_known &&
+		!meta_matches(tags, wallet->master_password, wallet->version)) {
+		meta_status = FORMAT_ERR_MAC;
+	}
+	report->meta_intact = (meta_status == FORMAT_OK);
+	if (ret == FORMAT_OK) {ret = meta_status;}
+
+	// records: the item count is checked against the section size
+	size_t produced = 0;
+	const section_t* section = find_section(&header, SECTION_ITEMS);
+	int items_status = section == NULL ? FORMAT_ERR_MAC :
+		load_payload(file, section, items, count * item_size, &produced);
+	if (ret == FORMAT_OK) {ret = items_status;}
+	uint32_t decoded = (uint32_t)(produced / item_size);
+	for (uint32_t i = 0; i < decoded; ++i) {
+		const uint8_t* record = items + i * item_size;
+		int same = known != NULL && have_mac && i < known->size && item_size == sizeof(item_t) &&
+			secure_memcmp(tags + (size_t)(i+1) * MAC_TAG_SIZE, known_tags + (size_t)(i+1) * MAC_TAG_SIZE, MAC_TAG_SIZE) == 0 &&
+			secure_memcmp(record, &known->items[i], item_size) == 0;
+		if (!same && changed != NULL && i < MAX_ITEMS) {bitmap_add(changed, i);}
+		int crc_ok = same || !have_crc || crc32c(0, record, item_size) == checksums[i];
+		int mac_ok = same || (have_mac && tag_matches(tags, i, i+1, record, item_size));
+		int intact = mac_ok && crc_ok;
+		// older, shorter records leave the new fields empty
+		if (intact) {memcpy(&wallet->items[report->intact++], record, item_size);}
+		else if (ret == FORMAT_OK) {ret = (have_mac && !mac_ok && crc_ok) ? FORMAT_ERR_MAC : FORMAT_ERR_CHECKSUM;}
+	}
+	report->damaged = count - report->intact;
+	wallet->size = report->intact;
+	uint32_t derived = derive_ids(wallet->items, wallet->size);
+
+	// removals: a merge needs them all, so a damaged list is an error
+	int sync_ok = 0;
+	sync_section_t* sync = (sync_section_t*)secure_malloc(sizeof(sync_section_t));
+	int sync_status = sync == NULL ? FORMAT_ERR_IO :
+		required(read_section(file, &header, SECTION_SYNC, sync, sizeof(sync_section_t)));
+	if (sync_status == FORMAT_OK) {
+		uint8_t tag[MAC_TAG_SIZE];
+		sync_tag(sync, tags, count, tag);
+		if (!have_mac || secure_memcmp(tag, sync->tag, MAC_TAG_SIZE) != 0 ||
+			sync->tombstones.count > MAX_TOMBSTONES) {
+			sync_status = FORMAT_ERR_MAC;
+		}
+		else {
+			wallet->tombstones = sync->tombstones;
+			sync_ok = 1;
+		}
+	}
+	if (ret == FORMAT_OK) {ret = sync_status;}
+
+	// indexes: derived from the records, so they are rebuilt rather
+	// than trusted whenever they are missing, damaged, out of date or
+	// not the index the merge state was sealed with
+	int tags_ok = report->intact == count && sync_ok &&
+		read_section(file, &header, SECTION_TAGS, &wallet->tags, sizeof(tag_index_t)) == FORMAT_OK;
+	if (tags_ok) {
+		uint8_t digest[SHA256_SIZE];
+		sha256(&wallet->tags, sizeof(tag_index_t), digest);
+		tags_ok = memcmp(digest, sync->tag_index, SHA256_SIZE) == 0 && tag_index_valid(&wallet->tags, wallet->size);
+	}
+	if (!tags_ok) {tag_index_build(&wallet->tags, wallet->items, wallet->size);}
+	if (report->intact != count ||
+		read_section(file, &header, SECTION_EXPIRY, &wallet->expiry, sizeof(expiry_index_t)) != FORMAT_OK ||
+		!expiry_index_valid(&wallet->expiry, wallet->size)) {
+		expiry_index_build(&wallet->expiry, wallet->items, wallet->size);
+	}
+	if (report->intact != count || !sync_ok || derived > 0) {
+		merkle_build(&wallet->merkle, wallet->items, wallet->size, &wallet->tombstones);
+	}
+	else {
+		wallet->merkle = sync->merkle;
+	}
+	secure_free(sync);
+
+	if (tags_out != NULL && have_mac && count <= MAX_ITEMS) {memcpy(tags_out, tags, (count + 1) * MAC_TAG_SIZE);}
+	secure_free(checksums);
+	secure_free(tags);
+	secure_free(items);
+	report->status = ret;
+	return ret;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int read_header(FILE* file, file_header_t* header) {
+	uint64_t size;
+	if (file_size(file, &size) != FORMAT_OK) {return FORMAT_ERR_IO;}
+	if (fseek(file, 0, SEEK_SET) != 0) {return FORMAT_ERR_IO;}
+	if (size < sizeof(uint32_t) + sizeof(uint16_t)) {return FORMAT_ERR_MAGIC;}
+	if (size < sizeof(file_header_t)) {
+		if (fread(header, sizeof(uint32_t), 1, file) != 1) {return FORMAT_ERR_IO;}
+		return header->magic == WALLET_MAGIC ? FORMAT_ERR_LAYOUT : FORMAT_ERR_MAGIC;
+	}
+	if (fread(header, sizeof(file_header_t), 1, file) != 1) {return FORMAT_ERR_IO;}
+
+	// identity, then integrity, then compatibility
+	if (header->magic != WALLET_MAGIC) {return FORMAT_ERR_MAGIC;}
+	if (header->version != WALLET_FORMAT_VERSION || header->header_size != sizeof(file_header_t)) {
+		return FORMAT_ERR_VERSION;
+	}
+	if (header_crc(header) != header->crc) {return FORMAT_ERR_CHECKSUM;}
+	if (header->item_size < ITEM_SIZE_MIN || header->item_size > sizeof(item_t) || header->max_item_size != MAX_ITEM_SIZE) {
+		return FORMAT_ERR_VERSION;
+	}
+
+	// layout
+	if (header->item_count > MAX_ITEMS || header->section_count > WALLET_MAX_SECTIONS) {
+		return FORMAT_ERR_LAYOUT;
+	}
+	for (uint32_t i = 0; i < header->section_count; ++i) {
+		const section_t* section = &header->sections[i];
+		if (section->offset < sizeof(file_header_t) || section->offset > size ||
+			section->length > size - section->offset) {
+			return FORMAT_ERR_LAYOUT;
+		}
+	}
+	return FORMAT_OK;
+}
+
+const section_t* find_section(const file_header_t* header, uint32_t type) {
+	for (uint32_t i = 0; i < header->section_count; ++i) {
+		if (header->sections[i].type == type) {return &header->sections[i];}
+	}
+	return NULL;
+}
+
+int read_section(FILE* file, const file_header_t* header, uint32_t type, void* buf, size_t size) {
+	const section_t* section = find_section(header, type);
+	if (section == NULL) {return FORMAT_ERR_NO_SECTION;}
+	size_t produced;
+	int ret = load_payload(file, section, buf, size, &produced);
+	return (ret == FORMAT_OK && produced != size) ? FORMAT_ERR_LAYOUT : ret;
+}
+
+int write_wallet_file(FILE* file, const wallet_t* wallet) {
+	if (wallet->size > MAX_ITEMS) {return FORMAT_ERR_LAYOUT;}
+	if (mac_key() == NULL) {return FORMAT_ERR_KEY;}
+
+	// checksum and tag of every record
+	uint32_t* checksums = (uint32_t*)secure_malloc((wallet->size + 1) * sizeof(uint32_t));
+	uint8_t* tags = (uint8_t*)secure_malloc((wallet->size + 1) * MAC_TAG_SIZE);
+	if (checksums == NULL || tags == NULL) {
+		secure_free(checksums);
+		secure_free(tags);
+		return FORMAT_ERR_IO;
+	}
+	meta_tag(wallet->master_password, wallet->version, tags);
+	for (uint32_t i = 0; i < wallet->size; ++i) {
+		checksums[i] = crc32c(0, &wallet->items[i], sizeof(item_t));
+		record_tag(i, &wallet->items[i], sizeof(item_t), tags + (size_t)(i+1) * MAC_TAG_SIZE);
+	}
+	sync_section_t* sync = (sync_section_t*)secure_malloc(sizeof(sync_section_t));
+	if (sync == NULL) {
+		secure_free(checksums);
+		secure_free(tags);
+		return FORMAT_ERR_IO;
+	}
+	sync->tombstones = wallet->tombstones;
+	sync->merkle = wallet->merkle;
+	sha256(&wallet->tags, sizeof(tag_index_t), sync->tag_index);
+	sync_tag(sync, tags, (uint32_t)wallet->size, sync->tag);
+
+	struct PendingSection all[] = {
+		{SECTION_META, CODEC_NONE, wallet->master_password, MAX_ITEM_SIZE, NULL},
+		{SECTION_ITEMS, WALLET_CODEC, wallet->items, wallet->size * sizeof(item_t), NULL},
+		{SECTION_VERSION, CODEC_NONE, &wallet->version, sizeof(wallet->version), NULL},
+		{SECTION_CHECKSUMS, CODEC_NONE, checksums, wallet->size * sizeof(uint32_t), NULL},
+		{SECTION_MACS, CODEC_NONE, tags, (wallet->size + 1) * MAC_TAG_SIZE, NULL},
+		{SECTION_TAGS, WALLET_CODEC, &wallet->tags, sizeof(tag_index_t), NULL},
+		{SECTION_EXPIRY, WALLET_CODEC, &wallet->expiry, sizeof(expiry_index_t), NULL},
+		{SECTION_SYNC, WALLET_CODEC, sync, sizeof(sync_section_t), NULL},
+	};
+	const uint32_t count = sizeof(all) / sizeof(all[0]);
+
+	file_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.magic = WALLET_MAGIC;
+	header.version = WALLET_FORMAT_VERSION;
+	header.header_size = sizeof(file_header_t);
+	header.item_count = (uint32_t)wallet->size;
+	header.item_size = sizeof(item_t);
+	header.max_item_size = MAX_ITEM_SIZE;
+	header.section_count = count;
+
+	// encode and lay out the sections after the header
+	int ret = FORMAT_OK;
+	uint64_t offset = sizeof(file_header_t);
+	for (uint32_t i = 0; i < count && ret == FORMAT_OK; ++i) {
+		ret = encode_section(&all[i], &header.sections[i]);
+		header.sections[i].offset = offset;
+		offset += header.sections[i].length;
+	}
+	header.crc = header_crc(&header);
+
+	// write
+	if (ret == FORMAT_OK && fwrite(&header, sizeof(header), 1, file) != 1) {ret = FORMAT_ERR_IO;}
+	for (uint32_t i = 0; i < count && ret == FORMAT_OK; ++i) {
+		size_t length = (size_t)header.sections[i].length;
+		if (length > 0 && fwrite(all[i].data, length, 1, file) != 1) {ret = FORMAT_ERR_IO;}
+	}
+	for (uint32_t i = 0; i < count; ++i) {secure_free(all[i].encoded);}
+	secure_free(checksums);
+	secure_free(tags);
+	secure_free(sync);
+	return ret;
+}
+
+int verify_wallet_file(FILE* file, wallet_t* wallet, verify_report_t* report) {
+	return verify_image(file, wallet, report, NULL, NULL, NULL, NULL);
+}
+
+int read_wallet_file(FILE* file, wallet_t* wallet) {
+	verify_report_t report;
+	int ret = verify_wallet_file(file, wallet, &report);
+	if (ret != FORMAT_OK) {secure_zero(wallet, sizeof(wallet_t));}
+	return ret;
+}
+
+int read_legacy_wallet_file(FILE* file, wallet_t* wallet) {
+	file_header_t header;
+	uint64_t size;
+	secure_zero(wallet, sizeof(wallet_t));
+	int ret = read_header(file, &header);
+	if (ret != FORMAT_ERR_MAGIC) {return ret == FORMAT_ERR_IO ? ret : FORMAT_ERR_MAGIC;}
+	ret = file_size(file, &size) == FORMAT_OK ? read_legacy(file, size, wallet) : FORMAT_ERR_IO;
+	if (ret != FORMAT_OK) {
+		secure_zero(wallet, sizeof(wallet_t));
+		return ret;
+	}
+	derive_ids(wallet->items, wallet->size);
+	tag_index_build(&wallet->tags, wallet->items, wallet->size);
+	expiry_index_build(&wallet->expiry, wallet->items, wallet->size);
+	merkle_build(&wallet->merkle, wallet->items, wallet->size, &wallet->tombstones);
+	return FORMAT_OK;
+}
+
+int reload_wallet_file(FILE* file, const wallet_t* known, const uint8_t* known_tags,
+	wallet_t* wallet, uint8_t* tags, bitmap_t* changed) {
+	verify_report_t report;
+	int ret = verify_image(file, wallet, &report, known, known_tags, tags, changed);
+	if (ret != FORMAT_OK) {secure_zero(wallet, sizeof(wallet_t));}
+	return ret;
+}
+
+int read_generation(FILE* file, uint64_t* generation) {
+	file_header_t header;
+	*generation = 0;
+	int ret = read_header(file, &header);
+	if (ret == FORMAT_OK && mac_key() == NULL) {ret = FORMAT_ERR_KEY;}
+	if (ret != FORMAT_OK) {return ret;}
+
+	// the tag of the wallet-wide fields comes first
+	uint8_t* tags = (uint8_t*)secure_malloc((header.item_count + 1) * MAC_TAG_SIZE);
+	char* master_password = (char*)secure_malloc(MAX_ITEM_SIZE);
+	ret = tags == NULL || master_password == NULL ? FORMAT_ERR_IO :
+		required(read_section(file, &header, SECTION_MACS, tags, (header.item_count + 1) * MAC_TAG_SIZE));
+	if (ret == FORMAT_OK) {ret = read_meta(file, &header, master_password, generation);}
+	if (ret == FORMAT_OK && !meta_matches(tags, master_password, *generation)) {ret = FORMAT_ERR_MAC;}
+	if (ret != FORMAT_OK) {*generation = 0;}
+	secure_free(tags);
+	secure_free(master_password);
+	return ret;
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FORMAT_H_
+#define FORMAT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "wallet.h"
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define WALLET_MAGIC 0x57584753		// "SGXW"
+#define WALLET_FORMAT_VERSION 3	// 2: the integrity and sync sections are mandatory; 3: the version is authenticated
+#define WALLET_MAX_SECTIONS 8
+
+// section types
+#define SECTION_META 1		// wallet-wide fields (master-password)
+#define SECTION_ITEMS 2		// item_count records of item_size bytes
+#define SECTION_VERSION 3	// number of saves (optional, 0 if absent), under the meta tag
+#define SECTION_CHECKSUMS 4	// CRC32C of every item record
+#define SECTION_MACS 5		// MAC tags of the meta and version sections, then of every record
+#define SECTION_TAGS 6		// tag index (optional, rebuilt from the records unless SYNC vouches for it)
+#define SECTION_EXPIRY 7	// expiry index (optional, rebuilt from the records if absent)
+#define SECTION_SYNC 8		// removals and hash tree used to merge replicas
+
+// records written before item_t grew are zero-extended on load
+#define ITEM_SIZE_MIN (3 * MAX_ITEM_SIZE)
+
+// format errors
+#define FORMAT_OK 0
+#define FORMAT_ERR_IO 1				// file could not be read or written
+#define FORMAT_ERR_MAGIC 2			// not a wallet file
+#define FORMAT_ERR_VERSION 3		// written by an incompatible version
+#define FORMAT_ERR_CHECKSUM 4		// header or section corrupted
+#define FORMAT_ERR_LAYOUT 5			// sizes or offsets out of range
+#define FORMAT_ERR_NO_SECTION 6		// section not present
+#define FORMAT_ERR_MAC 7			// record failed authentication
+#define FORMAT_ERR_KEY 8			// sealing key unavailable
+#define FORMAT_ERR_LEGACY 9			// image without header: to be migrated
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// section descriptor
+struct Section {
+	uint32_t type;			// SECTION_*
+	uint32_t codec;			// CODEC_* the payload is stored with
+	uint32_t crc;			// CRC32C of the stored payload
+	uint32_t reserved;
+	uint64_t offset;		// from the start of the file
+	uint64_t length;		// stored length
+	uint64_t raw_length;	// length once decoded
+};
+typedef struct Section section_t;
+
+// fixed-size file header, always at offset 0
+struct FileHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;	// sizeof(file_header_t) at write time
+	uint32_t item_count;
+	uint32_t item_size;		// sizeof(item_t) at write time, ITEM_SIZE_MIN at least
+	uint32_t max_item_size;	// MAX_ITEM_SIZE at write time
+	uint32_t section_count;
+	section_t sections[WALLET_MAX_SECTIONS];
+	uint32_t crc;			// CRC32C of all the fields above
+	uint32_t reserved;
+};
+typedef struct FileHeader file_header_t;
+
+// wallet layout written before the header was introduced
+struct LegacyWallet {
+	char items[MAX_ITEMS][3][MAX_ITEM_SIZE];
+	size_t size;
+	char master_password[MAX_ITEM_SIZE];
+};
+typedef struct LegacyWallet legacy_wallet_t;
+
+// outcome of a verification
+struct VerifyReport {
+	int status;			// FORMAT_OK, or the first error found
+	int legacy;			// image without header: nothing to verify, only to migrate
+	int meta_intact;	// master-password section passed its checks
+	uint32_t items;		// records announced by the header
+	uint32_t intact;	// records passing their checksum and MAC
+	uint32_t damaged;	// records failing, or lost to a damaged section
+};
+typedef struct VerifyReport verify_report_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Reads and validates the file header. Only the header
+ *             bytes are read: foreign, truncated or incompatible
+ *             files are rejected before any section is touched.
+ *
+ * @param[in]  file      The wallet file
+ * @param[out] header    The validated header
+ *
+ * @return     FORMAT_OK if successful, FORMAT_ERR_* otherwise.
+ */
+int read_header(FILE* file, file_header_t* header);
+
+
+/**
+ * @brief      Finds a section descriptor in a validated header.
+ *
+ * @param[in]  header    The header
+ * @param[in]  type      The section type
+ *
+ * @return     The descriptor, NULL if the section is absent.
+ */
+const section_t* find_section(const file_header_t* header, uint32_t type);
+
+
+/**
+ * @brief      Reads, verifies and decodes one section. This allows
+ *             loading sections lazily, one at a time.
+ *
+ * @param[in]  file      The wallet file
+ * @param[in]  header    The validated header
+ * @param[in]  type      The section type
+ * @param[out] buf       The output buffer
+ * @param[in]  size      The expected decoded size
+ *
+ * @return     FORMAT_OK if successful, FORMAT_ERR_* otherwise.
+ */
+int read_section(FILE* file, const file_header_t* header, uint32_t type, void* buf, size_t size);
+
+
+/**
+ * @brief      Encodes a wallet and writes it to a file.
+ *
+ * @param[in]  file      The wallet file
+ * @param[in]  wallet    The wallet
+ *
+ * @return     FORMAT_OK if successful, FORMAT_ERR_* otherwise.
+ */
+int write_wallet_file(FILE* file, const wallet_t* wallet);
+
+
+/**
+ * @brief      Verifies a wallet file and salvages its intact records.
+ *             Checks the header, the item count against the section
+ *             sizes, the section checksums, and the checksum and MAC
+ *             tag of every record. The records that pass are copied,
+ *             in order, into 'wallet'; 'wallet->size' never exceeds
+ *             the records actually recovered.
+ *
+ * @param[in]  file      The wallet file
+ * @param[out] wallet    The salvaged wallet
+ * @param[out] report    The outcome
+ *
+ * @return     FORMAT_OK if the file is intact, FORMAT_ERR_* otherwise.
+ */
+int verify_wallet_file(FILE* file, wallet_t* wallet, verify_report_t* report);
+
+
+/**
+ * @brief      Reads a wallet file. Any damaged or tampered record, or
+ *             a missing integrity section, fails the whole read.
+ *             Images written before the header was introduced carry
+ *             no tag, so they are refused too: they are only read by
+ *             read_legacy_wallet_file, to be migrated.
+ *
+ * @param[in]  file      The wallet file
+ * @param[out] wallet    The wallet
+ *
+ * @return     FORMAT_OK if successful, FORMAT_ERR_LEGACY for an image
+ *             to migrate, FORMAT_ERR_* otherwise.
+ */
+int read_wallet_file(FILE* file, wallet_t* wallet);
+
+
+/**
+ * @brief      Reads an image written before the header was introduced.
+ *             Nothing in it can be authenticated: it is only to be
+ *             called on the user's request, and the wallet sealed in
+ *             the current format right away.
+ *
+ * @param[in]  file      The wallet file
+ * @param[out] wallet    The wallet
+ *
+ * @return     FORMAT_OK if successful, FORMAT_ERR_MAGIC if it is not a
+ *             legacy image, FORMAT_ERR_* otherwise.
+ */
+int read_legacy_wallet_file(FILE* file, wallet_t* wallet);
+
+
+/**
+ * @brief      Reads a wallet file again after it changed. The records
+ *             whose bytes and tag are those of the copy read before
+ *             are not authenticated again; only the changed ones are.
+ *             Fails like read_wallet_file.
+ *
+ * @param[in]  file          The wallet file
+ * @param[in]  known         The copy read before, NULL for none
+ * @param[in]  known_tags    The MAC tags that copy was read with
+ * @param[out] wallet        The wallet
+ * @param[out] tags          The MAC tags read, (MAX_ITEMS + 1) of them
+ * @param[out] changed       The records that differ from 'known', or
+ *                           NULL
+ *
+ * @return     FORMAT_OK if successful, FORMAT_ERR_* otherwise.
+ */
+int reload_wallet_file(FILE* file, const wallet_t* known, const uint8_t* known_tags,
+	wallet_t* wallet, uint8_t* tags, bitmap_t* changed);
+
+
+/**
+ * @brief      Reads the number of saves of a wallet file: only its
+ *             header, tags, and meta and version sections are read.
+ *             The count is authenticated, so a forged one cannot hide
+ *             a change.
+ *
+ * @param[in]  file          The wallet file
+ * @param[out] generation    The number of saves, 0 if not recorded
+ *
+ * @return     FORMAT_OK if successful, FORMAT_ERR_* otherwise.
+ */
+int read_generation(FILE* file, uint64_t* generation);
+
+
+#endif // FORMAT_H_
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <ctype.h>
+
+#include "generator.h"
+#include "secure.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+static const char* const LOWER_SET = "abcdefghijklmnopqrstuvwxyz";
+static const char* const UPPER_SET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const char* const DIGIT_SET = "0123456789";
+static const char* const CONSONANT_SET = "bcdfghjklmnprstvwz";	// no q, x or y: they read poorly
+static const char* const VOWEL_SET = "aeiou";
+
+static uint32_t class_of(char c) {
+	if (islower((unsigned char)c)) {return PASSWORD_LOWER;}
+	if (isupper((unsigned char)c)) {return PASSWORD_UPPER;}
+	if (isdigit((unsigned char)c)) {return PASSWORD_DIGITS;}
+	return PASSWORD_SYMBOLS;
+}
+
+static int count_classes(uint32_t classes) {
+	return __builtin_popcount(classes & PASSWORD_CLASSES);
+}
+
+/**
+ * @brief      Draws one character of a set.
+ *
+ */
+static int draw(csprng_t* rng, const char* set, char* c) {
+	uint32_t index;
+	if (csprng_uniform(rng, (uint32_t)strlen(set), &index) != 0) {return GENERATOR_ERR_RANDOM;}
+	*c = set[index];
+	return GENERATOR_OK;
+}
+
+/**
+ * @brief      Draws every character from the union of the classes.
+ *             Returns the classes the password holds.
+ *
+ */
+static int draw_random(csprng_t* rng, uint32_t classes, char* password, uint32_t length, uint32_t* seen) {
+	char alphabet[128] = {0};
+	if (classes & PASSWORD_LOWER) {strcat(alphabet, LOWER_SET);}
+	if (classes & PASSWORD_UPPER) {strcat(alphabet, UPPER_SET);}
+	if (classes & PASSWORD_DIGITS) {strcat(alphabet, DIGIT_SET);}
+	if (classes & PASSWORD_SYMBOLS) {strcat(alphabet, PASSWORD_SYMBOL_SET);}
+	*seen = 0;
+	for (uint32_t i = 0; i < length; ++i) {
+		if (draw(rng, alphabet, &password[i]) != GENERATOR_OK) {return GENERATOR_ERR_RANDOM;}
+		*seen |= class_of(password[i]);
+	}
+	return GENERATOR_OK;
+}
+
+/**
+ * @brief      Alternates consonants and vowels, each letter in a case
+ *             of the policy; then a digit and a symbol, if asked for,
+ *             replace letters at random positions. Returns the classes
+ *             the password holds.
+ *
+ */
+static int draw_pronounceable(csprng_t* rng, uint32_t classes, char* password, uint32_t length, uint32_t* seen) {
+	int mixed_case = (classes & PASSWORD_LOWER) && (classes & PASSWORD_UPPER);
+	*seen = 0;
+	for (uint32_t i = 0; i < length; ++i) {
+		if (draw(rng, i % 2 == 0 ? CONSONANT_SET : VOWEL_SET, &password[i]) != GENERATOR_OK) {
+			return GENERATOR_ERR_RANDOM;
+		}
+		uint32_t upper = !(classes & PASSWORD_LOWER);
+		if (mixed_case && csprng_uniform(rng, 2, &upper) != 0) {return GENERATOR_ERR_RANDOM;}
+		if (upper) {password[i] = (char)toupper((unsigned char)password[i]);}
+	}
+
+	// distinct positions for the digit and the symbol
+	uint32_t taken = length;
+	const uint32_t extras[2] = {PASSWORD_DIGITS, PASSWORD_SYMBOLS};
+	for (int k = 0; k < 2; ++k) {
+		if (!(classes & extras[k])) {continue;}
+		uint32_t position;
+		if (csprng_uniform(rng, taken == length ? length : length - 1, &position) != 0) {return GENERATOR_ERR_RANDOM;}
+		if (taken != length && position >= taken) {++position;}
+		if (draw(rng, extras[k] == PASSWORD_DIGITS ? DIGIT_SET : PASSWORD_SYMBOL_SET, &password[position]) != GENERATOR_OK) {
+			return GENERATOR_ERR_RANDOM;
+		}
+		taken = position;
+	}
+	for (uint32_t i = 0; i < length; ++i) {*seen |= class_of(password[i]);}
+	return GENERATOR_OK;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int password_policy_check(const password_policy_t* policy, size_t field_size) {
+	uint32_t classes = policy->flags & PASSWORD_CLASSES;
+	if (classes == 0 || (policy->flags & ~(PASSWORD_CLASSES | PASSWORD_PRONOUNCEABLE)) != 0) {
+		return GENERATOR_ERR_POLICY;
+	}
+	if ((policy->flags & PASSWORD_PRONOUNCEABLE) && !(classes & (PASSWORD_LOWER | PASSWORD_UPPER))) {
+		return GENERATOR_ERR_POLICY;
+	}
+	if (policy->length < (uint32_t)count_classes(classes) || (size_t)policy->length + 1 > field_size) {
+		return GENERATOR_ERR_POLICY;
+	}
+	return GENERATOR_OK;
+}
+
+int generate_password(csprng_t* rng, const password_policy_t* policy, char* password) {
+	uint32_t classes = policy->flags & PASSWORD_CLASSES;
+	uint32_t seen = 0;
+	int ret;
+	do {
+		ret = (policy->flags & PASSWORD_PRONOUNCEABLE) ?
+			draw_pronounceable(rng, classes, password, policy->length, &seen) :
+			draw_random(rng, classes, password, policy->length, &seen);
+	} while (ret == GENERATOR_OK && seen != classes);
+	if (ret != GENERATOR_OK) {
+		secure_zero(password, policy->length);
+		return ret;
+	}
+	password[policy->length] = '\0';
+	return GENERATOR_OK;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef GENERATOR_H_
+#define GENERATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "crypto.h"
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+// characters a password is drawn from
+#define PASSWORD_LOWER 0x01
+#define PASSWORD_UPPER 0x02
+#define PASSWORD_DIGITS 0x04
+#define PASSWORD_SYMBOLS 0x08
+#define PASSWORD_CLASSES 0x0f
+#define PASSWORD_PRONOUNCEABLE 0x10		// alternate consonants and vowels
+
+#define PASSWORD_DEFAULT_LENGTH 20
+#define PASSWORD_SYMBOL_SET "!#$%&*+-./:;=?@^_~"	// no quotes, spaces or backslashes
+
+// generator errors
+#define GENERATOR_OK 0
+#define GENERATOR_ERR_POLICY 1		// no class, or too short to hold one of each
+#define GENERATOR_ERR_RANDOM 2		// the system's random source failed
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// what a generated password looks like
+struct PasswordPolicy {
+	uint32_t length;
+	uint32_t flags;		// PASSWORD_* classes, and PASSWORD_PRONOUNCEABLE
+};
+typedef struct PasswordPolicy password_policy_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Checks a policy: at least one class, and room for one
+ *             character of each in 'length', which must fit a field
+ *             of 'field_size' bytes with its terminator.
+ *
+ * @param[in]  policy        The policy
+ * @param[in]  field_size    The size of the field the password goes to
+ *
+ * @return     GENERATOR_OK if valid, GENERATOR_ERR_POLICY otherwise.
+ */
+int password_policy_check(const password_policy_t* policy, size_t field_size);
+
+
+/**
+ * @brief      Generates a password holding one character of each class
+ *             of the policy at least. Characters are drawn uniformly
+ *             by rejection sampling, and passwords missing a class
+ *             are drawn again, so every valid password is equally
+ *             likely. A pronounceable password alternates consonants
+ *             and vowels; each other class then takes one position.
+ *
+ * @param      rng         The CSPRNG
+ * @param[in]  policy      The policy, checked by password_policy_check
+ * @param[out] password    The password, of policy->length + 1 bytes
+ *
+ * @return     GENERATOR_OK if successful, GENERATOR_ERR_* otherwise.
+ */
+int generate_password(csprng_t* rng, const password_policy_t* policy, char* password);
+
+
+#endif // GENERATOR_H_
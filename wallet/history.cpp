@@ -0,0 +1,359 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <cstdlib>
+#include <stdio.h>
+#include <vector>
+
+#include "history.h"
+#include "arena.h"
+#include "secure.h"
+#include "crc32c.h"
+#include "enclave.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+// a record header and where its payload starts
+struct IndexEntry {
+	history_record_t record;
+	size_t offset;
+};
+
+/**
+ * @brief      Reads the record headers of the history, skipping the
+ *             payloads. A record cut short by a crash ends the
+ *             history; 'complete' is where the last whole record
+ *             ends.
+ *
+ */
+static int read_index(const uint8_t* history, size_t length, vector<IndexEntry>& index, size_t* complete) {
+	struct IndexEntry entry;
+	*complete = 0;
+	while (length - *complete >= sizeof(history_record_t)) {
+		memcpy(&entry.record, history + *complete, sizeof(history_record_t));
+		if (entry.record.magic != HISTORY_MAGIC) {return HISTORY_ERR_CORRUPT;}
+		entry.offset = *complete + sizeof(history_record_t);
+		if (entry.record.length > length - entry.offset) {break;}
+		index.push_back(entry);
+		*complete = entry.offset + entry.record.length;
+	}
+	return HISTORY_OK;
+}
+
+static const uint8_t* mac_key(void) {
+	static uint8_t key[SEAL_KEY_SIZE];
+	static const int ready = (derive_seal_key("wallet-history-mac", key), 1);
+	(void)ready;
+	return key;
+}
+
+/**
+ * @brief      Computes the tag of a record. The version it rebuilds
+ *             is covered, so records cannot be swapped undetected.
+ *
+ */
+static void record_tag(const history_record_t* record, const uint8_t* payload, uint8_t tag[MAC_TAG_SIZE]) {
+	hmac_t ctx;
+	uint8_t mac[SHA256_SIZE];
+	hmac_init(&ctx, mac_key(), SEAL_KEY_SIZE);
+	hmac_update(&ctx, &record->version, sizeof(record->version));
+	hmac_update(&ctx, &record->timestamp, sizeof(record->timestamp));
+	hmac_update(&ctx, &record->size, sizeof(record->size));
+	hmac_update(&ctx, &record->length, sizeof(record->length));
+	hmac_update(&ctx, payload, record->length);
+	hmac_final(&ctx, mac);
+	memcpy(tag, mac, MAC_TAG_SIZE);
+}
+
+static uint8_t* put_u32(uint8_t* p, uint32_t v) {
+	memcpy(p, &v, sizeof(v));
+	return p + sizeof(v);
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/**
+ * @brief      Finds an item of the newer version equal to 'item',
+ *             using an open-addressing table of record checksums.
+ *
+ */
+static int find_item(const vector<int32_t>& table, const wallet_t* wallet, const item_t* item) {
+	size_t mask = table.size() - 1;
+	for (size_t slot = crc32c(0, item, sizeof(item_t)) & mask; table[slot] >= 0; slot = (slot + 1) & mask) {
+		if (memcmp(&wallet->items[table[slot]], item, sizeof(item_t)) == 0) {return table[slot];}
+	}
+	return -1;
+}
+
+/**
+ * @brief      Encodes the reverse delta rebuilding 'old_wallet' from
+ *             'new_wallet': runs of items found in the newer version
+ *             are copied, the others are stored.
+ *
+ */
+static size_t encode_delta(const wallet_t* old_wallet, const wallet_t* new_wallet, uint8_t* out) {
+	uint8_t* p = out;
+
+	// index the newer version
+	size_t capacity = 16;
+	while (capacity < 2 * new_wallet->size) {capacity <<= 1;}
+	vector<int32_t> table(capacity, -1);
+	for (size_t j = 0; j < new_wallet->size; ++j) {
+		size_t slot = crc32c(0, &new_wallet->items[j], sizeof(item_t)) & (capacity - 1);
+		while (table[slot] >= 0) {slot = (slot + 1) & (capacity - 1);}
+		table[slot] = (int32_t)j;
+	}
+
+	// wallet-wide fields
+	if (memcmp(old_wallet->master_password, new_wallet->master_password, MAX_ITEM_SIZE) != 0) {
+		*p++ = DELTA_META;
+		memcpy(p, old_wallet->master_password, MAX_ITEM_SIZE);
+		p += MAX_ITEM_SIZE;
+	}
+
+	// items
+	size_t i = 0;
+	long next = -1;
+	while (i < old_wallet->size) {
+		const item_t* item = &old_wallet->items[i];
+		long j = (next >= 0 && (size_t)next < new_wallet->size &&
+			memcmp(&new_wallet->items[next], item, sizeof(item_t)) == 0) ? next : find_item(table, new_wallet, item);
+		size_t count = 1;
+		if (j >= 0) {
+			while (i + count < old_wallet->size && (size_t)j + count < new_wallet->size &&
+				memcmp(&old_wallet->items[i+count], &new_wallet->items[j+count], sizeof(item_t)) == 0) {++count;}
+			*p++ = DELTA_COPY;
+			p = put_u32(p, (uint32_t)j);
+			p = put_u32(p, (uint32_t)count);
+			next = j + (long)count;
+		}
+		else {
+			while (i + count < old_wallet->size && find_item(table, new_wallet, &old_wallet->items[i+count]) < 0) {++count;}
+			*p++ = DELTA_INSERT;
+			p = put_u32(p, (uint32_t)count);
+			memcpy(p, item, count * sizeof(item_t));
+			p += count * sizeof(item_t);
+			next = -1;
+		}
+		i += count;
+	}
+	*p++ = DELTA_END;
+	return (size_t)(p - out);
+}
+
+static size_t delta_bound(void) {
+	return 2 + MAX_ITEM_SIZE + MAX_ITEMS * (1 + 2*sizeof(uint32_t) + sizeof(item_t));
+}
+
+/**
+ * @brief      Applies a reverse delta to 'wallet' in place.
+ *
+ */
+static int apply_delta(const uint8_t* p, size_t length, const history_record_t* record, wallet_t* wallet) {
+	const uint8_t* end = p + length;
+	item_t* items = (item_t*)secure_malloc(MAX_ITEMS * sizeof(item_t));
+	if (items == NULL) {return HISTORY_ERR_IO;}
+	size_t size = 0;
+	int ret = HISTORY_ERR_CORRUPT;
+
+	while (p < end) {
+		uint8_t op = *p++;
+		if (op == DELTA_END) {
+			ret = (p == end && size == record->size) ? HISTORY_OK : HISTORY_ERR_CORRUPT;
+			break;
+		}
+		if (op == DELTA_META) {
+			if ((size_t)(end - p) < MAX_ITEM_SIZE) {break;}
+			memcpy(wallet->master_password, p, MAX_ITEM_SIZE);
+			p += MAX_ITEM_SIZE;
+		}
+		else if (op == DELTA_COPY) {
+			if (end - p < 8) {break;}
+			uint32_t start = get_u32(p), count = get_u32(p+4);
+			p += 8;
+			if (start > wallet->size || count > wallet->size - start || count > MAX_ITEMS - size) {break;}
+			memcpy(&items[size], &wallet->items[start], count * sizeof(item_t));
+			size += count;
+		}
+		else if (op == DELTA_INSERT) {
+			if (end - p < 4) {break;}
+			uint32_t count = get_u32(p);
+			p += 4;
+			if (count > MAX_ITEMS - size || (size_t)(end - p) < count * sizeof(item_t)) {break;}
+			memcpy(&items[size], p, count * sizeof(item_t));
+			p += count * sizeof(item_t);
+			size += count;
+		}
+		else {
+			break;
+		}
+	}
+
+	if (ret == HISTORY_OK) {
+		memcpy(wallet->items, items, MAX_ITEMS * sizeof(item_t));
+		wallet->size = size;
+		wallet->version = record->version;
+	}
+	secure_free(items);
+	return ret;
+}
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int history_append(const char* path, const uint8_t* history, size_t length,
+	const wallet_t* old_wallet, const wallet_t* new_wallet, int64_t timestamp, history_write_t* write) {
+	memset(write, 0, sizeof(history_write_t));
+	uint8_t* payload = (uint8_t*)secure_malloc(delta_bound());
+	if (payload == NULL) {return HISTORY_ERR_IO;}
+
+	history_record_t record;
+	memset(&record, 0, sizeof(record));
+	record.magic = HISTORY_MAGIC;
+	record.version = old_wallet->version;
+	record.timestamp = timestamp;
+	record.size = (uint32_t)old_wallet->size;
+	record.length = (uint32_t)encode_delta(old_wallet, new_wallet, payload);
+	record.crc = crc32c(0, payload, record.length);
+	record_tag(&record, payload, record.tag);
+
+	// a history that cannot be read would fail every save: start a
+	// new one, keeping the old one aside
+	vector<IndexEntry> index;
+	size_t complete = 0;
+	int ret = read_index(history, length, index, &complete);
+	if (ret == HISTORY_ERR_CORRUPT) {
+		index.clear();
+		complete = 0;
+		ret = history_set_aside(path);
+	}
+
+	// the record is appended; the history is rewritten instead to cut
+	// what a crash left of the last record, to start it anew, or to
+	// keep the newest HISTORY_DEPTH records once it holds twice as many
+	if (ret == HISTORY_OK) {
+		size_t first = index.size() + 1 > 2 * HISTORY_DEPTH ? index.size() + 1 - HISTORY_DEPTH : 0;
+		size_t start = first > 0 ? index[first].offset - sizeof(history_record_t) : 0;
+		int rewrite = first > 0 || complete != length;
+		size_t kept = rewrite ? complete - start : 0;
+		write->size = kept + sizeof(record) + record.length;
+		write->buffer = (uint8_t*)malloc(write->size);
+		if (write->buffer == NULL) {ret = HISTORY_ERR_IO;}
+		else {
+			if (kept > 0) {memcpy(write->buffer, history + start, kept);}
+			memcpy(write->buffer + kept, &record, sizeof(record));
+			memcpy(write->buffer + kept + sizeof(record), payload, record.length);
+			ocall_t call = {rewrite ? (uint32_t)OCALL_SAVE : (uint32_t)OCALL_WRITE, path, write->buffer, write->size,
+				NULL, 0, rewrite ? 0 : (uint64_t)complete, -1};
+			write->call = call;
+		}
+	}
+	secure_free(payload);
+	return ret;
+}
+
+void history_write_free(history_write_t* write) {
+	if (write->buffer != NULL) {
+		secure_zero(write->buffer, write->size);
+		free(write->buffer);
+	}
+	memset(write, 0, sizeof(history_write_t));
+}
+
+int history_set_aside(const char* path) {
+	uint8_t probe;
+	ocall_t exists[] = {
+		{OCALL_READ, path, NULL, sizeof(probe), &probe, 0, 0, -1},
+		{OCALL_CLOCK, NULL, NULL, 0, NULL, 0, 0, -1},
+	};
+	if (enclave_ocalls(exists, 2) != 0 || exists[0].length == 0) {return HISTORY_OK;}
+
+	// the name is taken by a history set aside within the same second
+	char aside[256];
+	long long now = (long long)exists[1].offset;
+	snprintf(aside, sizeof(aside), "%s.%lld", path, now);
+	for (int n = 1; n <= 100; ++n) {
+		ocall_t move = {OCALL_RENAME, path, (const uint8_t*)aside, 0, NULL, 0, 0, -1};
+		if (enclave_ocalls(&move, 1) == 0) {return HISTORY_OK;}
+		snprintf(aside, sizeof(aside), "%s.%lld.%d", path, now, n);
+	}
+	return HISTORY_ERR_IO;
+}
+
+int history_list(const uint8_t* history, size_t length, snapshot_t* snapshots, size_t* count) {
+	*count = 0;
+	vector<IndexEntry> index;
+	size_t complete;
+	int ret = read_index(history, length, index, &complete);
+	for (size_t i = index.size(); i > 0 && *count < HISTORY_DEPTH; --i) {
+		snapshots[*count].version = index[i-1].record.version;
+		snapshots[*count].timestamp = index[i-1].record.timestamp;
+		snapshots[*count].size = index[i-1].record.size;
+		++*count;
+	}
+	return ret;
+}
+
+int history_restore(const uint8_t* history, size_t length, uint64_t version, wallet_t* wallet) {
+	vector<IndexEntry> index;
+	size_t complete;
+	int ret = read_index(history, length, index, &complete);
+
+	// the newest record must rebuild the version just before this one
+	size_t last = index.size();
+	if (ret == HISTORY_OK && (last == 0 || index[last-1].record.version + 1 != wallet->version)) {
+		ret = HISTORY_ERR_NOT_FOUND;
+	}
+	size_t first = last;
+	while (ret == HISTORY_OK && first > 0 && last - first < HISTORY_DEPTH && index[first-1].record.version >= version) {--first;}
+	if (ret == HISTORY_OK && (first == last || index[first].record.version != version)) {ret = HISTORY_ERR_NOT_FOUND;}
+
+	// walk backwards from the current version
+	for (size_t i = last; i > first && ret == HISTORY_OK; --i) {
+		const history_record_t* record = &index[i-1].record;
+		uint8_t* payload = (uint8_t*)secure_malloc(record->length + 1);
+		if (payload == NULL) {
+			ret = HISTORY_ERR_IO;
+		}
+		else {
+			memcpy(payload, history + index[i-1].offset, record->length);
+			if (crc32c(0, payload, record->length) != record->crc || record->version + 1 != wallet->version) {
+				ret = HISTORY_ERR_CORRUPT;
+			}
+			else {
+				uint8_t tag[MAC_TAG_SIZE];
+				record_tag(record, payload, tag);
+				if (secure_memcmp(tag, record->tag, MAC_TAG_SIZE) != 0) {ret = HISTORY_ERR_MAC;}
+			}
+		}
+		if (ret == HISTORY_OK) {
+			ret = apply_delta(payload, record->length, record, wallet);
+		}
+		secure_free(payload);
+	}
+	return ret;
+}
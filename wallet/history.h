@@ -0,0 +1,157 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wallet.h"
+#include "crypto.h"
+#include "enclave.h"
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define HISTORY_MAGIC 0x32534857	// "WHS2", records with a MAC tag
+
+// delta operations, rebuilding an older version from a newer one
+#define DELTA_END 0
+#define DELTA_COPY 1		// copy a run of items of the newer version
+#define DELTA_INSERT 2		// insert items stored in the delta
+#define DELTA_META 3		// restore the wallet-wide fields
+
+#define HISTORY_OK 0
+#define HISTORY_ERR_IO 1
+#define HISTORY_ERR_CORRUPT 2
+#define HISTORY_ERR_NOT_FOUND 3
+#define HISTORY_ERR_MAC 4			// record failed authentication
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// header of every record of the history file
+struct HistoryRecord {
+	uint32_t magic;
+	uint32_t crc;			// CRC32C of the payload
+	uint64_t version;		// version the delta rebuilds
+	int64_t timestamp;		// when that version was replaced
+	uint32_t size;			// number of items of that version
+	uint32_t length;		// payload length
+	uint8_t tag[MAC_TAG_SIZE];	// MAC of the fields above but the CRC, and of the payload
+};
+typedef struct HistoryRecord history_record_t;
+
+// what recording a version writes, batched with the wallet's save
+struct HistoryWrite {
+	ocall_t call;			// OCALL_WRITE appending the record, or OCALL_SAVE rewriting the history
+	uint8_t* buffer;		// what the call writes
+	size_t size;
+};
+typedef struct HistoryWrite history_write_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Prepares the record of the version being replaced. The
+ *             history file is append-only and holds reverse deltas:
+ *             each record rebuilds a version from the one saved after
+ *             it, at item granularity, so its size is proportional to
+ *             the edits. Only the last HISTORY_DEPTH records are kept.
+ *             The record is appended, unless a crash left part of one
+ *             or the history is due for compaction: it is then
+ *             rewritten. A history that cannot be read is set aside,
+ *             see history_set_aside, and a new one is started.
+ *
+ * @param[in]  path           The history file
+ * @param[in]  history        Its content, as read by OCALL_LOAD
+ * @param[in]  length         The size of the content
+ * @param[in]  old_wallet     The version being replaced
+ * @param[in]  new_wallet     The version replacing it
+ * @param[in]  timestamp      When it was replaced, read by an ocall
+ * @param[out] write          The ocall writing the record, to be freed
+ *                            by history_write_free
+ *
+ * @return     HISTORY_OK if successful, HISTORY_ERR_* otherwise.
+ */
+int history_append(const char* path, const uint8_t* history, size_t length,
+	const wallet_t* old_wallet, const wallet_t* new_wallet, int64_t timestamp, history_write_t* write);
+
+
+/**
+ * @brief      Wipes and frees what history_append prepared.
+ *
+ * @param      write    The write
+ *
+ * @return     -
+ */
+void history_write_free(history_write_t* write);
+
+
+/**
+ * @brief      Moves a history out of the way, under its name followed
+ *             by the time, so that a new one can be started without
+ *             losing the versions it holds. A missing or empty
+ *             history is not an error.
+ *
+ * @param[in]  path    The history file
+ *
+ * @return     HISTORY_OK if successful, HISTORY_ERR_IO otherwise.
+ */
+int history_set_aside(const char* path);
+
+
+/**
+ * @brief      Lists the recorded versions, newest first. Only the
+ *             record headers are read.
+ *
+ * @param[in]  history      The history file, as read by OCALL_LOAD
+ * @param[in]  length       The size of the content
+ * @param[out] snapshots    The versions, HISTORY_DEPTH long: only the
+ *                          newest HISTORY_DEPTH are listed
+ * @param[out] count        The number of versions
+ *
+ * @return     HISTORY_OK if successful, HISTORY_ERR_* otherwise.
+ */
+int history_list(const uint8_t* history, size_t length, snapshot_t* snapshots, size_t* count);
+
+
+/**
+ * @brief      Rebuilds a previous version by applying the reverse
+ *             deltas from the current version backwards. Restoring
+ *             a recent version only reads the latest few records,
+ *             each of which is copied in and authenticated before it
+ *             is applied.
+ *
+ * @param[in]  history    The history file, as read by OCALL_LOAD
+ * @param[in]  length     The size of the content
+ * @param[in]  version    The version to rebuild
+ * @param[in,out] wallet  The current version in, the rebuilt one out
+ *
+ * @return     HISTORY_OK if successful, HISTORY_ERR_* otherwise.
+ */
+int history_restore(const uint8_t* history, size_t length, uint64_t version, wallet_t* wallet);
+
+
+#endif // HISTORY_H_
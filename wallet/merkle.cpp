@@ -0,0 +1,112 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+
+#include "merkle.h"
+#include "crypto.h"
+#include "secure.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+#define ENTRY_ITEM 1
+#define ENTRY_TOMBSTONE 2
+
+static void entry_hash(uint8_t kind, uint64_t id, uint64_t revision, const void* record, size_t len, uint8_t hash[MERKLE_HASH_SIZE]) {
+	sha256_t ctx;
+	uint8_t digest[SHA256_SIZE];
+	sha256_init(&ctx);
+	sha256_update(&ctx, &kind, sizeof(kind));
+	sha256_update(&ctx, &id, sizeof(id));
+	sha256_update(&ctx, &revision, sizeof(revision));
+	if (len > 0) {sha256_update(&ctx, record, len);}
+	sha256_final(&ctx, digest);
+	memcpy(hash, digest, MERKLE_HASH_SIZE);
+	secure_zero(digest, sizeof(digest));
+}
+
+static void rehash_node(merkle_tree_t* tree, uint32_t node) {
+	uint8_t digest[SHA256_SIZE];
+	sha256(tree->nodes[2*node], 2 * MERKLE_HASH_SIZE, digest);
+	memcpy(tree->nodes[node], digest, MERKLE_HASH_SIZE);
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+void merkle_item_hash(const item_t* item, uint8_t hash[MERKLE_HASH_SIZE]) {
+	entry_hash(ENTRY_ITEM, item->id, item->revision, item, sizeof(item_t), hash);
+}
+
+void merkle_tombstone_hash(const tombstone_t* tombstone, uint8_t hash[MERKLE_HASH_SIZE]) {
+	entry_hash(ENTRY_TOMBSTONE, tombstone->id, tombstone->revision, NULL, 0, hash);
+}
+
+uint32_t merkle_bucket(uint64_t id) {
+	return (uint32_t)(id >> (64 - MERKLE_LEAF_BITS));
+}
+
+void merkle_toggle(merkle_tree_t* tree, uint64_t id, const uint8_t hash[MERKLE_HASH_SIZE]) {
+	uint32_t node = MERKLE_LEAVES + merkle_bucket(id);
+	for (int i = 0; i < MERKLE_HASH_SIZE; ++i) {tree->nodes[node][i] ^= hash[i];}
+	for (node /= 2; node > 0; node /= 2) {rehash_node(tree, node);}
+}
+
+void merkle_build(merkle_tree_t* tree, const item_t* items, size_t count, const tombstones_t* tombstones) {
+	uint8_t hash[MERKLE_HASH_SIZE];
+	memset(tree, 0, sizeof(merkle_tree_t));
+
+	// leaves first, then every inner node once
+	for (size_t i = 0; i < count; ++i) {
+		merkle_item_hash(&items[i], hash);
+		uint8_t* leaf = tree->nodes[MERKLE_LEAVES + merkle_bucket(items[i].id)];
+		for (int j = 0; j < MERKLE_HASH_SIZE; ++j) {leaf[j] ^= hash[j];}
+	}
+	for (uint32_t i = 0; i < tombstones->count && i < MAX_TOMBSTONES; ++i) {
+		merkle_tombstone_hash(&tombstones->entries[i], hash);
+		uint8_t* leaf = tree->nodes[MERKLE_LEAVES + merkle_bucket(tombstones->entries[i].id)];
+		for (int j = 0; j < MERKLE_HASH_SIZE; ++j) {leaf[j] ^= hash[j];}
+	}
+	for (uint32_t node = MERKLE_LEAVES - 1; node > 0; --node) {rehash_node(tree, node);}
+}
+
+uint32_t merkle_diff(const merkle_tree_t* a, const merkle_tree_t* b, uint32_t buckets[MERKLE_LEAVES], uint32_t* count) {
+	// depth-first, left to right: at most one pending node per level
+	// plus the siblings pushed on the way down
+	uint32_t stack[2 * MERKLE_LEAF_BITS + 2];
+	uint32_t depth = 0, compared = 0;
+	*count = 0;
+	stack[depth++] = 1;
+	while (depth > 0) {
+		uint32_t node = stack[--depth];
+		++compared;
+		if (memcmp(a->nodes[node], b->nodes[node], MERKLE_HASH_SIZE) == 0) {continue;}
+		if (node >= MERKLE_LEAVES) {
+			buckets[(*count)++] = node - MERKLE_LEAVES;
+			continue;
+		}
+		stack[depth++] = 2*node + 1;
+		stack[depth++] = 2*node;
+	}
+	return compared;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MERKLE_H_
+#define MERKLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wallet.h"
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Hashes the current state of an item: its id, revision
+ *             and whole record.
+ *
+ * @param[in]  item    The item
+ * @param[out] hash    The MERKLE_HASH_SIZE-byte hash
+ *
+ * @return     -
+ */
+void merkle_item_hash(const item_t* item, uint8_t hash[MERKLE_HASH_SIZE]);
+
+
+/**
+ * @brief      Hashes a removal. It never equals the hash of an item
+ *             with the same id and revision.
+ *
+ * @param[in]  tombstone    The removal
+ * @param[out] hash         The MERKLE_HASH_SIZE-byte hash
+ *
+ * @return     -
+ */
+void merkle_tombstone_hash(const tombstone_t* tombstone, uint8_t hash[MERKLE_HASH_SIZE]);
+
+
+/**
+ * @brief      Gives the bucket, i.e. the leaf, an id belongs to.
+ *
+ * @param[in]  id    The item id
+ *
+ * @return     The bucket, below MERKLE_LEAVES.
+ */
+uint32_t merkle_bucket(uint64_t id);
+
+
+/**
+ * @brief      Adds an entry to the tree, or takes it out if it is
+ *             there: a leaf is the XOR of the hashes of its entries,
+ *             so both are the same operation. Only the path from the
+ *             leaf to the root is rehashed.
+ *
+ * @param      tree    The tree
+ * @param[in]  id      The id of the entry
+ * @param[in]  hash    The hash of the entry
+ *
+ * @return     -
+ */
+void merkle_toggle(merkle_tree_t* tree, uint64_t id, const uint8_t hash[MERKLE_HASH_SIZE]);
+
+
+/**
+ * @brief      Rebuilds the tree from the items and the removals.
+ *
+ * @param[out] tree          The tree
+ * @param[in]  items         The items
+ * @param[in]  count         The number of items
+ * @param[in]  tombstones    The removals
+ *
+ * @return     -
+ */
+void merkle_build(merkle_tree_t* tree, const item_t* items, size_t count, const tombstones_t* tombstones);
+
+
+/**
+ * @brief      Finds the buckets in which two trees differ, descending
+ *             only into the subtrees whose hashes differ: the cost is
+ *             O(changes * MERKLE_LEAF_BITS) rather than O(items).
+ *
+ * @param[in]  a         The first tree
+ * @param[in]  b         The second tree
+ * @param[out] buckets   The differing buckets, in increasing order
+ * @param[out] count     The number of differing buckets
+ *
+ * @return     The number of node pairs compared.
+ */
+uint32_t merkle_diff(const merkle_tree_t* a, const merkle_tree_t* b, uint32_t buckets[MERKLE_LEAVES], uint32_t* count);
+
+
+#endif // MERKLE_H_
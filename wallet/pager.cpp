@@ -0,0 +1,267 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <cstdlib>
+
+#include "pager.h"
+#include "arena.h"
+#include "enclave.h"
+#include "secure.h"
+
+using namespace std;
+
+#define NO_PAGE UINT32_MAX
+
+
+/***************************************************
+ * Sealing
+ ***************************************************/
+// the version makes every nonce unique under the store's key
+static void page_nonce(uint32_t page, uint64_t version, uint8_t nonce[CHACHA20_NONCE_SIZE]) {
+	memcpy(nonce, &page, sizeof(page));
+	memcpy(nonce + sizeof(page), &version, sizeof(version));
+}
+
+static void page_tag(const item_store_t* store, uint32_t page, uint64_t version, const uint8_t* ciphertext, uint8_t tag[MAC_TAG_SIZE]) {
+	hmac_t ctx;
+	uint8_t mac[SHA256_SIZE];
+	hmac_init(&ctx, store->mac_key, SEAL_KEY_SIZE);
+	hmac_update(&ctx, &page, sizeof(page));
+	hmac_update(&ctx, &version, sizeof(version));
+	hmac_update(&ctx, ciphertext, PAGER_PAGE_SIZE);
+	hmac_final(&ctx, mac);
+	memcpy(tag, mac, MAC_TAG_SIZE);
+}
+
+/**
+ * @brief      Encrypts a page, then tags the ciphertext, and stores
+ *             the result outside the trusted cache.
+ *
+ */
+static int seal_page(item_store_t* store, uint32_t page, const item_t* items) {
+	uint8_t sealed[PAGER_SEALED_SIZE];
+	uint8_t nonce[CHACHA20_NONCE_SIZE];
+	uint64_t version = store->versions[page] + 1;
+	page_nonce(page, version, nonce);
+	chacha20_xor(store->enc_key, nonce, 1, items, sealed + MAC_TAG_SIZE, PAGER_PAGE_SIZE);
+	page_tag(store, page, version, sealed + MAC_TAG_SIZE, sealed);
+
+	if (store->fd >= 0) {
+		ocall_t request = {OCALL_WRITE, NULL, sealed, PAGER_SEALED_SIZE, NULL, 0, (uint64_t)page * PAGER_SEALED_SIZE, store->fd};
+		if (enclave_ocalls(&request, 1) != 0) {return PAGER_ERR_IO;}
+	}
+	else {
+		memcpy(store->backing + (size_t)page * PAGER_SEALED_SIZE, sealed, PAGER_SEALED_SIZE);
+	}
+	store->versions[page] = version;
+	return PAGER_OK;
+}
+
+/**
+ * @brief      Fetches a sealed page, authenticates it and decrypts it.
+ *             The page is copied in first, so the untrusted side
+ *             cannot change it between the check and the decryption.
+ *
+ */
+static int unseal_page(item_store_t* store, uint32_t page, item_t* items) {
+	if (store->versions[page] == 0) {
+		memset(items, 0, PAGER_PAGE_SIZE);
+		return PAGER_OK;
+	}
+	uint8_t sealed[PAGER_SEALED_SIZE];
+	if (store->fd >= 0) {
+		ocall_t request = {OCALL_READ, NULL, NULL, PAGER_SEALED_SIZE, sealed, 0, (uint64_t)page * PAGER_SEALED_SIZE, store->fd};
+		if (enclave_ocalls(&request, 1) != 0 || request.length != PAGER_SEALED_SIZE) {return PAGER_ERR_IO;}
+	}
+	else {
+		memcpy(sealed, store->backing + (size_t)page * PAGER_SEALED_SIZE, PAGER_SEALED_SIZE);
+	}
+
+	uint8_t tag[MAC_TAG_SIZE];
+	uint8_t nonce[CHACHA20_NONCE_SIZE];
+	page_tag(store, page, store->versions[page], sealed + MAC_TAG_SIZE, tag);
+	if (secure_memcmp(tag, sealed, MAC_TAG_SIZE) != 0) {return PAGER_ERR_MAC;}
+	page_nonce(page, store->versions[page], nonce);
+	chacha20_xor(store->enc_key, nonce, 1, sealed + MAC_TAG_SIZE, items, PAGER_PAGE_SIZE);
+	return PAGER_OK;
+}
+
+
+/***************************************************
+ * Cache
+ ***************************************************/
+static int evict(item_store_t* store, uint32_t slot) {
+	pager_frame_t* frame = &store->frame[slot];
+	if (frame->page == NO_PAGE) {return PAGER_OK;}
+	if (frame->dirty) {
+		int ret = seal_page(store, frame->page, frame->items);
+		if (ret != PAGER_OK) {return ret;}
+		++store->stats.writebacks;
+	}
+	store->resident[frame->page] = -1;
+	secure_zero(frame->items, PAGER_PAGE_SIZE);
+	frame->page = NO_PAGE;
+	frame->dirty = 0;
+	++store->stats.evictions;
+	return PAGER_OK;
+}
+
+/**
+ * @brief      Finds the frame holding a page, paging it in if needed.
+ *             The victim is chosen by CLOCK: the hand sweeps the
+ *             frames, clearing reference bits, and takes the first
+ *             frame not referenced since the last sweep.
+ *
+ */
+static int resident_frame(item_store_t* store, uint32_t page, pager_frame_t** out) {
+	if (store->resident[page] >= 0) {
+		*out = &store->frame[store->resident[page]];
+		(*out)->referenced = 1;
+		++store->stats.hits;
+		return PAGER_OK;
+	}
+	++store->stats.misses;
+
+	uint32_t victim;
+	for (;;) {
+		pager_frame_t* frame = &store->frame[store->hand];
+		victim = store->hand;
+		store->hand = (store->hand + 1) % store->frames;
+		if (frame->page == NO_PAGE || !frame->referenced) {break;}
+		frame->referenced = 0;
+	}
+	// a failed write-back leaves the victim resident and dirty
+	int ret = evict(store, victim);
+	if (ret != PAGER_OK) {return ret;}
+	ret = unseal_page(store, page, store->frame[victim].items);
+	if (ret != PAGER_OK) {
+		secure_zero(store->frame[victim].items, PAGER_PAGE_SIZE);
+		return ret;
+	}
+
+	pager_frame_t* frame = &store->frame[victim];
+	frame->page = page;
+	frame->referenced = 1;
+	frame->dirty = 0;
+	store->resident[page] = (int32_t)victim;
+	*out = frame;
+	return PAGER_OK;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int pager_init(item_store_t* store, uint32_t capacity, size_t budget, const char* swap_path) {
+	memset(store, 0, sizeof(item_store_t));
+	store->fd = -1;
+	store->capacity = capacity;
+	store->pages = (capacity + PAGER_ITEMS_PER_PAGE - 1) / PAGER_ITEMS_PER_PAGE;
+	if (store->pages == 0) {store->pages = 1;}
+	store->frames = (uint32_t)(budget / PAGER_PAGE_SIZE);
+	if (store->frames == 0) {store->frames = 1;}
+	if (store->frames > store->pages) {store->frames = store->pages;}
+
+	if (random_bytes(store->enc_key, CHACHA20_KEY_SIZE) != 0 || random_bytes(store->mac_key, SEAL_KEY_SIZE) != 0) {
+		return PAGER_ERR_IO;
+	}
+	store->frame = (pager_frame_t*)secure_malloc(store->frames * sizeof(pager_frame_t));
+	store->resident = (int32_t*)secure_malloc(store->pages * sizeof(int32_t));
+	store->versions = (uint64_t*)secure_malloc(store->pages * sizeof(uint64_t));
+	if (store->frame == NULL || store->resident == NULL || store->versions == NULL) {
+		pager_free(store);
+		return PAGER_ERR_MEMORY;
+	}
+	for (uint32_t i = 0; i < store->pages; ++i) {store->resident[i] = -1;}
+	for (uint32_t i = 0; i < store->frames; ++i) {
+		store->frame[i].page = NO_PAGE;
+		store->frame[i].items = (item_t*)secure_malloc(PAGER_PAGE_SIZE);
+		if (store->frame[i].items == NULL) {
+			pager_free(store);
+			return PAGER_ERR_MEMORY;
+		}
+	}
+
+	// sealed pages live outside the enclave; the swap file is
+	// unlinked as soon as it is open
+	if (swap_path != NULL) {
+		ocall_t swap[] = {
+			{OCALL_OPEN, swap_path, NULL, 0, NULL, 0, 0, -1},
+			{OCALL_TRUNCATE, swap_path, NULL, 0, NULL, 0, 0, -1},
+			{OCALL_REMOVE, swap_path, NULL, 0, NULL, 0, 0, -1},
+		};
+		enclave_ocalls(swap, 3);
+		if (swap[0].status == 0) {store->fd = swap[0].handle;}
+		if (swap[2].status != 0) {
+			pager_free(store);
+			return PAGER_ERR_IO;
+		}
+	}
+	else {
+		store->backing = (uint8_t*)calloc(store->pages, PAGER_SEALED_SIZE);
+		if (store->backing == NULL) {
+			pager_free(store);
+			return PAGER_ERR_MEMORY;
+		}
+	}
+	return PAGER_OK;
+}
+
+int pager_get(item_store_t* store, uint32_t index, item_t* item) {
+	if (index >= store->capacity) {return PAGER_ERR_RANGE;}
+	pager_frame_t* frame;
+	int ret = resident_frame(store, index / PAGER_ITEMS_PER_PAGE, &frame);
+	if (ret != PAGER_OK) {return ret;}
+	*item = frame->items[index % PAGER_ITEMS_PER_PAGE];
+	return PAGER_OK;
+}
+
+int pager_put(item_store_t* store, uint32_t index, const item_t* item) {
+	if (index >= store->capacity) {return PAGER_ERR_RANGE;}
+	pager_frame_t* frame;
+	int ret = resident_frame(store, index / PAGER_ITEMS_PER_PAGE, &frame);
+	if (ret != PAGER_OK) {return ret;}
+	frame->items[index % PAGER_ITEMS_PER_PAGE] = *item;
+	frame->dirty = 1;
+	return PAGER_OK;
+}
+
+int pager_flush(item_store_t* store) {
+	for (uint32_t i = 0; i < store->frames; ++i) {
+		int ret = evict(store, i);
+		if (ret != PAGER_OK) {return ret;}
+	}
+	return PAGER_OK;
+}
+
+void pager_free(item_store_t* store) {
+	if (store->frame != NULL) {
+		for (uint32_t i = 0; i < store->frames; ++i) {secure_free(store->frame[i].items);}
+	}
+	secure_free(store->frame);
+	secure_free(store->resident);
+	secure_free(store->versions);
+	free(store->backing);
+	if (store->fd >= 0) {
+		ocall_t request = {OCALL_CLOSE, NULL, NULL, 0, NULL, 0, 0, store->fd};
+		enclave_ocalls(&request, 1);
+	}
+	secure_zero(store, sizeof(item_store_t));
+	store->fd = -1;
+}
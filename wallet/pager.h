@@ -0,0 +1,160 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PAGER_H_
+#define PAGER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wallet.h"
+#include "crypto.h"
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define PAGER_ITEMS_PER_PAGE 8		// 8 items fit in a 4 KiB EPC page
+#define PAGER_PAGE_SIZE (PAGER_ITEMS_PER_PAGE * sizeof(item_t))
+#define PAGER_SEALED_SIZE (MAC_TAG_SIZE + PAGER_PAGE_SIZE)
+
+// pager errors
+#define PAGER_OK 0
+#define PAGER_ERR_RANGE 1		// no such item
+#define PAGER_ERR_IO 2			// backing store could not be read or written
+#define PAGER_ERR_MAC 3			// page tampered with or rolled back
+#define PAGER_ERR_MEMORY 4		// allocation failed
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// pager counters
+struct PagerStats {
+	uint64_t hits;			// accesses served by a resident page
+	uint64_t misses;		// accesses that paged in
+	uint64_t evictions;		// pages dropped from the cache
+	uint64_t writebacks;	// evicted pages that had to be re-sealed
+};
+typedef struct PagerStats pager_stats_t;
+
+// resident page
+struct PagerFrame {
+	uint32_t page;			// page held, UINT32_MAX if free
+	uint8_t referenced;		// second chance for CLOCK
+	uint8_t dirty;			// changed since paged in
+	item_t* items;
+};
+typedef struct PagerFrame pager_frame_t;
+
+// item store running under a resident-memory budget: at most 'frames'
+// pages are decrypted at a time, the others are sealed in untrusted
+// memory or in a swap file
+struct ItemStore {
+	uint32_t capacity;		// items
+	uint32_t pages;
+	uint32_t frames;		// resident budget, in pages
+	uint32_t hand;			// CLOCK hand
+
+	// trusted
+	pager_frame_t* frame;
+	int32_t* resident;		// frame holding each page, -1 if sealed
+	uint64_t* versions;		// times each page was sealed, 0 if never
+	uint8_t enc_key[CHACHA20_KEY_SIZE];
+	uint8_t mac_key[SEAL_KEY_SIZE];
+	pager_stats_t stats;
+
+	// untrusted
+	uint8_t* backing;		// sealed pages, when there is no swap file
+	int fd;					// swap file handle, -1 if none
+};
+typedef struct ItemStore item_store_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Creates an empty store. The page keys are random and
+ *             only live as long as the store: sealed pages are a swap
+ *             space, not a persistent format.
+ *
+ * @param[out] store        The store
+ * @param[in]  capacity     The number of items
+ * @param[in]  budget       The resident-memory budget in bytes; at
+ *                          least one page is kept resident
+ * @param[in]  swap_path    The swap file, NULL to seal pages in
+ *                          untrusted memory
+ *
+ * @return     PAGER_OK if successful, PAGER_ERR_* otherwise.
+ */
+int pager_init(item_store_t* store, uint32_t capacity, size_t budget, const char* swap_path);
+
+
+/**
+ * @brief      Reads an item, paging it in if needed. A sealed page is
+ *             authenticated before it is decrypted; its tag binds the
+ *             page number and version, so pages can neither be swapped
+ *             nor replayed.
+ *
+ * @param      store    The store
+ * @param[in]  index    The item
+ * @param[out] item     The item's content
+ *
+ * @return     PAGER_OK if successful, PAGER_ERR_* otherwise.
+ */
+int pager_get(item_store_t* store, uint32_t index, item_t* item);
+
+
+/**
+ * @brief      Writes an item, paging it in if needed. The page is
+ *             re-sealed when it is evicted.
+ *
+ * @param      store    The store
+ * @param[in]  index    The item
+ * @param[in]  item     The item's new content
+ *
+ * @return     PAGER_OK if successful, PAGER_ERR_* otherwise.
+ */
+int pager_put(item_store_t* store, uint32_t index, const item_t* item);
+
+
+/**
+ * @brief      Evicts every resident page, sealing the dirty ones.
+ *
+ * @param      store    The store
+ *
+ * @return     PAGER_OK if successful, PAGER_ERR_* otherwise.
+ */
+int pager_flush(item_store_t* store);
+
+
+/**
+ * @brief      Wipes the resident pages and releases the store. The
+ *             swap file was unlinked when it was created, so closing
+ *             it is enough.
+ *
+ * @param      store    The store
+ *
+ * @return     -
+ */
+void pager_free(item_store_t* store);
+
+
+#endif // PAGER_H_
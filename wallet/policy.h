@@ -0,0 +1,307 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef POLICY_H_
+#define POLICY_H_
+
+// included by wallet.h, after its limits and error codes, which size
+// the default policy
+
+#include <cstring>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+#include "arena.h"
+#include "secure.h"
+#include "crypto.h"
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define PASSWORD_MIN_SIZE 8				// shortest master-password accepted
+#define POLICY_INLINE_LIMIT (64 * 1024)	// largest item storage AutoStorage keeps inline
+#define POLICY_PAGE_ITEMS 256			// items per page of PagedStorage
+#define POLICY_SALT_SIZE 16
+
+
+/***************************************************
+ * Storage backends
+ ***************************************************/
+// items inside the wallet object itself: no heap. It reads as a plain
+// array, so a wallet laid out with it is a single block
+template <class T, size_t N>
+struct InlineStorage {
+	static constexpr bool is_inline = true;
+
+	T* at(size_t index) {return &slots[index];}
+	const T* at(size_t index) const {return &slots[index];}
+	T* reserve(size_t index) {return &slots[index];}
+	void wipe() {secure_zero(slots, sizeof(slots));}
+
+	operator T*() {return slots;}
+	operator const T*() const {return slots;}
+
+	T slots[N];
+};
+
+// items in pages of the secure arena, allocated as the wallet grows;
+// only the page table is part of the wallet object
+template <class T, size_t N>
+class PagedStorage {
+public:
+	static constexpr bool is_inline = false;
+	static constexpr size_t page_count = (N + POLICY_PAGE_ITEMS - 1) / POLICY_PAGE_ITEMS;
+
+	PagedStorage() {memset(pages, 0, sizeof(pages));}
+	~PagedStorage() {wipe();}
+	PagedStorage(const PagedStorage&) = delete;
+	PagedStorage& operator=(const PagedStorage&) = delete;
+
+	T* at(size_t index) {return &pages[index / POLICY_PAGE_ITEMS][index % POLICY_PAGE_ITEMS];}
+	const T* at(size_t index) const {return &pages[index / POLICY_PAGE_ITEMS][index % POLICY_PAGE_ITEMS];}
+
+	// the slot about to be written, its page allocated if needed
+	T* reserve(size_t index) {
+		T*& page = pages[index / POLICY_PAGE_ITEMS];
+		if (page == NULL) {
+			page = (T*)secure_malloc(POLICY_PAGE_ITEMS * sizeof(T));
+			if (page == NULL) {return NULL;}
+			memset(page, 0, POLICY_PAGE_ITEMS * sizeof(T));
+		}
+		return &page[index % POLICY_PAGE_ITEMS];
+	}
+
+	// secure_free wipes the pages
+	void wipe() {
+		for (size_t i = 0; i < page_count; ++i) {
+			secure_free(pages[i]);
+			pages[i] = NULL;
+		}
+	}
+
+private:
+	T* pages[page_count];
+};
+
+// inline while the items fit in POLICY_INLINE_LIMIT, paged beyond
+template <class T, size_t N>
+using AutoStorage = typename std::conditional<sizeof(T) * N <= POLICY_INLINE_LIMIT,
+	InlineStorage<T, N>, PagedStorage<T, N>>::type;
+
+
+/***************************************************
+ * Key derivation
+ ***************************************************/
+// master-password kept as is, zero-padded: the wallet file format.
+// Padding written by older versions may not be zero, so only the
+// string is compared
+struct PlainKdf {
+	static constexpr size_t verifier_size(size_t field_size) {return field_size;}
+	static constexpr size_t salt_size = 0;
+
+	static void derive(const char* password, size_t len, const uint8_t* salt, uint8_t* out, size_t out_len) {
+		(void)salt;
+		memset(out, 0, out_len);
+		memcpy(out, password, len < out_len ? len : out_len);
+	}
+
+	static int compare(const uint8_t* candidate, const uint8_t* verifier, size_t len) {
+		return secure_strcmp((const char*)candidate, (const char*)verifier, len);
+	}
+};
+
+// master-password stretched with PBKDF2-HMAC-SHA256 and a random salt
+template <uint32_t Iterations>
+struct Pbkdf2Kdf {
+	static_assert(Iterations > 0, "PBKDF2 needs one iteration at least");
+	static constexpr size_t verifier_size(size_t field_size) {return (void)field_size, SHA256_SIZE;}
+	static constexpr size_t salt_size = POLICY_SALT_SIZE;
+
+	static void derive(const char* password, size_t len, const uint8_t* salt, uint8_t* out, size_t out_len) {
+		pbkdf2_sha256(password, len, salt, salt_size, Iterations, out, out_len);
+	}
+
+	static int compare(const uint8_t* candidate, const uint8_t* verifier, size_t len) {
+		return secure_memcmp(candidate, verifier, len);
+	}
+};
+
+
+/***************************************************
+ * Policies
+ ***************************************************/
+/**
+ * @brief      The limits of a wallet, fixed at compile time: how many
+ *             items it holds, the size of their fields (terminator
+ *             included), the shortest master-password, how the
+ *             master-password is stored and where the items live.
+ *             Every check is a constant of the type, so it folds
+ *             away; an invalid policy does not compile.
+ *
+ */
+template <size_t Capacity, size_t FieldSize, size_t MinPassword = PASSWORD_MIN_SIZE,
+	class Kdf = PlainKdf, template <class, size_t> class Storage = AutoStorage>
+struct WalletPolicy {
+	static constexpr size_t capacity = Capacity;
+	static constexpr size_t field_size = FieldSize;
+	static constexpr size_t min_password = MinPassword;
+	static constexpr size_t salt_size = Kdf::salt_size;
+	static constexpr size_t verifier_size = Kdf::verifier_size(FieldSize);
+	typedef Kdf kdf;
+	template <class T, size_t N> using storage = Storage<T, N>;
+
+	static_assert(capacity > 0, "a wallet holds one item at least");
+	static_assert(capacity <= UINT32_MAX, "item indexes are 32-bit");
+	static_assert(field_size >= 2, "fields hold one character and a terminator at least");
+	static_assert(min_password > 0, "an empty master-password is not a password");
+	static_assert(min_password + 1 <= field_size, "the shortest master-password must fit a field");
+
+	static constexpr bool password_in_range(size_t len) {
+		return len >= min_password && len + 1 <= field_size;
+	}
+
+	static constexpr bool index_in_range(int index) {
+		return index >= 0 && (size_t)index < capacity;
+	}
+
+	// room for 'count' more items in a wallet holding 'size'
+	static constexpr bool has_room(size_t size, size_t count) {
+		return size <= capacity && count <= capacity - size;
+	}
+
+	// terminated within a field
+	static bool field_fits(const char* field) {
+		return strnlen(field, field_size) + 1 <= field_size;
+	}
+
+	// a KDF with a salt draws a new one
+	static int set_master_password(const char* password, uint8_t* salt, uint8_t* verifier) {
+		size_t len = strnlen(password, field_size);
+		if (!password_in_range(len)) {return ERR_PASSWORD_OUT_OF_RANGE;}
+		if (salt_size > 0 && random_bytes(salt, salt_size) != 0) {return ERR_CANNOT_SAVE_WALLET;}
+		Kdf::derive(password, len, salt, verifier, verifier_size);
+		return RET_SUCCESS;
+	}
+
+	// constant time; 0 if the password matches
+	static int check_master_password(const char* password, const uint8_t* salt, const uint8_t* verifier) {
+		uint8_t candidate[verifier_size];
+		Kdf::derive(password, strnlen(password, field_size), salt, candidate, verifier_size);
+		int ret = Kdf::compare(candidate, verifier, verifier_size);
+		secure_zero(candidate, sizeof(candidate));
+		return ret;
+	}
+};
+
+// the wallet file: its items are sealed as one block, so they live
+// inline, and the master-password is kept as is
+typedef WalletPolicy<MAX_ITEMS, MAX_ITEM_SIZE, PASSWORD_MIN_SIZE, PlainKdf, InlineStorage> default_policy_t;
+
+static_assert(default_policy_t::password_in_range(PASSWORD_MIN_SIZE) &&
+	!default_policy_t::password_in_range(MAX_ITEM_SIZE), "the default policy matches the wallet file");
+static_assert(default_policy_t::salt_size == 0 && default_policy_t::verifier_size == MAX_ITEM_SIZE,
+	"the wallet file keeps the master-password in a field");
+
+
+/***************************************************
+ * Wallet core
+ ***************************************************/
+/**
+ * @brief      A wallet laid out for one policy, for deployments whose
+ *             limits differ from the wallet file's: the storage and
+ *             the key derivation are chosen at compile time.
+ *
+ */
+template <class Policy>
+class BasicWallet {
+public:
+	static constexpr size_t capacity = Policy::capacity;
+	static constexpr size_t field_size = Policy::field_size;
+	static constexpr size_t verifier_size = Policy::verifier_size;
+	typedef typename Policy::kdf kdf_t;
+
+	struct Item {
+		char title[field_size];
+		char username[field_size];
+		char password[field_size];
+	};
+	typedef typename Policy::template storage<Item, capacity> storage_t;
+	static constexpr bool is_inline = storage_t::is_inline;
+
+	BasicWallet() : count(0) {
+		memset(salt, 0, sizeof(salt));
+		memset(verifier, 0, sizeof(verifier));
+	}
+	~BasicWallet() {
+		secure_zero(salt, sizeof(salt));
+		secure_zero(verifier, sizeof(verifier));
+		items.wipe();
+	}
+	BasicWallet(const BasicWallet&) = delete;
+	BasicWallet& operator=(const BasicWallet&) = delete;
+
+	size_t size() const {return count;}
+
+	int set_master_password(const char* password) {
+		return Policy::set_master_password(password, salt, verifier);
+	}
+
+	int check_master_password(const char* password) const {
+		return Policy::check_master_password(password, salt, verifier);
+	}
+
+	int add(const char* title, const char* username, const char* password) {
+		if (!Policy::has_room(count, 1)) {return ERR_WALLET_FULL;}
+		if (!Policy::field_fits(title) || !Policy::field_fits(username) || !Policy::field_fits(password)) {
+			return ERR_ITEM_TOO_LONG;
+		}
+		Item* item = items.reserve(count);
+		if (item == NULL) {return ERR_CANNOT_SAVE_WALLET;}
+		memset(item, 0, sizeof(Item));
+		strcpy(item->title, title);
+		strcpy(item->username, username);
+		strcpy(item->password, password);
+		++count;
+		return RET_SUCCESS;
+	}
+
+	// the items after it move down by one, as in the wallet file
+	int remove(size_t index) {
+		if (index >= count) {return ERR_ITEM_DOES_NOT_EXIST;}
+		for (size_t i = index; i + 1 < count; ++i) {*items.at(i) = *items.at(i + 1);}
+		secure_zero(items.at(--count), sizeof(Item));
+		return RET_SUCCESS;
+	}
+
+	const Item* get(size_t index) const {return index < count ? items.at(index) : NULL;}
+
+private:
+	size_t count;
+	uint8_t salt[Policy::salt_size > 0 ? Policy::salt_size : 1];
+	uint8_t verifier[verifier_size];
+	storage_t items;
+};
+
+static_assert(BasicWallet<default_policy_t>::is_inline, "the default wallet fits inline");
+static_assert(sizeof(BasicWallet<default_policy_t>::Item) == 3 * MAX_ITEM_SIZE,
+	"the default item matches the legacy record");
+
+
+#endif // POLICY_H_
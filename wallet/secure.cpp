@@ -0,0 +1,144 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SECURE_X86
+#endif
+
+#include "secure.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Comparison kernels
+ ***************************************************/
+// All kernels accumulate the XOR of both inputs and only look at the
+// accumulator once the whole range has been consumed.
+
+static unsigned char diff_tail(const unsigned char* a, const unsigned char* b, size_t len) {
+	unsigned char acc = 0;
+	for (size_t i = 0; i < len; ++i) {acc |= a[i] ^ b[i];}
+	return acc;
+}
+
+static int diff_generic(const unsigned char* a, const unsigned char* b, size_t len) {
+	uint64_t acc = 0;
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t x, y;
+		memcpy(&x, a+i, 8);
+		memcpy(&y, b+i, 8);
+		acc |= x ^ y;
+	}
+	return (acc | diff_tail(a+i, b+i, len-i)) != 0;
+}
+
+#ifdef SECURE_X86
+static int diff_sse2(const unsigned char* a, const unsigned char* b, size_t len) {
+	__m128i acc = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(a+i));
+		__m128i y = _mm_loadu_si128((const __m128i*)(b+i));
+		acc = _mm_or_si128(acc, _mm_xor_si128(x, y));
+	}
+	int zero = _mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) == 0xffff;
+	return (!zero) | (diff_tail(a+i, b+i, len-i) != 0);
+}
+
+__attribute__((target("avx2")))
+static int diff_avx2(const unsigned char* a, const unsigned char* b, size_t len) {
+	__m256i acc = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(a+i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(b+i));
+		acc = _mm256_or_si256(acc, _mm256_xor_si256(x, y));
+	}
+	int zero = _mm256_testz_si256(acc, acc);
+	unsigned char tail = 0;
+	for (; i < len; ++i) {tail |= a[i] ^ b[i];}
+	// avoid AVX/SSE transition stalls in the caller
+	_mm256_zeroupper();
+	return (!zero) | (tail != 0);
+}
+#endif
+
+typedef int (*diff_fn)(const unsigned char*, const unsigned char*, size_t);
+
+static diff_fn select_kernel(void) {
+#ifdef SECURE_X86
+	if (__builtin_cpu_supports("avx2")) {return diff_avx2;}
+	if (__builtin_cpu_supports("sse2")) {return diff_sse2;}
+#endif
+	return diff_generic;
+}
+
+static const diff_fn diff_kernel = select_kernel();
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int secure_memcmp(const void* a, const void* b, size_t len) {
+	return diff_kernel((const unsigned char*)a, (const unsigned char*)b, len);
+}
+
+int secure_strcmp(const char* a, const char* b, size_t size) {
+	// 'live' masks stay 0xff until the string's terminator is seen
+	unsigned char live_a = 0xff, live_b = 0xff, acc = 0;
+	size_t i = 0;
+#ifdef SECURE_X86
+	// 16 bytes at a time: only the bytes of 'a' up to and including
+	// its terminator have to match; 'alive' drops to 0 past it
+	uint32_t alive = 0xffff, diff = 0;
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= size; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(a+i));
+		__m128i y = _mm_loadu_si128((const __m128i*)(b+i));
+		uint32_t eq = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+		uint32_t nul = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero));
+		uint32_t upto = ((nul & (0u-nul)) << 1) - 1;
+		diff |= ~eq & upto & alive;
+		alive &= 0u - (uint32_t)(nul == 0);
+	}
+	acc = (unsigned char)(diff != 0);
+	live_a = live_b = (unsigned char)(0u - (uint32_t)(alive != 0));
+#endif
+	for (; i < size; ++i) {
+		unsigned char x = (unsigned char)a[i] & live_a;
+		unsigned char y = (unsigned char)b[i] & live_b;
+		acc |= x ^ y;
+		live_a &= (unsigned char)-(unsigned char)((x | (unsigned char)-x) >> 7);
+		live_b &= (unsigned char)-(unsigned char)((y | (unsigned char)-y) >> 7);
+	}
+	// a string filling the whole buffer is not terminated
+	return (acc | live_a | live_b) != 0;
+}
+
+void secure_zero(void* ptr, size_t len) {
+	// libc's memset is already vectorised; the barrier keeps the
+	// compiler from dropping it as a dead store
+	memset(ptr, 0, len);
+	__asm__ __volatile__("" : : "r"(ptr) : "memory");
+}
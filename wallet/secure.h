@@ -0,0 +1,72 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SECURE_H_
+#define SECURE_H_
+
+#include <stddef.h>
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Compares two buffers in constant time. The running
+ *             time only depends on the length, never on the
+ *             position of the first mismatch. Uses AVX2 or SSE2
+ *             when the CPU supports them.
+ *
+ * @param[in]  a      The first buffer
+ * @param[in]  b      The second buffer
+ * @param[in]  len    The number of bytes to compare
+ *
+ * @return     0 if the buffers are equal, 1 otherwise.
+ */
+int secure_memcmp(const void* a, const void* b, size_t len);
+
+
+/**
+ * @brief      Compares two NUL-terminated strings held in buffers
+ *             of 'size' bytes in constant time. Bytes after the
+ *             terminator are ignored, so stale padding never
+ *             causes a mismatch; both buffers must be readable
+ *             over their full size.
+ *
+ * @param[in]  a       The first string buffer
+ * @param[in]  b       The second string buffer
+ * @param[in]  size    The size of both buffers
+ *
+ * @return     0 if the strings are equal, 1 otherwise.
+ */
+int secure_strcmp(const char* a, const char* b, size_t size);
+
+
+/**
+ * @brief      Zeroes a buffer holding secrets; unlike memset the
+ *             store cannot be optimised away.
+ *
+ * @param[out] ptr    The buffer to wipe
+ * @param[in]  len    The number of bytes to wipe
+ *
+ * @return     -
+ */
+void secure_zero(void* ptr, size_t len);
+
+
+#endif // SECURE_H_
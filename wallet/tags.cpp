@@ -0,0 +1,277 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <ctype.h>
+#include <strings.h>
+
+#include "tags.h"
+#include "bitmap.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+static int find_tag(const tag_index_t* index, const char* name) {
+	for (uint32_t i = 0; i < index->count; ++i) {
+		if (strcmp(index->names[i], name) == 0) {return (int)i;}
+	}
+	return -1;
+}
+
+/**
+ * @brief      Splits a tag list into trimmed, non-empty, distinct
+ *             names.
+ *
+ */
+static int split_tags(const char* tags, char names[MAX_TAGS+1][MAX_TAG_SIZE], uint32_t* count) {
+	*count = 0;
+	const char* p = tags;
+	while (*p != '\0') {
+		const char* end = strchr(p, TAG_SEPARATOR);
+		if (end == NULL) {end = p + strlen(p);}
+		const char* start = p;
+		const char* stop = end;
+		while (start < stop && isspace((unsigned char)*start)) {++start;}
+		while (stop > start && isspace((unsigned char)stop[-1])) {--stop;}
+		size_t length = (size_t)(stop - start);
+		if (length + 1 > MAX_TAG_SIZE) {return TAGS_ERR_TOO_LONG;}
+		if (length > 0) {
+			char name[MAX_TAG_SIZE];
+			memcpy(name, start, length);
+			name[length] = '\0';
+			uint32_t i = 0;
+			while (i < *count && strcmp(names[i], name) != 0) {++i;}
+			if (i == *count) {
+				if (*count == MAX_TAGS) {return TAGS_ERR_FULL;}
+				memcpy(names[(*count)++], name, MAX_TAG_SIZE);
+			}
+		}
+		p = *end == '\0' ? end : end + 1;
+	}
+	return TAGS_OK;
+}
+
+/**
+ * @brief      Takes an item out of every tag, shifting the items
+ *             after it if 'shift' is set.
+ *
+ */
+static void drop_item(tag_index_t* index, uint32_t position, int shift) {
+	uint32_t i = 0;
+	while (i < index->count) {
+		if (shift) {bitmap_delete(&index->items[i], position);}
+		else {bitmap_remove(&index->items[i], position);}
+		if (bitmap_cardinality(&index->items[i]) > 0) {
+			++i;
+			continue;
+		}
+		// forget the tag: the last one takes its slot
+		uint32_t last = --index->count;
+		if (i != last) {
+			memcpy(index->names[i], index->names[last], MAX_TAG_SIZE);
+			index->items[i] = index->items[last];
+		}
+		memset(index->names[last], 0, MAX_TAG_SIZE);
+		bitmap_clear(&index->items[last]);
+	}
+}
+
+
+/***************************************************
+ * Queries
+ ***************************************************/
+#define TOKEN_SIZE MAX_TAG_SIZE
+
+struct Query {
+	const char* p;
+	const tag_index_t* index;
+	size_t size;
+	int error;
+};
+
+/**
+ * @brief      Reads the next token without consuming it: a
+ *             parenthesis, or a word ending at a space or parenthesis.
+ *
+ */
+static size_t peek(struct Query* q, char token[TOKEN_SIZE]) {
+	while (isspace((unsigned char)*q->p)) {++q->p;}
+	const char* p = q->p;
+	if (*p == '(' || *p == ')') {
+		token[0] = *p;
+		token[1] = '\0';
+		return 1;
+	}
+	size_t length = 0;
+	while (p[length] != '\0' && !isspace((unsigned char)p[length]) && p[length] != '(' && p[length] != ')') {++length;}
+	if (length + 1 > TOKEN_SIZE) {
+		q->error = 1;
+		length = 0;
+	}
+	memcpy(token, p, length);
+	token[length] = '\0';
+	return length;
+}
+
+static void consume(struct Query* q, size_t length) {
+	q->p += length;
+}
+
+static int is_keyword(const char* token, const char* keyword) {
+	return strcasecmp(token, keyword) == 0;
+}
+
+static void parse_or(struct Query* q, bitmap_t* out);
+
+static void parse_not(struct Query* q, bitmap_t* out) {
+	char token[TOKEN_SIZE];
+	size_t length = peek(q, token);
+	bitmap_clear(out);
+	if (length == 0 || strcmp(token, ")") == 0 || is_keyword(token, "AND") || is_keyword(token, "OR")) {
+		q->error = 1;
+		return;
+	}
+	consume(q, length);
+
+	// complement within the wallet
+	if (is_keyword(token, "NOT")) {
+		bitmap_t operand;
+		parse_not(q, &operand);
+		bitmap_fill(out, q->size);
+		bitmap_andnot(out, &operand, out);
+	}
+
+	// sub-expression
+	else if (strcmp(token, "(") == 0) {
+		parse_or(q, out);
+		length = peek(q, token);
+		if (strcmp(token, ")") != 0) {q->error = 1;}
+		consume(q, length);
+	}
+
+	// tag
+	else {
+		int tag = find_tag(q->index, token);
+		if (tag >= 0) {*out = q->index->items[tag];}
+	}
+}
+
+static void parse_and(struct Query* q, bitmap_t* out) {
+	char token[TOKEN_SIZE];
+	parse_not(q, out);
+	while (!q->error) {
+		size_t length = peek(q, token);
+		if (length == 0 || strcmp(token, ")") == 0 || is_keyword(token, "OR")) {return;}
+		if (is_keyword(token, "AND")) {
+			consume(q, length);
+			length = peek(q, token);
+		}
+		// "AND NOT x" is a difference, no complement needed
+		bitmap_t operand;
+		if (is_keyword(token, "NOT")) {
+			consume(q, length);
+			parse_not(q, &operand);
+			bitmap_andnot(out, &operand, out);
+		}
+		else {
+			parse_not(q, &operand);
+			bitmap_and(out, &operand, out);
+		}
+	}
+}
+
+static void parse_or(struct Query* q, bitmap_t* out) {
+	char token[TOKEN_SIZE];
+	parse_and(q, out);
+	while (!q->error) {
+		size_t length = peek(q, token);
+		if (!is_keyword(token, "OR")) {return;}
+		consume(q, length);
+		bitmap_t operand;
+		parse_and(q, &operand);
+		bitmap_or(out, &operand, out);
+	}
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int tag_index_add(tag_index_t* index, uint32_t position, const char* tags) {
+	char names[MAX_TAGS+1][MAX_TAG_SIZE];
+	uint32_t count;
+	int ret = split_tags(tags, names, &count);
+	if (ret != TAGS_OK) {return ret;}
+
+	// check the new tags fit before touching the index
+	uint32_t missing = 0;
+	for (uint32_t i = 0; i < count; ++i) {missing += find_tag(index, names[i]) < 0;}
+	if (index->count + missing > MAX_TAGS) {return TAGS_ERR_FULL;}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		int tag = find_tag(index, names[i]);
+		if (tag < 0) {
+			tag = (int)index->count++;
+			memcpy(index->names[tag], names[i], MAX_TAG_SIZE);
+			bitmap_clear(&index->items[tag]);
+		}
+		bitmap_add(&index->items[tag], position);
+	}
+	return TAGS_OK;
+}
+
+void tag_index_remove(tag_index_t* index, uint32_t position) {
+	drop_item(index, position, 0);
+}
+
+void tag_index_delete(tag_index_t* index, uint32_t position) {
+	drop_item(index, position, 1);
+}
+
+int tag_index_build(tag_index_t* index, const item_t* items, size_t count) {
+	int ret = TAGS_OK;
+	memset(index, 0, sizeof(tag_index_t));
+	for (size_t i = 0; i < count; ++i) {
+		int status = tag_index_add(index, (uint32_t)i, items[i].tags);
+		if (ret == TAGS_OK) {ret = status;}
+	}
+	return ret;
+}
+
+int tag_index_valid(const tag_index_t* index, size_t size) {
+	if (index->count > MAX_TAGS) {return 0;}
+	for (uint32_t i = 0; i < index->count; ++i) {
+		if (strnlen(index->names[i], MAX_TAG_SIZE) == MAX_TAG_SIZE || !bitmap_valid(&index->items[i], size)) {return 0;}
+	}
+	return 1;
+}
+
+int tag_query(const tag_index_t* index, size_t size, const char* query, bitmap_t* result) {
+	struct Query q = {query, index, size, 0};
+	char token[TOKEN_SIZE];
+	parse_or(&q, result);
+	if (!q.error && peek(&q, token) != 0) {q.error = 1;}
+	if (q.error) {
+		bitmap_clear(result);
+		return TAGS_ERR_SYNTAX;
+	}
+	return TAGS_OK;
+}
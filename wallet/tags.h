@@ -0,0 +1,121 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TAGS_H_
+#define TAGS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wallet.h"
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define TAGS_OK 0
+#define TAGS_ERR_FULL 1			// more than MAX_TAGS distinct tags
+#define TAGS_ERR_TOO_LONG 2		// a tag does not fit MAX_TAG_SIZE
+#define TAGS_ERR_SYNTAX 3		// malformed query
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Indexes the tags of a new item. Nothing is changed if
+ *             the item's tags do not all fit in the index.
+ *
+ * @param      index       The tag index
+ * @param[in]  position    The position of the item in the wallet
+ * @param[in]  tags        The item's tags, separated by TAG_SEPARATOR
+ *
+ * @return     TAGS_OK if successful, TAGS_ERR_* otherwise.
+ */
+int tag_index_add(tag_index_t* index, uint32_t position, const char* tags);
+
+
+/**
+ * @brief      Takes an item out of the index, leaving the other
+ *             positions unchanged. Used before re-indexing an item
+ *             whose tags changed.
+ *
+ * @param      index       The tag index
+ * @param[in]  position    The position of the item
+ *
+ * @return     -
+ */
+void tag_index_remove(tag_index_t* index, uint32_t position);
+
+
+/**
+ * @brief      Drops an item from the index; the items after it move
+ *             down by one, as they do in the wallet. Tags left
+ *             without items are forgotten.
+ *
+ * @param      index       The tag index
+ * @param[in]  position    The position of the removed item
+ *
+ * @return     -
+ */
+void tag_index_delete(tag_index_t* index, uint32_t position);
+
+
+/**
+ * @brief      Rebuilds the index from the items' tags.
+ *
+ * @param[out] index    The tag index
+ * @param[in]  items    The items
+ * @param[in]  count    The number of items
+ *
+ * @return     TAGS_OK if successful, TAGS_ERR_* otherwise.
+ */
+int tag_index_build(tag_index_t* index, const item_t* items, size_t count);
+
+
+/**
+ * @brief      Checks an index read from untrusted storage against
+ *             the number of items of the wallet.
+ *
+ * @param[in]  index    The tag index
+ * @param[in]  size     The number of items
+ *
+ * @return     1 if the index is valid, 0 otherwise.
+ */
+int tag_index_valid(const tag_index_t* index, size_t size);
+
+
+/**
+ * @brief      Evaluates a query such as "prod AND db AND NOT legacy"
+ *             by intersecting the tags' bitmaps; items are never
+ *             scanned. Supports AND, OR, NOT and parentheses; AND
+ *             binds tighter than OR, and adjacent tags are ANDed.
+ *             Unknown tags match no item.
+ *
+ * @param[in]  index     The tag index
+ * @param[in]  size      The number of items in the wallet
+ * @param[in]  query     The query
+ * @param[out] result    The matching items
+ *
+ * @return     TAGS_OK if successful, TAGS_ERR_SYNTAX otherwise.
+ */
+int tag_query(const tag_index_t* index, size_t size, const char* query, bitmap_t* result);
+
+
+#endif // TAGS_H_
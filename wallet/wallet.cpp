@@ -20,9 +20,29 @@
 #include <stdio.h>
 #include <fstream>
 #include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fnmatch.h>
 
 #include "../include/debug.h"
 #include "wallet.h"
+#include "arena.h"
+#include "secure.h"
+#include "format.h"
+#include "history.h"
+#include "audit.h"
+#include "tags.h"
+#include "expiry.h"
+#include "merkle.h"
+#include "crypto.h"
+#include "enclave.h"
+#include "pager.h"
+#include "blob.h"
+#include "accesslog.h"
+#include "watch.h"
+#include "policy.h"
+#include "generator.h"
 
 using namespace std;
 
@@ -34,45 +54,522 @@ void debug_print(const char* str) {
     printf("[DEBUG] %s\n", str);
 }
 
+/**
+ * @brief      Unseals the image fetched by an OCALL_LOAD from memory,
+ *             then frees it.
+ *
+ */
+static int read_loaded(ocall_t* load, wallet_t* wallet) {
+    int ret = 1;
+    FILE *file = load->status == 0 && load->length > 0 ? fmemopen(load->out, load->length, "r") : NULL;
+    if (file != NULL) {
+        ret = read_wallet_file(file, wallet);
+        fclose (file);
+    }
+    free(load->out);
+    load->out = NULL;
+    return ret;
+}
+
+/**
+ * @brief      Loads the wallet stored at a given path; see
+ *             load_wallet. The sealed image is fetched by an ocall
+ *             and unsealed from memory.
+ *
+ */
+static int load_wallet_from(const char* path, wallet_t* wallet) {
+    ocall_t load = {OCALL_LOAD, path, NULL, 0, NULL, 0, 0, -1};
+    enclave_ocalls(&load, 1);
+    return read_loaded(&load, wallet);
+}
+
+/**
+ * @brief      Loads the wallet stored at a given path again, only
+ *             authenticating the records that differ from a copy
+ *             loaded before; see reload_wallet_file.
+ *
+ */
+static int reload_wallet_from(const char* path, const wallet_t* known, const uint8_t* known_tags,
+    wallet_t* wallet, uint8_t* tags, bitmap_t* changed) {
+    ocall_t load = {OCALL_LOAD, path, NULL, 0, NULL, 0, 0, -1};
+    if (enclave_ocalls(&load, 1) != 0) {return 1;}
+    int ret = 1;
+    FILE *file = load.length > 0 ? fmemopen(load.out, load.length, "r") : NULL;
+    if (file != NULL) {
+        ret = reload_wallet_file(file, known, known_tags, wallet, tags, changed);
+        fclose (file);
+    }
+    free(load.out);
+    return ret;
+}
+
+/**
+ * @brief      A wallet loaded to be changed and saved back. The version
+ *             loaded is kept, with the history as it was read, so that
+ *             saving the change records it in the history without
+ *             reading either file again. An advisory lock on the
+ *             wallet is held from the load to the save, so that
+ *             concurrent changes are not lost. The save releases it;
+ *             a change that is not saved releases it once the update
+ *             goes out of scope, which also wipes the copies. The
+ *             time of the change is read in the same batch as the
+ *             load: the enclave has no trusted time source, so dates
+ *             are informational only.
+ *
+ */
+struct WalletUpdate {
+    wallet_t* previous;
+    uint8_t* history;
+    size_t history_size;
+    int locked;
+    int lock;
+    int64_t now;
+
+    WalletUpdate() : previous(NULL), history(NULL), history_size(0), locked(0), lock(-1), now(0) {}
+    ~WalletUpdate() {
+        secure_free(previous);
+        if (history != NULL) {
+            secure_zero(history, history_size);
+            free(history);
+        }
+        if (locked) {
+            ocall_t unlock = {OCALL_UNLOCK, NULL, NULL, 0, NULL, 0, 0, lock};
+            enclave_ocalls(&unlock, 1);
+        }
+    }
+    WalletUpdate(const WalletUpdate&) = delete;
+    WalletUpdate& operator=(const WalletUpdate&) = delete;
+};
+
+/**
+ * @brief      Takes the lock a change to the wallet at a given path
+ *             holds. It is a separate file, as saving replaces the
+ *             wallet's.
+ *
+ */
+static int lock_for_update(const char* path, struct WalletUpdate* update) {
+    string lock_path = string(path) + WALLET_LOCK_SUFFIX;
+    ocall_t lock = {OCALL_LOCK, lock_path.c_str(), NULL, 0, NULL, 0, 0, -1};
+    if (enclave_ocalls(&lock, 1) != 0) {return 1;}
+    update->locked = 1;
+    update->lock = lock.handle;
+    return 0;
+}
+
+/**
+ * @brief      Loads the wallet stored at a given path and its history
+ *             to change them, and reads the clock, in one batch of
+ *             ocalls. The lock is taken first in the same batch,
+ *             unless already held.
+ *
+ */
+static int load_update(const char* path, wallet_t* wallet, struct WalletUpdate* update, int take_lock) {
+    string lock_path = string(path) + WALLET_LOCK_SUFFIX;
+    string history_path = string(path) + WALLET_HISTORY_SUFFIX;
+    ocall_t load[] = {
+        {OCALL_LOCK, lock_path.c_str(), NULL, 0, NULL, 0, 0, -1},
+        {OCALL_LOAD, path, NULL, 0, NULL, 0, 0, -1},
+        {OCALL_LOAD, history_path.c_str(), NULL, 0, NULL, 0, 0, -1},
+        {OCALL_CLOCK, NULL, NULL, 0, NULL, 0, 0, -1},
+    };
+    if (take_lock) {enclave_ocalls(load, 4);}
+    else {enclave_ocalls(load + 1, 3);}
+    if (take_lock && load[0].status == 0) {
+        update->locked = 1;
+        update->lock = load[0].handle;
+    }
+    update->history = load[2].out;
+    update->history_size = load[2].length;
+    if (read_loaded(&load[1], wallet) != 0) {return 1;}
+
+    update->previous = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    if (load[2].status != 0 || load[3].status != 0 || update->previous == NULL) {
+        secure_zero(wallet, sizeof(wallet_t));
+        return 1;
+    }
+    *update->previous = *wallet;
+    update->now = (int64_t)load[3].offset;
+    return 0;
+}
+
+/**
+ * @brief      Loads the wallet stored at a given path to change it,
+ *             its lock already held; see load_update.
+ *
+ */
+static int load_locked(const char* path, wallet_t* wallet, struct WalletUpdate* update) {
+    return load_update(path, wallet, update, 0);
+}
+
+/**
+ * @brief      Locks, then loads the wallet stored at a given path to
+ *             change it; see load_update.
+ *
+ */
+static int load_for_update(const char* path, wallet_t* wallet, struct WalletUpdate* update) {
+    return load_update(path, wallet, update, 1);
+}
+
+/**
+ * @brief      Saves a wallet to a given path, recording the version it
+ *             replaces in the history next to it; see save_wallet.
+ *             'update' is NULL for a new wallet. The image is sealed
+ *             in memory; the history record, the image, which
+ *             replaces the wallet atomically, and the release of the
+ *             update's lock then go out in one batch of ocalls.
+ *
+ */
+static int save_wallet_to(const char* path, wallet_t* wallet, struct WalletUpdate* update) {
+    const wallet_t* previous = update != NULL ? update->previous : NULL;
+    string history_path = string(path) + WALLET_HISTORY_SUFFIX;
+    history_write_t history;
+    if (previous != NULL) {
+        wallet->version = previous->version + 1;
+        if (history_append(history_path.c_str(), update->history, update->history_size, previous, wallet,
+            update->now, &history) != HISTORY_OK) {
+            history_write_free(&history);
+            return 1;
+        }
+    }
+    else {
+        wallet->version = 1;
+        memset(&history, 0, sizeof(history));
+        if (history_set_aside(history_path.c_str()) != HISTORY_OK) {return 1;}
+    }
+
+    char* image = NULL;
+    size_t image_size = 0;
+    FILE *file = open_memstream(&image, &image_size);
+    int ret = file == NULL ? FORMAT_ERR_IO : write_wallet_file(file, wallet);
+    if (file != NULL && fclose (file) != 0) {ret = FORMAT_ERR_IO;}
+    if (ret == FORMAT_OK) {
+        // the record goes first: a failed one leaves the wallet as it was
+        int unlock = update != NULL && update->locked;
+        ocall_t store[3];
+        size_t count = 0, saved;
+        if (previous != NULL) {store[count++] = history.call;}
+        saved = count;
+        store[count++] = {OCALL_SAVE, path, (const uint8_t*)image, image_size, NULL, 0, 0, -1};
+        if (unlock) {store[count++] = {OCALL_UNLOCK, NULL, NULL, 0, NULL, 0, 0, update->lock};}
+        enclave_ocalls(store, count);
+        ret = store[saved].status == 0 ? FORMAT_OK : FORMAT_ERR_IO;
+        if (unlock && ret == FORMAT_OK) {update->locked = 0;}
+    }
+    history_write_free(&history);
+    free(image);
+    return ret;
+}
+
 /**
  * @brief      Save sealed data to file The sizes/length of 
  *             pointers need to be specified, otherwise SGX will
  *             assume a count of 1 for all pointers.
+ *             The image is compressed before sealing: titles,
+ *             usernames and the zero padding of unused items
+ *             compress well, secrets do not. The version being
+ *             replaced is kept as a reverse delta in the history.
  *
  */
-int save_wallet(const wallet_t* wallet) {
-    FILE *file = fopen (WALLET_FILE, "w");
-    if (file == NULL) {return 1;}
-    fwrite (wallet, sizeof(wallet_t), 1, file);
-    fclose (file);
-    return 0;
+int save_wallet(wallet_t* wallet, const wallet_t* previous) {
+    if (previous == NULL) {return save_wallet_to(WALLET_FILE, wallet, NULL);}
+    struct WalletUpdate update;
+    ocall_t load[] = {
+        {OCALL_LOAD, WALLET_HISTORY_FILE, NULL, 0, NULL, 0, 0, -1},
+        {OCALL_CLOCK, NULL, NULL, 0, NULL, 0, 0, -1},
+    };
+    update.previous = (wallet_t*)secure_malloc(sizeof(wallet_t));
+    if (update.previous == NULL) {return 1;}
+    int loading_status = enclave_ocalls(load, 2);
+    update.history = load[0].out;
+    update.history_size = load[0].length;
+    if (loading_status != 0) {return 1;}
+    update.now = (int64_t)load[1].offset;
+    *update.previous = *previous;
+    return save_wallet_to(WALLET_FILE, wallet, &update);
 }
 
 /**
  * @brief      Load sealed data from file The sizes/length of 
  *             pointers need to be specified, otherwise SGX will
  *             assume a count of 1 for all pointers.
+ *             The file header is validated first, so foreign,
+ *             truncated or incompatible files are rejected early.
  *
  */
 int load_wallet(wallet_t* wallet) {
-    FILE *file = fopen (WALLET_FILE, "r");
-    if (file == NULL) {return 1;}
-    fread (wallet, sizeof(wallet_t), 1, file);
-    fclose (file);
-    return 0;
+    return load_wallet_from(WALLET_FILE, wallet);
 }
 
 /**
- * @brief      Verifies if a wallet files exists.
+ * @brief      Verifies if a wallet files exists, by an ocall.
  *
  */
 int is_wallet(void) {
-    FILE *file = fopen (WALLET_FILE, "r");
-    if (file == NULL) {return 0;}
-    fclose (file);
-    return 1;
+    ocall_t size = {OCALL_SIZE, WALLET_FILE, NULL, 0, NULL, 0, 0, -1};
+    return enclave_ocalls(&size, 1) == 0;
+}
+
+/**
+ * @brief      Verifies the master-password in constant time, as the
+ *             wallet's policy derives it.
+ *
+ */
+static int check_master_password(const wallet_t* wallet, const char* password) {
+    return default_policy_t::check_master_password(password, NULL, (const uint8_t*)wallet->master_password);
+}
+
+/**
+ * @brief      Sets the master-password, as the wallet's policy derives
+ *             it.
+ *
+ */
+static int set_master_password(wallet_t* wallet, const char* password) {
+    return default_policy_t::set_master_password(password, NULL, (uint8_t*)wallet->master_password);
+}
+
+/**
+ * @brief      Records the removal of an item. The oldest removal is
+ *             forgotten when the list is full: a replica that has not
+ *             merged since then could bring that item back.
+ *
+ */
+static void add_tombstone(wallet_t* wallet, uint64_t id, uint64_t revision) {
+    uint8_t hash[MERKLE_HASH_SIZE];
+    tombstones_t* tombstones = &wallet->tombstones;
+    if (tombstones->count == MAX_TOMBSTONES) {
+        merkle_tombstone_hash(&tombstones->entries[0], hash);
+        merkle_toggle(&wallet->merkle, tombstones->entries[0].id, hash);
+        memmove(&tombstones->entries[0], &tombstones->entries[1], (MAX_TOMBSTONES - 1) * sizeof(tombstone_t));
+        --tombstones->count;
+    }
+    tombstone_t* tombstone = &tombstones->entries[tombstones->count++];
+    tombstone->id = id;
+    tombstone->revision = revision;
+    merkle_tombstone_hash(tombstone, hash);
+    merkle_toggle(&wallet->merkle, id, hash);
+}
+
+static int find_tombstone(const wallet_t* wallet, uint64_t id) {
+    for (uint32_t i = 0; i < wallet->tombstones.count; ++i) {
+        if (wallet->tombstones.entries[i].id == id) {return (int)i;}
+    }
+    return -1;
+}
+
+static void drop_tombstone(wallet_t* wallet, int at) {
+    uint8_t hash[MERKLE_HASH_SIZE];
+    tombstones_t* tombstones = &wallet->tombstones;
+    merkle_tombstone_hash(&tombstones->entries[at], hash);
+    merkle_toggle(&wallet->merkle, tombstones->entries[at].id, hash);
+    --tombstones->count;
+    memmove(&tombstones->entries[at], &tombstones->entries[at+1], (tombstones->count - at) * sizeof(tombstone_t));
+    memset(&tombstones->entries[tombstones->count], 0, sizeof(tombstone_t));
+}
+
+static int find_item(const item_t* items, size_t size, uint64_t id) {
+    for (size_t i = 0; i < size; ++i) {
+        if (items[i].id == id) {return (int)i;}
+    }
+    return -1;
+}
+
+/**
+ * @brief      Matches an item against a credential: shell patterns on
+ *             the title and, unless NULL or empty, on the username.
+ *
+ */
+static int is_credential(const item_t* item, const char* title, const char* username) {
+    if (fnmatch(title, item->title, 0) != 0) {return 0;}
+    return username == NULL || username[0] == '\0' || fnmatch(username, item->username, 0) == 0;
+}
+
+/**
+ * @brief      Makes restored items win over the versions they replace
+ *             when replicas are merged: changed items get a revision
+ *             above every one seen, and the items the restore drops
+ *             get a tombstone. The indexes are rebuilt by the caller.
+ *
+ */
+static void supersede(wallet_t* wallet, const item_t* previous, size_t previous_size) {
+    for (size_t i = 0; i < previous_size; ++i) {
+        if (find_item(wallet->items, wallet->size, previous[i].id) < 0) {
+            add_tombstone(wallet, previous[i].id, previous[i].revision + 1);
+        }
+    }
+    for (size_t i = 0; i < wallet->size; ++i) {
+        item_t* item = &wallet->items[i];
+        int before = find_item(previous, previous_size, item->id);
+        if (before >= 0 && memcmp(&previous[before], item, sizeof(item_t)) == 0) {continue;}
+        uint64_t revision = item->revision;
+        if (before >= 0 && previous[before].revision > revision) {revision = previous[before].revision;}
+        int tombstone = find_tombstone(wallet, item->id);
+        if (tombstone >= 0) {
+            if (wallet->tombstones.entries[tombstone].revision > revision) {
+                revision = wallet->tombstones.entries[tombstone].revision;
+            }
+            drop_tombstone(wallet, tombstone);
+        }
+        item->revision = revision + 1;
+    }
+}
+
+/**
+ * @brief      Stamps an item about to be added: its dates, a random id
+ *             and a first revision. Blobs are attached afterwards.
+ *
+ */
+static int new_item(const item_t* item, int64_t now, item_t* added) {
+    *added = *item;
+    added->created = now;
+    added->modified = now;
+    added->revision = 1;
+    added->blob = 0;
+    added->blob_size = 0;
+    added->id = 0;
+    while (added->id == 0) {
+        if (random_bytes(&added->id, sizeof(added->id)) != 0) {return ERR_CANNOT_SAVE_WALLET;}
+    }
+    return RET_SUCCESS;
+}
+
+/**
+ * @brief      Appends an item and indexes it. The item keeps its id
+ *             and revision.
+ *
+ */
+static int insert_item(wallet_t* wallet, const item_t* item) {
+    uint8_t hash[MERKLE_HASH_SIZE];
+    size_t position = wallet->size;
+    if (!default_policy_t::has_room(position, 1)) {
+        return ERR_WALLET_FULL;
+    }
+    int tags_status = tag_index_add(&wallet->tags, (uint32_t)position, item->tags);
+    if (tags_status != TAGS_OK) {
+        return tags_status == TAGS_ERR_FULL ? ERR_TOO_MANY_TAGS : ERR_ITEM_TOO_LONG;
+    }
+    wallet->items[position] = *item;
+    expiry_index_add(&wallet->expiry, (uint32_t)position, item->expires);
+    merkle_item_hash(item, hash);
+    merkle_toggle(&wallet->merkle, item->id, hash);
+    ++wallet->size;
+    return RET_SUCCESS;
+}
+
+/**
+ * @brief      Overwrites an item and re-indexes it.
+ *
+ */
+static int replace_item(wallet_t* wallet, size_t position, const item_t* item) {
+    uint8_t hash[MERKLE_HASH_SIZE];
+    tag_index_remove(&wallet->tags, (uint32_t)position);
+    int tags_status = tag_index_add(&wallet->tags, (uint32_t)position, item->tags);
+    if (tags_status != TAGS_OK) {
+        tag_index_add(&wallet->tags, (uint32_t)position, wallet->items[position].tags);
+        return tags_status == TAGS_ERR_FULL ? ERR_TOO_MANY_TAGS : ERR_ITEM_TOO_LONG;
+    }
+    merkle_item_hash(&wallet->items[position], hash);
+    merkle_toggle(&wallet->merkle, wallet->items[position].id, hash);
+    wallet->items[position] = *item;
+    expiry_index_update(&wallet->expiry, (uint32_t)position, item->expires);
+    merkle_item_hash(item, hash);
+    merkle_toggle(&wallet->merkle, item->id, hash);
+    return RET_SUCCESS;
+}
+
+/**
+ * @brief      Removes an item, leaving a tombstone with the given
+ *             revision behind.
+ *
+ */
+static void delete_item(wallet_t* wallet, size_t position, uint64_t revision) {
+    uint8_t hash[MERKLE_HASH_SIZE];
+    const item_t* item = &wallet->items[position];
+    uint64_t id = item->id;
+    merkle_item_hash(item, hash);
+    merkle_toggle(&wallet->merkle, id, hash);
+    for (size_t i = position; i + 1 < wallet->size; ++i) {
+        wallet->items[i] = wallet->items[i+1];
+    }
+    --wallet->size;
+    secure_zero(&wallet->items[wallet->size], sizeof(item_t));
+    tag_index_delete(&wallet->tags, (uint32_t)position);
+    expiry_index_delete(&wallet->expiry, (uint32_t)position);
+    add_tombstone(wallet, id, revision);
+}
+
+
+// what a replica tells about one entry of a bucket
+struct Summary {
+    uint64_t id;
+    uint64_t revision;
+    int64_t modified;
+    uint32_t deleted;
+    uint32_t position;      // in the replica's items or tombstones
+    uint8_t hash[MERKLE_HASH_SIZE];
+};
+typedef struct Summary summary_t;
+
+/**
+ * @brief      Lists, ordered by id, the items and removals of a
+ *             replica that fall in the given buckets.
+ *
+ */
+static void summarize(const wallet_t* wallet, const uint8_t wanted[MERKLE_LEAVES], vector<summary_t>& out) {
+    summary_t summary;
+    for (size_t i = 0; i < wallet->size; ++i) {
+        const item_t* item = &wallet->items[i];
+        if (!wanted[merkle_bucket(item->id)]) {continue;}
+        summary = {item->id, item->revision, item->modified, 0, (uint32_t)i, {0}};
+        merkle_item_hash(item, summary.hash);
+        out.push_back(summary);
+    }
+    for (uint32_t i = 0; i < wallet->tombstones.count; ++i) {
+        const tombstone_t* tombstone = &wallet->tombstones.entries[i];
+        if (!wanted[merkle_bucket(tombstone->id)]) {continue;}
+        summary = {tombstone->id, tombstone->revision, 0, 1, i, {0}};
+        merkle_tombstone_hash(tombstone, summary.hash);
+        out.push_back(summary);
+    }
+    sort(out.begin(), out.end(), [](const summary_t& a, const summary_t& b) {return a.id < b.id;});
+}
+
+/**
+ * @brief      Decides which of two versions of an entry wins: the
+ *             higher revision, then a removal, then the later change.
+ *             The hash breaks the remaining ties, so every replica
+ *             makes the same choice.
+ *
+ */
+static int supersedes(const summary_t* a, const summary_t* b) {
+    if (a->revision != b->revision) {return a->revision > b->revision;}
+    if (a->deleted != b->deleted) {return a->deleted;}
+    if (a->modified != b->modified) {return a->modified > b->modified;}
+    return memcmp(a->hash, b->hash, MERKLE_HASH_SIZE) > 0;
 }
 
+/**
+ * @brief      Brings an entry of a replica into another one.
+ *
+ */
+static int apply_entry(wallet_t* wallet, const wallet_t* source, const summary_t* entry) {
+    int position = find_item(wallet->items, wallet->size, entry->id);
+    int tombstone = find_tombstone(wallet, entry->id);
+
+    // removal
+    if (entry->deleted) {
+        if (tombstone >= 0) {drop_tombstone(wallet, tombstone);}
+        if (position >= 0) {delete_item(wallet, (size_t)position, entry->revision);}
+        else {add_tombstone(wallet, entry->id, entry->revision);}
+        return RET_SUCCESS;
+    }
+
+    // new or changed item
+    const item_t* item = &source->items[entry->position];
+    if (position >= 0) {return replace_item(wallet, (size_t)position, item);}
+    int ret = insert_item(wallet, item);
+    if (ret == RET_SUCCESS && tombstone >= 0) {drop_tombstone(wallet, tombstone);}
+    return ret;
+}
 
 /**
  * @brief      Creates a new wallet with the provided master-password.
@@ -94,7 +591,7 @@ int create_wallet(const char* master_password) {
 
 
 	// 1. check passaword policy
-	if (strlen(master_password) < 8 || strlen(master_password)+1 > MAX_ITEM_SIZE) {
+	if (!default_policy_t::password_in_range(strnlen(master_password, default_policy_t::field_size))) {
 		return ERR_PASSWORD_OUT_OF_RANGE;
 	}
 	DEBUG_PRINT("[OK] Password policy successfully checked.");
@@ -108,15 +605,19 @@ int create_wallet(const char* master_password) {
 
 
 	// 3. create new wallet
-	wallet_t* wallet = (wallet_t*)malloc(sizeof(wallet_t));
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
 	wallet->size = 0;
-	strncpy(wallet->master_password, master_password, strlen(master_password)+1);
+	if (set_master_password(wallet, master_password) != RET_SUCCESS) {
+		secure_free(wallet);
+		return ERR_PASSWORD_OUT_OF_RANGE;
+	}
+	merkle_build(&wallet->merkle, wallet->items, 0, &wallet->tombstones);
 	DEBUG_PRINT("[OK] New wallet successfully created.");
 
 
 	// 4. save wallet
-	int saving_status = save_wallet(wallet);
-	free(wallet);
+	int saving_status = save_wallet(wallet, NULL);
+	secure_free(wallet);
 	if (saving_status != 0) {
 		return ERR_CANNOT_SAVE_WALLET;
 	}
@@ -141,8 +642,9 @@ int show_wallet(const char* master_password, wallet_t* wallet) {
 	//	1. [ocall] load wallet
 	// 	2. unseal wallet
 	//	3. verify master-password
-	//	4. return wallet to app
-	//	5. exit enclave
+	//	4. record the access
+	//	5. return wallet to app
+	//	6. exit enclave
 	//
 
 	DEBUG_PRINT("RETURNING WALLET TO APP...");
@@ -150,17 +652,19 @@ int show_wallet(const char* master_password, wallet_t* wallet) {
 
 	// 1. load wallet
 	if (load_wallet(wallet) != 0) {
-		free(wallet);
 		return ERR_CANNOT_LOAD_WALLET;
 	}
 	DEBUG_PRINT("[ok] Wallet successfully loaded.");
 
 
 	// 2. verify master-password
-	if (strcmp(wallet->master_password, master_password) != 0) {
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_zero(wallet, sizeof(wallet_t));
+		access_log_record(ACCESS_SHOW, -1, 0, ERR_WRONG_MASTER_PASSWORD);
 		return ERR_WRONG_MASTER_PASSWORD;
 	}
 	DEBUG_PRINT("[ok] Master-password successfully verified.");
+	access_log_record(ACCESS_SHOW, -1, 0, RET_SUCCESS);
 
 
 	DEBUG_PRINT("WALLET SUCCESSFULLY RETURNED TO APP.");
@@ -183,48 +687,55 @@ int change_master_password(const char* old_password, const char* new_password) {
 	//	5. update password
 	//	6. seal wallet
 	// 	7. [ocall] save sealed wallet
-	//	8. exit enclave
+	//	8. record the access
+	//	9. exit enclave
 	//
 
 	DEBUG_PRINT("CHANGING MASTER PASSWORD...");
 
 
 	// 1. check passaword policy
-	if (strlen(new_password) < 8 || strlen(new_password)+1 > MAX_ITEM_SIZE) {
+	if (!default_policy_t::password_in_range(strnlen(new_password, default_policy_t::field_size))) {
 		return ERR_PASSWORD_OUT_OF_RANGE;
 	}
 	DEBUG_PRINT("[ok] Password policy successfully checked.");
 
 
 	// 2. load wallet
-	wallet_t* wallet = (wallet_t*)malloc(sizeof(wallet_t));
-	if (load_wallet(wallet) != 0) {
-		free(wallet);
+	struct WalletUpdate update;
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_for_update(WALLET_FILE, wallet, &update) != 0) {
+		secure_free(wallet);
 		return ERR_CANNOT_LOAD_WALLET;
 	}
 	DEBUG_PRINT("[ok] Wallet successfully loaded.");
 
 
 	// 3. verify master-password
-	if (strcmp(wallet->master_password, old_password) != 0) {
-		free(wallet);
+	if (check_master_password(wallet, old_password) != 0) {
+		secure_free(wallet);
+		access_log_record(ACCESS_CHANGE_PASSWORD, -1, 0, ERR_WRONG_MASTER_PASSWORD);
 		return ERR_WRONG_MASTER_PASSWORD;
 	}
 	DEBUG_PRINT("[ok] Master-password successfully verified.");
 
 
 	// 5. update password
-	strncpy(wallet->master_password, new_password, strlen(new_password)+1);
+	if (set_master_password(wallet, new_password) != RET_SUCCESS) {
+		secure_free(wallet);
+		return ERR_PASSWORD_OUT_OF_RANGE;
+	}
 	DEBUG_PRINT("[ok] Successfully updated master-password.");
 
 
 	// 6. save wallet
-	int saving_status = save_wallet(wallet);
-	free(wallet);
+	int saving_status = save_wallet_to(WALLET_FILE, wallet, &update);
+	secure_free(wallet);
 	if (saving_status != 0) {
 		return ERR_CANNOT_SAVE_WALLET;
 	}
 	DEBUG_PRINT("[OK] Wallet successfully saved.");
+	access_log_record(ACCESS_CHANGE_PASSWORD, -1, 0, RET_SUCCESS);
 
 
 	// 6. exit enclave
@@ -233,6 +744,85 @@ int change_master_password(const char* old_password, const char* new_password) {
 }
 
 
+/**
+ * @brief      Migrates the wallet stored at a given path from the
+ *             image written before the versioned header. Such an
+ *             image carries no tag, so every other entry point
+ *             refuses it; it is only read here, on request, and
+ *             sealed in the current format right away.
+ *
+ */
+int migrate_wallet(const char* path, const char* master_password) {
+
+	//
+	// OVERVIEW:
+	//	1. [ocall] lock and load wallet
+	//	2. read legacy image
+	//	3. verify master-password
+	//	4. seal wallet
+	//	5. [ocall] save sealed wallet
+	//	6. exit enclave
+	//
+
+	DEBUG_PRINT("MIGRATING WALLET...");
+
+
+	// 1. lock and load wallet
+	struct WalletUpdate update;
+	string lock_path = string(path) + WALLET_LOCK_SUFFIX;
+	ocall_t load[] = {
+		{OCALL_LOCK, lock_path.c_str(), NULL, 0, NULL, 0, 0, -1},
+		{OCALL_LOAD, path, NULL, 0, NULL, 0, 0, -1},
+	};
+	enclave_ocalls(load, 2);
+	if (load[0].status == 0) {
+		update.locked = 1;
+		update.lock = load[0].handle;
+	}
+
+
+	// 2. read legacy image
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	int ret = FORMAT_ERR_IO;
+	FILE *file = wallet != NULL && load[1].status == 0 && load[1].length > 0 ?
+		fmemopen(load[1].out, load[1].length, "r") : NULL;
+	if (file != NULL) {
+		ret = read_legacy_wallet_file(file, wallet);
+		fclose (file);
+	}
+	if (load[1].out != NULL) {
+		secure_zero(load[1].out, load[1].length);
+		free(load[1].out);
+	}
+	if (!update.locked || ret != FORMAT_OK) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Legacy image successfully read.");
+
+
+	// 3. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 4. seal and save wallet, as a new one: the legacy image has no history
+	int saving_status = save_wallet_to(path, wallet, &update);
+	secure_free(wallet);
+	if (saving_status != 0) {
+		return ERR_CANNOT_SAVE_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully saved.");
+
+
+	DEBUG_PRINT("WALLET SUCCESSFULLY MIGRATED.");
+	return RET_SUCCESS;
+}
+
+
 /**
  * @brief      Adds an item to the wallet. The sizes/length of
  *             pointers need to be specified, otherwise SGX will
@@ -250,57 +840,70 @@ int add_item(const char* master_password, const item_t* item, const size_t item_
 	//	5. add item to the wallet
 	//	6. seal wallet
 	//	7. [ocall] save sealed wallet
-	//	8. exit enclave
+	//	8. record the access
+	//	9. exit enclave
 	//
 
 	DEBUG_PRINT("ADDING ITEM TO THE WALLET...");
 
 
 	// 2. load wallet
-	wallet_t* wallet = (wallet_t*)malloc(sizeof(wallet_t));
-	if (load_wallet(wallet) != 0) {
-		free(wallet);
+	struct WalletUpdate update;
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_for_update(WALLET_FILE, wallet, &update) != 0) {
+		secure_free(wallet);
 		return ERR_CANNOT_LOAD_WALLET;
 	}
 	DEBUG_PRINT("[ok] Wallet successfully loaded.");
 
 
 	// 3. verify master-password
-	if (strcmp(wallet->master_password, master_password) != 0) {
-		free(wallet);
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		access_log_record(ACCESS_ADD, -1, 0, ERR_WRONG_MASTER_PASSWORD);
 		return ERR_WRONG_MASTER_PASSWORD;
 	}
 	DEBUG_PRINT("[ok] Master-password successfully verified.");
 
 
 	// 4. check input length
-	if (strlen(item->title)+1 > MAX_ITEM_SIZE ||
-		strlen(item->username)+1 > MAX_ITEM_SIZE ||
-		strlen(item->password)+1 > MAX_ITEM_SIZE
+	if (item_size != sizeof(item_t) ||
+		!default_policy_t::field_fits(item->title) ||
+		!default_policy_t::field_fits(item->username) ||
+		!default_policy_t::field_fits(item->password) ||
+		!default_policy_t::field_fits(item->tags)
 	) {
-		free(wallet);
+		secure_free(wallet);
 		return ERR_ITEM_TOO_LONG;
 	}
 	DEBUG_PRINT("[ok] Item successfully verified.");
 
 
 	// 5. add item to the wallet
-	size_t wallet_size = wallet->size;
-	if (wallet_size >= MAX_ITEMS) {
-		free(wallet);
-		return ERR_WALLET_FULL;
+	item_t* added = (item_t*)secure_malloc(sizeof(item_t));
+	if (new_item(item, update.now, added) != RET_SUCCESS) {
+		secure_free(added);
+		secure_free(wallet);
+		return ERR_CANNOT_SAVE_WALLET;
+	}
+	int32_t position = (int32_t)wallet->size;
+	uint64_t id = added->id;
+	int insert_status = insert_item(wallet, added);
+	secure_free(added);
+	if (insert_status != RET_SUCCESS) {
+		secure_free(wallet);
+		return insert_status;
 	}
-	wallet->items[wallet_size] = *item;
-	++wallet->size;
 	DEBUG_PRINT("[OK] Item successfully added.");
 
 	// 6. save wallet
-	int saving_status = save_wallet(wallet);
-	free(wallet);
+	int saving_status = save_wallet_to(WALLET_FILE, wallet, &update);
+	secure_free(wallet);
 	if (saving_status != 0) {
 		return ERR_CANNOT_SAVE_WALLET;
 	}
 	DEBUG_PRINT("[OK] Wallet successfully saved.");
+	access_log_record(ACCESS_ADD, position, id, RET_SUCCESS);
 
 
 	DEBUG_PRINT("ITEM SUCCESSFULLY ADDED TO THE WALLET.");
@@ -325,31 +928,35 @@ int remove_item(const char* master_password, const int index) {
 	//	5. remove item from the wallet
 	//	6. seal wallet
 	//	7. [ocall] save sealed wallet
-	//	8. exit enclave
+	//	8. record the access
+	//	9. [ocall] remove the item's blob
+	//	10. exit enclave
 	//
 
 	DEBUG_PRINT("REMOVING ITEM FROM THE WALLET...");
 
 
 	// 1. check index bounds
-	if (index < 0 || index >= MAX_ITEMS) {
+	if (!default_policy_t::index_in_range(index)) {
 		return ERR_ITEM_DOES_NOT_EXIST;
 	}
 	DEBUG_PRINT("[OK] Successfully checked index bounds.");
 
 
 	// 2. load wallet
-	wallet_t* wallet = (wallet_t*)malloc(sizeof(wallet_t));
-	if (load_wallet(wallet) != 0) {
-		free(wallet);
+	struct WalletUpdate update;
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_for_update(WALLET_FILE, wallet, &update) != 0) {
+		secure_free(wallet);
 		return ERR_CANNOT_LOAD_WALLET;
 	}
 	DEBUG_PRINT("[ok] Wallet successfully loaded.");
 
 
 	// 3. verify master-password
-	if (strcmp(wallet->master_password, master_password) != 0) {
-		free(wallet);
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		access_log_record(ACCESS_REMOVE, index, 0, ERR_WRONG_MASTER_PASSWORD);
 		return ERR_WRONG_MASTER_PASSWORD;
 	}
 	DEBUG_PRINT("[ok] Master-password successfully verified.");
@@ -358,26 +965,1325 @@ int remove_item(const char* master_password, const int index) {
 	// 4. remove item from the wallet
 	size_t wallet_size = wallet->size;
 	if (index >= wallet_size) {
-		free(wallet);
+		secure_free(wallet);
 		return ERR_ITEM_DOES_NOT_EXIST;
 	}
-	for (int i = index; i < wallet_size-1; ++i) {
-		wallet->items[i] = wallet->items[i+1];
-	}
-	--wallet->size;
+	uint64_t blob = wallet->items[index].blob;
+	uint64_t id = wallet->items[index].id;
+	delete_item(wallet, (size_t)index, wallet->items[index].revision + 1);
 	DEBUG_PRINT("[OK] Item successfully removed.");
 
 
 
 	// 5. save wallet
-	int saving_status = save_wallet(wallet);
-	free(wallet);
+	int saving_status = save_wallet_to(WALLET_FILE, wallet, &update);
+	secure_free(wallet);
 	if (saving_status != 0) {
 		return ERR_CANNOT_SAVE_WALLET;
 	}
 	DEBUG_PRINT("[OK] Wallet successfully saved.");
+	access_log_record(ACCESS_REMOVE, index, id, RET_SUCCESS);
+
+
+	// 6. remove its blob
+	if (blob != 0) {
+		char path[BLOB_MAX_PATH];
+		blob_path(WALLET_FILE, blob, path);
+		if (blob_remove(path) != BLOB_OK) {
+			DEBUG_PRINT("[WARNING] Could not remove the item's blob.");
+		}
+	}
 
 
 	DEBUG_PRINT("ITEM SUCCESSFULLY REMOVED FROM THE WALLET.");
 	return RET_SUCCESS;
 }
+
+
+/**
+ * @brief      Replaces an item of the wallet. Its creation date is
+ *             kept and its modification date is set; the tag and
+ *             expiry indexes are updated in place.
+ *
+ */
+int update_item(const char* master_password, const int index, const item_t* item, const size_t item_size) {
+
+	//
+	// OVERVIEW:
+	//	1. check index bounds and item size
+	//	2. [ocall] load wallet
+	//	3. unseal wallet
+	//	4. verify master-password
+	//	5. check input length
+	//	6. replace item
+	//	7. seal wallet
+	//	8. [ocall] save sealed wallet
+	//	9. record the access
+	//	10. exit enclave
+	//
+
+	DEBUG_PRINT("UPDATING ITEM OF THE WALLET...");
+
+
+	// 1. check index bounds and item size
+	if (!default_policy_t::index_in_range(index)) {
+		return ERR_ITEM_DOES_NOT_EXIST;
+	}
+	if (item_size != sizeof(item_t)) {
+		return ERR_ITEM_TOO_LONG;
+	}
+	DEBUG_PRINT("[OK] Successfully checked index bounds.");
+
+
+	// 2. load wallet
+	struct WalletUpdate update;
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_for_update(WALLET_FILE, wallet, &update) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 3. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		access_log_record(ACCESS_UPDATE, index, 0, ERR_WRONG_MASTER_PASSWORD);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 4. check input length
+	if ((size_t)index >= wallet->size) {
+		secure_free(wallet);
+		return ERR_ITEM_DOES_NOT_EXIST;
+	}
+	if (!default_policy_t::field_fits(item->title) ||
+		!default_policy_t::field_fits(item->username) ||
+		!default_policy_t::field_fits(item->password) ||
+		!default_policy_t::field_fits(item->tags)
+	) {
+		secure_free(wallet);
+		return ERR_ITEM_TOO_LONG;
+	}
+	DEBUG_PRINT("[ok] Item successfully verified.");
+
+
+	// 5. replace item
+	item_t* updated = (item_t*)secure_malloc(sizeof(item_t));
+	*updated = *item;
+	updated->created = wallet->items[index].created;
+	updated->modified = update.now;
+	updated->id = wallet->items[index].id;
+	uint64_t id = updated->id;
+	updated->revision = wallet->items[index].revision + 1;
+	updated->blob = wallet->items[index].blob;
+	updated->blob_size = wallet->items[index].blob_size;
+	int replace_status = replace_item(wallet, (size_t)index, updated);
+	secure_free(updated);
+	if (replace_status != RET_SUCCESS) {
+		secure_free(wallet);
+		return replace_status;
+	}
+	DEBUG_PRINT("[OK] Item successfully updated.");
+
+
+	// 6. save wallet
+	int saving_status = save_wallet_to(WALLET_FILE, wallet, &update);
+	secure_free(wallet);
+	if (saving_status != 0) {
+		return ERR_CANNOT_SAVE_WALLET;
+	}
+	DEBUG_PRINT("[OK] Wallet successfully saved.");
+	access_log_record(ACCESS_UPDATE, index, id, RET_SUCCESS);
+
+
+	DEBUG_PRINT("ITEM SUCCESSFULLY UPDATED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Lists the previous versions of the wallet, newest
+ *             first, HISTORY_DEPTH at most: 'snapshots' must hold
+ *             that many. The sizes/length of pointers need to be
+ *             specified, otherwise SGX will assume a count of 1
+ *             for all pointers.
+ *
+ */
+int list_snapshots(const char* master_password, snapshot_t* snapshots, size_t* count) {
+
+	//
+	// OVERVIEW:
+	//	1. [ocall] load wallet and history
+	//	2. unseal wallet
+	//	3. verify master-password
+	//	4. read history index
+	//	5. exit enclave
+	//
+
+	DEBUG_PRINT("LISTING SNAPSHOTS...");
+
+
+	// 1. load wallet and history
+	ocall_t load[] = {
+		{OCALL_LOAD, WALLET_FILE, NULL, 0, NULL, 0, 0, -1},
+		{OCALL_LOAD, WALLET_HISTORY_FILE, NULL, 0, NULL, 0, 0, -1},
+	};
+	enclave_ocalls(load, 2);
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (read_loaded(&load[0], wallet) != 0 || load[1].status != 0) {
+		secure_free(wallet);
+		free(load[1].out);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 2. verify master-password
+	int verified = check_master_password(wallet, master_password);
+	secure_free(wallet);
+	if (verified != 0) {
+		free(load[1].out);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 3. read history index
+	int listed = history_list(load[1].out, load[1].length, snapshots, count);
+	free(load[1].out);
+	if (listed != HISTORY_OK) {
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] History successfully read.");
+
+
+	DEBUG_PRINT("SNAPSHOTS SUCCESSFULLY LISTED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Restores the items of a previous version of the
+ *             wallet; the current master-password is kept. The
+ *             restore is saved as a new version, so it can itself
+ *             be undone.
+ *
+ */
+int restore_snapshot(const char* master_password, const uint64_t version) {
+
+	//
+	// OVERVIEW:
+	//	1. [ocall] load wallet and history
+	//	2. unseal wallet
+	//	3. verify master-password
+	//	4. rebuild version from history
+	//	5. seal wallet
+	//	6. [ocall] save sealed wallet
+	//	7. record the access
+	//	8. exit enclave
+	//
+
+	DEBUG_PRINT("RESTORING SNAPSHOT...");
+
+
+	// 1. load wallet
+	struct WalletUpdate update;
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_for_update(WALLET_FILE, wallet, &update) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 2. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		access_log_record(ACCESS_RESTORE, -1, 0, ERR_WRONG_MASTER_PASSWORD);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 3. rebuild version
+	char current_password[MAX_ITEM_SIZE];
+	memcpy(current_password, wallet->master_password, MAX_ITEM_SIZE);
+	item_t* current = (item_t*)secure_malloc(MAX_ITEMS * sizeof(item_t));
+	size_t current_size = wallet->size;
+	memcpy(current, wallet->items, MAX_ITEMS * sizeof(item_t));
+	int restore_status = history_restore(update.history, update.history_size, version, wallet);
+	memcpy(wallet->master_password, current_password, MAX_ITEM_SIZE);
+	secure_zero(current_password, MAX_ITEM_SIZE);
+	if (restore_status != HISTORY_OK) {
+		secure_free(current);
+		secure_free(wallet);
+		return ERR_SNAPSHOT_DOES_NOT_EXIST;
+	}
+	supersede(wallet, current, current_size);
+	secure_free(current);
+	tag_index_build(&wallet->tags, wallet->items, wallet->size);
+	expiry_index_build(&wallet->expiry, wallet->items, wallet->size);
+	merkle_build(&wallet->merkle, wallet->items, wallet->size, &wallet->tombstones);
+	DEBUG_PRINT("[ok] Snapshot successfully rebuilt.");
+
+
+	// 4. save wallet
+	int saving_status = save_wallet_to(WALLET_FILE, wallet, &update);
+	secure_free(wallet);
+	if (saving_status != 0) {
+		return ERR_CANNOT_SAVE_WALLET;
+	}
+	DEBUG_PRINT("[OK] Wallet successfully saved.");
+	access_log_record(ACCESS_RESTORE, -1, 0, RET_SUCCESS);
+
+
+	DEBUG_PRINT("SNAPSHOT SUCCESSFULLY RESTORED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Audits the wallet's passwords against a corpus of
+ *             breached password hashes, and for reuse across items.
+ *             Only SHA-1 digests are looked up in the corpus, which
+ *             lives in untrusted memory.
+ *
+ */
+int audit_wallet(const char* master_password, const char* corpus_path, audit_result_t* results, size_t* count) {
+
+	//
+	// OVERVIEW:
+	//	1. [ocall] load wallet
+	//	2. unseal wallet
+	//	3. verify master-password
+	//	4. [ocall] map breach corpus
+	//	5. audit items
+	//	6. exit enclave
+	//
+
+	DEBUG_PRINT("AUDITING WALLET...");
+
+
+	// 1. load wallet
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_wallet(wallet) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 2. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 3. map breach corpus
+	corpus_t corpus;
+	if (corpus_path != NULL && corpus_open(corpus_path, &corpus) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_CORPUS;
+	}
+	DEBUG_PRINT("[ok] Breach corpus successfully mapped.");
+
+
+	// 4. audit items
+	audit_items(wallet->items, wallet->size, corpus_path != NULL ? &corpus : NULL, results);
+	*count = wallet->size;
+	if (corpus_path != NULL) {corpus_close(&corpus);}
+	secure_free(wallet);
+	DEBUG_PRINT("[ok] Items successfully audited.");
+
+
+	DEBUG_PRINT("WALLET SUCCESSFULLY AUDITED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Finds the items whose tags match a query, using the
+ *             tag index only.
+ *
+ */
+int search_items(const char* master_password, const char* query, uint32_t* indexes, item_t* items, size_t* count) {
+
+	//
+	// OVERVIEW:
+	//	1. [ocall] load wallet
+	//	2. unseal wallet
+	//	3. verify master-password
+	//	4. evaluate query on the tag index
+	//	5. exit enclave
+	//
+
+	DEBUG_PRINT("SEARCHING WALLET...");
+
+
+	// 1. load wallet
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_wallet(wallet) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 2. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 3. evaluate query on the tag index
+	bitmap_t matches;
+	if (tag_query(&wallet->tags, wallet->size, query, &matches) != TAGS_OK) {
+		secure_free(wallet);
+		return ERR_INVALID_QUERY;
+	}
+	*count = bitmap_values(&matches, indexes, MAX_ITEMS);
+	for (size_t i = 0; i < *count && items != NULL; ++i) {
+		items[i] = wallet->items[indexes[i]];
+	}
+	secure_free(wallet);
+	DEBUG_PRINT("[ok] Query successfully evaluated.");
+
+
+	DEBUG_PRINT("WALLET SUCCESSFULLY SEARCHED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Lists the items expiring up to a date, soonest first.
+ *             Only the leading part of the expiry index is read.
+ *
+ */
+int list_expiring(const char* master_password, const int64_t horizon, expiring_t* items, size_t* count) {
+
+	//
+	// OVERVIEW:
+	//	1. [ocall] load wallet
+	//	2. unseal wallet
+	//	3. verify master-password
+	//	4. read expiry index
+	//	5. exit enclave
+	//
+
+	DEBUG_PRINT("LISTING EXPIRING ITEMS...");
+
+
+	// 1. load wallet
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_wallet(wallet) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 2. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 3. read expiry index
+	*count = expiry_index_until(&wallet->expiry, horizon);
+	for (size_t i = 0; i < *count; ++i) {
+		const expiry_entry_t* entry = &wallet->expiry.entries[i];
+		items[i].index = entry->item;
+		items[i].expires = entry->expires;
+		memcpy(items[i].title, wallet->items[entry->item].title, MAX_ITEM_SIZE);
+	}
+	secure_free(wallet);
+	DEBUG_PRINT("[ok] Expiry index successfully read.");
+
+
+	DEBUG_PRINT("EXPIRING ITEMS SUCCESSFULLY LISTED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Merges two replicas of a wallet. Their hash trees are
+ *             compared top-down to find the buckets that differ, and
+ *             only the entries of those buckets are exchanged: the
+ *             traffic grows with the divergence, not with the size
+ *             of the wallets. Both replicas end up with the same
+ *             items and removals.
+ *
+ */
+int merge_wallets(const char* master_password, const char* path_a, const char* path_b, merge_stats_t* stats) {
+
+	//
+	// OVERVIEW:
+	//	1. [ocall] load both replicas
+	//	2. unseal replicas
+	//	3. verify master-password of both
+	//	4. compare hash trees
+	//	5. exchange the entries of differing buckets
+	//	6. apply the winning entries to each replica
+	//	7. seal replicas
+	//	8. [ocall] save sealed replicas
+	//	9. record the access
+	//	10. exit enclave
+	//
+
+	DEBUG_PRINT("MERGING WALLETS...");
+	memset(stats, 0, sizeof(merge_stats_t));
+
+
+	// 1. load both replicas; the locks are taken in path order, so
+	// that opposite merges cannot deadlock, and once for one path
+	struct WalletUpdate update_a, update_b;
+	wallet_t* a = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	wallet_t* b = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	int order = strcmp(path_a, path_b);
+	int locked = lock_for_update(order <= 0 ? path_a : path_b, order <= 0 ? &update_a : &update_b) == 0 &&
+		(order == 0 || lock_for_update(order <= 0 ? path_b : path_a, order <= 0 ? &update_b : &update_a) == 0);
+	if (!locked || load_locked(path_a, a, &update_a) != 0 || load_locked(path_b, b, &update_b) != 0) {
+		secure_free(a);
+		secure_free(b);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallets successfully loaded.");
+
+
+	// 2. verify master-password
+	if (check_master_password(a, master_password) != 0 || check_master_password(b, master_password) != 0) {
+		secure_free(a);
+		secure_free(b);
+		access_log_record(ACCESS_MERGE, -1, 0, ERR_WRONG_MASTER_PASSWORD);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 3. compare hash trees
+	uint32_t buckets[MERKLE_LEAVES];
+	uint8_t wanted[MERKLE_LEAVES] = {0};
+	stats->nodes = merkle_diff(&a->merkle, &b->merkle, buckets, &stats->leaves);
+	for (uint32_t i = 0; i < stats->leaves; ++i) {wanted[buckets[i]] = 1;}
+	stats->bytes = (uint64_t)stats->nodes * 2 * MERKLE_HASH_SIZE;
+	DEBUG_PRINT("[ok] Hash trees successfully compared.");
+
+
+	// 4. exchange the entries of differing buckets
+	vector<summary_t> from_a, from_b;
+	summarize(a, wanted, from_a);
+	summarize(b, wanted, from_b);
+	stats->entries = (uint32_t)(from_a.size() + from_b.size());
+	stats->bytes += (uint64_t)stats->entries * sizeof(summary_t);
+
+
+	// 5. apply the winning entries to each replica: a merge join
+	// over both sorted lists
+	wallet_t* merged_a = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	wallet_t* merged_b = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	*merged_a = *a;
+	*merged_b = *b;
+	int ret = RET_SUCCESS;
+	size_t i = 0, j = 0;
+	while ((i < from_a.size() || j < from_b.size()) && ret == RET_SUCCESS) {
+		const summary_t* x = i < from_a.size() ? &from_a[i] : NULL;
+		const summary_t* y = j < from_b.size() ? &from_b[j] : NULL;
+		if (x != NULL && y != NULL && x->id == y->id) {
+			++i, ++j;
+			if (memcmp(x->hash, y->hash, MERKLE_HASH_SIZE) == 0) {continue;}
+			if (!supersedes(x, y)) {x = NULL;}
+			else {y = NULL;}
+		}
+		else if (y == NULL || (x != NULL && x->id < y->id)) {++i, y = NULL;}
+		else {++j, x = NULL;}
+
+		if (y != NULL) {
+			ret = apply_entry(merged_a, b, y);
+			stats->bytes += y->deleted ? 0 : sizeof(item_t);
+			++stats->pulled;
+		}
+		else {
+			ret = apply_entry(merged_b, a, x);
+			stats->bytes += x->deleted ? 0 : sizeof(item_t);
+			++stats->pushed;
+		}
+	}
+	secure_free(a);
+	secure_free(b);
+	if (ret != RET_SUCCESS) {
+		secure_free(merged_a);
+		secure_free(merged_b);
+		return ret;
+	}
+	DEBUG_PRINT("[ok] Entries successfully merged.");
+
+
+	// 6. save replicas that changed; a save releases its lock, which
+	// 'update_a' holds alone when both paths are the same
+	int saving_status = 0;
+	if (stats->pushed > 0) {saving_status |= save_wallet_to(path_b, merged_b, &update_b);}
+	if (stats->pulled > 0) {saving_status |= save_wallet_to(path_a, merged_a, &update_a);}
+	secure_free(merged_a);
+	secure_free(merged_b);
+	if (saving_status != 0) {
+		return ERR_CANNOT_SAVE_WALLET;
+	}
+	DEBUG_PRINT("[OK] Wallets successfully saved.");
+	access_log_record(ACCESS_MERGE, -1, 0, RET_SUCCESS);
+
+
+	DEBUG_PRINT("WALLETS SUCCESSFULLY MERGED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Moves the wallet's items into a store that keeps at most
+ *             'budget' bytes of them decrypted; the others are sealed
+ *             in untrusted memory and paged back in on access. The
+ *             store is released with pager_free.
+ *
+ */
+int open_item_store(const char* master_password, size_t budget, struct ItemStore* store) {
+
+	//
+	// OVERVIEW:
+	//	1. [ocall] load wallet
+	//	2. unseal wallet
+	//	3. verify master-password
+	//	4. page items out
+	//	5. record the access
+	//	6. exit enclave
+	//
+
+	DEBUG_PRINT("OPENING ITEM STORE...");
+
+
+	// 1. load wallet
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_wallet(wallet) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 2. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		access_log_record(ACCESS_SHOW, -1, 0, ERR_WRONG_MASTER_PASSWORD);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 3. page items out, so only the budget stays resident
+	int ret = pager_init(store, (uint32_t)wallet->size, budget, NULL);
+	for (uint32_t i = 0; i < wallet->size && ret == PAGER_OK; ++i) {
+		ret = pager_put(store, i, &wallet->items[i]);
+	}
+	if (ret == PAGER_OK) {ret = pager_flush(store);}
+	secure_free(wallet);
+	if (ret != PAGER_OK) {
+		pager_free(store);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Items successfully paged out.");
+	access_log_record(ACCESS_SHOW, -1, 0, RET_SUCCESS);
+
+
+	DEBUG_PRINT("ITEM STORE SUCCESSFULLY OPENED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Attaches a blob to an item, replacing the one it had, if
+ *             any; a NULL source only detaches it. The content is
+ *             streamed into a file of its own next to the wallet, so
+ *             the item record only grows by a reference and listing
+ *             and searching never read blobs.
+ *
+ */
+int attach_blob(const char* master_password, const int index, blob_source_fn source, void* ctx) {
+
+	//
+	// OVERVIEW:
+	//	1. check index bounds
+	//	2. [ocall] load wallet
+	//	3. unseal wallet
+	//	4. verify master-password
+	//	5. [ocall] seal the content into a new blob
+	//	6. point the item at the new blob
+	//	7. seal wallet
+	//	8. [ocall] save sealed wallet
+	//	9. [ocall] remove the previous blob
+	//	10. exit enclave
+	//
+
+	DEBUG_PRINT("ATTACHING BLOB...");
+
+
+	// 1. check index bounds
+	if (!default_policy_t::index_in_range(index)) {
+		return ERR_ITEM_DOES_NOT_EXIST;
+	}
+	DEBUG_PRINT("[OK] Successfully checked index bounds.");
+
+
+	// 2. load wallet
+	struct WalletUpdate update;
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_for_update(WALLET_FILE, wallet, &update) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 3. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	if ((size_t)index >= wallet->size) {
+		secure_free(wallet);
+		return ERR_ITEM_DOES_NOT_EXIST;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 4. seal the content into a new blob; ids are never reused, so
+	// the previous blob stays valid until the wallet is saved
+	char path[BLOB_MAX_PATH];
+	uint64_t previous = wallet->items[index].blob;
+	item_t* updated = (item_t*)secure_malloc(sizeof(item_t));
+	*updated = wallet->items[index];
+	updated->blob = 0;
+	updated->blob_size = 0;
+	if (source != NULL) {
+		while (updated->blob == 0) {
+			if (random_bytes(&updated->blob, sizeof(updated->blob)) != 0) {
+				secure_free(updated);
+				secure_free(wallet);
+				return ERR_CANNOT_SAVE_BLOB;
+			}
+		}
+		blob_path(WALLET_FILE, updated->blob, path);
+		if (blob_write(path, updated->blob, source, ctx, &updated->blob_size) != BLOB_OK) {
+			blob_remove(path);
+			secure_free(updated);
+			secure_free(wallet);
+			return ERR_CANNOT_SAVE_BLOB;
+		}
+		DEBUG_PRINT("[ok] Blob successfully sealed.");
+	}
+
+
+	// 5. point the item at the new blob
+	updated->modified = update.now;
+	updated->revision = wallet->items[index].revision + 1;
+	uint64_t attached = updated->blob;
+	int replace_status = replace_item(wallet, (size_t)index, updated);
+	secure_free(updated);
+	if (replace_status == RET_SUCCESS) {
+		replace_status = save_wallet_to(WALLET_FILE, wallet, &update) == 0 ? RET_SUCCESS : ERR_CANNOT_SAVE_WALLET;
+	}
+	secure_free(wallet);
+	if (replace_status != RET_SUCCESS) {
+		if (attached != 0) {blob_remove(path);}
+		return replace_status;
+	}
+	DEBUG_PRINT("[OK] Wallet successfully saved.");
+
+
+	// 6. remove the previous blob, now unreferenced
+	if (previous != 0) {
+		blob_path(WALLET_FILE, previous, path);
+		if (blob_remove(path) != BLOB_OK) {
+			DEBUG_PRINT("[WARNING] Could not remove the previous blob.");
+		}
+	}
+
+
+	DEBUG_PRINT("BLOB SUCCESSFULLY ATTACHED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Streams the blob of an item to a sink. The wallet is
+ *             released before the blob is read: only one chunk of the
+ *             blob is ever decrypted at a time.
+ *
+ */
+int read_blob(const char* master_password, const int index, blob_sink_fn sink, void* ctx) {
+
+	//
+	// OVERVIEW:
+	//	1. check index bounds
+	//	2. [ocall] load wallet
+	//	3. unseal wallet
+	//	4. verify master-password
+	//	5. [ocall] stream the blob, chunk by chunk
+	//	6. exit enclave
+	//
+
+	DEBUG_PRINT("READING BLOB...");
+
+
+	// 1. check index bounds
+	if (!default_policy_t::index_in_range(index)) {
+		return ERR_ITEM_DOES_NOT_EXIST;
+	}
+	DEBUG_PRINT("[OK] Successfully checked index bounds.");
+
+
+	// 2. load wallet
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_wallet(wallet) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 3. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 4. stream the blob the item refers to
+	if ((size_t)index >= wallet->size) {
+		secure_free(wallet);
+		return ERR_ITEM_DOES_NOT_EXIST;
+	}
+	uint64_t id = wallet->items[index].blob;
+	uint64_t size = wallet->items[index].blob_size;
+	secure_free(wallet);
+	if (id == 0) {
+		return ERR_BLOB_DOES_NOT_EXIST;
+	}
+	char path[BLOB_MAX_PATH];
+	blob_path(WALLET_FILE, id, path);
+	if (blob_read(path, id, size, sink, ctx) != BLOB_OK) {
+		return ERR_CANNOT_LOAD_BLOB;
+	}
+	DEBUG_PRINT("[ok] Blob successfully streamed.");
+
+
+	DEBUG_PRINT("BLOB SUCCESSFULLY READ.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Finds a credential in the wallet stored at a given path,
+ *             for bulk operations over many wallet files.
+ *
+ */
+int find_credential(const char* path, const char* master_password, const char* title, const char* username,
+	uint32_t* indexes, item_t* items, size_t* count) {
+
+	//
+	// OVERVIEW:
+	//	1. [ocall] load wallet
+	//	2. unseal wallet
+	//	3. verify master-password
+	//	4. match items
+	//	5. exit enclave
+	//
+
+	DEBUG_PRINT("FINDING CREDENTIAL...");
+
+
+	// 1. load wallet
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_wallet_from(path, wallet) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 2. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 3. match items
+	*count = 0;
+	for (size_t i = 0; i < wallet->size; ++i) {
+		if (!is_credential(&wallet->items[i], title, username)) {continue;}
+		indexes[*count] = (uint32_t)i;
+		if (items != NULL) {items[*count] = wallet->items[i];}
+		++*count;
+	}
+	secure_free(wallet);
+	DEBUG_PRINT("[ok] Items successfully matched.");
+
+
+	DEBUG_PRINT("CREDENTIAL SUCCESSFULLY SEARCHED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Sets a new password on every item of the wallet stored
+ *             at a given path that matches a credential. The wallet
+ *             is only saved if an item changed.
+ *
+ */
+int rotate_credential(const char* path, const char* master_password, const char* title, const char* username,
+	const char* password, size_t* count) {
+
+	//
+	// OVERVIEW:
+	//	1. check input length
+	//	2. [ocall] load wallet
+	//	3. unseal wallet
+	//	4. verify master-password
+	//	5. replace the password of the matching items
+	//	6. seal wallet
+	//	7. [ocall] save sealed wallet
+	//	8. record the access
+	//	9. exit enclave
+	//
+
+	DEBUG_PRINT("ROTATING CREDENTIAL...");
+
+
+	// 1. check input length
+	if (!default_policy_t::field_fits(password)) {
+		return ERR_ITEM_TOO_LONG;
+	}
+	DEBUG_PRINT("[ok] Password successfully verified.");
+
+
+	// 2. load wallet
+	struct WalletUpdate update;
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_for_update(path, wallet, &update) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 3. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		access_log_record(ACCESS_ROTATE, -1, 0, ERR_WRONG_MASTER_PASSWORD);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 4. replace the password of the matching items
+	*count = 0;
+	item_t* updated = (item_t*)secure_malloc(sizeof(item_t));
+	for (size_t i = 0; i < wallet->size; ++i) {
+		if (!is_credential(&wallet->items[i], title, username)) {continue;}
+		*updated = wallet->items[i];
+		secure_zero(updated->password, MAX_ITEM_SIZE);
+		strncpy(updated->password, password, MAX_ITEM_SIZE - 1);
+		updated->modified = update.now;
+		updated->revision = wallet->items[i].revision + 1;
+		replace_item(wallet, i, updated);
+		++*count;
+	}
+	secure_free(updated);
+	DEBUG_PRINT("[OK] Items successfully updated.");
+
+
+	// 5. save wallet
+	int saving_status = *count > 0 ? save_wallet_to(path, wallet, &update) : 0;
+	if (saving_status != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_SAVE_WALLET;
+	}
+	DEBUG_PRINT("[OK] Wallet successfully saved.");
+	for (size_t i = 0; i < wallet->size; ++i) {
+		if (!is_credential(&wallet->items[i], title, username)) {continue;}
+		access_log_record(ACCESS_ROTATE, (int32_t)i, wallet->items[i].id, RET_SUCCESS);
+	}
+	secure_free(wallet);
+
+
+	DEBUG_PRINT("CREDENTIAL SUCCESSFULLY ROTATED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Unlocks the wallet stored at a given path into a cache
+ *             that refresh_wallet_cache keeps in step with the file. The cache is released with
+ *             wallet_cache_free.
+ *
+ */
+int open_wallet_cache(const char* path, const char* master_password, int polling, struct WalletCache* cache) {
+
+	//
+	// OVERVIEW:
+	//	1. watch the wallet file
+	//	2. [ocall] load wallet
+	//	3. unseal wallet
+	//	4. verify master-password
+	//	5. exit enclave
+	//
+
+	DEBUG_PRINT("OPENING WALLET CACHE...");
+
+
+	// 1. watch first, so that no save after the load is missed
+	memset(cache, 0, sizeof(wallet_cache_t));
+	cache->wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	cache->tags = (uint8_t*)secure_malloc((MAX_ITEMS + 1) * MAC_TAG_SIZE);
+	if (cache->wallet == NULL || cache->tags == NULL || watch_init(&cache->watch, path, polling) != WATCH_OK) {
+		wallet_cache_free(cache);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet file successfully watched.");
+
+
+	// 2. load wallet
+	if (reload_wallet_from(path, NULL, NULL, cache->wallet, cache->tags, &cache->changed) != 0) {
+		wallet_cache_free(cache);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 3. verify master-password
+	if (check_master_password(cache->wallet, master_password) != 0) {
+		wallet_cache_free(cache);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	cache->generation = cache->wallet->version;
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	DEBUG_PRINT("WALLET CACHE SUCCESSFULLY OPENED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Brings a cache up to date with its file, waiting up to
+ *             'timeout_ms' for a change. The cheap generation check
+ *             comes first; then only the changed records are
+ *             authenticated. A cache whose master-password changed is
+ *             wiped and must be opened again.
+ *
+ */
+int refresh_wallet_cache(struct WalletCache* cache, int timeout_ms, size_t* changed) {
+
+	//
+	// OVERVIEW:
+	//	1. wait for a change
+	//	2. compare generations
+	//	3. [ocall] load wallet
+	//	4. unseal changed records
+	//	5. verify master-password is unchanged
+	//	6. swap the cache
+	//	7. exit enclave
+	//
+
+	*changed = 0;
+	if (cache->wallet == NULL) {
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+
+
+	// 1. wait for a change; a failed reload is retried anyway
+	if (!watch_wait(&cache->watch, timeout_ms) && !cache->stale) {
+		return RET_SUCCESS;
+	}
+
+
+	// 2. compare generations; a file being written is retried later
+	uint64_t generation = 0;
+	if (watch_generation(&cache->watch, &generation) != WATCH_OK) {
+		cache->stale = 1;
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	if (generation == cache->generation) {
+		cache->stale = 0;
+		return RET_SUCCESS;
+	}
+	DEBUG_PRINT("[ok] Wallet file changed.");
+
+
+	// 3. load wallet, authenticating the changed records only
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	uint8_t* tags = (uint8_t*)secure_malloc((MAX_ITEMS + 1) * MAC_TAG_SIZE);
+	bitmap_t* differing = (bitmap_t*)secure_malloc(sizeof(bitmap_t));
+	if (wallet == NULL || tags == NULL || differing == NULL ||
+		reload_wallet_from(cache->watch.path, cache->wallet, cache->tags, wallet, tags, differing) != 0) {
+		secure_free(wallet);
+		secure_free(tags);
+		secure_free(differing);
+		cache->stale = 1;
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully reloaded.");
+
+
+	// 4. verify master-password is unchanged
+	if (check_master_password(wallet, cache->wallet->master_password) != 0) {
+		secure_free(wallet);
+		secure_free(tags);
+		secure_free(differing);
+		wallet_cache_free(cache);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 5. swap the cache
+	secure_free(cache->wallet);
+	secure_free(cache->tags);
+	cache->wallet = wallet;
+	cache->tags = tags;
+	cache->changed = *differing;
+	cache->generation = wallet->version;
+	cache->stale = 0;
+	*changed = bitmap_cardinality(differing);
+	++cache->reloads;
+	cache->authenticated += *changed;
+	secure_free(differing);
+	DEBUG_PRINT("[ok] Cache successfully swapped.");
+
+
+	DEBUG_PRINT("WALLET CACHE SUCCESSFULLY REFRESHED.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Adds several items to the wallet stored at a given path,
+ *             loading and saving it once. Either every item is added
+ *             or none is. Given a policy, every item gets a generated
+ *             password, written back to 'items'.
+ *
+ */
+int add_items(const char* path, const char* master_password, item_t* items, const size_t count,
+	const password_policy_t* generate) {
+
+	//
+	// OVERVIEW:
+	//	1. check input length and password policy
+	//	2. [ocall] load wallet
+	//	3. unseal wallet
+	//	4. verify master-password
+	//	5. generate the passwords
+	//	6. add the items to the wallet
+	//	7. seal wallet
+	//	8. [ocall] save sealed wallet
+	//	9. record the accesses
+	//	10. exit enclave
+	//
+
+	DEBUG_PRINT("ADDING ITEMS TO THE WALLET...");
+
+
+	// 1. check input length and password policy
+	if (generate != NULL && password_policy_check(generate, default_policy_t::field_size) != GENERATOR_OK) {
+		return ERR_INVALID_PASSWORD_POLICY;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		if (!default_policy_t::field_fits(items[i].title) ||
+			!default_policy_t::field_fits(items[i].username) ||
+			(generate == NULL && !default_policy_t::field_fits(items[i].password)) ||
+			!default_policy_t::field_fits(items[i].tags)
+		) {
+			return ERR_ITEM_TOO_LONG;
+		}
+	}
+	DEBUG_PRINT("[ok] Items successfully verified.");
+
+
+	// 2. load wallet
+	struct WalletUpdate update;
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_for_update(path, wallet, &update) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 3. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		access_log_record(ACCESS_ADD, -1, 0, ERR_WRONG_MASTER_PASSWORD);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 4. generate the passwords, one CSPRNG for the whole batch
+	if (!default_policy_t::has_room(wallet->size, count)) {
+		secure_free(wallet);
+		return ERR_WALLET_FULL;
+	}
+	if (generate != NULL) {
+		csprng_t* rng = (csprng_t*)secure_malloc(sizeof(csprng_t));
+		int generate_status = rng != NULL && csprng_init(rng) == 0 ? GENERATOR_OK : GENERATOR_ERR_RANDOM;
+		for (size_t i = 0; i < count && generate_status == GENERATOR_OK; ++i) {
+			secure_zero(items[i].password, MAX_ITEM_SIZE);
+			generate_status = generate_password(rng, generate, items[i].password);
+		}
+		if (rng != NULL) {csprng_free(rng);}
+		secure_free(rng);
+		if (generate_status != GENERATOR_OK) {
+			secure_free(wallet);
+			return ERR_CANNOT_SAVE_WALLET;
+		}
+		DEBUG_PRINT("[ok] Passwords successfully generated.");
+	}
+
+
+	// 5. add the items; nothing is saved if one does not fit
+	size_t first = wallet->size;
+	int insert_status = RET_SUCCESS;
+	item_t* added = (item_t*)secure_malloc(sizeof(item_t));
+	for (size_t i = 0; i < count && insert_status == RET_SUCCESS; ++i) {
+		insert_status = new_item(&items[i], update.now, added);
+		if (insert_status == RET_SUCCESS) {insert_status = insert_item(wallet, added);}
+	}
+	secure_free(added);
+	if (insert_status != RET_SUCCESS) {
+		secure_free(wallet);
+		return insert_status;
+	}
+	DEBUG_PRINT("[OK] Items successfully added.");
+
+
+	// 6. save wallet
+	int saving_status = save_wallet_to(path, wallet, &update);
+	if (saving_status != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_SAVE_WALLET;
+	}
+	DEBUG_PRINT("[OK] Wallet successfully saved.");
+	for (size_t i = first; i < wallet->size; ++i) {
+		access_log_record(ACCESS_ADD, (int32_t)i, wallet->items[i].id, RET_SUCCESS);
+	}
+	secure_free(wallet);
+
+
+	DEBUG_PRINT("ITEMS SUCCESSFULLY ADDED TO THE WALLET.");
+	return RET_SUCCESS;
+}
+
+
+/**
+ * @brief      Removes several items from the wallet stored at a given
+ *             path, loading and saving it once. The indexes refer to
+ *             the wallet before the call; either every item is
+ *             removed or none is.
+ *
+ */
+int remove_items(const char* path, const char* master_password, const uint32_t* indexes, const size_t count) {
+
+	//
+	// OVERVIEW:
+	//	1. [ocall] load wallet
+	//	2. unseal wallet
+	//	3. verify master-password
+	//	4. remove the items from the wallet
+	//	5. seal wallet
+	//	6. [ocall] save sealed wallet
+	//	7. record the accesses
+	//	8. [ocall] remove the items' blobs
+	//	9. exit enclave
+	//
+
+	DEBUG_PRINT("REMOVING ITEMS FROM THE WALLET...");
+
+
+	// 1. load wallet
+	struct WalletUpdate update;
+	wallet_t* wallet = (wallet_t*)secure_malloc(sizeof(wallet_t));
+	if (load_for_update(path, wallet, &update) != 0) {
+		secure_free(wallet);
+		return ERR_CANNOT_LOAD_WALLET;
+	}
+	DEBUG_PRINT("[ok] Wallet successfully loaded.");
+
+
+	// 2. verify master-password
+	if (check_master_password(wallet, master_password) != 0) {
+		secure_free(wallet);
+		access_log_record(ACCESS_REMOVE, -1, 0, ERR_WRONG_MASTER_PASSWORD);
+		return ERR_WRONG_MASTER_PASSWORD;
+	}
+	DEBUG_PRINT("[ok] Master-password successfully verified.");
+
+
+	// 3. remove the items, the last one first so that the indexes hold
+	bitmap_t removed;
+	bitmap_clear(&removed);
+	for (size_t i = 0; i < count; ++i) {
+		if (indexes[i] >= wallet->size) {
+			secure_free(wallet);
+			return ERR_ITEM_DOES_NOT_EXIST;
+		}
+		bitmap_add(&removed, indexes[i]);
+	}
+	uint64_t blobs[MAX_ITEMS];
+	uint64_t ids[MAX_ITEMS];
+	int32_t positions[MAX_ITEMS];
+	size_t blob_count = 0;
+	size_t removed_count = 0;
+	for (size_t i = wallet->size; i-- > 0; ) {
+		if (!bitmap_contains(&removed, (uint32_t)i)) {continue;}
+		if (wallet->items[i].blob != 0) {blobs[blob_count++] = wallet->items[i].blob;}
+		positions[removed_count] = (int32_t)i;
+		ids[removed_count++] = wallet->items[i].id;
+		delete_item(wallet, i, wallet->items[i].revision + 1);
+	}
+	DEBUG_PRINT("[OK] Items successfully removed.");
+
+
+	// 4. save wallet
+	int saving_status = save_wallet_to(path, wallet, &update);
+	secure_free(wallet);
+	if (saving_status != 0) {
+		return ERR_CANNOT_SAVE_WALLET;
+	}
+	DEBUG_PRINT("[OK] Wallet successfully saved.");
+	for (size_t i = 0; i < removed_count; ++i) {
+		access_log_record(ACCESS_REMOVE, positions[i], ids[i], RET_SUCCESS);
+	}
+
+
+	// 5. remove their blobs
+	for (size_t i = 0; i < blob_count; ++i) {
+		char blob_file[BLOB_MAX_PATH];
+		blob_path(path, blobs[i], blob_file);
+		if (blob_remove(blob_file) != BLOB_OK) {
+			DEBUG_PRINT("[WARNING] Could not remove an item's blob.");
+		}
+	}
+
+
+	DEBUG_PRINT("ITEMS SUCCESSFULLY REMOVED FROM THE WALLET.");
+	return RET_SUCCESS;
+}
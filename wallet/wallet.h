@@ -20,6 +20,9 @@
 #ifndef WALLET_H_
 #define WALLET_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 
 /***************************************************
  * Defines
@@ -27,6 +30,23 @@
 #define MAX_ITEMS 100
 #define MAX_ITEM_SIZE 100
 #define WALLET_FILE "wallet.seal"
+#define WALLET_HISTORY_SUFFIX ".history"	// previous versions of a wallet
+#define WALLET_HISTORY_FILE WALLET_FILE WALLET_HISTORY_SUFFIX
+#define WALLET_LOCK_SUFFIX ".lock"	// held while a wallet is changed
+#define WALLET_LOCK_FILE WALLET_FILE WALLET_LOCK_SUFFIX
+#define WALLET_CODEC CODEC_LZ	// codec used by save_wallet (see compress.h)
+#define HISTORY_DEPTH 16		// number of previous versions kept
+#define MAX_TAGS 32				// distinct tags in a wallet
+#define MAX_TAG_SIZE 32
+#define TAG_SEPARATOR ','
+#define MAX_TOMBSTONES MAX_ITEMS	// deletions remembered for merging
+#define MERKLE_LEAF_BITS 7			// item ids are hashed into 2^7 buckets
+#define MERKLE_LEAVES (1 << MERKLE_LEAF_BITS)
+#define MERKLE_HASH_SIZE 16
+#define BLOB_CHUNK_SIZE 65536		// blobs are encrypted and streamed chunk by chunk
+#define MAX_BLOB_SIZE (1ull << 36)
+
+#include "bitmap.h"		// sized by MAX_ITEMS
 
 #define RET_SUCCESS 0
 #define ERR_PASSWORD_OUT_OF_RANGE 1
@@ -37,6 +57,16 @@
 #define ERR_WALLET_FULL 6
 #define ERR_ITEM_DOES_NOT_EXIST 7
 #define ERR_ITEM_TOO_LONG 8
+#define ERR_SNAPSHOT_DOES_NOT_EXIST 9
+#define ERR_CANNOT_LOAD_CORPUS 10
+#define ERR_TOO_MANY_TAGS 11
+#define ERR_INVALID_QUERY 12
+#define ERR_BLOB_DOES_NOT_EXIST 13
+#define ERR_CANNOT_SAVE_BLOB 14
+#define ERR_CANNOT_LOAD_BLOB 15
+#define ERR_INVALID_PASSWORD_POLICY 16
+
+#include "policy.h"		// sized by MAX_ITEMS and MAX_ITEM_SIZE, reports ERR_*
 
 
 /***************************************************
@@ -47,30 +77,153 @@ struct Item {
 	char  title[MAX_ITEM_SIZE];
 	char  username[MAX_ITEM_SIZE];
 	char  password[MAX_ITEM_SIZE];
+	char  tags[MAX_ITEM_SIZE];		// separated by TAG_SEPARATOR
+	int64_t created;				// dates in seconds since the epoch
+	int64_t modified;
+	int64_t expires;				// 0 for never
+	uint64_t id;					// identifies the item across replicas
+	uint64_t revision;				// bumped by every change
+	uint64_t blob;					// attached blob, 0 if none
+	uint64_t blob_size;				// its length in bytes
 };
 typedef struct Item item_t;
 
+// streams blob content: a source fills 'buf' with up to 'len' bytes and
+// returns how many, 0 at the end or -1 on error; a sink consumes 'len'
+// bytes and returns 0, or -1 to stop
+typedef long (*blob_source_fn)(void* ctx, uint8_t* buf, size_t len);
+typedef int (*blob_sink_fn)(void* ctx, const uint8_t* data, size_t len);
+
+// item removed since, kept so that merges do not bring it back
+struct Tombstone {
+	uint64_t id;
+	uint64_t revision;	// revision of the removal
+};
+typedef struct Tombstone tombstone_t;
+
+struct Tombstones {
+	uint32_t count;
+	uint32_t reserved;
+	tombstone_t entries[MAX_TOMBSTONES];	// oldest first
+};
+typedef struct Tombstones tombstones_t;
+
+// hash tree over items and tombstones, bucketed by id: node 1 is the
+// root, the children of node n are 2n and 2n+1, and the leaves are
+// the nodes from MERKLE_LEAVES on
+struct MerkleTree {
+	uint8_t nodes[2 * MERKLE_LEAVES][MERKLE_HASH_SIZE];
+};
+typedef struct MerkleTree merkle_tree_t;
+
+// secondary index: the items carrying each tag
+struct TagIndex {
+	uint32_t count;
+	char names[MAX_TAGS][MAX_TAG_SIZE];
+	bitmap_t items[MAX_TAGS];
+};
+typedef struct TagIndex tag_index_t;
+
+// expiry index: items ordered by expiry date
+struct ExpiryEntry {
+	int64_t expires;
+	uint32_t item;
+	uint32_t reserved;
+};
+typedef struct ExpiryEntry expiry_entry_t;
+
+struct ExpiryIndex {
+	uint32_t count;
+	uint32_t reserved;
+	expiry_entry_t entries[MAX_ITEMS];
+};
+typedef struct ExpiryIndex expiry_index_t;
+
 // wallet
 struct Wallet {
-	item_t items[MAX_ITEMS];
+	default_policy_t::storage<item_t, MAX_ITEMS> items;	// reads as item_t[MAX_ITEMS]
 	size_t size;
 	char master_password[MAX_ITEM_SIZE];
+	uint64_t version;	// bumped by every save
+	tag_index_t tags;
+	expiry_index_t expiry;
+	tombstones_t tombstones;
+	merkle_tree_t merkle;
 };
 typedef struct Wallet wallet_t;
 
+// snapshot of a previous version
+struct Snapshot {
+	uint64_t version;
+	int64_t timestamp;	// when this version was replaced
+	uint32_t size;		// number of items
+};
+typedef struct Snapshot snapshot_t;
+
+// audit of one item
+struct AuditResult {
+	char title[MAX_ITEM_SIZE];
+	int breached;		// password found in the breach corpus
+	int reused_with;	// first other item with the same password, or -1
+};
+typedef struct AuditResult audit_result_t;
+
+// item due for rotation
+struct Expiring {
+	uint32_t index;
+	int64_t expires;
+	char title[MAX_ITEM_SIZE];
+};
+typedef struct Expiring expiring_t;
+
+// what a merge compared and exchanged
+struct MergeStats {
+	uint32_t nodes;			// tree nodes compared
+	uint32_t leaves;		// buckets found different
+	uint32_t entries;		// (id, revision) summaries exchanged
+	uint32_t pulled;		// items or removals taken from the second wallet
+	uint32_t pushed;		// items or removals taken from the first wallet
+	uint64_t bytes;			// data that would cross a link
+};
+typedef struct MergeStats merge_stats_t;
+
+struct ItemStore;	// memory-budgeted item store, see pager.h
+struct WalletCache;	// unlocked wallet kept in step with its file, see watch.h
+struct PasswordPolicy;	// how passwords are generated, see generator.h
+
 
 /***************************************************
  * Functions
  ***************************************************/
 void debug_print(const char* str);
-int save_wallet(const wallet_t* wallet);
-int load_wallet(const wallet_t* wallet);
+int save_wallet(wallet_t* wallet, const wallet_t* previous);
+int load_wallet(wallet_t* wallet);
 int is_wallet(void);
 int create_wallet(const char* master_password);
 int show_wallet(const char* master_password, wallet_t* wallet);
 int change_master_password(const char* old_password, const char* new_password);
+int migrate_wallet(const char* path, const char* master_password);
 int add_item(const char* master_password, const item_t* item, const size_t item_size);
 int remove_item(const char* master_password, const int index);
+int update_item(const char* master_password, const int index, const item_t* item, const size_t item_size);
+int list_snapshots(const char* master_password, snapshot_t* snapshots, size_t* count);
+int restore_snapshot(const char* master_password, const uint64_t version);
+int audit_wallet(const char* master_password, const char* corpus_path, audit_result_t* results, size_t* count);
+int search_items(const char* master_password, const char* query, uint32_t* indexes, item_t* items, size_t* count);
+int list_expiring(const char* master_password, const int64_t horizon, expiring_t* items, size_t* count);
+int merge_wallets(const char* master_password, const char* path_a, const char* path_b, merge_stats_t* stats);
+int open_item_store(const char* master_password, size_t budget, struct ItemStore* store);
+int attach_blob(const char* master_password, const int index, blob_source_fn source, void* ctx);
+int read_blob(const char* master_password, const int index, blob_sink_fn sink, void* ctx);
+int find_credential(const char* path, const char* master_password, const char* title, const char* username,
+	uint32_t* indexes, item_t* items, size_t* count);
+int rotate_credential(const char* path, const char* master_password, const char* title, const char* username,
+	const char* password, size_t* count);
+int open_wallet_cache(const char* path, const char* master_password, int polling, struct WalletCache* cache);
+int refresh_wallet_cache(struct WalletCache* cache, int timeout_ms, size_t* changed);
+int add_items(const char* path, const char* master_password, item_t* items, const size_t count,
+	const struct PasswordPolicy* generate);
+int remove_items(const char* path, const char* master_password, const uint32_t* indexes, const size_t count);
 
 
 #endif // WALLET_H_
\ No newline at end of file
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+#include "format.h"
+#include "arena.h"
+
+using namespace std;
+
+
+/***************************************************
+ * Helpers
+ ***************************************************/
+// saves write in place, other tools rename over: both end an update
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE)
+
+static int64_t monotonic_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief      Takes a snapshot of what the file looks like; returns
+ *             whether it differs from the previous one.
+ *
+ */
+static int stat_changed(wallet_watch_t* watch) {
+	struct stat st;
+	uint64_t device = 0, inode = 0, size = 0;
+	int64_t mtime_ns = 0;
+	if (stat(watch->path, &st) == 0) {
+		device = (uint64_t)st.st_dev;
+		inode = (uint64_t)st.st_ino;
+		size = (uint64_t)st.st_size;
+		mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	}
+	int changed = device != watch->device || inode != watch->inode || size != watch->size ||
+		mtime_ns != watch->mtime_ns;
+	watch->device = device;
+	watch->inode = inode;
+	watch->size = size;
+	watch->mtime_ns = mtime_ns;
+	return changed;
+}
+
+/**
+ * @brief      Drains the pending inotify events; returns whether one
+ *             of them was about the watched file.
+ *
+ */
+static int drain_events(wallet_watch_t* watch) {
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	int changed = 0;
+	for (;;) {
+		ssize_t n = read(watch->fd, buf, sizeof(buf));
+		if (n <= 0) {break;}
+		for (char* p = buf; p < buf + n; ) {
+			const struct inotify_event* event = (const struct inotify_event*)p;
+			if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && strcmp(event->name, watch->name) == 0)) {
+				changed = 1;
+			}
+			p += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	return changed;
+}
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+int watch_init(wallet_watch_t* watch, const char* path, int polling) {
+	memset(watch, 0, sizeof(wallet_watch_t));
+	watch->fd = -1;
+	if (strlen(path) + 1 > WATCH_MAX_PATH) {return WATCH_ERR_IO;}
+	strcpy(watch->path, path);
+
+	// the directory and the name within it
+	char dir[WATCH_MAX_PATH];
+	const char* slash = strrchr(path, '/');
+	if (slash == NULL) {
+		strcpy(dir, ".");
+		strcpy(watch->name, path);
+	}
+	else {
+		size_t len = slash == path ? 1 : (size_t)(slash - path);
+		memcpy(dir, path, len);
+		dir[len] = '\0';
+		strcpy(watch->name, slash + 1);
+	}
+
+	stat_changed(watch);
+	if (!polling) {
+		watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (watch->fd >= 0 && inotify_add_watch(watch->fd, dir, WATCH_EVENTS) >= 0) {
+			watch->mode = WATCH_INOTIFY;
+			return WATCH_OK;
+		}
+		if (watch->fd >= 0) {close(watch->fd);}
+		watch->fd = -1;
+	}
+	watch->mode = WATCH_POLLING;
+	return WATCH_OK;
+}
+
+int watch_wait(wallet_watch_t* watch, int timeout_ms) {
+	if (watch->mode == WATCH_INOTIFY) {
+		struct pollfd fds = {watch->fd, POLLIN, 0};
+		int64_t deadline = monotonic_ms() + timeout_ms;
+		for (;;) {
+			int64_t left = deadline - monotonic_ms();
+			int ready = poll(&fds, 1, left > 0 ? (int)left : 0);
+			if (ready < 0 && errno != EINTR) {return 1;}
+			if (ready > 0 && drain_events(watch)) {return 1;}
+			if (left <= 0) {return 0;}
+		}
+	}
+
+	// polling: check now, then every WATCH_POLL_MS until the timeout
+	int64_t deadline = monotonic_ms() + timeout_ms;
+	for (;;) {
+		if (stat_changed(watch)) {return 1;}
+		int64_t left = deadline - monotonic_ms();
+		if (left <= 0) {return 0;}
+		usleep((useconds_t)(left < WATCH_POLL_MS ? left : WATCH_POLL_MS) * 1000);
+	}
+}
+
+int watch_generation(const wallet_watch_t* watch, uint64_t* generation) {
+	FILE* file = fopen(watch->path, "rb");
+	if (file == NULL) {return WATCH_ERR_IO;}
+	int ret = read_generation(file, generation);
+	fclose(file);
+	return ret == FORMAT_OK ? WATCH_OK : WATCH_ERR_IO;
+}
+
+void watch_free(wallet_watch_t* watch) {
+	if (watch->fd >= 0) {close(watch->fd);}
+	watch->fd = -1;
+}
+
+void wallet_cache_free(wallet_cache_t* cache) {
+	watch_free(&cache->watch);
+	secure_free(cache->wallet);
+	secure_free(cache->tags);
+	cache->wallet = NULL;
+	cache->tags = NULL;
+}
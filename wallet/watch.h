@@ -0,0 +1,138 @@
+/*
+ * Copyright 2018 Alberto Sonnino
+ * 
+ * This file is part of SGX-WALLET.
+ * 
+ * SGX-WALLET is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * SGX-WALLET is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with SGX-WALLET.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef WATCH_H_
+#define WATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wallet.h"
+#include "crypto.h"
+
+
+/***************************************************
+ * Defines
+ ***************************************************/
+#define WATCH_MAX_PATH 4096
+#define WATCH_POLL_MS 250		// interval between checks when inotify is unavailable
+
+// how changes are noticed
+#define WATCH_INOTIFY 1
+#define WATCH_POLLING 2
+
+// watch errors
+#define WATCH_OK 0
+#define WATCH_ERR_IO 1			// the file or its directory cannot be watched
+
+
+/***************************************************
+ * Struct
+ ***************************************************/
+// a wallet file being watched for saves by other processes
+struct WalletWatch {
+	int mode;					// WATCH_INOTIFY or WATCH_POLLING
+	int fd;						// inotify instance, -1 when polling
+	char path[WATCH_MAX_PATH];
+	char name[WATCH_MAX_PATH];	// the file name within its directory
+	// WATCH_POLLING: what the file looked like at the last check
+	uint64_t device, inode, size;
+	int64_t mtime_ns;
+};
+typedef struct WalletWatch wallet_watch_t;
+
+// an unlocked wallet kept in step with its file
+struct WalletCache {
+	wallet_t* wallet;			// in secure memory
+	uint8_t* tags;				// the MAC tags it was authenticated with
+	uint64_t generation;		// saves of the file it was read from
+	bitmap_t changed;			// records that differ from the previous read
+	int stale;					// a reload failed: try again at the next refresh
+	uint64_t reloads;			// reads after the first one
+	uint64_t authenticated;		// records authenticated by those reads
+	wallet_watch_t watch;
+};
+typedef struct WalletCache wallet_cache_t;
+
+
+/***************************************************
+ * Functions
+ ***************************************************/
+
+/**
+ * @brief      Starts watching a file. inotify watches its directory,
+ *             so that a file written in place and a file renamed over
+ *             are both seen; when inotify is unavailable, or polling
+ *             is asked for, the file's identity, size and modification
+ *             time are compared instead.
+ *
+ * @param[out] watch      The watch
+ * @param[in]  path       The file
+ * @param[in]  polling    Whether to poll even if inotify is available
+ *
+ * @return     WATCH_OK if successful, WATCH_ERR_IO otherwise.
+ */
+int watch_init(wallet_watch_t* watch, const char* path, int polling);
+
+
+/**
+ * @brief      Waits until the file may have changed. A change is only
+ *             a hint: the caller compares the generation to be sure.
+ *
+ * @param      watch         The watch
+ * @param[in]  timeout_ms    How long to wait, 0 to only check
+ *
+ * @return     1 if the file may have changed, 0 otherwise.
+ */
+int watch_wait(wallet_watch_t* watch, int timeout_ms);
+
+
+/**
+ * @brief      Reads the generation of a watched file: the number of
+ *             saves, from its header and version section only.
+ *
+ * @param[in]  watch         The watch
+ * @param[out] generation    The generation
+ *
+ * @return     WATCH_OK if successful, WATCH_ERR_IO otherwise.
+ */
+int watch_generation(const wallet_watch_t* watch, uint64_t* generation);
+
+
+/**
+ * @brief      Stops watching a file.
+ *
+ * @param      watch    The watch
+ *
+ * @return     -
+ */
+void watch_free(wallet_watch_t* watch);
+
+
+/**
+ * @brief      Releases a cache opened by open_wallet_cache; the wallet
+ *             is wiped.
+ *
+ * @param      cache    The cache
+ *
+ * @return     -
+ */
+void wallet_cache_free(wallet_cache_t* cache);
+
+
+#endif // WATCH_H_